@@ -0,0 +1,92 @@
+// Checks that on-the-fly augmentation keeps up with training:
+// augmented images/s (one thread, then through DataLoader workers) against the samples/s
+// train_step consumes on the MNIST architecture from main.cpp.
+#include "../src/core/neural_network.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include "../src/utils/idx_file.hpp"
+#include "../src/utils/data_loader.hpp"
+#include "../src/utils/augmentation.hpp"
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+// Random 28x28 images so the benchmark does not need the MNIST download
+static void writeSyntheticIdx(const std::string &images, const std::string &labels, uint32_t n) {
+    auto header = [](std::ofstream &file, uint8_t ndims, std::initializer_list<uint32_t> dims) {
+        unsigned char magic[4] = {0, 0, 0x08, ndims};
+        file.write((char*)magic, 4);
+        for (uint32_t d : dims) {
+            unsigned char be[4] = {(unsigned char)(d >> 24), (unsigned char)(d >> 16), (unsigned char)(d >> 8), (unsigned char)d};
+            file.write((char*)be, 4);
+        }
+    };
+    std::mt19937 gen(1);
+    std::ofstream imageFile(images, std::ios::binary), labelFile(labels, std::ios::binary);
+    header(imageFile, 3, {n, 28, 28});
+    header(labelFile, 1, {n});
+    for (uint32_t i = 0; i < n * 784; i++) imageFile.put(static_cast<char>(gen() % 256));
+    for (uint32_t i = 0; i < n; i++) labelFile.put(static_cast<char>(gen() % 10));
+}
+
+int main(int argc, char** argv) {
+    int workers = argc > 1 ? std::stoi(argv[1]) : 2;
+    const std::string images = "./bench_aug_images.idx", labels = "./bench_aug_labels.idx";
+    const uint32_t n = 4096;
+    const int batch_size = 64;
+    writeSyntheticIdx(images, labels, n);
+
+    AugmentationConfig config;
+    config.elasticAlpha = argc > 2 ? std::stod(argv[2]) : 8.0;
+    config.noiseStddev = argc > 3 ? std::stod(argv[3]) : 0.02;
+    Augmenter augmenter(28, 28, config, 7);
+
+    {
+        IdxFile imageFile(images), labelFile(labels);
+
+        // 1. Raw augmentation throughput on one thread
+        Augmenter::Workspace workspace;
+        std::vector<double> out(784);
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < n; i++) {
+            augmenter.apply(imageFile.ubyteData() + static_cast<size_t>(i) * 784, out.data(), 0, i, workspace);
+        }
+        double single = n / std::chrono::duration<double>(Clock::now() - start).count();
+
+        // 2. Trainer consumption rate on ready made batches
+        NeuralNetwork nn;
+        nn.addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+        nn.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+        nn.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+        Matrix inputs;
+        imageFile.toMatrix(0, batch_size, inputs, 1.0 / 255.0);
+        std::vector<int> batchLabels(labelFile.ubyteData(), labelFile.ubyteData() + batch_size);
+        int steps = n / batch_size;
+        start = Clock::now();
+        for (int s = 0; s < steps; s++) nn.train_step(inputs, batchLabels, 0.01);
+        double trainer = steps * batch_size / std::chrono::duration<double>(Clock::now() - start).count();
+
+        // 3. End to end: training fed by augmenting DataLoader workers
+        DataLoader loader(imageFile, labelFile, batch_size, true, 7, workers, workers + 1, &augmenter);
+        start = Clock::now();
+        for (int s = 0; s < steps; s++) {
+            const Batch& batch = loader.next();
+            nn.train_step(batch.inputs, batch.labels, 0.01);
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::cout << "augmentation, 1 thread:      " << single << " images/s\n";
+        std::cout << "train_step consumption:      " << trainer << " samples/s\n";
+        std::cout << "augmented training (" << workers << " workers): " << steps * batch_size / seconds
+                  << " samples/s, stalled " << 100.0 * loader.stallSeconds() / seconds << "% of the time\n";
+    }
+
+    std::remove(images.c_str());
+    std::remove(labels.c_str());
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Layer-by-layer inference (InferenceContext: double, one virtual infer() per layer, activations
+// through std::vector) against the compiled plan for every SIMD kernel the CPU supports, on the
+// main.cpp MNIST network and on a wider variant with batch normalization. Inputs are MNIST-like:
+// about 80% zeros.
+//
+//   ./compiled_model_bench [max batch]
+#include "../src/core/neural_network.hpp"
+#include "../src/core/inference_context.hpp"
+#include "../src/core/compiled_model.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/layers/batch_norm_layer.hpp"
+#include "../src/layers/dropout_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include "../src/utils/benchmark.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void benchModel(Benchmark &bench, const std::string &name, NeuralNetwork &nn, int maxBatch) {
+    nn.setTraining(false);
+    std::shared_ptr<const Weights> weights = nn.shareWeights();
+    CompiledModel reference = nn.compile();
+    reference.print(std::cout);
+    for (int batch : {1, 64, maxBatch}) {
+        Matrix input(batch, 784);
+        input.randomize(0.0, 1.0);
+        for (int r = 0; r < batch; r++) {
+            for (int j = 0; j < 784; j++) {
+                if ((r * 7 + j * 13) % 5 != 0) input.data[r][j] = 0.0;
+            }
+        }
+        std::vector<float> floats(static_cast<size_t>(batch) * 784), output(static_cast<size_t>(batch) * reference.outputSize());
+        for (int r = 0; r < batch; r++) {
+            for (int j = 0; j < 784; j++) floats[static_cast<size_t>(r) * 784 + j] = static_cast<float>(input.data[r][j]);
+        }
+
+        const std::string suffix = "/batch" + std::to_string(batch);
+        InferenceContext context(weights);
+        Benchmark::print(bench.run(name + "/layers_double" + suffix, [&] { doNotOptimize(context.forward(input).data); }),
+                         std::cout);
+        CompileOptions options;
+        options.maxBatch = maxBatch;
+        for (SimdKernel simd : {SimdKernel::Scalar, SimdKernel::Avx2, SimdKernel::Avx512}) {
+            if (!CompiledModel::supported(simd)) continue;
+            options.simd = simd;
+            CompiledModel model = nn.compile(options);
+            Benchmark::print(bench.run(name + "/compiled_" + CompiledModel::simdName(simd) + suffix, [&] {
+                model.run(floats.data(), output.data(), batch);
+                doNotOptimize(output.data());
+            }), std::cout);
+        }
+    }
+    std::cout << "\n";
+}
+
+int main(int argc, char** argv) {
+    int maxBatch = argc > 1 ? std::stoi(argv[1]) : 256;
+
+    BenchmarkOptions options;
+    options.repetitions = 7;
+    options.minSeconds = 0.05;
+    Benchmark bench(options);
+
+    NeuralNetwork mnist;
+    mnist.addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+    mnist.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+    mnist.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+
+    NeuralNetwork normalized;
+    normalized.addLayer(std::make_unique<DenseLayer>(784, 128, new activations::Linear()));
+    normalized.addLayer(std::make_unique<BatchNormLayer>(128, new activations::ReLU()));
+    normalized.addLayer(std::make_unique<DropoutLayer>(0.5));
+    normalized.addLayer(std::make_unique<DenseLayer>(128, 10, new activations::Softmax(), true));
+
+    Benchmark::printHeader(std::cout);
+    benchModel(bench, "mnist_784x16x16x10", mnist, maxBatch);
+    benchModel(bench, "batchnorm_784x128x10", normalized, maxBatch);
+    return 0;
+}
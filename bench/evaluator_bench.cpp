@@ -0,0 +1,109 @@
+// Scoring a whole test set with the main.cpp MNIST network: the per-sample loop main.cpp used to
+// run (one row per forward pass, scan the output for the argmax; here through an InferenceContext,
+// since NeuralNetwork::forward prints every layer) against Evaluator for several batch sizes, on
+// one thread and on the pool. Every mode must report the same accuracy.
+// Uses the MNIST test set from ./data when present, otherwise 10000 MNIST-like samples (~80% zeros),
+// and the model_v3.1 weights when they load, otherwise random ones.
+//
+//   ./evaluator_bench [threads]
+#include "../src/core/neural_network.hpp"
+#include "../src/core/evaluator.hpp"
+#include "../src/core/inference_context.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include "../src/utils/idx_file.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    const int threads = argc > 1 ? std::stoi(argv[1]) : 0;
+
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+    bool trained = true;
+    try {
+        nn.loadFromFile("./src/models/model_v3.1");
+    } catch (const std::exception &) {
+        trained = false;
+    }
+
+    const std::string imagesFile = "./data/t10k-images-idx3-ubyte", labelsFile = "./data/t10k-labels-idx1-ubyte";
+    const bool mnist = std::filesystem::exists(imagesFile) && std::filesystem::exists(labelsFile);
+    Matrix inputs;
+    std::vector<int> labels;
+    if (mnist) {
+        IdxFile images(imagesFile), labelFile(labelsFile);
+        images.toMatrix(0, images.count(), inputs, 1.0 / 255.0);
+        labels.resize(labelFile.count());
+        for (size_t i = 0; i < labels.size(); i++) labels[i] = labelFile.ubyteData()[i];
+    } else {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        inputs = Matrix(10000, 784);
+        labels.resize(10000);
+        for (int r = 0; r < inputs.rows; r++) {
+            labels[r] = static_cast<int>(gen() % 10);
+            for (int j = 0; j < 784; j++) inputs.data[r][j] = uniform(gen) < 0.2 ? uniform(gen) : 0.0;
+        }
+    }
+    std::cout << (mnist ? "MNIST test set" : "Synthetic MNIST-like data") << ", " << inputs.rows << " samples, "
+              << (trained ? "model_v3.1" : "random weights") << "\n\n";
+    std::cout << std::left << std::setw(32) << "mode" << std::right << std::setw(10) << "ms"
+              << std::setw(14) << "samples/s" << std::setw(10) << "speedup" << std::setw(12) << "accuracy" << "\n";
+
+    double baseline = 0.0;
+    auto report = [&](const std::string &mode, double seconds, double accuracy) {
+        if (baseline == 0.0) baseline = seconds;
+        std::cout << std::left << std::setw(32) << mode << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << seconds * 1000.0 << std::setprecision(0) << std::setw(14) << inputs.rows / seconds
+                  << std::setprecision(2) << std::setw(9) << baseline / seconds << "x"
+                  << std::setprecision(4) << std::setw(12) << accuracy << "\n";
+    };
+
+    // The loop main.cpp used to run
+    {
+        InferenceContext context(nn.shareWeights());
+        const auto start = std::chrono::steady_clock::now();
+        int correct = 0;
+        Matrix sample(1, inputs.cols);
+        for (int i = 0; i < inputs.rows; i++) {
+            for (int j = 0; j < inputs.cols; j++) sample.data[0][j] = inputs.data[i][j];
+            const Matrix &output = context.forward(sample);
+            int max = 0;
+            for (int j = 0; j < output.cols; j++) {
+                if (output.data[0][j] > output.data[0][max]) max = j;
+            }
+            if (max == labels[i]) correct++;
+        }
+        report("per-sample forward", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+               static_cast<double>(correct) / inputs.rows);
+    }
+
+    Evaluation last;
+    for (int poolThreads : {1, threads}) {
+        for (int batchSize : {64, 256, 1024, 4096}) {
+            EvaluatorOptions options;
+            options.batchSize = batchSize;
+            options.threads = poolThreads;
+            Evaluator evaluator(options);
+            evaluator.evaluate(nn, inputs, labels);  // warm up the pool and the buffers
+            last = evaluator.evaluate(nn, inputs, labels);
+            const std::string mode = "evaluator batch " + std::to_string(batchSize) + ", " +
+                                     (poolThreads == 1 ? std::string("1 thread") : std::string("pool"));
+            report(mode, last.seconds, last.accuracy());
+        }
+        if (threads == 1) break;
+    }
+
+    std::cout << "\n";
+    last.report(std::cout);
+    return 0;
+}
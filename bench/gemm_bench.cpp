@@ -0,0 +1,76 @@
+// Tunes the GEMM shapes of the main.cpp MNIST network (784x16x16x10, forward and both backward
+// products, batch 1 to 512), writes the winners to the tuning cache and then times the textbook
+// loop operator* used to run, the heuristic choice and the tuned choice for each shape.
+//
+//   ./gemm_bench [cache file] [max threads]
+#include "../src/core/neural_network.hpp"
+#include "../src/core/gemm_tuner.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include "../src/math/gemm.hpp"
+#include "../src/utils/benchmark.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void naive(const Matrix &a, const Matrix &b, Matrix &c) {
+    for (int i = 0; i < a.rows; i++) {
+        for (int j = 0; j < b.cols; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < a.cols; k++) sum += a.data[i][k] * b.data[k][j];
+            c.data[i][j] = sum;
+        }
+    }
+}
+
+static std::string describe(const GemmConfig &config) {
+    std::string text = Gemm::kernelName(config.kernel);
+    if (Gemm::packed(config.kernel)) {
+        text += " " + std::to_string(config.mc) + "/" + std::to_string(config.kc) + "/" + std::to_string(config.nc);
+    }
+    if (config.threads > 1) text += " x" + std::to_string(config.threads) + " " + Gemm::splitName(config.split);
+    return text;
+}
+
+int main(int argc, char** argv) {
+    const std::string path = argc > 1 ? argv[1] : Gemm::defaultTuningPath();
+    GemmTunerOptions tunerOptions;
+    if (argc > 2) tunerOptions.maxThreads = std::stoi(argv[2]);
+
+    NeuralNetwork mnist;
+    mnist.addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+    mnist.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+    mnist.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+
+    std::cout << "Tuning for " << Gemm::cpuModel() << " into " << path << "\n";
+    GemmTuning tuning = GemmTuner::tune(mnist, path, tunerOptions, &std::cout);
+    std::cout << tuning.size() << " shapes in this CPU's section\n\n";
+
+    BenchmarkOptions options;
+    options.repetitions = 7;
+    options.minSeconds = 0.02;
+    Benchmark bench(options);
+    Benchmark::printHeader(std::cout);
+    for (const GemmShape &shape : GemmTuner::shapes(mnist, {1, 64, 512})) {
+        Matrix a(shape.m, shape.k), b(shape.k, shape.n), c(shape.m, shape.n);
+        a.randomize(-1.0, 1.0);
+        b.randomize(-1.0, 1.0);
+        const double flops = 2.0 * shape.m * shape.k * shape.n;
+        const double bytes = (static_cast<double>(shape.m) * shape.k + static_cast<double>(shape.k) * shape.n +
+                              static_cast<double>(shape.m) * shape.n) * sizeof(double);
+        const std::string name = std::to_string(shape.m) + "x" + std::to_string(shape.k) + "x" + std::to_string(shape.n);
+
+        Benchmark::print(bench.run(name + "/naive", [&] { naive(a, b, c); doNotOptimize(c.data[0][0]); }, flops, bytes),
+                         std::cout);
+        const GemmConfig heuristic = Gemm::heuristic(shape.m, shape.k, shape.n);
+        const GemmConfig tuned = Gemm::config(shape.m, shape.k, shape.n);
+        for (const auto &choice : {std::make_pair(std::string("heuristic"), heuristic), std::make_pair(std::string("tuned"), tuned)}) {
+            Benchmark::print(bench.run(name + "/" + choice.first + " " + describe(choice.second), [&] {
+                Gemm::multiply(choice.second, a.data[0], b.data[0], c.data[0], shape.m, shape.k, shape.n);
+                doNotOptimize(c.data[0][0]);
+            }, flops, bytes), std::cout);
+        }
+    }
+    return 0;
+}
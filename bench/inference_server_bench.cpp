@@ -0,0 +1,122 @@
+// Load generator for InferenceServer: open-loop Poisson arrivals at several rates,
+// reports p50/p99 latency, achieved throughput and average batch size,
+// once with batching disabled (max batch 1) and once with dynamic batching.
+#include "../src/core/neural_network.hpp"
+#include "../src/core/inference_server.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+using Clock = std::chrono::steady_clock;
+
+struct RunResult {
+    double p50_us, p99_us, throughput;
+    double average_batch;
+};
+
+static double percentile(std::vector<double> &sorted, double p) {
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+static RunResult runLoad(std::shared_ptr<const Weights> weights, int max_batch, int max_wait_us,
+                         double rate, int num_requests) {
+    InferenceServer server(weights, max_batch, max_wait_us);
+
+    Matrix sample(1, 784);
+    sample.randomize(0.0, 1.0);
+
+    struct Pending { Clock::time_point sent; std::future<Matrix> result; };
+    std::deque<Pending> pending;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done_sending = false;
+
+    std::vector<double> latencies;
+    latencies.reserve(num_requests);
+
+    // Collector: waits on futures in submission order (the server answers FIFO)
+    std::thread collector([&] {
+        while (true) {
+            Pending p;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return done_sending || !pending.empty(); });
+                if (pending.empty()) return;
+                p = std::move(pending.front());
+                pending.pop_front();
+            }
+            p.result.get();
+            latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - p.sent).count());
+        }
+    });
+
+    // Generator: exponential inter-arrival times, fixed seed so runs are comparable
+    std::mt19937 gen(42);
+    std::exponential_distribution<double> gap(rate);
+    Clock::time_point start = Clock::now();
+    Clock::time_point next = start;
+    for (int i = 0; i < num_requests; i++) {
+        next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(gen)));
+        std::this_thread::sleep_until(next);
+        Pending p{Clock::now(), server.submit(sample)};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(p));
+        }
+        cv.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done_sending = true;
+    }
+    cv.notify_one();
+    collector.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    RunResult result;
+    result.p50_us = percentile(latencies, 0.50);
+    result.p99_us = percentile(latencies, 0.99);
+    result.throughput = num_requests / elapsed;
+    result.average_batch = server.getStats().averageBatchSize();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    int num_requests = argc > 1 ? std::stoi(argv[1]) : 5000;
+
+    // Same architecture as the MNIST recipe in main.cpp
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+    std::shared_ptr<const Weights> weights = nn.shareWeights();
+
+    const double rates[] = {1000, 5000, 20000, 50000};
+    struct Config { const char* name; int max_batch; int max_wait_us; };
+    const Config configs[] = {{"unbatched", 1, 0}, {"batched", 64, 200}};
+
+    std::cout << std::left << std::setw(12) << "config" << std::setw(12) << "rate/s"
+              << std::setw(14) << "achieved/s" << std::setw(12) << "p50 us"
+              << std::setw(12) << "p99 us" << "avg batch\n";
+    for (double rate : rates) {
+        for (const Config& config : configs) {
+            RunResult r = runLoad(weights, config.max_batch, config.max_wait_us, rate, num_requests);
+            std::cout << std::left << std::fixed << std::setprecision(1)
+                      << std::setw(12) << config.name << std::setw(12) << rate
+                      << std::setw(14) << r.throughput << std::setw(12) << r.p50_us
+                      << std::setw(12) << r.p99_us << r.average_batch << "\n";
+        }
+    }
+    return 0;
+}
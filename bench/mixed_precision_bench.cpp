@@ -0,0 +1,126 @@
+// Throughput, accuracy and memory of double vs fp16 / bf16 mixed precision training on the MNIST
+// recipe from main.cpp (784-16-16-10, sigmoid/softmax, batch 64, learning rate 0.1).
+// Uses ./data (MNIST) when present, otherwise a synthetic task with one noisy pixel pattern per class.
+//
+//   ./mixed_precision_bench [epochs] [training samples]
+#include "../src/core/neural_network.hpp"
+#include "../src/core/inference_context.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include "../src/utils/dataset_cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Split {
+    Matrix images;
+    std::vector<int> labels;
+};
+
+// MNIST-like task: every class has a stroke pattern of ~150 pixels, a sample shows most of its
+// class pattern plus random noise pixels (~80% zeros overall)
+static void synthetic(int n, std::mt19937 &gen, const std::vector<std::vector<int>> &patterns, Split &split) {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    split.images = Matrix(n, 784);
+    split.labels.resize(n);
+    for (int r = 0; r < n; r++) {
+        int label = static_cast<int>(gen() % 10);
+        split.labels[r] = label;
+        for (int i = 0; i < 784; i++) {
+            if (uniform(gen) < 0.05) split.images.data[r][i] = uniform(gen);
+        }
+        for (int i : patterns[label]) {
+            if (uniform(gen) < 0.8) split.images.data[r][i] = 0.5 + 0.5 * uniform(gen);
+        }
+    }
+}
+
+static double accuracy(const NeuralNetwork &nn, const Split &test) {
+    InferenceContext context(nn.shareWeights());
+    const Matrix &output = context.forward(test.images);
+    int correct = 0;
+    for (int r = 0; r < output.rows; r++) {
+        correct += std::max_element(output.data[r], output.data[r] + output.cols) - output.data[r] == test.labels[r];
+    }
+    return static_cast<double>(correct) / output.rows;
+}
+
+int main(int argc, char** argv) {
+    int epochs = argc > 1 ? std::stoi(argv[1]) : 3;
+    int trainSamples = argc > 2 ? std::stoi(argv[2]) : 8192;
+    const int testSamples = 2000, batchSize = 64;
+    const double learningRate = 0.1;
+
+    Split train, test;
+    const std::string images = "./data/train-images-idx3-ubyte", labels = "./data/train-labels-idx1-ubyte";
+    if (std::filesystem::exists(images) && std::filesystem::exists(labels)) {
+        std::shared_ptr<const DatasetCache> data = DatasetCache::open(images, labels);
+        trainSamples = std::min<int>(trainSamples, data->count() - testSamples);
+        data->toMatrix(0, trainSamples, train.images);
+        data->toMatrix(trainSamples, testSamples, test.images);
+        train.labels.assign(data->labels(), data->labels() + trainSamples);
+        test.labels.assign(data->labels() + trainSamples, data->labels() + trainSamples + testSamples);
+        std::cout << "MNIST, " << trainSamples << " training samples\n";
+    } else {
+        std::mt19937 gen(3);
+        std::vector<std::vector<int>> patterns(10);
+        for (auto &pattern : patterns) {
+            for (int i = 0; i < 784; i++) {
+                if (gen() % 100 < 19) pattern.push_back(i);
+            }
+        }
+        synthetic(trainSamples, gen, patterns, train);
+        synthetic(testSamples, gen, patterns, test);
+        std::cout << "No MNIST data in ./data, synthetic task with " << trainSamples << " training samples\n";
+    }
+
+    // The same initial weights for every precision
+    NeuralNetwork initial;
+    initial.addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+    initial.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+    initial.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+
+    std::cout << std::left << std::setw(10) << "precision" << std::right << std::setw(14) << "samples/s"
+              << std::setw(12) << "loss" << std::setw(12) << "accuracy" << "\n";
+    std::vector<MixedPrecisionReport> reports;
+    for (Precision precision : {Precision::Double, Precision::Float16, Precision::BFloat16}) {
+        NeuralNetwork nn;
+        for (const auto &layer : initial.layers) nn.addLayer(layer->clone());
+        nn.setPrecision(precision);
+
+        Matrix batch;
+        std::vector<int> batchLabels;
+        double loss = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (int epoch = 0; epoch < epochs; epoch++) {
+            loss = 0.0;
+            int batches = 0;
+            for (int first = 0; first + batchSize <= trainSamples; first += batchSize) {
+                batch = Matrix(batchSize, 784);
+                for (int r = 0; r < batchSize; r++) {
+                    std::copy(train.images.data[first + r], train.images.data[first + r] + 784, batch.data[r]);
+                }
+                batchLabels.assign(train.labels.begin() + first, train.labels.begin() + first + batchSize);
+                loss += nn.train_step(batch, batchLabels, learningRate);
+                batches++;
+            }
+            loss /= batches;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double samplesPerSecond = static_cast<double>(epochs) * (trainSamples / batchSize * batchSize) / seconds;
+
+        std::cout << std::left << std::setw(10) << precisionName(precision) << std::right << std::fixed
+                  << std::setprecision(0) << std::setw(14) << samplesPerSecond << std::setprecision(4)
+                  << std::setw(12) << loss << std::setprecision(2) << std::setw(11) << accuracy(nn, test) * 100
+                  << "%\n" << std::defaultfloat;
+        if (nn.mixedPrecision) reports.push_back(nn.mixedPrecision->report());
+    }
+    std::cout << "\n";
+    for (const MixedPrecisionReport &report : reports) report.print(std::cout);
+    return 0;
+}
@@ -0,0 +1,272 @@
+// Micro and macro benchmark suite: Matrix ops across sizes, Dense/Conv forward and backward,
+// activations, IDX/MNIST loading and one full training epoch, on synthetic data.
+//
+//   nn_bench [--filter text] [--json results.json] [--compare baseline.json] [--threshold 0.10]
+//            [--repetitions n] [--quick]
+//
+// --json saves the results, --compare prints the change against a saved run and exits with 1
+// when any benchmark got slower than the threshold (relative, 0.10 = 10%).
+#include "../src/core/neural_network.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/layers/dropout_layer.hpp"
+#include "../src/layers/batch_norm_layer.hpp"
+#include "../src/layers/conv_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include "../src/utils/utils.hpp"
+#include "../src/utils/idx_file.hpp"
+#include "../src/utils/dataset.hpp"
+#include "../src/utils/benchmark.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+// Random 28x28 images in MNIST layout so the suite does not need the download
+static void writeSyntheticIdx(const std::string &images, const std::string &labels, uint32_t n) {
+    auto header = [](std::ofstream &file, uint8_t ndims, std::initializer_list<uint32_t> dims) {
+        unsigned char magic[4] = {0, 0, 0x08, ndims};
+        file.write((char*)magic, 4);
+        for (uint32_t d : dims) {
+            unsigned char be[4] = {(unsigned char)(d >> 24), (unsigned char)(d >> 16), (unsigned char)(d >> 8), (unsigned char)d};
+            file.write((char*)be, 4);
+        }
+    };
+    std::mt19937 gen(1);
+    std::ofstream imageFile(images, std::ios::binary), labelFile(labels, std::ios::binary);
+    header(imageFile, 3, {n, 28, 28});
+    header(labelFile, 1, {n});
+    for (uint32_t i = 0; i < n * 784; i++) imageFile.put(static_cast<char>(gen() % 256));
+    for (uint32_t i = 0; i < n; i++) labelFile.put(static_cast<char>(gen() % 10));
+}
+
+struct Suite {
+    Benchmark bench;
+    std::string filter;
+
+    Suite(const BenchmarkOptions &options, const std::string &filter) : bench(options), filter(filter) {}
+
+    bool selected(const std::string &name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+    void run(const std::string &name, const std::function<void()> &fn, double flops = 0.0, double bytes = 0.0) {
+        if (!selected(name)) return;
+        Benchmark::print(bench.run(name, fn, flops, bytes), std::cout);
+    }
+    void run(const std::string &name, const std::function<void()> &fn, double flops, double bytes,
+             const BenchmarkOptions &options) {
+        if (!selected(name)) return;
+        Benchmark::print(bench.run(name, fn, flops, bytes, options), std::cout);
+    }
+};
+
+static void matrixBenchmarks(Suite &suite) {
+    for (int n : {16, 64, 128, 256}) {
+        Matrix a(n, n), b(n, n), c;
+        a.randomize(-1.0, 1.0);
+        b.randomize(-1.0, 1.0);
+        double elems = static_cast<double>(n) * n, bytes = elems * sizeof(double);
+        std::string size = std::to_string(n);
+
+        suite.run("matrix/multiply/" + size, [&] { c = a * b; doNotOptimize(c.data); }, 2.0 * elems * n, 3.0 * bytes);
+        suite.run("matrix/add/" + size, [&] { c = a + b; doNotOptimize(c.data); }, elems, 3.0 * bytes);
+        suite.run("matrix/hadamard/" + size, [&] { c = a.elementWiseMultiply(b); doNotOptimize(c.data); }, elems, 3.0 * bytes);
+        suite.run("matrix/scale/" + size, [&] { c = a * 0.5; doNotOptimize(c.data); }, elems, 2.0 * bytes);
+        suite.run("matrix/transpose/" + size, [&] { c = a.transpose(); doNotOptimize(c.data); }, 0.0, 2.0 * bytes);
+    }
+}
+
+static void activationBenchmarks(Suite &suite) {
+    const int batch = 64, width = 128;
+    Matrix x(batch, width), y;
+    x.randomize(-4.0, 4.0);
+    double bytes = 2.0 * batch * width * sizeof(double);
+
+    activations::Sigmoid sigmoid;
+    activations::ReLU relu;
+    activations::Softmax softmax;
+    suite.run("activation/sigmoid/64x128", [&] {
+        y = x.applyFunction([&](std::vector<double> &v) { return sigmoid.activate(v); });
+        doNotOptimize(y.data);
+    }, 0.0, bytes);
+    suite.run("activation/relu/64x128", [&] {
+        y = x.applyFunction([&](std::vector<double> &v) { return relu.activate(v); });
+        doNotOptimize(y.data);
+    }, 0.0, bytes);
+    suite.run("activation/softmax/64x128", [&] {
+        y = x.applyFunction([&](std::vector<double> &v) { return softmax.activate(v); });
+        doNotOptimize(y.data);
+    }, 0.0, bytes);
+}
+
+static void layerBenchmarks(Suite &suite) {
+    // MNIST sized dense layer on a minibatch, learning rate 0 keeps the weights fixed between calls
+    const int batch = 64, in = 784, out = 128;
+    DenseLayer dense(in, out, new activations::Sigmoid());
+    Matrix x(batch, in), grad(batch, out);
+    x.randomize(0.0, 1.0);
+    grad.randomize(-0.1, 0.1);
+    double forwardFlops = 2.0 * batch * in * out;
+    double weightBytes = static_cast<double>(in) * out * sizeof(double);
+
+    suite.run("dense/forward/64x784x128", [&] { dense.forward(x); doNotOptimize(dense.output.data); },
+              forwardFlops, weightBytes + (double)batch * (in + out) * sizeof(double));
+    dense.forward(x);
+    suite.run("dense/backward/64x784x128", [&] { Matrix d = dense.backward(grad, 0.0); doNotOptimize(d.data); },
+              2.0 * forwardFlops, 2.0 * weightBytes);
+
+    ConvLayer conv(3, 1, 1, new activations::ReLU());
+    Matrix image(28, 28), convGrad(28, 28);
+    image.randomize(0.0, 1.0);
+    convGrad.randomize(-0.1, 0.1);
+    suite.run("conv/forward/28x28k3", [&] { conv.forward(image); doNotOptimize(conv.output.data); },
+              2.0 * 28 * 28 * 9, 2.0 * 28 * 28 * sizeof(double));
+    conv.forward(image);
+    suite.run("conv/backward/28x28k3", [&] { Matrix d = conv.backward(convGrad, 0.0); doNotOptimize(d.data); });
+
+    // Dropout on the hidden activations: mask generation plus the fused scaling
+    DropoutLayer dropout(0.5);
+    Matrix hidden(batch, out);
+    hidden.randomize(0.0, 1.0);
+    double hiddenBytes = static_cast<double>(batch) * out * sizeof(double);
+    suite.run("dropout/forward/64x128", [&] { dropout.forward(hidden); doNotOptimize(dropout.output.data); },
+              static_cast<double>(batch) * out, 2.0 * hiddenBytes);
+    dropout.forward(hidden);
+    Matrix dropoutGrad = grad;
+    // backward works in place on the gradient, feeding it back keeps the shape (values do not matter)
+    suite.run("dropout/backward/64x128", [&] { dropoutGrad = dropout.backward(dropoutGrad, 0.0); doNotOptimize(dropoutGrad.data); },
+              static_cast<double>(batch) * out, 2.0 * hiddenBytes);
+
+    // Batch normalization: training statistics and backward, then the served cost of a linear dense
+    // layer plus normalization against the same layer with the normalization folded in
+    BatchNormLayer norm(out, new activations::ReLU());
+    suite.run("batchnorm/forward/64x128", [&] { norm.forward(hidden); doNotOptimize(norm.output.data); },
+              11.0 * batch * out, 3.0 * hiddenBytes);
+    norm.forward(hidden);
+    suite.run("batchnorm/backward/64x128", [&] { Matrix d = norm.backward(grad, 0.0); doNotOptimize(d.data); },
+              10.0 * batch * out, 3.0 * hiddenBytes);
+    DenseLayer linear(in, out, new activations::Linear());
+    std::unique_ptr<DenseLayer> folded = norm.foldInto(linear);
+    Matrix linearOut, normOut, foldedOut;
+    suite.run("batchnorm/infer_unfolded/64x784x128", [&] {
+        linear.infer(x, linearOut);
+        norm.infer(linearOut, normOut);
+        doNotOptimize(normOut.data);
+    }, forwardFlops + 4.0 * batch * out, weightBytes + (double)batch * (in + 3 * out) * sizeof(double));
+    suite.run("batchnorm/infer_folded/64x784x128", [&] { folded->infer(x, foldedOut); doNotOptimize(foldedOut.data); },
+              forwardFlops, weightBytes + (double)batch * (in + out) * sizeof(double));
+}
+
+static void dataBenchmarks(Suite &suite, const std::string &images, const std::string &labels, uint32_t n) {
+    double fileBytes = static_cast<double>(n) * 785;
+    suite.run("data/idx_to_matrix/" + std::to_string(n), [&] {
+        IdxFile file(images);
+        Matrix all;
+        file.toMatrix(0, file.count(), all, 1.0 / 255.0);
+        doNotOptimize(all.data);
+    }, 0.0, fileBytes);
+
+    // loadMNISTImages prints a summary per call, keep it out of the table
+    suite.run("data/load_mnist/" + std::to_string(n), [&] {
+        std::ostringstream sink;
+        std::streambuf* previous = std::cout.rdbuf(sink.rdbuf());
+        std::vector<Matrix> loaded = utils::loadMNISTImages(images);
+        std::vector<int> loadedLabels = utils::loadMNISTLabels(labels);
+        std::cout.rdbuf(previous);
+        doNotOptimize(loaded.data());
+        doNotOptimize(loadedLabels.data());
+    }, 0.0, fileBytes);
+}
+
+static void trainingBenchmarks(Suite &suite, const std::string &images, const std::string &labels, uint32_t n,
+                               const BenchmarkOptions &macro) {
+    // The architecture from main.cpp, one epoch of minibatch SGD streamed from disk
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+    IdxStreamDataset dataset(images, labels);
+
+    double flopsPerSample = 3.0 * 2.0 * (784 * 16 + 16 * 16 + 16 * 10);  // forward + two backward products
+    suite.run("train/epoch/" + std::to_string(n) + "/batch64", [&] {
+        double loss = nn.train_epoch(dataset, 64, 0.01);
+        doNotOptimize(loss);
+    }, flopsPerSample * n, static_cast<double>(n) * 785, macro);
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    std::string filter, jsonPath, baselinePath;
+    double threshold = 0.10;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--filter") filter = value();
+        else if (arg == "--json") jsonPath = value();
+        else if (arg == "--compare") baselinePath = value();
+        else if (arg == "--threshold") threshold = std::stod(value());
+        else if (arg == "--repetitions") options.repetitions = std::stoi(value());
+        else if (arg == "--quick") { options.warmup = 1; options.repetitions = 5; options.minSeconds = 0.005; }
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    // Macro benchmarks take long enough per call on their own
+    BenchmarkOptions macro = options;
+    macro.warmup = 1;
+    macro.repetitions = std::max(3, options.repetitions / 3);
+    macro.minSeconds = 0.0;
+
+    const std::string images = "./bench_nn_images.idx", labels = "./bench_nn_labels.idx";
+    const uint32_t n = 4096;
+    writeSyntheticIdx(images, labels, n);
+
+    Suite suite(options, filter);
+    Benchmark::printHeader(std::cout);
+    try {
+        matrixBenchmarks(suite);
+        activationBenchmarks(suite);
+        layerBenchmarks(suite);
+        dataBenchmarks(suite, images, labels, n);
+        trainingBenchmarks(suite, images, labels, n, macro);
+    } catch (const std::exception &e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        std::remove(images.c_str());
+        std::remove(labels.c_str());
+        return 1;
+    }
+    std::remove(images.c_str());
+    std::remove(labels.c_str());
+
+    int status = 0;
+    try {
+        if (!jsonPath.empty()) {
+            suite.bench.writeJson(jsonPath);
+            std::cout << "\nResults written to " << jsonPath << std::endl;
+        }
+        if (!baselinePath.empty()) {
+            std::cout << "\nCompared with " << baselinePath << ":\n";
+            std::vector<BenchmarkResult> baseline;
+            for (const BenchmarkResult &r : Benchmark::readJson(baselinePath)) {
+                if (suite.selected(r.name)) baseline.push_back(r);
+            }
+            if (Benchmark::compare(baseline, suite.bench.getResults(), threshold, std::cout) > 0) status = 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+    return status;
+}
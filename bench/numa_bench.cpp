@@ -0,0 +1,197 @@
+// Data-parallel training throughput under the NUMA placement and pinning policies. Every worker
+// trains its own replica of a 784x1024x10 network on its share of a synthetic MNIST-sized dataset;
+// after each step the workers average the replicas into the shared master weights (each worker a
+// slice of the rows) and copy the result back, so every step reads the master and the dataset
+// from all sockets and the replicas from their own.
+//
+//   baseline      no pinning, replicas cloned by the main thread, everything on the heap
+//   pinned        workers spread over the nodes, each clones its replica under FirstTouch
+//   interleaved   pinned, plus the master weights and the dataset interleaved over the nodes
+//   huge_pages    interleaved, plus 2 MB pages for every large buffer
+//
+// On a single-node machine the placements change nothing and the rows should match within noise.
+//
+//   ./numa_bench [workers] [steps]
+#include "../src/core/neural_network.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include "../src/math/gemm.hpp"
+#include "../src/math/numa.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Config {
+    std::string name;
+    PinMode pin;
+    bool cloneOnWorker;
+    MemoryPlacement shared;
+    bool hugePages;
+};
+
+// Reusable barrier for a fixed number of threads
+class Barrier {
+public:
+    explicit Barrier(int count) : count(count) {}
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        const long long arrivedIn = generation;
+        if (++waiting == count) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+            return;
+        }
+        cv.wait(lock, [&] { return generation != arrivedIn; });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    int count, waiting = 0;
+    long long generation = 0;
+};
+
+static std::unique_ptr<NeuralNetwork> makeNetwork() {
+    auto nn = std::make_unique<NeuralNetwork>();
+    nn->addLayer(std::make_unique<DenseLayer>(784, 1024, new activations::ReLU()));
+    nn->addLayer(std::make_unique<DenseLayer>(1024, 10, new activations::Softmax(), true));
+    return nn;
+}
+
+static std::unique_ptr<NeuralNetwork> cloneNetwork(const NeuralNetwork &nn) {
+    auto copy = std::make_unique<NeuralNetwork>();
+    for (const auto &layer : nn.layers) copy->addLayer(layer->clone());
+    return copy;
+}
+
+static std::vector<DenseLayer*> denseLayers(NeuralNetwork &nn) {
+    std::vector<DenseLayer*> layers;
+    for (auto &layer : nn.layers) layers.push_back(dynamic_cast<DenseLayer*>(layer.get()));
+    return layers;
+}
+
+// Samples per second of `steps` data-parallel steps (after two warmup steps)
+static double run(const Config &config, int workers, int steps, int batch, NumaMemory::Stats &memory) {
+    const int samples = workers * batch * 8;
+    std::unique_ptr<NeuralNetwork> master;
+    Matrix dataset;
+    {
+        MemoryPolicyScope scope({config.shared, config.hugePages});
+        master = makeNetwork();
+        dataset = Matrix(samples, 784);
+    }
+    dataset.randomize(0.0, 1.0);
+    std::vector<int> labels(samples);
+    for (int i = 0; i < samples; i++) labels[i] = i % 10;
+
+    std::vector<std::unique_ptr<NeuralNetwork>> replicas(workers);
+    if (!config.cloneOnWorker) {
+        MemoryPolicyScope scope({MemoryPlacement::Default, config.hugePages});
+        for (auto &replica : replicas) replica = cloneNetwork(*master);
+    }
+
+    Barrier barrier(workers + 1);
+    std::vector<std::thread> pool;
+    for (int w = 0; w < workers; w++) {
+        pool.emplace_back([&, w] {
+            NumaTopology::system().pinWorker(w, config.pin);
+            GemmThreadLimit limit(GemmThreadLimit::shareOf(workers));
+            if (config.cloneOnWorker) {
+                MemoryPolicyScope scope({MemoryPlacement::FirstTouch, config.hugePages});
+                replicas[w] = cloneNetwork(*master);
+            }
+            Matrix inputs(batch, 784);
+            std::vector<int> targets(batch);
+            barrier.wait();
+            for (int step = 0; step < steps + 2; step++) {
+                const int first = ((step * workers + w) * batch) % samples;
+                std::memcpy(inputs.data[0], dataset.data[first], sizeof(double) * batch * 784);
+                std::copy(labels.begin() + first, labels.begin() + first + batch, targets.begin());
+                replicas[w]->train_step(inputs, targets, 0.01);
+                barrier.wait();
+                // Average a slice of every layer's rows into the master
+                std::vector<DenseLayer*> out = denseLayers(*master);
+                for (size_t l = 0; l < out.size(); l++) {
+                    Matrix &target = out[l]->weights;
+                    const int begin = target.rows * w / workers, end = target.rows * (w + 1) / workers;
+                    for (int r = begin; r < end; r++) {
+                        double* row = target.data[r];
+                        std::fill(row, row + target.cols, 0.0);
+                        for (auto &replica : replicas) {
+                            const double* source = denseLayers(*replica)[l]->weights.data[r];
+                            for (int c = 0; c < target.cols; c++) row[c] += source[c];
+                        }
+                        for (int c = 0; c < target.cols; c++) row[c] /= workers;
+                    }
+                }
+                barrier.wait();
+                std::vector<DenseLayer*> mine = denseLayers(*replicas[w]);
+                for (size_t l = 0; l < out.size(); l++) mine[l]->weights = out[l]->weights;
+                barrier.wait();
+            }
+        });
+    }
+
+    barrier.wait();  // replicas ready
+    std::chrono::steady_clock::time_point start;
+    for (int step = 0; step < steps + 2; step++) {
+        if (step == 2) start = std::chrono::steady_clock::now();
+        barrier.wait();
+        barrier.wait();
+        barrier.wait();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    memory = NumaMemory::stats();
+    for (std::thread &thread : pool) thread.join();
+    return static_cast<double>(steps) * workers * batch / seconds;
+}
+
+int main(int argc, char** argv) {
+    const NumaTopology &topology = NumaTopology::system();
+    const int workers = argc > 1 ? std::stoi(argv[1]) : topology.cpuCount();
+    const int steps = argc > 2 ? std::stoi(argv[2]) : 20;
+    const int batch = 64;
+
+    std::cout << topology.nodes() << " NUMA node(s), " << topology.cpuCount() << " CPUs:";
+    for (int node = 0; node < topology.nodes(); node++) {
+        std::cout << " node" << node << "=" << topology.nodeCpus[node].size();
+    }
+    std::cout << "\n" << workers << " workers, batch " << batch << ", " << steps << " steps per run\n";
+    if (!topology.isNuma()) std::cout << "Single node: placement is a no-op, pinning only stops migration\n";
+    std::cout << "\n";
+
+    const std::vector<Config> configs = {
+        {"baseline", PinMode::None, false, MemoryPlacement::Default, false},
+        {"pinned", PinMode::Spread, true, MemoryPlacement::Default, false},
+        {"interleaved", PinMode::Spread, true, MemoryPlacement::Interleave, false},
+        {"huge_pages", PinMode::Spread, true, MemoryPlacement::Interleave, true},
+    };
+    std::cout << std::left << std::setw(14) << "config" << std::right << std::setw(14) << "samples/s"
+              << std::setw(10) << "speedup" << std::setw(12) << "mapped MB" << std::setw(12) << "interleaved"
+              << std::setw(12) << "huge bufs" << "\n";
+    double baseline = 0.0;
+    for (const Config &config : configs) {
+        std::vector<double> rates;
+        NumaMemory::Stats memory;
+        const NumaMemory::Stats before = NumaMemory::stats();
+        for (int repeat = 0; repeat < 3; repeat++) rates.push_back(run(config, workers, steps, batch, memory));
+        std::sort(rates.begin(), rates.end());
+        const double rate = rates[1];
+        if (baseline == 0.0) baseline = rate;
+        std::cout << std::left << std::setw(14) << config.name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << rate << std::setprecision(2) << std::setw(9) << rate / baseline << "x"
+                  << std::setprecision(1) << std::setw(12) << memory.mappedBytes / 1048576.0
+                  << std::setw(12) << (memory.interleaved - before.interleaved)
+                  << std::setw(12) << (memory.hugePageBuffers - before.hugePageBuffers) << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Double vs int8 inference: latency per batch for every int8 kernel the CPU supports and the
+// accuracy delta of the quantized model.
+// Uses model_v3.1 and ./data (MNIST) when present, random inputs otherwise.
+//
+//   ./quantization_bench [calibration samples] [test samples]
+#include "../src/core/neural_network.hpp"
+#include "../src/core/inference_context.hpp"
+#include "../src/core/quantization.hpp"
+#include "../src/layers/dense_layer.hpp"
+#include "../src/activations/activations.hpp"
+#include "../src/utils/dataset_cache.hpp"
+#include "../src/utils/benchmark.hpp"
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void benchModel(Benchmark &bench, const std::string &name, const NeuralNetwork &nn,
+                       const QuantizedModel &quantized, const Matrix &samples) {
+    std::shared_ptr<const Weights> weights = nn.shareWeights();
+    for (int batch : {1, 64}) {
+        Matrix input(batch, samples.cols);
+        for (int r = 0; r < batch; r++) {
+            std::copy(samples.data[r % samples.rows], samples.data[r % samples.rows] + samples.cols, input.data[r]);
+        }
+
+        InferenceContext context(weights);
+        Benchmark::print(bench.run(name + "/double/batch" + std::to_string(batch),
+                                   [&] { doNotOptimize(context.forward(input).data); }), std::cout);
+
+        QuantizedModel q = quantized;
+        Matrix output;
+        for (Int8Kernel kernel : {Int8Kernel::Scalar, Int8Kernel::Avx2, Int8Kernel::Avx512Vnni}) {
+            if (!QuantizedModel::supported(kernel)) continue;
+            q.setKernel(kernel);
+            Benchmark::print(bench.run(name + "/int8-" + QuantizedModel::kernelName(kernel) + "/batch" + std::to_string(batch),
+                                       [&] { q.infer(input, output); doNotOptimize(output.data); }), std::cout);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int calibrationSamples = argc > 1 ? std::stoi(argv[1]) : 512;
+    int testSamples = argc > 2 ? std::stoi(argv[2]) : 2000;
+
+    // The MNIST model from main.cpp
+    NeuralNetwork mnist;
+    mnist.addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+    mnist.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+    mnist.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+    bool trained = std::filesystem::exists("./src/models/model_v3.1_layer_0.dat");
+    if (trained) mnist.loadFromFile("./src/models/model_v3.1");
+
+    Matrix calibration(calibrationSamples, 784), test(testSamples, 784);
+    std::vector<int> labels;
+    const std::string images = "./data/train-images-idx3-ubyte", labelFile = "./data/train-labels-idx1-ubyte";
+    if (std::filesystem::exists(images) && std::filesystem::exists(labelFile)) {
+        std::shared_ptr<const DatasetCache> train = DatasetCache::open(images, labelFile);
+        train->toMatrix(0, calibrationSamples, calibration);
+        train->toMatrix(calibrationSamples, testSamples, test);
+        labels.assign(train->labels() + calibrationSamples, train->labels() + calibrationSamples + testSamples);
+    } else {
+        std::cout << "No MNIST data in ./data, using random inputs (accuracy not measured)\n";
+        calibration.randomize(0.0, 1.0);
+        test.randomize(0.0, 1.0);
+    }
+
+    QuantizedModel quantizedMnist = QuantizedModel::quantize(mnist, calibration);
+    std::cout << (trained ? "model_v3.1" : "untrained 784-16-16-10") << ", best int8 kernel "
+              << QuantizedModel::kernelName(QuantizedModel::bestKernel()) << "\n";
+    QuantizedModel::compare(mnist, quantizedMnist, test, labels).print(std::cout);
+
+    // A wider network, where the weights no longer fit in L2 and memory traffic dominates
+    NeuralNetwork wide;
+    wide.addLayer(std::make_unique<DenseLayer>(784, 1024, new activations::ReLU()));
+    wide.addLayer(std::make_unique<DenseLayer>(1024, 512, new activations::ReLU()));
+    wide.addLayer(std::make_unique<DenseLayer>(512, 10, new activations::Softmax(), true));
+    QuantizedModel quantizedWide = QuantizedModel::quantize(wide, calibration);
+    std::cout << "\nuntrained 784-1024-512-10\n";
+    QuantizedModel::compare(wide, quantizedWide, test, labels).print(std::cout);
+
+    BenchmarkOptions options;
+    options.repetitions = 5;
+    Benchmark bench(options);
+    std::cout << "\n";
+    Benchmark::printHeader(std::cout);
+    benchModel(bench, "mnist", mnist, quantizedMnist, test);
+    benchModel(bench, "wide", wide, quantizedWide, test);
+    return 0;
+}
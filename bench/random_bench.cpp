@@ -0,0 +1,86 @@
+// Weight initialization throughput: the old Matrix::randomize (a std::random_device and a fresh
+// std::mt19937 per call, one element at a time) against the Philox streams, per generator kernel,
+// for uniform and normal values, and a large matrix filled on 1..N threads. Every thread count must
+// give the same checksum; the speedup column shows the scaling.
+//
+//   ./random_bench [matrix side] [max threads]
+#include "../src/math/matrix.hpp"
+#include "../src/math/random.hpp"
+#include "../src/utils/benchmark.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Matrix::randomize before the Philox streams
+static void randomizeMt19937(Matrix &m, double lo, double hi) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<> dist(lo, hi);
+    for (int i = 0; i < m.rows; i++) {
+        for (int j = 0; j < m.cols; j++) m.data[i][j] = dist(gen);
+    }
+}
+
+static double checksum(const Matrix &m) {
+    double sum = 0.0;
+    for (int i = 0; i < m.rows; i++) {
+        for (int j = 0; j < m.cols; j++) sum += m.data[i][j] * (1 + (i + j) % 7);
+    }
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    int side = argc > 1 ? std::stoi(argv[1]) : 1024;
+    int maxThreads = argc > 2 ? std::stoi(argv[2]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    BenchmarkOptions options;
+    options.repetitions = 7;
+    options.minSeconds = 0.05;
+    Benchmark bench(options);
+
+    const double values = static_cast<double>(side) * side;
+    Matrix weights(side, side);
+    std::cout << side << "x" << side << " weights, " << Random::threads() << " hardware threads\n\n";
+    Benchmark::printHeader(std::cout);
+    Random::setThreads(1);
+    Benchmark::print(bench.run("mt19937_uniform", [&] {
+        randomizeMt19937(weights, -0.1, 0.1);
+        doNotOptimize(weights.data);
+    }, 0.0, values * sizeof(double)), std::cout);
+    for (Random::Kernel kernel : {Random::Kernel::Scalar, Random::Kernel::Avx2, Random::Kernel::Avx512}) {
+        if (!Random::supported(kernel)) continue;
+        Random::setKernel(kernel);
+        const std::string name = Random::kernelName(kernel);
+        Benchmark::print(bench.run("philox_uniform/" + name, [&] {
+            weights.randomize(-0.1, 0.1);
+            doNotOptimize(weights.data);
+        }, 0.0, values * sizeof(double)), std::cout);
+        Benchmark::print(bench.run("philox_normal/" + name, [&] {
+            weights.randomizeNormal(0.0, 0.1);
+            doNotOptimize(weights.data);
+        }, 0.0, values * sizeof(double)), std::cout);
+    }
+
+    // Thread scaling on a fixed stream: same values for every thread count
+    std::cout << "\n" << std::left << std::setw(10) << "threads" << std::right << std::setw(12) << "ms"
+              << std::setw(10) << "speedup" << std::setw(24) << "checksum" << "\n";
+    double baseline = 0.0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        Random::setThreads(threads);
+        const BenchmarkResult &result = bench.run("philox_uniform/threads" + std::to_string(threads), [&] {
+            RandomStream(7, 0).fillUniform(weights.data[0], static_cast<size_t>(side) * side, -0.1, 0.1);
+            doNotOptimize(weights.data);
+        });
+        if (threads == 1) baseline = result.median_ns;
+        std::cout << std::left << std::setw(10) << threads << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << result.median_ns / 1e6 << std::setw(9) << baseline / result.median_ns << "x"
+                  << std::setprecision(12) << std::setw(24) << checksum(weights) << "\n" << std::defaultfloat;
+        if (threads < maxThreads && threads * 2 > maxThreads) threads = maxThreads / 2;
+    }
+    Random::setThreads(0);
+    return 0;
+}
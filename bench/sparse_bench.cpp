@@ -0,0 +1,111 @@
+// Density crossover of the sparse kernels against the dense GEMM path of DenseLayer:
+// a batch of inputs at a given fraction of non-zeros (sparse input, incl. the CSR conversion)
+// and magnitude pruned weights at a given density, for the MNIST hidden layer and a wider one.
+// Matrix::operator* is the blocked SIMD GEMM (Gemm); a naive row-streaming loop (the sparse kernels'
+// access pattern without the zero skipping) is kept as a reference. The crossover against operator*
+// is where skipping zeros stops paying off: about 0.05 for 784x16 and 0.1 for 784x256 at batch 64,
+// DenseLayer::sparseInputThreshold defaults a little below the narrower one.
+//
+//   ./sparse_bench [batch size]
+#include "../src/math/matrix.hpp"
+#include "../src/math/sparse_matrix.hpp"
+#include "../src/utils/benchmark.hpp"
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Random matrix with about `density` of its entries non-zero
+static Matrix randomSparse(int rows, int cols, double density, std::mt19937 &gen) {
+    std::uniform_real_distribution<double> value(0.05, 1.0), keep(0.0, 1.0);
+    Matrix m(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            if (keep(gen) < density) m.data[i][j] = value(gen);
+        }
+    }
+    return m;
+}
+
+// out = a * b in i-k-j order, every row of b is streamed
+static void multiplyStreaming(const Matrix &a, const Matrix &b, Matrix &out) {
+    if (out.rows != a.rows || out.cols != b.cols) out = Matrix(a.rows, b.cols);
+    else out.fill(0.0);
+    for (int i = 0; i < a.rows; i++) {
+        for (int k = 0; k < a.cols; k++) {
+            const double x = a.data[i][k];
+            for (int j = 0; j < b.cols; j++) out.data[i][j] += x * b.data[k][j];
+        }
+    }
+}
+
+static double medianOf(Benchmark &bench, const std::string &name, const std::function<void()> &fn) {
+    const BenchmarkResult &result = bench.run(name, fn);
+    Benchmark::print(result, std::cout);
+    return result.median_ns;
+}
+
+int main(int argc, char** argv) {
+    int batch = argc > 1 ? std::stoi(argv[1]) : 64;
+    const std::vector<double> densities = {0.01, 0.02, 0.05, 0.1, 0.2, 0.3, 0.4, 0.5, 0.7, 1.0};
+    std::mt19937 gen(1);
+
+    BenchmarkOptions options;
+    options.repetitions = 5;
+    options.minSeconds = 0.01;
+    Benchmark bench(options);
+
+    for (int outputs : {16, 256}) {
+        const std::string shape = "784x" + std::to_string(outputs);
+        Matrix weights(784, outputs), denseInput(batch, 784), out;
+        weights.randomize(-0.1, 0.1);
+        denseInput.randomize(0.0, 1.0);
+
+        std::cout << "\n";
+        Benchmark::printHeader(std::cout);
+        std::vector<double> dense, streaming, sparseInput, prunedWeights;
+        for (double density : densities) {
+            std::string suffix = "/" + shape + "/density" + std::to_string(static_cast<int>(density * 100));
+            Matrix input = randomSparse(batch, 784, density, gen);
+            dense.push_back(medianOf(bench, "dense" + suffix, [&] { out = input * weights; doNotOptimize(out.data); }));
+            streaming.push_back(medianOf(bench, "dense_streaming" + suffix, [&] {
+                multiplyStreaming(input, weights, out);
+                doNotOptimize(out.data);
+            }));
+
+            SparseMatrix csr;
+            sparseInput.push_back(medianOf(bench, "sparse_input" + suffix, [&] {
+                csr.assign(input);
+                csr.multiply(weights, out);
+                doNotOptimize(out.data);
+            }));
+
+            SparseMatrix pruned = SparseMatrix::fromDense(randomSparse(784, outputs, density, gen));
+            prunedWeights.push_back(medianOf(bench, "pruned_weights" + suffix, [&] {
+                SparseMatrix::multiply(denseInput, pruned, out);
+                doNotOptimize(out.data);
+            }));
+        }
+
+        // Speedups over the dense multiplies (same input, dense weights), and the crossover densities
+        std::cout << "\n" << shape << ", batch " << batch << ", speedup over operator* / over the streaming loop\n"
+                  << std::setw(10) << "density" << std::setw(22) << "sparse input" << std::setw(22) << "pruned weights" << "\n";
+        double crossover[2][2] = {};  // [input, weights][operator*, streaming]
+        for (size_t i = 0; i < densities.size(); i++) {
+            double speedups[2][2] = {{dense[i] / sparseInput[i], streaming[i] / sparseInput[i]},
+                                     {dense.back() / prunedWeights[i], streaming.back() / prunedWeights[i]}};
+            std::cout << std::fixed << std::setprecision(2) << std::setw(10) << densities[i];
+            for (int kind = 0; kind < 2; kind++) {
+                std::cout << std::setw(12) << speedups[kind][0] << "x / " << std::setw(5) << speedups[kind][1] << "x";
+                for (int baseline = 0; baseline < 2; baseline++) {
+                    if (speedups[kind][baseline] >= 1.0) crossover[kind][baseline] = densities[i];
+                }
+            }
+            std::cout << "\n";
+        }
+        std::cout << "sparse input faster up to density " << crossover[0][0] << " / " << crossover[0][1]
+                  << ", pruned weights up to " << crossover[1][0] << " / " << crossover[1][1] << "\n" << std::defaultfloat;
+    }
+    return 0;
+}
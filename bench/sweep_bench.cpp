@@ -0,0 +1,157 @@
+// Hyperparameter sweep over the main.cpp MNIST recipe (learning rate x hidden sizes x activation,
+// 18 models) trained three ways for the same number of steps:
+//
+//   sequential   one model after the other, each with its own DataLoader (the one-process-per-
+//                config setup, minus process startup and the data reload)
+//   pool         SweepRunner, all models on one shared loader spread over the thread pool
+//   pool+fused   the same with the first layers of all models in one GEMM
+//
+// and finally pool+fused with early stopping, followed by its results table.
+// Uses ./data (MNIST) when present, otherwise a synthetic task with one noisy pixel pattern per class.
+//
+//   ./sweep_bench [steps] [threads]
+#include "../src/core/neural_network.hpp"
+#include "../src/core/sweep_runner.hpp"
+#include "../src/utils/data_loader.hpp"
+#include "../src/utils/idx_file.hpp"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static void writeIdx(const std::string &filename, const std::vector<uint32_t> &dims, const std::vector<uint8_t> &bytes) {
+    std::ofstream file(filename, std::ios::binary);
+    const unsigned char magic[4] = {0, 0, 0x08, static_cast<unsigned char>(dims.size())};
+    file.write(reinterpret_cast<const char*>(magic), 4);
+    for (uint32_t dim : dims) {
+        const unsigned char big[4] = {static_cast<unsigned char>(dim >> 24), static_cast<unsigned char>(dim >> 16),
+                                      static_cast<unsigned char>(dim >> 8), static_cast<unsigned char>(dim)};
+        file.write(reinterpret_cast<const char*>(big), 4);
+    }
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+// MNIST-like task: every class has a stroke pattern of ~150 pixels, a sample shows most of its
+// class pattern plus random noise pixels (~80% zeros overall)
+static void synthetic(int n, std::mt19937 &gen, const std::string &images, const std::string &labels) {
+    std::vector<std::vector<int>> patterns(10);
+    std::mt19937 patternGen(1);
+    for (auto &pattern : patterns) {
+        for (int i = 0; i < 150; i++) pattern.push_back(static_cast<int>(patternGen() % 784));
+    }
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<uint8_t> pixels(static_cast<size_t>(n) * 784, 0), classes(n);
+    for (int r = 0; r < n; r++) {
+        const int label = static_cast<int>(gen() % 10);
+        classes[r] = static_cast<uint8_t>(label);
+        uint8_t* image = pixels.data() + static_cast<size_t>(r) * 784;
+        for (int i = 0; i < 784; i++) {
+            if (uniform(gen) < 0.05) image[i] = static_cast<uint8_t>(255 * uniform(gen));
+        }
+        for (int i : patterns[label]) {
+            if (uniform(gen) < 0.8) image[i] = static_cast<uint8_t>(128 + 127 * uniform(gen));
+        }
+    }
+    writeIdx(images, {static_cast<uint32_t>(n), 28, 28}, pixels);
+    writeIdx(labels, {static_cast<uint32_t>(n)}, classes);
+}
+
+static std::vector<SweepConfig> configs() {
+    return SweepConfig::grid({0.05, 0.1, 0.5}, {{16, 16}, {32}, {64}}, {"sigmoid", "relu"});
+}
+
+int main(int argc, char** argv) {
+    const int steps = argc > 1 ? std::stoi(argv[1]) : 300;
+    const int threads = argc > 2 ? std::stoi(argv[2]) : 0;
+    const int batchSize = 64;
+
+    std::string trainImages = "./data/train-images-idx3-ubyte", trainLabels = "./data/train-labels-idx1-ubyte";
+    std::string testImages = "./data/t10k-images-idx3-ubyte", testLabels = "./data/t10k-labels-idx1-ubyte";
+    const std::filesystem::path temporary = std::filesystem::temp_directory_path() / "sweep_bench_data";
+    const bool mnist = std::filesystem::exists(trainImages) && std::filesystem::exists(testImages);
+    if (!mnist) {
+        std::filesystem::create_directories(temporary);
+        trainImages = (temporary / "train-images").string();
+        trainLabels = (temporary / "train-labels").string();
+        testImages = (temporary / "test-images").string();
+        testLabels = (temporary / "test-labels").string();
+        std::mt19937 gen(42);
+        synthetic(12000, gen, trainImages, trainLabels);
+        synthetic(2000, gen, testImages, testLabels);
+    }
+    IdxFile images(trainImages), labels(trainLabels), validationImages(testImages), validationLabelFile(testLabels);
+    Matrix validation;
+    validationImages.toMatrix(0, validationImages.count(), validation, 1.0 / 255.0);
+    std::vector<int> validationLabels(validationLabelFile.count());
+    for (size_t i = 0; i < validationLabels.size(); i++) validationLabels[i] = validationLabelFile.ubyteData()[i];
+
+    const int models = static_cast<int>(configs().size());
+    std::cout << (mnist ? "MNIST" : "Synthetic MNIST-like data") << ": " << images.count() << " training, "
+              << validation.rows << " validation samples\n"
+              << models << " models, " << steps << " steps of batch " << batchSize << " each\n\n";
+    std::cout << std::left << std::setw(24) << "mode" << std::right << std::setw(10) << "seconds"
+              << std::setw(16) << "model steps/s" << std::setw(10) << "speedup" << std::setw(12) << "best acc" << "\n";
+
+    double sequentialSeconds = 0.0;
+    auto report = [&](const std::string &mode, double seconds, long long modelSteps, double best) {
+        if (sequentialSeconds == 0.0) sequentialSeconds = seconds;
+        std::cout << std::left << std::setw(24) << mode << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << seconds << std::setprecision(0) << std::setw(16) << modelSteps / seconds
+                  << std::setprecision(2) << std::setw(9) << sequentialSeconds / seconds << "x"
+                  << std::setprecision(4) << std::setw(12) << best << "\n";
+    };
+
+    SweepOptions noStopping;
+    noStopping.steps = steps;
+    noStopping.evalInterval = steps;
+    noStopping.stopMargin = 1.0;
+    noStopping.threads = threads;
+
+    // One runner per model, trained one after the other (each model alone: no pool, no fusion)
+    {
+        Random::setSeed(7);
+        std::vector<SweepRunner> alone(models);
+        for (int m = 0; m < models; m++) alone[m].add(configs()[m]);
+        SweepOptions single = noStopping;
+        single.threads = 1;
+        double best = 0.0;
+        const auto start = std::chrono::steady_clock::now();
+        for (SweepRunner &runner : alone) {
+            DataLoader loader(images, labels, batchSize, true, 1);
+            best = std::max(best, runner.run(loader, validation, validationLabels, single)[0].bestAccuracy);
+        }
+        report("sequential", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+               static_cast<long long>(models) * steps, best);
+    }
+
+    std::vector<SweepResult> results;
+    for (int mode = 0; mode < 3; mode++) {
+        Random::setSeed(7);
+        SweepRunner sweep;
+        for (const SweepConfig &config : configs()) sweep.add(config);
+        SweepOptions options = noStopping;
+        options.fuseGemms = mode > 0;
+        if (mode == 2) {
+            options.evalInterval = std::max(1, steps / 3);
+            options.stopMargin = 0.05;
+        }
+        DataLoader loader(images, labels, batchSize, true, 1);
+        const auto start = std::chrono::steady_clock::now();
+        results = sweep.run(loader, validation, validationLabels, options);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long long modelSteps = 0;
+        for (const SweepResult &result : results) modelSteps += result.steps;
+        const char* names[] = {"pool", "pool+fused", "pool+fused+early stop"};
+        report(names[mode], seconds, modelSteps, results[0].bestAccuracy);
+    }
+
+    std::cout << "\n";
+    SweepRunner::writeTable(results, std::cout);
+    if (!mnist) std::filesystem::remove_all(temporary);
+    return 0;
+}
@@ -2,6 +2,10 @@
 #include "./src/layers/dense_layer.hpp"
 #include "./src/activations/activations.hpp"
 #include "./src/utils/utils.hpp"
+#include "./src/utils/idx_file.hpp"
+#include "./src/utils/data_loader.hpp"
+#include "./src/utils/dataset_cache.hpp"
+#include "./src/core/evaluator.hpp"
 #include <vector>
 #include <chrono> // To Measure time
 #include <iostream>
@@ -17,18 +21,16 @@ int main() {
     nn.addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
     nn.addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true)); // Output layer
     
-    std::vector<Matrix> input = utils::loadMNISTImages(images_file);
-    // For flattening the input data (from 28x28 to 1x784) in place
-    for (auto& img : input) {
-        img = utils::flatten(img);  // Replace with flattened version
-    }
-    
-    std::vector<int> labels = utils::loadMNISTLabels(labels_file);
-    std::vector<Matrix> target(labels.size());
-    // Converting from int to Matrix(1, 10), with 1 in the correct index
-    for (int i = 0; i < labels.size(); i++) {
-        target[i] = utils::createMNISTTargetMatrix(labels[i]);
-    } 
+    // Per-sample matrices for the train()/train_batch() examples below, from normalized, flattened
+    // images and labels preprocessed on the first run only (./data/train-images-idx3-ubyte.cache),
+    // later runs map the cache directly
+    // std::shared_ptr<const DatasetCache> train = DatasetCache::open(images_file, labels_file);
+    // std::vector<Matrix> input(train->count());
+    // std::vector<Matrix> target(train->count());
+    // for (size_t i = 0; i < train->count(); i++) {
+    //     train->toMatrix(i, 1, input[i]);
+    //     target[i] = utils::createMNISTTargetMatrix(train->labels()[i]);
+    // }
 
     
     // Data training
@@ -73,29 +75,34 @@ int main() {
     // nn.saveToFile("./src/models/model_v3.1");
 
     // ==================================================
-    // first n inputs accuracy
+    // Minibatch training with DataLoader (shuffled batches prefetched in the background)
+
+    // IdxFile train_images(images_file);
+    // IdxFile train_labels(labels_file);
+    // DataLoader loader(train_images, train_labels, 64);
+
+    // for (int epoch = 0; epoch < 5; epoch++) {
+    //     double loss = 0.0;
+    //     for (int b = 0; b < loader.batchesPerEpoch(); b++) {
+    //         const Batch& batch = loader.next();
+    //         loss += nn.train_step(batch.inputs, batch.labels, 0.1);
+    //     }
+    //     std::cout << "Epoch " << epoch + 1 << " loss: " << loss / loader.batchesPerEpoch()
+    //               << ", waited for data: " << loader.stallSeconds() << "s\n";
+    // }
+
+    // nn.saveToFile("./src/models/model_v3.1");
+
+    // ==================================================
+    // Test set accuracy (batched over all cores, see Evaluator)
 
     nn.loadFromFile("./src/models/model_v3.1");
 
-    int m = 100; // Number of samples to test
-    int correct = 0;
-    for (int i = 0; i < m; i++) {
-        Matrix output = nn.forward(input[i]);
-
-        int max = 0;
-        for (int j = 0; j < output.cols; j++) {
-            if (output.data[0][j] > output.data[0][max]) {
-                max = j; // maximum probability
-            }
-        }
-        std::cout << "Predicted: " << max << ", Actual: " << labels[i] << std::endl;
-        if (max == labels[i]) {
-            correct++;
-        }
-    }
-
-    double accuracy = static_cast<double>(correct) / m;
-    std::cout << "\nFinal accuracy: " << accuracy * 100 << "%\n";
+    std::shared_ptr<const DatasetCache> test = DatasetCache::open("./data/t10k-images-idx3-ubyte",
+                                                                  "./data/t10k-labels-idx1-ubyte");
+    Evaluator evaluator;
+    Evaluation result = evaluator.evaluate(nn, *test);
+    result.report(std::cout);
 
     // nn.saveToFile("./src/models/model_v3.1");
 
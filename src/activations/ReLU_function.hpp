@@ -6,7 +6,7 @@
 
 class ReLUFunction : public ActivationFunction {
     public:
-        std::vector<double> activate(const std::vector<double> &x) {
+        std::vector<double> activate(const std::vector<double> &x) const {
             std::vector<double> y(x.size());
             for (int i = 0; i < x.size(); i++) {
                 y[i] = (x[i] > 0) ? x[i] : 0.01 * x[i];  // small slope for x < 0
@@ -14,13 +14,27 @@ class ReLUFunction : public ActivationFunction {
             return y;
         }
     
-        std::vector<double> derivative(const std::vector<double> &x) {
+        std::vector<double> derivative(const std::vector<double> &x) const {
             std::vector<double> y(x.size());
             for (int i = 0; i < x.size(); i++) {
                 y[i] = (x[i] > 0) ? 1 : 0.01;  // small gradient for x < 0
             }
             return y;
         }
+
+        void activateInto(const std::vector<double> &x, std::vector<double> &y) const {
+            y.resize(x.size());
+            for (int i = 0; i < x.size(); i++) {
+                y[i] = (x[i] > 0) ? x[i] : 0.01 * x[i];
+            }
+        }
+
+        void derivativeInto(const std::vector<double> &x, std::vector<double> &y) const {
+            y.resize(x.size());
+            for (int i = 0; i < x.size(); i++) {
+                y[i] = (x[i] > 0) ? 1 : 0.01;
+            }
+        }
     };
     
 
@@ -5,8 +5,19 @@
 
 class ActivationFunction {
 public:
-    virtual std::vector<double> activate(const std::vector<double> &x) = 0;
-    virtual std::vector<double> derivative(const std::vector<double> &x) = 0;
+    // const so one instance can be shared by layers used from several threads
+    virtual std::vector<double> activate(const std::vector<double> &x) const = 0;
+    virtual std::vector<double> derivative(const std::vector<double> &x) const = 0;
+    // Same values written into y (resized to x.size()), so a loop over rows can reuse one buffer.
+    // The built-in functions allocate nothing once y has the capacity.
+    virtual void activateInto(const std::vector<double> &x, std::vector<double> &y) const {
+        std::vector<double> result = activate(x);
+        y.assign(result.begin(), result.end());
+    }
+    virtual void derivativeInto(const std::vector<double> &x, std::vector<double> &y) const {
+        std::vector<double> result = derivative(x);
+        y.assign(result.begin(), result.end());
+    }
     virtual ~ActivationFunction() {}
 };
 
@@ -4,11 +4,13 @@
 #include "ReLU_function.hpp"
 #include "sigmoid_function.hpp"
 #include "softmax_function.hpp"
+#include "linear_function.hpp"
 
 namespace activations { // Namespace for activation functions
     using ReLU = ReLUFunction;
     using Sigmoid = SigmoidFunction;
     using Softmax = SoftmaxFunction;
+    using Linear = LinearFunction;
 }
 
 #endif // ACTIVATIONS_HPP
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef LINEAR_FUNCTION_HPP
+#define LINEAR_FUNCTION_HPP
+
+#include "activation_function.hpp"
+#include <vector>
+
+// Identity, for layers whose output feeds a normalization (DenseLayer before a BatchNormLayer)
+class LinearFunction : public ActivationFunction {
+    public:
+        std::vector<double> activate(const std::vector<double> &x) const {
+            return x;
+        }
+    
+        std::vector<double> derivative(const std::vector<double> &x) const {
+            return std::vector<double>(x.size(), 1.0);
+        }
+
+        void activateInto(const std::vector<double> &x, std::vector<double> &y) const {
+            y.assign(x.begin(), x.end());
+        }
+
+        void derivativeInto(const std::vector<double> &x, std::vector<double> &y) const {
+            y.assign(x.size(), 1.0);
+        }
+    };
+
+#endif // LINEAR_FUNCTION_HPP
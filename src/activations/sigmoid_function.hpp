@@ -7,7 +7,7 @@
 
 class SigmoidFunction : public ActivationFunction {
     public:
-        std::vector<double> activate(const std::vector<double> &x) {
+        std::vector<double> activate(const std::vector<double> &x) const {
             std::vector<double> y(x.size());
             for (int i = 0; i < x.size(); i++) {
                 y[i] = 1.0 / (1.0 + exp(-x[i]));
@@ -15,7 +15,7 @@ class SigmoidFunction : public ActivationFunction {
             return y;
         }
     
-        std::vector<double> derivative(const std::vector<double> &x) {
+        std::vector<double> derivative(const std::vector<double> &x) const {
             std::vector<double> y(x.size());
             for (int i = 0; i < x.size(); i++) {
                 double sigmoid_x = 1.0 / (1.0 + exp(-x[i]));
@@ -23,6 +23,21 @@ class SigmoidFunction : public ActivationFunction {
             }
             return y;
         }
+
+        void activateInto(const std::vector<double> &x, std::vector<double> &y) const {
+            y.resize(x.size());
+            for (int i = 0; i < x.size(); i++) {
+                y[i] = 1.0 / (1.0 + exp(-x[i]));
+            }
+        }
+
+        void derivativeInto(const std::vector<double> &x, std::vector<double> &y) const {
+            y.resize(x.size());
+            for (int i = 0; i < x.size(); i++) {
+                double sigmoid_x = 1.0 / (1.0 + exp(-x[i]));
+                y[i] = sigmoid_x * (1 - sigmoid_x);
+            }
+        }
     };
     
 
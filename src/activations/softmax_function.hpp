@@ -12,7 +12,7 @@ public:
 
 
 // Function to apply Softmax across a vector of inputs (used for layers with multiple neurons)
-    std::vector<double> activate(const std::vector<double>& input) {
+    std::vector<double> activate(const std::vector<double>& input) const {
         double sum = 0.0;
         // Calculate the sum of the exponentials of all inputs
         for (auto val : input) {
@@ -28,8 +28,19 @@ public:
         return output;
     }
 
+    void activateInto(const std::vector<double>& input, std::vector<double>& output) const {
+        double sum = 0.0;
+        for (auto val : input) {
+            sum += exp(val);
+        }
+        output.resize(input.size());
+        for (size_t i = 0; i < input.size(); i++) {
+            output[i] = exp(input[i]) / sum;
+        }
+    }
+
     // Compute the derivative of the Softmax function
-    std::vector<double> derivative(const std::vector<double>& input) {
+    std::vector<double> derivative(const std::vector<double>& input) const {
         // here we would typically compute the Jacobian matrix of the Softmax function
         // but for simplicity, we will return a vector of zeros
         // since the derivative of Softmax is not straightforward and depends on the output
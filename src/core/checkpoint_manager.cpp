@@ -0,0 +1,214 @@
+#include "checkpoint_manager.hpp"
+#include "model_file.hpp"
+#include "mixed_precision.hpp"
+#include "../layers/dropout_layer.hpp"
+#include "../utils/trace.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstdio>
+#include <stdexcept>
+
+CheckpointManager::CheckpointManager(const std::string &directory, const std::string &prefix, int keepLast)
+    : directory(directory), prefix(prefix), keepLast(keepLast) {
+    if (directory.empty() || prefix.empty()) {
+        throw std::invalid_argument("Checkpoint directory and prefix cannot be empty");
+    }
+    if (keepLast <= 0) {
+        throw std::invalid_argument("keepLast must be positive");
+    }
+    std::filesystem::create_directories(directory);
+    writer = std::thread(&CheckpointManager::writerLoop, this);
+}
+
+CheckpointManager::~CheckpointManager() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (writer.joinable()) writer.join();
+}
+
+void CheckpointManager::save(const NeuralNetwork &nn, const TrainingState &state) {
+    // The copy happens on the training thread, everything after it is in the background
+    TraceScope trace("checkpoint_snapshot", "checkpoint", "step", state.step);
+    auto snapshot = std::make_unique<Snapshot>();
+    snapshot->layers.reserve(nn.layers.size());
+    for (const auto& layer : nn.layers) {
+        if (auto* dropout = dynamic_cast<const DropoutLayer*>(layer.get())) {
+            // clone() derives a new stream, the checkpoint needs this one
+            snapshot->layers.push_back(std::make_unique<DropoutLayer>(*dropout));
+        } else {
+            snapshot->layers.push_back(layer->clone());
+        }
+    }
+    snapshot->state = state;
+    if (nn.mixedPrecision) {
+        snapshot->state.lossScale = nn.mixedPrecision->lossScale();
+        snapshot->state.cleanSteps = nn.mixedPrecision->cleanStepCount();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    rethrowWriteError();
+    cv.wait(lock, [this] { return !pending; });
+    pending = std::move(snapshot);
+    cv.notify_all();
+}
+
+void CheckpointManager::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return !pending && !busy; });
+    rethrowWriteError();
+}
+
+void CheckpointManager::rethrowWriteError() {
+    if (writeError) {
+        std::exception_ptr error = writeError;
+        writeError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void CheckpointManager::writerLoop() {
+    Tracer::setThreadName("Checkpoint writer");
+    while (true) {
+        std::unique_ptr<Snapshot> writing;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || pending; });
+            if (!pending) return;  // stopping with nothing queued
+            writing = std::move(pending);
+            busy = true;
+        }
+        cv.notify_all();  // the pending slot is free again
+
+        std::exception_ptr error;
+        try {
+            TraceScope trace("checkpoint_write", "checkpoint", "step", writing->state.step);
+            write(*writing);
+            prune();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy = false;
+            if (error) writeError = error;
+        }
+        cv.notify_all();
+    }
+}
+
+std::string CheckpointManager::basePath(long long step) const {
+    std::ostringstream name;
+    name << prefix << "_" << std::setw(12) << std::setfill('0') << step;
+    return (std::filesystem::path(directory) / name.str()).string();
+}
+
+void CheckpointManager::write(const Snapshot &snapshot) {
+    std::string base = basePath(snapshot.state.step);
+
+    // Parameters first (ModelFile renames into place itself)
+    ModelFile::save(snapshot.layers, base + ".nnm");
+
+    // The state file marks the checkpoint as complete
+    std::string tmpFilename = base + ".state.tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Could not create file " + tmpFilename);
+        }
+        file << "epoch " << snapshot.state.epoch << "\n";
+        file << "step " << snapshot.state.step << "\n";
+        file << "learning_rate " << std::hexfloat << snapshot.state.learningRate << std::defaultfloat << "\n";
+        if (snapshot.state.lossScale > 0.0) {
+            file << "loss_scale " << std::hexfloat << snapshot.state.lossScale << std::defaultfloat << "\n";
+            file << "clean_steps " << snapshot.state.cleanSteps << "\n";
+        }
+        file << "rng " << snapshot.state.rngState << "\n";
+        if (!file) {
+            throw std::runtime_error("Failed writing " + tmpFilename);
+        }
+    }
+    if (std::rename(tmpFilename.c_str(), (base + ".state").c_str()) != 0) {
+        throw std::runtime_error("Could not move " + tmpFilename + " into place");
+    }
+}
+
+std::vector<long long> CheckpointManager::listCheckpoints() const {
+    std::vector<long long> steps;
+    std::string start = prefix + "_";
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        if (entry.path().extension() != ".state" || name.compare(0, start.size(), start) != 0) continue;
+
+        std::string digits = entry.path().stem().string().substr(start.size());
+        if (digits.empty() || !std::all_of(digits.begin(), digits.end(), ::isdigit)) continue;
+        steps.push_back(std::stoll(digits));
+    }
+    std::sort(steps.begin(), steps.end());
+    return steps;
+}
+
+void CheckpointManager::prune() {
+    std::vector<long long> steps = listCheckpoints();
+    for (size_t i = 0; i + keepLast < steps.size(); i++) {
+        std::string base = basePath(steps[i]);
+        // Remove the completion marker first so a crash in between leaves no half checkpoint behind
+        std::filesystem::remove(base + ".state");
+        std::filesystem::remove(base + ".nnm");
+    }
+}
+
+bool CheckpointManager::restoreLatest(NeuralNetwork &nn, TrainingState &state) {
+    wait();
+    std::vector<long long> steps = listCheckpoints();
+    if (steps.empty()) return false;
+
+    std::string base = basePath(steps.back());
+    std::ifstream file(base + ".state");
+    if (!file) {
+        throw std::runtime_error("Could not open " + base + ".state");
+    }
+
+    TrainingState restored;
+    std::string key;
+    while (file >> key) {
+        if (key == "epoch") file >> restored.epoch;
+        else if (key == "step") file >> restored.step;
+        else if (key == "learning_rate") {
+            // hexfloat keeps the value exact, read it back with strtod
+            std::string value;
+            file >> value;
+            restored.learningRate = std::strtod(value.c_str(), nullptr);
+        }
+        else if (key == "loss_scale") {
+            std::string value;
+            file >> value;
+            restored.lossScale = std::strtod(value.c_str(), nullptr);
+        }
+        else if (key == "clean_steps") file >> restored.cleanSteps;
+        else if (key == "rng") {
+            file.get();  // the separating space
+            std::getline(file, restored.rngState);
+        }
+        else throw std::runtime_error("Unknown key '" + key + "' in " + base + ".state");
+    }
+
+    NeuralNetwork loaded = ModelFile::load(base + ".nnm");
+    nn.layers = std::move(loaded.layers);
+    nn.mappedStorage = std::move(loaded.mappedStorage);
+    nn.setTraining(nn.isTraining());  // the loaded layers take the network's train/eval mode
+    if (nn.mixedPrecision) {
+        nn.mixedPrecision->reload(nn);  // its master weights belong to the replaced layers
+        if (restored.lossScale > 0.0) nn.mixedPrecision->setLossScale(restored.lossScale, restored.cleanSteps);
+    }
+    state = restored;
+    return true;
+}
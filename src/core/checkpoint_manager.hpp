@@ -0,0 +1,79 @@
+#ifndef CHECKPOINT_MANAGER_HPP
+#define CHECKPOINT_MANAGER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include "neural_network.hpp"
+#include "../layers/layer.hpp"
+
+// Everything besides the parameters needed to resume training exactly where it stopped
+struct TrainingState {
+    int epoch = 0;
+    long long step = 0;
+    double learningRate = 0.0;
+    std::string rngState; // text form of the trainer's generator, e.g. `std::ostringstream() << rng`
+    // Loss scaling of a mixed precision network, filled in by save(); 0 for double training
+    double lossScale = 0.0;
+    int cleanSteps = 0;
+};
+
+// Writes checkpoints from a background thread so the training loop only pays for a parameter copy.
+//
+// save() snapshots the parameters into a staging slot and returns, the writer thread turns the
+// snapshot into <prefix>_<step>.nnm (ModelFile format) plus <prefix>_<step>.state. Both are written
+// to a temporary name and renamed, and the .state file is written last, so a checkpoint only counts
+// as complete once its .state exists. Only the newest keepLast checkpoints are kept.
+class CheckpointManager {
+private:
+    struct Snapshot {
+        std::vector<std::unique_ptr<Layer>> layers;
+        TrainingState state;
+    };
+
+    std::string directory, prefix;
+    int keepLast;
+
+    // Double buffering: the writer owns `writing` while training fills `pending`
+    std::unique_ptr<Snapshot> pending;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool busy = false;      // writer is working on a snapshot
+    bool stopping = false;
+    std::exception_ptr writeError;
+    std::thread writer;
+
+    void writerLoop();
+    void write(const Snapshot &snapshot);
+    void prune();
+    std::string basePath(long long step) const;
+    void rethrowWriteError();
+
+public:
+    CheckpointManager(const std::string &directory, const std::string &prefix = "checkpoint", int keepLast = 3);
+    ~CheckpointManager();  // finishes the queued checkpoint
+
+    CheckpointManager(const CheckpointManager&) = delete;
+    CheckpointManager& operator=(const CheckpointManager&) = delete;
+
+    // Copies the parameters and queues them for writing.
+    // Blocks only if the previous snapshot has not been picked up by the writer yet.
+    void save(const NeuralNetwork &nn, const TrainingState &state);
+
+    // Blocks until every queued checkpoint is on disk
+    void wait();
+
+    // Steps of the complete checkpoints on disk, oldest first
+    std::vector<long long> listCheckpoints() const;
+
+    // Replaces the network's layers with the newest complete checkpoint and fills state. A mixed
+    // precision network rebuilds its master weights from them and takes the saved loss scale.
+    // Returns false when there is no checkpoint to resume from.
+    bool restoreLatest(NeuralNetwork &nn, TrainingState &state);
+};
+
+#endif  // CHECKPOINT_MANAGER_HPP
@@ -0,0 +1,556 @@
+#include "compiled_model.hpp"
+#include "neural_network.hpp"
+#include "../layers/dense_layer.hpp"
+#include "../layers/batch_norm_layer.hpp"
+#include "../activations/activations.hpp"
+#include "../utils/trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <typeinfo>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NN_X86_KERNELS 1
+#endif
+
+typedef CompiledModel::Step Step;
+typedef CompiledModel::Activation Activation;
+
+static const int ROW_ALIGN = 16;  // floats, one AVX-512 vector
+
+static int roundUp(int value, int multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Activation of one output row in place, over the real outputs (the padding is never read).
+// ReLU is the leaky one of ReLUFunction.
+static inline void activate(Activation activation, float* row, int n) {
+    switch (activation) {
+        case Activation::Linear:
+            return;
+        case Activation::ReLU:
+            for (int o = 0; o < n; o++) row[o] = row[o] > 0.0f ? row[o] : 0.01f * row[o];
+            return;
+        case Activation::Sigmoid:
+            for (int o = 0; o < n; o++) row[o] = 1.0f / (1.0f + std::exp(-row[o]));
+            return;
+        case Activation::Softmax: {
+            float max = row[0], sum = 0.0f;
+            for (int o = 1; o < n; o++) max = std::max(max, row[o]);
+            for (int o = 0; o < n; o++) {
+                row[o] = std::exp(row[o] - max);
+                sum += row[o];
+            }
+            const float inv = 1.0f / sum;
+            for (int o = 0; o < n; o++) row[o] *= inv;
+            return;
+        }
+    }
+}
+
+// Indices of the non-zero entries of x (MNIST pixels, ReLU outputs), without a branch per input:
+// the dense and sparse kernels then only loop over those. Scattered zeros would make a
+// skip-if-zero branch mispredict on most inputs.
+static inline int nonZeroInputs(const float* x, int n, int* index) {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        index[count] = i;
+        count += x[i] != 0.0f;
+    }
+    return count;
+}
+
+// Dense rows: y = x * W + b over the non-zero inputs. W is padded column-wise to step.stride,
+// a tile is a range of columns accumulated in registers.
+
+template <int W>
+static void denseFixedScalar(const Step &step, const float* in, int inStride, float* out, int outStride,
+                             int batch, CompiledModel::Scratch &scratch) {
+    const float* weights = step.weights.data();
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        const int count = nonZeroInputs(x, step.inputs, scratch.nonZero);
+        float acc[W];
+        std::copy(step.biases.begin(), step.biases.begin() + W, acc);
+        for (int k = 0; k < count; k++) {
+            const int i = scratch.nonZero[k];
+            const float* w = weights + static_cast<size_t>(i) * W;
+            for (int o = 0; o < W; o++) acc[o] += x[i] * w[o];
+        }
+        float* y = out + static_cast<size_t>(r) * outStride;
+        std::copy(acc, acc + W, y);
+        activate(step.activation, y, step.outputs);
+    }
+}
+
+static void denseTiledScalar(const Step &step, const float* in, int inStride, float* out, int outStride,
+                             int batch, CompiledModel::Scratch &scratch) {
+    const int stride = step.stride;
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        const int count = nonZeroInputs(x, step.inputs, scratch.nonZero);
+        float* y = out + static_cast<size_t>(r) * outStride;
+        std::copy(step.biases.begin(), step.biases.end(), y);
+        for (int k = 0; k < count; k++) {
+            const int i = scratch.nonZero[k];
+            const float* w = &step.weights[static_cast<size_t>(i) * stride];
+            for (int o = 0; o < stride; o++) y[o] += x[i] * w[o];
+        }
+        activate(step.activation, y, step.outputs);
+    }
+}
+
+#ifdef NN_X86_KERNELS
+// 16 inputs per compare, the indices of the non-zero ones compress-stored in one instruction
+__attribute__((target("avx512f")))
+static inline int nonZeroInputsAvx512(const float* x, int n, int* index) {
+    const __m512i step = _mm512_set1_epi32(16);
+    __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    int count = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __mmask16 nonZero = _mm512_cmp_ps_mask(_mm512_loadu_ps(x + i), _mm512_setzero_ps(), _CMP_NEQ_UQ);
+        _mm512_mask_compressstoreu_epi32(index + count, nonZero, lanes);
+        count += __builtin_popcount(nonZero);
+        lanes = _mm512_add_epi32(lanes, step);
+    }
+    for (; i < n; i++) {
+        index[count] = i;
+        count += x[i] != 0.0f;
+    }
+    return count;
+}
+
+// 8 inputs per compare, then one iteration per set bit of the mask
+__attribute__((target("avx2")))
+static inline int nonZeroInputsAvx2(const float* x, int n, int* index) {
+    int count = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 zero = _mm256_cmp_ps(_mm256_loadu_ps(x + i), _mm256_setzero_ps(), _CMP_EQ_OQ);
+        unsigned bits = ~static_cast<unsigned>(_mm256_movemask_ps(zero)) & 0xFF;
+        while (bits) {
+            index[count++] = i + __builtin_ctz(bits);
+            bits &= bits - 1;
+        }
+    }
+    for (; i < n; i++) {
+        index[count] = i;
+        count += x[i] != 0.0f;
+    }
+    return count;
+}
+
+// V accumulators of 16 floats stay in registers for the whole input loop
+template <int V>
+__attribute__((target("avx512f")))
+static inline void tileAvx512(const float* x, const int* index, int count, const float* w, int stride,
+                              const float* bias, float* y) {
+    __m512 acc[V];
+    for (int v = 0; v < V; v++) acc[v] = _mm512_loadu_ps(bias + 16 * v);
+    for (int k = 0; k < count; k++) {
+        const int i = index[k];
+        const __m512 broadcast = _mm512_set1_ps(x[i]);
+        const float* row = w + static_cast<size_t>(i) * stride;
+        for (int v = 0; v < V; v++) acc[v] = _mm512_fmadd_ps(broadcast, _mm512_loadu_ps(row + 16 * v), acc[v]);
+    }
+    for (int v = 0; v < V; v++) _mm512_storeu_ps(y + 16 * v, acc[v]);
+}
+
+template <int V>
+__attribute__((target("avx512f")))
+static void denseFixedAvx512(const Step &step, const float* in, int inStride, float* out, int outStride,
+                             int batch, CompiledModel::Scratch &scratch) {
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        const int count = nonZeroInputsAvx512(x, step.inputs, scratch.nonZero);
+        float* y = out + static_cast<size_t>(r) * outStride;
+        tileAvx512<V>(x, scratch.nonZero, count, step.weights.data(), step.stride, step.biases.data(), y);
+        activate(step.activation, y, step.outputs);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void denseTiledAvx512(const Step &step, const float* in, int inStride, float* out, int outStride,
+                             int batch, CompiledModel::Scratch &scratch) {
+    const float* w = step.weights.data();
+    const float* b = step.biases.data();
+    const int* index = scratch.nonZero;
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        const int count = nonZeroInputsAvx512(x, step.inputs, scratch.nonZero);
+        float* y = out + static_cast<size_t>(r) * outStride;
+        int c = 0;
+        for (; c + 64 <= step.stride; c += 64) tileAvx512<4>(x, index, count, w + c, step.stride, b + c, y + c);
+        switch ((step.stride - c) / 16) {
+            case 3: tileAvx512<3>(x, index, count, w + c, step.stride, b + c, y + c); break;
+            case 2: tileAvx512<2>(x, index, count, w + c, step.stride, b + c, y + c); break;
+            case 1: tileAvx512<1>(x, index, count, w + c, step.stride, b + c, y + c); break;
+        }
+        activate(step.activation, y, step.outputs);
+    }
+}
+
+// Same with 8 float vectors
+template <int V>
+__attribute__((target("avx2,fma")))
+static inline void tileAvx2(const float* x, const int* index, int count, const float* w, int stride,
+                            const float* bias, float* y) {
+    __m256 acc[V];
+    for (int v = 0; v < V; v++) acc[v] = _mm256_loadu_ps(bias + 8 * v);
+    for (int k = 0; k < count; k++) {
+        const int i = index[k];
+        const __m256 broadcast = _mm256_set1_ps(x[i]);
+        const float* row = w + static_cast<size_t>(i) * stride;
+        for (int v = 0; v < V; v++) acc[v] = _mm256_fmadd_ps(broadcast, _mm256_loadu_ps(row + 8 * v), acc[v]);
+    }
+    for (int v = 0; v < V; v++) _mm256_storeu_ps(y + 8 * v, acc[v]);
+}
+
+template <int V>
+__attribute__((target("avx2,fma")))
+static void denseFixedAvx2(const Step &step, const float* in, int inStride, float* out, int outStride,
+                           int batch, CompiledModel::Scratch &scratch) {
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        const int count = nonZeroInputsAvx2(x, step.inputs, scratch.nonZero);
+        float* y = out + static_cast<size_t>(r) * outStride;
+        tileAvx2<V>(x, scratch.nonZero, count, step.weights.data(), step.stride, step.biases.data(), y);
+        activate(step.activation, y, step.outputs);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void denseTiledAvx2(const Step &step, const float* in, int inStride, float* out, int outStride,
+                           int batch, CompiledModel::Scratch &scratch) {
+    const float* w = step.weights.data();
+    const float* b = step.biases.data();
+    const int* index = scratch.nonZero;
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        const int count = nonZeroInputsAvx2(x, step.inputs, scratch.nonZero);
+        float* y = out + static_cast<size_t>(r) * outStride;
+        int c = 0;
+        for (; c + 32 <= step.stride; c += 32) tileAvx2<4>(x, index, count, w + c, step.stride, b + c, y + c);
+        if (c < step.stride) tileAvx2<2>(x, index, count, w + c, step.stride, b + c, y + c);  // stride is a multiple of 16
+        activate(step.activation, y, step.outputs);
+    }
+}
+#endif
+
+// Pruned weights, CSR over the inputs: each non-zero input scatters its row of non-zeros
+static void sparseRows(const Step &step, const float* in, int inStride, float* out, int outStride,
+                       int batch, CompiledModel::Scratch &scratch) {
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        const int count = nonZeroInputs(x, step.inputs, scratch.nonZero);
+        float* y = out + static_cast<size_t>(r) * outStride;
+        std::copy(step.biases.begin(), step.biases.end(), y);
+        for (int n = 0; n < count; n++) {
+            const int i = scratch.nonZero[n];
+            for (int k = step.rowStart[i]; k < step.rowStart[i + 1]; k++) y[step.columns[k]] += x[i] * step.values[k];
+        }
+        activate(step.activation, y, step.outputs);
+    }
+}
+
+// QuantizedModel::infer for one layer on float rows, one quantized row at a time
+static void int8Rows(const Step &step, const float* in, int inStride, float* out, int outStride,
+                     int batch, CompiledModel::Scratch &scratch) {
+    const QuantizedModel::DenseInt8 &layer = step.int8;
+    const double invScale = 1.0 / layer.inputScale;
+    uint8_t* q = scratch.quantized;
+    std::fill(q + layer.inputs, q + layer.stride, 0);
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        for (int i = 0; i < layer.inputs; i++) {
+            int v = static_cast<int>(std::nearbyint(x[i] * invScale)) + layer.inputZeroPoint;
+            q[i] = static_cast<uint8_t>(std::max(0, std::min(QuantizedModel::QMAX, v)));
+        }
+        float* y = out + static_cast<size_t>(r) * outStride;
+        for (int o = 0; o < layer.outputs; o++) {
+            int32_t acc = step.dot(q, &layer.weights[static_cast<size_t>(o) * layer.stride], layer.stride);
+            acc -= layer.inputZeroPoint * layer.weightSums[o];
+            y[o] = static_cast<float>(layer.inputScale * layer.weightScales[o] * acc + layer.biases[o]);
+        }
+        activate(step.activation, y, step.outputs);
+    }
+}
+
+// Batch normalization that was not folded: y = x * scale + shift
+static void affineRows(const Step &step, const float* in, int inStride, float* out, int outStride,
+                       int batch, CompiledModel::Scratch &) {
+    for (int r = 0; r < batch; r++) {
+        const float* x = in + static_cast<size_t>(r) * inStride;
+        float* y = out + static_cast<size_t>(r) * outStride;
+        for (int j = 0; j < step.outputs; j++) y[j] = x[j] * step.scales[j] + step.biases[j];
+        activate(step.activation, y, step.outputs);
+    }
+}
+
+static CompiledModel::StepFunction denseFunction(SimdKernel simd, int stride, bool &fixed) {
+    fixed = true;
+    switch (simd) {
+#ifdef NN_X86_KERNELS
+        case SimdKernel::Avx512:
+            switch (stride) {
+                case 16: return denseFixedAvx512<1>;
+                case 32: return denseFixedAvx512<2>;
+                case 48: return denseFixedAvx512<3>;
+                case 64: return denseFixedAvx512<4>;
+            }
+            fixed = false;
+            return denseTiledAvx512;
+        case SimdKernel::Avx2:
+            switch (stride) {
+                case 16: return denseFixedAvx2<2>;
+                case 32: return denseFixedAvx2<4>;
+            }
+            fixed = false;
+            return denseTiledAvx2;
+#endif
+        default:
+            switch (stride) {
+                case 16: return denseFixedScalar<16>;
+                case 32: return denseFixedScalar<32>;
+                case 48: return denseFixedScalar<48>;
+                case 64: return denseFixedScalar<64>;
+            }
+            fixed = false;
+            return denseTiledScalar;
+    }
+}
+
+static Activation activationOf(const Layer &layer) {
+    const ActivationFunction &activation = *layer.activation;
+    if (typeid(activation) == typeid(LinearFunction)) return Activation::Linear;
+    if (typeid(activation) == typeid(ReLUFunction)) return Activation::ReLU;
+    if (typeid(activation) == typeid(SigmoidFunction)) return Activation::Sigmoid;
+    if (typeid(activation) == typeid(SoftmaxFunction)) {
+        if (!layer.isOutputLayer) {
+            throw std::logic_error("SoftmaxFunction can only be used in the output layer");
+        }
+        return Activation::Softmax;
+    }
+    throw std::invalid_argument("Activation function of " + layer.describe() + " cannot be compiled");
+}
+
+bool CompiledModel::supported(SimdKernel simd) {
+    switch (simd) {
+        case SimdKernel::Auto:
+        case SimdKernel::Scalar: return true;
+#ifdef NN_X86_KERNELS
+        case SimdKernel::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case SimdKernel::Avx512: return __builtin_cpu_supports("avx512f");
+#else
+        default: return false;
+#endif
+    }
+    return false;
+}
+
+const char* CompiledModel::simdName(SimdKernel simd) {
+    switch (simd) {
+        case SimdKernel::Auto: return "auto";
+        case SimdKernel::Scalar: return "scalar";
+        case SimdKernel::Avx2: return "avx2";
+        case SimdKernel::Avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+const char* CompiledModel::kernelName(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::DenseFixed: return "dense_fixed";
+        case Kernel::DenseTiled: return "dense_tiled";
+        case Kernel::Sparse: return "sparse";
+        case Kernel::Int8: return "int8";
+        case Kernel::Affine: return "affine";
+    }
+    return "unknown";
+}
+
+CompiledModel CompiledModel::compile(const NeuralNetwork &nn, const CompileOptions &options) {
+    TraceScope trace("compile", "inference");
+    if (nn.layers.empty()) {
+        throw std::invalid_argument("Cannot compile a network without layers");
+    }
+    if (options.maxBatch <= 0) {
+        throw std::invalid_argument("maxBatch must be positive");
+    }
+    auto plan = std::make_shared<Plan>();
+    plan->simd = options.simd;
+    if (plan->simd == SimdKernel::Auto) {
+        plan->simd = supported(SimdKernel::Avx512) ? SimdKernel::Avx512
+                   : supported(SimdKernel::Avx2) ? SimdKernel::Avx2 : SimdKernel::Scalar;
+    }
+    if (!supported(plan->simd)) {
+        throw std::invalid_argument(std::string("SIMD kernel not supported on this CPU: ") + simdName(plan->simd));
+    }
+
+    // The inference view of the network: dropout dropped, batch normalization folded
+    std::vector<std::unique_ptr<Layer>> copies;
+    for (const auto &layer : nn.layers) {
+        if (layer->identityInEval()) continue;  // e.g. dropout, lower() would drop the copy anyway
+        copies.push_back(layer->clone());
+    }
+    std::vector<std::string> sources;
+    std::vector<std::unique_ptr<Layer>> lowered = Weights::lower(std::move(copies), &sources);
+
+    QuantizedModel quantized;
+    const bool int8 = options.calibration.rows > 0;
+    if (int8) {
+        quantized = QuantizedModel::quantize(nn, options.calibration);
+    }
+
+    for (size_t l = 0; l < lowered.size(); l++) {
+        const Layer &layer = *lowered[l];
+        Step step;
+        step.source = sources[l];
+        step.activation = activationOf(layer);
+        if (auto* dense = dynamic_cast<const DenseLayer*>(&layer)) {
+            const Matrix &w = dense->weights;
+            step.inputs = w.rows;
+            step.outputs = w.cols;
+            step.stride = roundUp(w.cols, ROW_ALIGN);
+            step.biases.assign(step.stride, 0.0f);
+            for (int o = 0; o < w.cols; o++) step.biases[o] = static_cast<float>(dense->biases.data[0][o]);
+
+            if (int8) {
+                step.kernel = Kernel::Int8;
+                step.int8 = quantized.getLayers()[l];
+                step.dot = QuantizedModel::dotKernel(quantized.getKernel());
+                step.function = int8Rows;
+                plan->widestInt8 = std::max(plan->widestInt8, step.int8.stride);
+            } else if (dense->sparseWeights && dense->sparseWeights->density() <= options.sparseDensity) {
+                step.kernel = Kernel::Sparse;
+                step.rowStart.push_back(0);
+                for (int i = 0; i < w.rows; i++) {
+                    for (int o = 0; o < w.cols; o++) {
+                        if (w.data[i][o] == 0.0) continue;
+                        step.columns.push_back(o);
+                        step.values.push_back(static_cast<float>(w.data[i][o]));
+                    }
+                    step.rowStart.push_back(static_cast<int>(step.values.size()));
+                }
+                step.function = sparseRows;
+            } else {
+                step.weights.assign(static_cast<size_t>(w.rows) * step.stride, 0.0f);
+                for (int i = 0; i < w.rows; i++) {
+                    for (int o = 0; o < w.cols; o++) {
+                        step.weights[static_cast<size_t>(i) * step.stride + o] = static_cast<float>(w.data[i][o]);
+                    }
+                }
+                bool fixed;
+                step.function = denseFunction(plan->simd, step.stride, fixed);
+                step.kernel = fixed ? Kernel::DenseFixed : Kernel::DenseTiled;
+            }
+        } else if (auto* norm = dynamic_cast<const BatchNormLayer*>(&layer)) {
+            std::vector<double> scale, shift;
+            norm->affine(scale, shift);
+            step.kernel = Kernel::Affine;
+            step.inputs = step.outputs = norm->features();
+            step.stride = roundUp(step.outputs, ROW_ALIGN);
+            step.scales.assign(scale.begin(), scale.end());
+            step.biases.assign(shift.begin(), shift.end());
+            step.function = affineRows;
+        } else {
+            throw std::invalid_argument("CompiledModel supports dense and batch normalization layers, layer " +
+                                        std::to_string(l) + " is " + layer.describe());
+        }
+        if (!plan->steps.empty() && step.inputs != plan->steps.back().outputs) {
+            throw std::invalid_argument("Layer shapes do not chain at " + step.source);
+        }
+        plan->widest = std::max(plan->widest, step.stride);
+        plan->widestInput = std::max(plan->widestInput, step.inputs);
+        plan->steps.push_back(std::move(step));
+    }
+    plan->inputs = plan->steps.front().inputs;
+    plan->outputs = plan->steps.back().outputs;
+    return CompiledModel(std::move(plan), options.maxBatch);
+}
+
+CompiledModel::CompiledModel(std::shared_ptr<const Plan> plan, int maxBatch)
+    : plan(std::move(plan)), batchCapacity(maxBatch) {
+    allocate();
+}
+
+CompiledModel::CompiledModel(const CompiledModel &other) : plan(other.plan), batchCapacity(other.batchCapacity) {
+    allocate();
+}
+
+CompiledModel& CompiledModel::operator=(CompiledModel other) {
+    std::swap(plan, other.plan);
+    std::swap(batchCapacity, other.batchCapacity);
+    std::swap(buffers, other.buffers);
+    std::swap(nonZero, other.nonZero);
+    std::swap(quantized, other.quantized);
+    return *this;
+}
+
+void CompiledModel::allocate() {
+    buffers.assign(2 * static_cast<size_t>(batchCapacity) * plan->widest, 0.0f);
+    nonZero.assign(plan->widestInput, 0);
+    quantized.assign(plan->widestInt8, 0);
+}
+
+void CompiledModel::run(const float* input, float* output, int batch) {
+    if (batch < 0) {
+        throw std::invalid_argument("Batch size cannot be negative");
+    }
+    for (int first = 0; first < batch; first += batchCapacity) {
+        const int rows = std::min(batchCapacity, batch - first);
+        runChunk(input + static_cast<size_t>(first) * plan->inputs, output + static_cast<size_t>(first) * plan->outputs, rows);
+    }
+}
+
+void CompiledModel::runChunk(const float* input, float* output, int batch) {
+    float* ping = buffers.data();
+    float* pong = ping + static_cast<size_t>(batchCapacity) * plan->widest;
+    const float* in = input;
+    int inStride = plan->inputs;
+    Scratch scratch = {nonZero.data(), quantized.data()};
+    for (const Step &step : plan->steps) {
+        step.function(step, in, inStride, ping, step.stride, batch, scratch);
+        in = ping;
+        inStride = step.stride;
+        std::swap(ping, pong);
+    }
+    for (int r = 0; r < batch; r++) {
+        std::copy(in + static_cast<size_t>(r) * inStride, in + static_cast<size_t>(r) * inStride + plan->outputs,
+                  output + static_cast<size_t>(r) * plan->outputs);
+    }
+}
+
+int CompiledModel::inputSize() const {
+    return plan->inputs;
+}
+
+int CompiledModel::outputSize() const {
+    return plan->outputs;
+}
+
+size_t CompiledModel::size() const {
+    return plan->steps.size();
+}
+
+const CompiledModel::Step& CompiledModel::step(size_t i) const {
+    return plan->steps.at(i);
+}
+
+SimdKernel CompiledModel::simd() const {
+    return plan->simd;
+}
+
+size_t CompiledModel::bufferBytes() const {
+    return buffers.size() * sizeof(float) + nonZero.size() * sizeof(int) + quantized.size();
+}
+
+void CompiledModel::print(std::ostream &out) const {
+    out << "CompiledModel " << plan->inputs << " -> " << plan->outputs << ", " << simdName(plan->simd)
+        << ", buffers " << bufferBytes() << " bytes for batches of " << batchCapacity << "\n";
+    for (size_t i = 0; i < plan->steps.size(); i++) {
+        const Step &step = plan->steps[i];
+        out << "  " << i << ": " << step.source << " -> " << kernelName(step.kernel) << " " << step.inputs << "x"
+            << step.outputs << "\n";
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef COMPILED_MODEL_HPP
+#define COMPILED_MODEL_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "quantization.hpp"
+#include "../math/matrix.hpp"
+
+class NeuralNetwork;
+
+// Instruction set of the fp32 kernels, Auto picks the widest the CPU supports
+enum class SimdKernel { Auto, Scalar, Avx2, Avx512 };
+
+struct CompileOptions {
+    int maxBatch = 256;           // samples per pass through the preallocated buffers, run() splits larger batches
+    double sparseDensity = 0.3;   // pruned dense layers at or below this weight density use the CSR kernel
+    Matrix calibration;           // when set, dense layers run in int8, quantized on these samples (QuantizedModel)
+    SimdKernel simd = SimdKernel::Auto;
+};
+
+// A trained network lowered to a static fp32 execution plan for serving.
+//
+//   nn.setTraining(false);
+//   CompiledModel model = nn.compile();
+//   model.run(images, scores, batch);     // float rows in, float rows out
+//
+// Compilation works on the inference view of the network (Weights::lower: dropout dropped, batch
+// normalization folded into the dense layer in front of it) and turns every layer into one step:
+// a dense layer with its bias and activation fused into a single pass per row, a leftover batch
+// normalization into a per-feature scale and shift. Each step gets its kernel from the shapes, once:
+//
+//   dense_fixed   outputs fit in registers (<= 64 floats with AVX-512, 32 with AVX2): the whole
+//                 output row is accumulated in registers over the non-zero inputs of the row
+//   dense_tiled   wider layers, the same loop over 64/32 float column tiles
+//   sparse        pruned layers at or below CompileOptions::sparseDensity, CSR weights
+//   int8          CompileOptions::calibration set, the QuantizedModel layers and dot kernels
+//   affine        batch normalization that could not be folded
+//
+// Weights are converted to float and padded to whole vectors, activations are resolved to an enum,
+// and both ping-pong activation buffers are allocated here, so run() makes no allocation and no
+// virtual call. The plan is immutable and shared by copies; the buffers are not, use one copy per
+// thread.
+class CompiledModel {
+public:
+    enum class Kernel { DenseFixed, DenseTiled, Sparse, Int8, Affine };
+    enum class Activation { Linear, ReLU, Sigmoid, Softmax };
+
+    struct Step;
+    // Per-row work space of a step, preallocated with the activation buffers
+    struct Scratch {
+        int* nonZero;        // indices of the non-zero inputs of the current row
+        uint8_t* quantized;  // the current row quantized for an int8 step
+    };
+    // in: batch rows of inStride floats, out: batch rows of outStride floats
+    typedef void (*StepFunction)(const Step &step, const float* in, int inStride, float* out, int outStride,
+                                 int batch, Scratch &scratch);
+
+    struct Step {
+        Kernel kernel = Kernel::DenseFixed;
+        Activation activation = Activation::Linear;
+        int inputs = 0, outputs = 0;
+        int stride = 0;                  // floats per output row, outputs rounded up to 16
+        std::string source;              // the layers it was compiled from, e.g. "Dense 784x16 + BatchNorm 16"
+        StepFunction function = nullptr;
+
+        std::vector<float> weights;      // dense: inputs x stride, padding columns are 0
+        std::vector<float> biases;       // dense, sparse, int8: stride; affine: the shift
+        std::vector<float> scales;       // affine: per feature
+        std::vector<int> rowStart;       // sparse: CSR over the inputs (inputs + 1 entries)
+        std::vector<int> columns;
+        std::vector<float> values;
+        QuantizedModel::DenseInt8 int8;  // int8: the quantized layer
+        QuantizedModel::DotKernel dot = nullptr;
+    };
+
+    static CompiledModel compile(const NeuralNetwork &nn, const CompileOptions &options = CompileOptions());
+
+    // Copies share the plan and get their own buffers
+    CompiledModel(const CompiledModel &other);
+    CompiledModel(CompiledModel &&other) noexcept = default;
+    CompiledModel& operator=(CompiledModel other);
+
+    // batch rows of inputSize() floats to batch rows of outputSize() floats
+    void run(const float* input, float* output, int batch);
+
+    int inputSize() const;
+    int outputSize() const;
+    int maxBatch() const { return batchCapacity; }
+    size_t size() const;
+    const Step& step(size_t i) const;
+    SimdKernel simd() const;
+    size_t bufferBytes() const;  // preallocated activation buffers and scratch
+
+    void print(std::ostream &out) const;  // one line per step: source, kernel, shape
+    static const char* kernelName(Kernel kernel);
+    static const char* simdName(SimdKernel simd);
+    static bool supported(SimdKernel simd);
+
+private:
+    struct Plan {
+        std::vector<Step> steps;
+        SimdKernel simd = SimdKernel::Scalar;
+        int inputs = 0, outputs = 0;
+        int widest = 0;        // largest step stride
+        int widestInput = 0;   // most inputs of a step
+        int widestInt8 = 0;    // largest int8 input stride
+    };
+
+    std::shared_ptr<const Plan> plan;
+    int batchCapacity = 0;
+    std::vector<float> buffers;     // two maxBatch x widest activation buffers
+    std::vector<int> nonZero;       // Scratch::nonZero, widestInput entries
+    std::vector<uint8_t> quantized; // Scratch::quantized, widestInt8 bytes
+
+    CompiledModel(std::shared_ptr<const Plan> plan, int maxBatch);
+    void allocate();
+    void runChunk(const float* input, float* output, int batch);
+};
+
+#endif  // COMPILED_MODEL_HPP
@@ -0,0 +1,324 @@
+#include "evaluator.hpp"
+#include "inference_context.hpp"
+#include "../utils/trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NN_X86_KERNELS 1
+#endif
+
+double Evaluation::accuracy() const {
+    return samples ? static_cast<double>(correct) / samples : 0.0;
+}
+
+double Evaluation::topKAccuracy() const {
+    return samples ? static_cast<double>(topKCorrect) / samples : 0.0;
+}
+
+double Evaluation::loss() const {
+    return samples ? lossSum / samples : 0.0;
+}
+
+long long Evaluation::support(int label) const {
+    long long total = 0;
+    for (int p = 0; p < classes; p++) total += count(label, p);
+    return total;
+}
+
+long long Evaluation::predicted(int label) const {
+    long long total = 0;
+    for (int a = 0; a < classes; a++) total += count(a, label);
+    return total;
+}
+
+double Evaluation::precision(int label) const {
+    long long total = predicted(label);
+    return total ? static_cast<double>(count(label, label)) / total : 0.0;
+}
+
+double Evaluation::recall(int label) const {
+    long long total = support(label);
+    return total ? static_cast<double>(count(label, label)) / total : 0.0;
+}
+
+double Evaluation::f1(int label) const {
+    double p = precision(label), r = recall(label);
+    return p + r > 0.0 ? 2.0 * p * r / (p + r) : 0.0;
+}
+
+double Evaluation::macroF1() const {
+    if (classes == 0) return 0.0;
+    double total = 0.0;
+    for (int c = 0; c < classes; c++) total += f1(c);
+    return total / classes;
+}
+
+void Evaluation::report(std::ostream &out) const {
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    out << std::fixed << std::setprecision(4)
+        << "Samples: " << samples << " in " << std::setprecision(1) << seconds * 1000.0 << " ms\n" << std::setprecision(4)
+        << "Accuracy: " << accuracy() * 100.0 << "%, top-" << k << ": " << topKAccuracy() * 100.0 << "%\n"
+        << "Loss: " << loss() << ", macro F1: " << macroF1() << "\n\n";
+
+    out << std::setw(6) << "class" << std::setw(10) << "support" << std::setw(11) << "precision"
+        << std::setw(9) << "recall" << std::setw(9) << "f1" << "\n";
+    for (int c = 0; c < classes; c++) {
+        out << std::setw(6) << c << std::setw(10) << support(c) << std::setw(11) << precision(c)
+            << std::setw(9) << recall(c) << std::setw(9) << f1(c) << "\n";
+    }
+
+    // Rows are the actual class, columns the prediction
+    int width = 4;
+    for (long long n : confusion) width = std::max(width, static_cast<int>(std::to_string(n).size()) + 1);
+    out << "\nConfusion (row: actual, column: predicted)\n" << std::setw(6) << "";
+    for (int p = 0; p < classes; p++) out << std::setw(width) << p;
+    out << "\n";
+    for (int a = 0; a < classes; a++) {
+        out << std::setw(6) << a;
+        for (int p = 0; p < classes; p++) out << std::setw(width) << count(a, p);
+        out << "\n";
+    }
+    out.copyfmt(state);
+}
+
+#ifdef NN_X86_KERNELS
+// Vector max over the row, then the first lane equal to it; -1 if none is (NaN scores)
+__attribute__((target("avx2")))
+static int argmaxAvx2(const double* row, int n) {
+    __m256d best = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+    int j = 0;
+    for (; j + 4 <= n; j += 4) best = _mm256_max_pd(best, _mm256_loadu_pd(row + j));
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, best);
+    double top = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    for (int t = j; t < n; t++) top = std::max(top, row[t]);
+
+    const __m256d target = _mm256_set1_pd(top);
+    for (j = 0; j + 4 <= n; j += 4) {
+        int hit = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(row + j), target, _CMP_EQ_OQ));
+        if (hit) return j + __builtin_ctz(hit);
+    }
+    for (; j < n; j++) {
+        if (row[j] == top) return j;
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static int rankAvx2(const double* row, int n, int label) {
+    const double score = row[label];
+    const __m256d target = _mm256_set1_pd(score);
+    int above = 0, j = 0;
+    for (; j + 4 <= n; j += 4) {
+        above += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(row + j), target, _CMP_GT_OQ)));
+    }
+    for (; j < n; j++) above += row[j] > score;
+    for (j = 0; j + 4 <= label; j += 4) {  // ties before the label rank above it
+        above += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(row + j), target, _CMP_EQ_OQ)));
+    }
+    for (; j < label; j++) above += row[j] == score;
+    return above;
+}
+
+// The same with 8 lanes, the tail through a masked load
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+__attribute__((target("avx512f")))
+static int argmaxAvx512(const double* row, int n) {
+    const __m512d lowest = _mm512_set1_pd(-std::numeric_limits<double>::infinity());
+    __m512d best = lowest;
+    int j = 0;
+    for (; j + 8 <= n; j += 8) best = _mm512_max_pd(best, _mm512_loadu_pd(row + j));
+    const __mmask8 tail = static_cast<__mmask8>((1u << (n - j)) - 1);
+    if (j < n) best = _mm512_max_pd(best, _mm512_mask_loadu_pd(lowest, tail, row + j));
+    const __m512d target = _mm512_set1_pd(_mm512_reduce_max_pd(best));
+
+    for (j = 0; j + 8 <= n; j += 8) {
+        __mmask8 hit = _mm512_cmp_pd_mask(_mm512_loadu_pd(row + j), target, _CMP_EQ_OQ);
+        if (hit) return j + __builtin_ctz(hit);
+    }
+    if (j < n) {
+        __mmask8 hit = _mm512_mask_cmp_pd_mask(tail, _mm512_maskz_loadu_pd(tail, row + j), target, _CMP_EQ_OQ);
+        if (hit) return j + __builtin_ctz(hit);
+    }
+    return -1;
+}
+
+__attribute__((target("avx512f")))
+static int rankAvx512(const double* row, int n, int label) {
+    const __m512d target = _mm512_set1_pd(row[label]);
+    int above = 0, j = 0;
+    for (; j + 8 <= n; j += 8) {
+        above += __builtin_popcount(_mm512_cmp_pd_mask(_mm512_loadu_pd(row + j), target, _CMP_GT_OQ));
+    }
+    if (j < n) {
+        const __mmask8 tail = static_cast<__mmask8>((1u << (n - j)) - 1);
+        above += __builtin_popcount(_mm512_mask_cmp_pd_mask(tail, _mm512_maskz_loadu_pd(tail, row + j), target, _CMP_GT_OQ));
+    }
+    for (j = 0; j + 8 <= label; j += 8) {
+        above += __builtin_popcount(_mm512_cmp_pd_mask(_mm512_loadu_pd(row + j), target, _CMP_EQ_OQ));
+    }
+    if (j < label) {
+        const __mmask8 tail = static_cast<__mmask8>((1u << (label - j)) - 1);
+        above += __builtin_popcount(_mm512_mask_cmp_pd_mask(tail, _mm512_maskz_loadu_pd(tail, row + j), target, _CMP_EQ_OQ));
+    }
+    return above;
+}
+#pragma GCC diagnostic pop
+#endif
+
+// Auto to the widest kernel the CPU has
+static SimdKernel resolve(SimdKernel simd) {
+    if (simd != SimdKernel::Auto) {
+        if (!CompiledModel::supported(simd)) throw std::invalid_argument("SIMD kernel not supported on this CPU");
+        return simd;
+    }
+    if (CompiledModel::supported(SimdKernel::Avx512)) return SimdKernel::Avx512;
+    if (CompiledModel::supported(SimdKernel::Avx2)) return SimdKernel::Avx2;
+    return SimdKernel::Scalar;
+}
+
+int Evaluator::argmax(const double* row, int n, SimdKernel simd) {
+    static const SimdKernel widest = resolve(SimdKernel::Auto);
+    int best = -1;
+#ifdef NN_X86_KERNELS
+    switch (simd == SimdKernel::Auto ? widest : simd) {
+        case SimdKernel::Avx512: best = argmaxAvx512(row, n); break;
+        case SimdKernel::Avx2: best = argmaxAvx2(row, n); break;
+        default: break;
+    }
+#endif
+    if (best < 0) best = static_cast<int>(std::max_element(row, row + n) - row);
+    return best;
+}
+
+int Evaluator::rank(const double* row, int n, int label, SimdKernel simd) {
+    static const SimdKernel widest = resolve(SimdKernel::Auto);
+#ifdef NN_X86_KERNELS
+    switch (simd == SimdKernel::Auto ? widest : simd) {
+        case SimdKernel::Avx512: return rankAvx512(row, n, label);
+        case SimdKernel::Avx2: return rankAvx2(row, n, label);
+        default: break;
+    }
+#endif
+    const double score = row[label];
+    int above = 0;
+    for (int j = 0; j < n; j++) above += row[j] > score || (row[j] == score && j < label);
+    return above;
+}
+
+std::vector<int> Evaluator::topK(const double* row, int n, int k) {
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    k = std::max(0, std::min(k, n));
+    std::partial_sort(order.begin(), order.begin() + k, order.end(), [row](int a, int b) {
+        return row[a] > row[b] || (row[a] == row[b] && a < b);
+    });
+    order.resize(k);
+    return order;
+}
+
+Evaluator::Evaluator(const EvaluatorOptions &options) : options(options) {
+    if (options.batchSize <= 0 || options.topK <= 0) {
+        throw std::invalid_argument("Evaluator needs a positive batch size and top-k");
+    }
+    resolve(options.simd);  // fails early on a CPU without the requested kernel
+    pool = std::make_unique<ThreadPool>(options.threads);
+}
+
+Evaluation Evaluator::evaluate(const NeuralNetwork &nn, const Matrix &inputs, const std::vector<int> &labels) {
+    return evaluate(nn.shareWeights(), inputs, labels);
+}
+
+Evaluation Evaluator::evaluate(std::shared_ptr<const Weights> weights, const Matrix &inputs, const std::vector<int> &labels) {
+    if (inputs.rows != static_cast<int>(labels.size())) {
+        throw std::invalid_argument("Number of inputs must match number of labels");
+    }
+    return run(std::move(weights), labels.size(), [&inputs](size_t first, size_t n, Matrix &batch) {
+        batch = Matrix::view(inputs.data[first], static_cast<int>(n), inputs.cols);  // no copy
+    }, labels);
+}
+
+Evaluation Evaluator::evaluate(const NeuralNetwork &nn, const DatasetCache &data) {
+    std::vector<int> labels(data.labels(), data.labels() + data.count());
+    return run(nn.shareWeights(), data.count(), [&data](size_t first, size_t n, Matrix &batch) {
+        data.toMatrix(first, n, batch);
+    }, labels);
+}
+
+Evaluation Evaluator::evaluate(const NeuralNetwork &nn, const IdxFile &images, const IdxFile &labelFile) {
+    if (images.count() != labelFile.count() || labelFile.dtype() != IdxFile::DataType::UByte) {
+        throw std::invalid_argument("Evaluator needs one ubyte label per image");
+    }
+    std::vector<int> labels(labelFile.ubyteData(), labelFile.ubyteData() + labelFile.count());
+    return run(nn.shareWeights(), images.count(), [&images](size_t first, size_t n, Matrix &batch) {
+        images.toMatrix(first, n, batch, 1.0 / 255.0);
+    }, labels);
+}
+
+Evaluation Evaluator::run(std::shared_ptr<const Weights> weights, size_t count, const BatchSource &source,
+                          const std::vector<int> &labels) {
+    TraceScope trace("evaluate", "eval", "samples", count);
+    const auto start = std::chrono::steady_clock::now();
+    const SimdKernel simd = resolve(options.simd);
+    const size_t batchSize = static_cast<size_t>(options.batchSize);
+    const int batches = static_cast<int>((count + batchSize - 1) / batchSize);
+
+    // One partial result per batch, merged in order below; workers claim batches from a counter
+    std::vector<Evaluation> partials(batches);
+    std::atomic<int> nextBatch{0};
+    const int tasks = std::min(pool->size(), batches);
+    pool->parallelFor(tasks, [&](int) {
+        InferenceContext context(weights);
+        Matrix batch;
+        for (int b = nextBatch++; b < batches; b = nextBatch++) {
+            const size_t first = static_cast<size_t>(b) * batchSize;
+            const size_t n = std::min(batchSize, count - first);
+            source(first, n, batch);
+            const Matrix &scores = context.forward(batch);
+
+            Evaluation &part = partials[b];
+            part.classes = scores.cols;
+            part.confusion.assign(static_cast<size_t>(scores.cols) * scores.cols, 0);
+            for (int r = 0; r < scores.rows; r++) {
+                const double* row = scores.data[r];
+                const int label = labels[first + r];
+                if (label < 0 || label >= scores.cols) {
+                    throw std::out_of_range("Label out of range for the output layer");
+                }
+                const int guess = argmax(row, scores.cols, simd);
+                part.confusion[static_cast<size_t>(label) * scores.cols + guess]++;
+                part.correct += guess == label;
+                part.topKCorrect += rank(row, scores.cols, label, simd) < options.topK;
+                part.lossSum -= std::log(std::max(row[label], 1e-12));
+            }
+            part.samples = scores.rows;
+        }
+    });
+
+    Evaluation result;
+    result.k = options.topK;
+    for (const Evaluation &part : partials) {
+        if (result.confusion.empty()) {
+            result.classes = part.classes;
+            result.confusion.assign(part.confusion.size(), 0);
+        }
+        for (size_t i = 0; i < part.confusion.size(); i++) result.confusion[i] += part.confusion[i];
+        result.samples += part.samples;
+        result.correct += part.correct;
+        result.topKCorrect += part.topKCorrect;
+        result.lossSum += part.lossSum;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,92 @@
+#ifndef EVALUATOR_HPP
+#define EVALUATOR_HPP
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "neural_network.hpp"
+#include "weights.hpp"
+#include "compiled_model.hpp"
+#include "../utils/dataset_cache.hpp"
+#include "../utils/idx_file.hpp"
+#include "../utils/thread_pool.hpp"
+
+struct EvaluatorOptions {
+    int batchSize = 1024;  // samples per forward pass
+    int threads = 0;       // 0: the hardware threads
+    int topK = 5;          // for Evaluation::topKAccuracy
+    SimdKernel simd = SimdKernel::Auto;  // argmax / rank kernels
+};
+
+// Scores of a classifier on a labelled set
+struct Evaluation {
+    int classes = 0;
+    int k = 1;                         // top-k of topKCorrect
+    long long samples = 0;
+    long long correct = 0;             // argmax == label
+    long long topKCorrect = 0;         // label among the k highest scores
+    double lossSum = 0.0;              // cross-entropy, -log(max(p_label, 1e-12)) as in train_step
+    std::vector<long long> confusion;  // classes x classes, row = actual, column = predicted
+    double seconds = 0.0;
+
+    double accuracy() const;
+    double topKAccuracy() const;
+    double loss() const;  // mean cross-entropy
+    long long count(int actual, int predicted) const { return confusion[static_cast<size_t>(actual) * classes + predicted]; }
+    long long support(int label) const;     // samples of the class
+    long long predicted(int label) const;   // samples predicted as the class
+    double precision(int label) const;      // 0 when the class is never predicted
+    double recall(int label) const;         // 0 when the class never occurs
+    double f1(int label) const;
+    double macroF1() const;
+
+    // Summary, per-class precision / recall / F1 and the confusion matrix
+    void report(std::ostream &out) const;
+};
+
+// Full test set evaluation in large batches on a thread pool:
+//
+//   Evaluator evaluator;                                        // keep it, the pool is reused
+//   auto test = DatasetCache::open("./data/t10k-images-idx3-ubyte", "./data/t10k-labels-idx1-ubyte");
+//   Evaluation result = evaluator.evaluate(nn, *test);          // all 10000 samples
+//   result.report(std::cout);
+//
+// The network is snapshotted once (Weights) and every worker runs its own InferenceContext over
+// the batches it claims; batches are converted into a per-worker buffer (IdxFile, DatasetCache)
+// or viewed in place (Matrix). Each output row is scored with SIMD argmax and rank kernels and
+// counted into per-batch partial results that are merged in batch order, so the result does not
+// depend on the thread count. Nothing is printed while evaluating.
+class Evaluator {
+public:
+    explicit Evaluator(const EvaluatorOptions &options = EvaluatorOptions());
+
+    Evaluation evaluate(const NeuralNetwork &nn, const Matrix &inputs, const std::vector<int> &labels);
+    Evaluation evaluate(std::shared_ptr<const Weights> weights, const Matrix &inputs, const std::vector<int> &labels);
+    Evaluation evaluate(const NeuralNetwork &nn, const DatasetCache &data);
+    // ubyte images scaled to [0, 1] and ubyte labels, as DataLoader reads them
+    Evaluation evaluate(const NeuralNetwork &nn, const IdxFile &images, const IdxFile &labels);
+
+    const EvaluatorOptions& getOptions() const { return options; }
+
+    // Index of the largest of n scores, the first one on ties (as std::max_element). An explicit
+    // kernel must be supported by the CPU (see CompiledModel::supported).
+    static int argmax(const double* row, int n, SimdKernel simd = SimdKernel::Auto);
+    // Position of label when the scores are sorted in descending order, ties broken by index, so
+    // the label is in the top k exactly when rank < k (and rank == 0 when argmax == label)
+    static int rank(const double* row, int n, int label, SimdKernel simd = SimdKernel::Auto);
+    // The k highest scoring indices, best first
+    static std::vector<int> topK(const double* row, int n, int k);
+
+private:
+    // Writes samples [first, first + n) as rows of the buffer (or a view)
+    typedef std::function<void(size_t first, size_t n, Matrix &batch)> BatchSource;
+
+    EvaluatorOptions options;
+    std::unique_ptr<ThreadPool> pool;
+
+    Evaluation run(std::shared_ptr<const Weights> weights, size_t count, const BatchSource &source,
+                   const std::vector<int> &labels);
+};
+
+#endif  // EVALUATOR_HPP
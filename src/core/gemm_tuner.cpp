@@ -0,0 +1,157 @@
+#include "gemm_tuner.hpp"
+#include "../layers/dense_layer.hpp"
+#include "../utils/benchmark.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <set>
+#include <thread>
+
+std::vector<GemmShape> GemmTuner::shapes(const NeuralNetwork &nn, const std::vector<int> &batchSizes) {
+    std::vector<GemmShape> result;
+    std::set<GemmShape> seen;
+    auto add = [&](int m, int k, int n) {
+        GemmShape shape{m, k, n};
+        if (m > 0 && k > 0 && n > 0 && seen.insert(shape).second) result.push_back(shape);
+    };
+    for (const auto &layer : nn.layers) {
+        const DenseLayer* dense = dynamic_cast<const DenseLayer*>(layer.get());
+        if (!dense) continue;
+        const int in = dense->weights.rows, out = dense->weights.cols;
+        for (int batch : batchSizes) {
+            add(batch, in, out);  // input * weights
+            add(in, batch, out);  // input^T * delta
+            add(batch, out, in);  // delta * weights^T
+        }
+    }
+    return result;
+}
+
+// Configurations that run the same code on this shape, e.g. every kc >= k
+static std::vector<int> effectiveKey(const GemmConfig &config, const GemmShape &shape) {
+    const int split = config.threads > 1 ? static_cast<int>(config.split) : -1;
+    if (!Gemm::packed(config.kernel)) return {static_cast<int>(config.kernel), config.threads, split};
+    const int mr = Gemm::tileRows(config.kernel), nr = Gemm::tileColumns(config.kernel);
+    auto roundUp = [](int value, int multiple) { return (value + multiple - 1) / multiple * multiple; };
+    return {static_cast<int>(config.kernel), config.threads, split,
+            std::min(roundUp(config.mc, mr), roundUp(shape.m, mr)), std::min(config.kc, shape.k),
+            std::min(roundUp(config.nc, nr), roundUp(shape.n, nr))};
+}
+
+namespace {
+
+// Times candidates of one shape on the same operands and remembers the fastest. A candidate has to
+// beat the best so far by the margin, so timing noise does not replace the heuristic's choice.
+struct ShapeSearch {
+    static constexpr double margin = 0.03;
+
+    GemmShape shape;
+    Matrix a, b, c;
+    Benchmark bench;
+    BenchmarkOptions timing;
+    std::set<std::vector<int>> timed;
+    GemmConfig best;
+    double bestNs = -1.0;
+
+    ShapeSearch(const GemmShape &shape, const GemmTunerOptions &options)
+        : shape(shape), a(shape.m, shape.k), b(shape.k, shape.n), c(shape.m, shape.n) {
+        a.randomize(-1.0, 1.0);
+        b.randomize(-1.0, 1.0);
+        timing.warmup = 1;
+        timing.repetitions = std::max(1, options.repetitions);
+        timing.minSeconds = options.secondsPerCandidate;
+    }
+
+    double time(const GemmConfig &config) {
+        if (!timed.insert(effectiveKey(config, shape)).second) return -1.0;
+        const BenchmarkResult &result = bench.run(Gemm::kernelName(config.kernel), [&] {
+            Gemm::multiply(config, a.data[0], b.data[0], c.data[0], shape.m, shape.k, shape.n);
+            doNotOptimize(c.data[0][0]);
+        }, 2.0 * shape.m * shape.k * shape.n, 0.0, timing);
+        if (bestNs < 0.0 || result.median_ns < bestNs * (1.0 - margin)) {
+            best = config;
+            bestNs = result.median_ns;
+        }
+        return result.median_ns;
+    }
+};
+
+}  // namespace
+
+void GemmTuner::tune(const std::vector<GemmShape> &shapes, GemmTuning &tuning, const GemmTunerOptions &options,
+                     std::ostream* log) {
+    const int hardware = std::max(1u, std::thread::hardware_concurrency());
+    const int maxThreads = options.maxThreads > 0 ? options.maxThreads : hardware;
+    const std::vector<int> mcs = {48, 96, 192}, kcs = {128, 256, 512}, ncs = {128, 512, 2048};
+
+    for (const GemmShape &shape : shapes) {
+        ShapeSearch search(shape, options);
+        const GemmConfig heuristic = Gemm::heuristic(shape.m, shape.k, shape.n);
+        GemmConfig single = heuristic;
+        single.threads = 1;
+        const double heuristicNs = search.time(single);
+
+        // 1. kernels
+        GemmConfig fastestPacked;
+        double fastestPackedNs = -1.0;
+        for (int i = 0; i <= static_cast<int>(GemmKernel::PackedAvx512_8x16); i++) {
+            GemmConfig config;
+            config.kernel = static_cast<GemmKernel>(i);
+            if (!Gemm::supported(config.kernel)) continue;
+            double ns = search.time(config);
+            if (ns < 0.0 && config.kernel == single.kernel) ns = heuristicNs;
+            if (Gemm::packed(config.kernel) && ns >= 0.0 && (fastestPackedNs < 0.0 || ns < fastestPackedNs)) {
+                fastestPacked = config;
+                fastestPackedNs = ns;
+            }
+        }
+        // 2. cache blocks of the best packed kernel
+        if (fastestPackedNs >= 0.0) {
+            for (int mc : mcs) {
+                for (int kc : kcs) {
+                    for (int nc : ncs) {
+                        GemmConfig config = fastestPacked;
+                        config.mc = mc;
+                        config.kc = kc;
+                        config.nc = nc;
+                        search.time(config);
+                    }
+                }
+            }
+        }
+        // 3. threads
+        const GemmConfig oneThread = search.best;
+        for (int threads = 2; threads <= maxThreads; threads *= 2) {
+            for (GemmSplit split : {GemmSplit::Rows, GemmSplit::Columns}) {
+                GemmConfig config = oneThread;
+                config.threads = threads;
+                config.split = split;
+                search.time(config);
+            }
+        }
+
+        tuning.set(shape, search.best, search.bestNs);
+        if (log) {
+            std::ios state(nullptr);
+            state.copyfmt(*log);
+            const GemmConfig &w = search.best;
+            *log << std::setw(4) << shape.m << " x " << std::setw(4) << shape.k << " x " << std::setw(4) << shape.n
+                 << "  " << std::left << std::setw(20) << Gemm::kernelName(w.kernel) << std::right;
+            if (Gemm::packed(w.kernel)) *log << " blocks " << w.mc << "/" << w.kc << "/" << w.nc;
+            *log << " threads " << w.threads;
+            if (w.threads > 1) *log << " (" << Gemm::splitName(w.split) << ")";
+            *log << std::fixed << std::setprecision(0) << "  " << search.bestNs << " ns, heuristic "
+                 << heuristicNs << " ns\n";
+            log->copyfmt(state);
+        }
+    }
+}
+
+GemmTuning GemmTuner::tune(const NeuralNetwork &nn, const std::string &path, const GemmTunerOptions &options,
+                           std::ostream* log) {
+    GemmTuning tuning = GemmTuning::load(path);
+    tune(shapes(nn, options.batchSizes), tuning, options, log);
+    tuning.save(path);
+    Gemm::setTuning(std::make_shared<const GemmTuning>(tuning));
+    return tuning;
+}
@@ -0,0 +1,44 @@
+#ifndef GEMM_TUNER_HPP
+#define GEMM_TUNER_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "neural_network.hpp"
+#include "../math/gemm.hpp"
+
+struct GemmTunerOptions {
+    std::vector<int> batchSizes = {1, 8, 32, 64, 128, 256, 512};
+    int maxThreads = 0;                 // largest thread count tried, 0: the hardware threads
+    double secondsPerCandidate = 0.002; // each timed repetition runs at least this long
+    int repetitions = 5;                // the median of these decides
+};
+
+// Finds the fastest GEMM configuration for the products a network runs and stores it in the tuning
+// cache Matrix::operator* consults (see Gemm):
+//
+//   GemmTuner::tune(nn, Gemm::defaultTuningPath(), GemmTunerOptions(), &std::cout);
+//
+// Every dense layer (in x out) at batch size b multiplies b x in by in x out going forward, and
+// in x b by b x out (weight gradient) and b x out by out x in (input gradient) going back. For
+// each shape the search runs in three rounds, each starting from the winner so far:
+//
+//   1. every kernel the CPU supports, one thread, default blocks
+//   2. the cache blocks (mc, kc, nc) of the fastest packed kernel; blocks that clamp to the same
+//      effective size for the shape are timed once
+//   3. 2, 4, ... maxThreads threads, splitting C by rows and by columns
+class GemmTuner {
+public:
+    static std::vector<GemmShape> shapes(const NeuralNetwork &nn, const std::vector<int> &batchSizes);
+
+    // Times the candidates of each shape and sets the winners in `tuning`; log gets one line per shape
+    static void tune(const std::vector<GemmShape> &shapes, GemmTuning &tuning,
+                     const GemmTunerOptions &options = GemmTunerOptions(), std::ostream* log = nullptr);
+
+    // Tunes nn's shapes on top of this CPU's section of the cache at `path`, saves it and installs
+    // it for the running process
+    static GemmTuning tune(const NeuralNetwork &nn, const std::string &path,
+                           const GemmTunerOptions &options = GemmTunerOptions(), std::ostream* log = nullptr);
+};
+
+#endif  // GEMM_TUNER_HPP
@@ -0,0 +1,30 @@
+#include "inference_context.hpp"
+#include "../utils/trace.hpp"
+#include <stdexcept>
+
+InferenceContext::InferenceContext(std::shared_ptr<const Weights> weights)
+    : weights(std::move(weights)) {
+    if (!this->weights) {
+        throw std::invalid_argument("InferenceContext needs weights");
+    }
+    activations.resize(this->weights->size());
+}
+
+const Matrix& InferenceContext::forward(const Matrix &input) {
+    if (activations.empty()) {
+        throw std::logic_error("Cannot run inference on a model without layers");
+    }
+
+    const Matrix* curr = &input;
+    for (size_t i = 0; i < activations.size(); i++) {
+        TraceScope trace("infer", "layer", "layer", i);
+        AllocationScope allocations(AllocCategory::Forward);
+        weights->layer(i).infer(*curr, activations[i]);
+        curr = &activations[i];
+    }
+    return *curr;
+}
+
+const Weights& InferenceContext::getWeights() const {
+    return *weights;
+}
@@ -0,0 +1,26 @@
+#ifndef INFERENCE_CONTEXT_HPP
+#define INFERENCE_CONTEXT_HPP
+
+#include <vector>
+#include <memory>
+#include "weights.hpp"
+#include "../math/matrix.hpp"
+
+// Per-thread state for running a shared model: one activation buffer per layer.
+// Contexts are cheap, create one per serving thread and reuse it across requests.
+// A context itself is not thread safe, the Weights it points to are.
+class InferenceContext {
+private:
+    std::shared_ptr<const Weights> weights;
+    std::vector<Matrix> activations; // activations[i] is the output of layer i, reused between calls
+public:
+    explicit InferenceContext(std::shared_ptr<const Weights> weights);
+
+    // Forward pass, each row of input is one sample.
+    // The returned reference stays valid until the next call on this context.
+    const Matrix& forward(const Matrix &input);
+
+    const Weights& getWeights() const;
+};
+
+#endif  // INFERENCE_CONTEXT_HPP
@@ -0,0 +1,148 @@
+#include "inference_server.hpp"
+#include "../layers/batch_norm_layer.hpp"
+#include "../layers/dense_layer.hpp"
+#include "../math/gemm.hpp"
+#include "../utils/trace.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// The width the first layer expects, 0 when it takes any width
+static int inputWidthOf(const Weights &weights) {
+    if (weights.size() == 0) return 0;
+    if (auto* dense = dynamic_cast<const DenseLayer*>(&weights.layer(0))) return dense->weights.rows;
+    if (auto* norm = dynamic_cast<const BatchNormLayer*>(&weights.layer(0))) return norm->features();
+    return 0;
+}
+
+InferenceServer::InferenceServer(std::shared_ptr<const Weights> weights, int max_batch_size, int max_wait_us, int num_workers)
+    : weights(std::move(weights)), max_batch_size(max_batch_size), max_wait(max_wait_us) {
+    if (!this->weights) {
+        throw std::invalid_argument("InferenceServer needs weights");
+    }
+    inputWidth = inputWidthOf(*this->weights);
+    if (max_batch_size <= 0 || max_wait_us < 0 || num_workers <= 0) {
+        throw std::invalid_argument("InferenceServer needs a positive batch size and worker count");
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        workers.emplace_back(&InferenceServer::workerLoop, this, num_workers);
+    }
+}
+
+InferenceServer::~InferenceServer() {
+    stop();
+}
+
+std::future<Matrix> InferenceServer::submit(const Matrix &sample) {
+    if (sample.rows != 1) {
+        throw std::invalid_argument("InferenceServer::submit expects a single sample (1 row)");
+    }
+    if (inputWidth > 0 && sample.cols != inputWidth) {
+        throw std::invalid_argument("InferenceServer::submit expects " + std::to_string(inputWidth) +
+                                    " columns, got " + std::to_string(sample.cols));
+    }
+
+    Request request;
+    request.sample = sample;
+    request.arrival = std::chrono::steady_clock::now();
+    std::future<Matrix> future = request.result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            throw std::logic_error("InferenceServer is stopped");
+        }
+        queue.push_back(std::move(request));
+    }
+    cv.notify_one();
+    return future;
+}
+
+void InferenceServer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+InferenceServer::Stats InferenceServer::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void InferenceServer::workerLoop(int numWorkers) {
+    Tracer::setThreadName("InferenceServer worker");
+    GemmThreadLimit limit(GemmThreadLimit::shareOf(numWorkers));  // the workers batch side by side
+    InferenceContext ctx(weights);  // activation buffers stay with this worker
+    std::vector<Request> batch;
+    batch.reserve(max_batch_size);
+
+    while (true) {
+        bool leftovers;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;  // stopping and fully drained
+
+            // Wait for a full batch, but never past the oldest request's deadline
+            auto deadline = queue.front().arrival + max_wait;
+            cv.wait_until(lock, deadline, [this] {
+                return stopping || queue.empty() || static_cast<int>(queue.size()) >= max_batch_size;
+            });
+            if (queue.empty()) continue;  // another worker took them
+
+            int n = std::min(static_cast<int>(queue.size()), max_batch_size);
+            for (int i = 0; i < n; i++) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            stats.requests += n;
+            stats.batches++;
+            leftovers = !queue.empty();
+        }
+        if (leftovers) cv.notify_one();  // let another worker start on the rest
+
+        runBatch(ctx, batch);
+        batch.clear();
+    }
+}
+
+void InferenceServer::runBatch(InferenceContext &ctx, std::vector<Request> &batch) {
+    TraceScope trace("run_batch", "inference", "size", batch.size());
+    // Only reachable when the first layer takes any width: a sample that does not match the first
+    // one fails on its own instead of taking the whole batch down with it
+    int cols = batch[0].sample.cols;
+    auto mismatched = std::stable_partition(batch.begin(), batch.end(),
+                                            [cols](const Request &request) { return request.sample.cols == cols; });
+    for (auto it = mismatched; it != batch.end(); ++it) {
+        it->result.set_exception(std::make_exception_ptr(
+            std::invalid_argument("All samples in a batch must have the same size")));
+    }
+    batch.erase(mismatched, batch.end());
+
+    size_t answered = 0;
+    try {
+        // Gather the samples into one (batch, input_size) matrix
+        Matrix inputs(static_cast<int>(batch.size()), cols);
+        for (size_t i = 0; i < batch.size(); i++) {
+            std::copy(batch[i].sample.data[0], batch[i].sample.data[0] + cols, inputs.data[i]);
+        }
+
+        const Matrix& outputs = ctx.forward(inputs);
+
+        // Scatter one output row back to each caller
+        for (size_t i = 0; i < batch.size(); i++) {
+            Matrix row(1, outputs.cols);
+            std::copy(outputs.data[i], outputs.data[i] + outputs.cols, row.data[0]);
+            batch[i].result.set_value(row);
+            answered++;
+        }
+    } catch (...) {
+        for (size_t i = answered; i < batch.size(); i++) {
+            batch[i].result.set_exception(std::current_exception());
+        }
+    }
+}
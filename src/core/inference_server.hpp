@@ -0,0 +1,67 @@
+#ifndef INFERENCE_SERVER_HPP
+#define INFERENCE_SERVER_HPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include "weights.hpp"
+#include "inference_context.hpp"
+#include "../math/matrix.hpp"
+
+// In-process inference server with dynamic batching.
+// Callers submit single samples and get a future, worker threads coalesce queued samples
+// into one batch (up to max_batch_size, or whatever arrived within max_wait_us of the oldest
+// request), run one batched forward pass and hand every caller its own output row.
+class InferenceServer {
+public:
+    struct Stats {
+        long long requests = 0;
+        long long batches = 0;
+        double averageBatchSize() const { return batches ? static_cast<double>(requests) / batches : 0.0; }
+    };
+
+    // max_wait_us bounds the extra queueing latency a request pays to get batched
+    InferenceServer(std::shared_ptr<const Weights> weights, int max_batch_size = 64, int max_wait_us = 200, int num_workers = 1);
+    ~InferenceServer();
+
+    InferenceServer(const InferenceServer&) = delete;
+    InferenceServer& operator=(const InferenceServer&) = delete;
+
+    // sample is a single row (1, input_size), the future holds the (1, output_size) output.
+    // Throws std::invalid_argument for a sample of the wrong width, before it can join a batch.
+    std::future<Matrix> submit(const Matrix &sample);
+
+    // Finishes the queued requests and joins the workers, later submits throw
+    void stop();
+
+    Stats getStats() const;
+
+private:
+    struct Request {
+        Matrix sample;
+        std::promise<Matrix> result;
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+    std::shared_ptr<const Weights> weights;
+    int max_batch_size;
+    std::chrono::microseconds max_wait;
+    int inputWidth;  // columns of a sample, 0 when the first layer takes any width (convolution)
+
+    std::deque<Request> queue;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    Stats stats;
+    std::vector<std::thread> workers;
+
+    void workerLoop(int numWorkers);
+    void runBatch(InferenceContext &ctx, std::vector<Request> &batch);
+};
+
+#endif  // INFERENCE_SERVER_HPP
@@ -0,0 +1,308 @@
+#include "mixed_precision.hpp"
+#include "neural_network.hpp"
+#include "../layers/dense_layer.hpp"
+#include "../utils/trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+MixedPrecision::MixedPrecision(const NeuralNetwork &nn, Precision precision, const LossScaleOptions &options)
+    : precision(precision), options(options),
+      scale(precision == Precision::Float16 ? options.initialScale : 1.0) {
+    if (precision == Precision::Double) {
+        throw std::invalid_argument("MixedPrecision needs a 16 bit precision");
+    }
+    reload(nn);
+}
+
+const DenseLayer& MixedPrecision::denseLayer(const NeuralNetwork &nn, size_t l) {
+    const DenseLayer* dense = dynamic_cast<const DenseLayer*>(nn.layers[l].get());
+    if (!dense) {
+        throw std::invalid_argument("Mixed precision supports dense layers only, layer " + std::to_string(l) +
+                                    " is " + nn.layers[l]->describe());
+    }
+    if (dense->sparseWeights) {
+        throw std::invalid_argument("Mixed precision does not support pruned layers (layer " + std::to_string(l) + ")");
+    }
+    return *dense;
+}
+
+void MixedPrecision::reload(const NeuralNetwork &nn) {
+    if (nn.layers.empty()) {
+        throw std::invalid_argument("Cannot train a network without layers");
+    }
+    std::vector<LayerState> loaded;
+    for (size_t l = 0; l < nn.layers.size(); l++) {
+        const DenseLayer &dense = denseLayer(nn, l);
+        LayerState state;
+        state.inputs = dense.weights.rows;
+        state.outputs = dense.weights.cols;
+        if (l > 0 && state.inputs != loaded.back().outputs) {
+            throw std::invalid_argument("Layer shapes do not chain at layer " + std::to_string(l));
+        }
+        loadLayer(dense, state);
+        state.weightGrad.resize(state.master.size());
+        state.biasGrad.resize(state.outputs);
+        loaded.push_back(std::move(state));
+    }
+    layers = std::move(loaded);
+}
+
+void MixedPrecision::loadLayer(const DenseLayer &dense, LayerState &state) const {
+    state.master.resize(static_cast<size_t>(state.inputs) * state.outputs);
+    for (int i = 0; i < state.inputs; i++) {
+        for (int o = 0; o < state.outputs; o++) {
+            state.master[static_cast<size_t>(i) * state.outputs + o] = static_cast<float>(dense.weights.data[i][o]);
+        }
+    }
+    state.bias.resize(state.outputs);
+    for (int o = 0; o < state.outputs; o++) {
+        state.bias[o] = static_cast<float>(dense.biases.data[0][o]);
+    }
+    state.weights.resize(state.master.size());
+    toHalf(state.master.data(), state.weights.data(), state.master.size());
+}
+
+// After syncTo() the double weights hold exactly the fp32 master values
+bool MixedPrecision::matches(const DenseLayer &dense, const LayerState &state) const {
+    if (dense.weights.rows != state.inputs || dense.weights.cols != state.outputs) return false;
+    for (int i = 0; i < state.inputs; i++) {
+        const float* master = &state.master[static_cast<size_t>(i) * state.outputs];
+        for (int o = 0; o < state.outputs; o++) {
+            if (dense.weights.data[i][o] != static_cast<double>(master[o])) return false;
+        }
+    }
+    for (int o = 0; o < state.outputs; o++) {
+        if (dense.biases.data[0][o] != static_cast<double>(state.bias[o])) return false;
+    }
+    return true;
+}
+
+void MixedPrecision::setLossScale(double lossScale, int cleanStepCount) {
+    if (!(lossScale > 0.0) || cleanStepCount < 0) {
+        throw std::invalid_argument("Loss scale must be positive and the clean step count not negative");
+    }
+    scale = lossScale;
+    cleanSteps = cleanStepCount;
+}
+
+double MixedPrecision::train_step(NeuralNetwork &nn, const Matrix &inputs, const std::vector<int> &labels,
+                                  double learning_rate) {
+    if (inputs.rows != static_cast<int>(labels.size())) {
+        throw std::invalid_argument("Number of inputs must match number of labels");
+    }
+    // Take over layers that were replaced or reloaded since the last step
+    bool changed = nn.layers.size() != layers.size();
+    for (size_t l = 0; l < layers.size() && !changed; l++) {
+        changed = !matches(denseLayer(nn, l), layers[l]);
+    }
+    if (changed) reload(nn);
+    if (inputs.cols != layers[0].inputs) {
+        throw std::invalid_argument("Input does not match the first layer");
+    }
+
+    TraceScope trace("train_step", "train", "batch", inputs.rows);
+    const int batch = inputs.rows;
+    lastBatch = batch;
+
+    // Inputs to 16 bit, like any other activation
+    const int firstInputs = layers[0].inputs;
+    input.resize(static_cast<size_t>(batch) * firstInputs);
+    rowScratch.resize(firstInputs);
+    for (int r = 0; r < batch; r++) {
+        std::copy(inputs.data[r], inputs.data[r] + firstInputs, rowScratch.begin());
+        toHalf(rowScratch.data(), &input[static_cast<size_t>(r) * firstInputs], firstInputs);
+    }
+
+    // Forward: 16 bit operands, fp32 accumulation, 16 bit outputs.
+    // The output layer's error (output - one_hot(labels)) / batch_size * scale goes to gradScratch.
+    double loss = 0.0;
+    const uint16_t* x = input.data();
+    for (size_t l = 0; l < layers.size(); l++) {
+        TraceScope layerTrace("forward", "layer", "layer", l);
+        LayerState &layer = layers[l];
+        const Layer &source = *nn.layers[l];
+        const int in = layer.inputs, out = layer.outputs;
+        const bool last = l + 1 == layers.size();
+        weightScratch.resize(static_cast<size_t>(in) * out);
+        fromHalf(layer.weights.data(), weightScratch.data(), weightScratch.size());
+        inputScratch.resize(static_cast<size_t>(batch) * in);
+        fromHalf(x, inputScratch.data(), inputScratch.size());
+
+        layer.output.resize(static_cast<size_t>(batch) * out);
+        rowScratch.resize(out);
+        activationRow.resize(out);
+        if (last) gradScratch.resize(static_cast<size_t>(batch) * out);
+        for (int r = 0; r < batch; r++) {
+            float* z = rowScratch.data();
+            std::copy(layer.bias.begin(), layer.bias.end(), z);
+            const float* xr = &inputScratch[static_cast<size_t>(r) * in];
+            for (int i = 0; i < in; i++) {
+                const float xv = xr[i];
+                if (xv == 0.0f) continue;
+                const float* w = &weightScratch[static_cast<size_t>(i) * out];
+                for (int o = 0; o < out; o++) z[o] += xv * w[o];
+            }
+            std::copy(z, z + out, activationRow.begin());
+            source.activation->activateInto(activationRow, activatedRow);
+            const std::vector<double> &a = activatedRow;
+            for (int o = 0; o < out; o++) z[o] = static_cast<float>(a[o]);
+            toHalf(z, &layer.output[static_cast<size_t>(r) * out], out);
+
+            if (last) {
+                int label = labels[r];
+                if (label < 0 || label >= out) {
+                    throw std::out_of_range("Label out of range for the output layer");
+                }
+                loss -= std::log(std::max(a[label], 1e-12));
+                float* error = &gradScratch[static_cast<size_t>(r) * out];
+                for (int o = 0; o < out; o++) {
+                    error[o] = static_cast<float>((a[o] - (o == label ? 1.0 : 0.0)) / batch * scale);
+                }
+            }
+        }
+        x = layer.output.data();
+    }
+
+    // Backward with the weights of this step, gradients of every layer before any update
+    bool overflow = false;
+    for (size_t l = layers.size(); l-- > 0;) {
+        TraceScope layerTrace("backward", "layer", "layer", l);
+        LayerState &layer = layers[l];
+        const Layer &source = *nn.layers[l];
+        const int in = layer.inputs, out = layer.outputs;
+        const size_t cells = static_cast<size_t>(batch) * out;
+
+        // gradScratch holds dLoss/dOutput (fp32), delta = that * activation'(output) as in DenseLayer::backward
+        if (l + 1 < layers.size()) {
+            gradScratch.resize(cells);
+            fromHalf(gradient.data(), gradScratch.data(), cells);
+        }
+        delta.assign(gradScratch.begin(), gradScratch.begin() + cells);
+        if (!source.isOutputLayer) {
+            rowScratch.resize(out);
+            activationRow.resize(out);
+            for (int r = 0; r < batch; r++) {
+                fromHalf(&layer.output[static_cast<size_t>(r) * out], rowScratch.data(), out);
+                std::copy(rowScratch.begin(), rowScratch.end(), activationRow.begin());
+                source.activation->derivativeInto(activationRow, activatedRow);
+                const std::vector<double> &d = activatedRow;
+                for (int o = 0; o < out; o++) delta[static_cast<size_t>(r) * out + o] *= static_cast<float>(d[o]);
+            }
+        }
+
+        // weightGrad = input^T * delta, biasGrad = column sums of delta
+        inputScratch.resize(static_cast<size_t>(batch) * in);
+        fromHalf(l == 0 ? input.data() : layers[l - 1].output.data(), inputScratch.data(), inputScratch.size());
+        std::fill(layer.weightGrad.begin(), layer.weightGrad.end(), 0.0f);
+        std::fill(layer.biasGrad.begin(), layer.biasGrad.end(), 0.0f);
+        for (int r = 0; r < batch; r++) {
+            const float* d = &delta[static_cast<size_t>(r) * out];
+            const float* xr = &inputScratch[static_cast<size_t>(r) * in];
+            for (int i = 0; i < in; i++) {
+                const float xv = xr[i];
+                if (xv == 0.0f) continue;
+                float* g = &layer.weightGrad[static_cast<size_t>(i) * out];
+                for (int o = 0; o < out; o++) g[o] += xv * d[o];
+            }
+            for (int o = 0; o < out; o++) layer.biasGrad[o] += d[o];
+        }
+        for (float g : layer.biasGrad) overflow = overflow || !std::isfinite(g);
+        for (float g : layer.weightGrad) overflow = overflow || !std::isfinite(g);
+
+        // Gradient for the previous layer, delta * weights^T, stored in 16 bit
+        if (l > 0) {
+            weightScratch.resize(static_cast<size_t>(in) * out);
+            fromHalf(layer.weights.data(), weightScratch.data(), weightScratch.size());
+            gradient.resize(static_cast<size_t>(batch) * in);
+            rowScratch.resize(in);
+            for (int r = 0; r < batch; r++) {
+                const float* d = &delta[static_cast<size_t>(r) * out];
+                for (int i = 0; i < in; i++) {
+                    const float* w = &weightScratch[static_cast<size_t>(i) * out];
+                    float sum = 0.0f;
+                    for (int o = 0; o < out; o++) sum += d[o] * w[o];
+                    rowScratch[i] = sum;
+                }
+                toHalf(rowScratch.data(), &gradient[static_cast<size_t>(r) * in], in);
+            }
+        }
+    }
+
+    steps++;
+    if (overflow) {
+        // Scaled gradients overflowed: drop the step and retry smaller
+        skippedSteps++;
+        cleanSteps = 0;
+        scale = std::max(options.minScale, scale * options.backoffFactor);
+        return loss / batch;
+    }
+
+    {
+        TraceScope updateTrace("update", "layer");
+        const float step = static_cast<float>(learning_rate / scale);
+        for (LayerState &layer : layers) {
+            for (size_t k = 0; k < layer.master.size(); k++) layer.master[k] -= step * layer.weightGrad[k];
+            for (size_t o = 0; o < layer.bias.size(); o++) layer.bias[o] -= step * layer.biasGrad[o];
+            toHalf(layer.master.data(), layer.weights.data(), layer.master.size());
+        }
+        syncTo(nn);
+    }
+    if (precision == Precision::Float16 && ++cleanSteps >= options.growthInterval) {
+        scale *= options.growthFactor;
+        cleanSteps = 0;
+    }
+    return loss / batch;
+}
+
+void MixedPrecision::syncTo(NeuralNetwork &nn) const {
+    for (size_t l = 0; l < layers.size(); l++) {
+        DenseLayer* dense = dynamic_cast<DenseLayer*>(nn.layers[l].get());
+        const LayerState &layer = layers[l];
+        for (int i = 0; i < layer.inputs; i++) {
+            for (int o = 0; o < layer.outputs; o++) {
+                dense->weights.data[i][o] = layer.master[static_cast<size_t>(i) * layer.outputs + o];
+            }
+        }
+        for (int o = 0; o < layer.outputs; o++) {
+            dense->biases.data[0][o] = layer.bias[o];
+        }
+    }
+}
+
+MixedPrecisionReport MixedPrecision::report() const {
+    MixedPrecisionReport r;
+    r.precision = precision;
+    r.steps = steps;
+    r.skippedSteps = skippedSteps;
+    r.lossScale = scale;
+    const size_t batch = static_cast<size_t>(lastBatch);
+    for (const LayerState &layer : layers) {
+        size_t weights = static_cast<size_t>(layer.inputs) * layer.outputs;
+        r.doubleParameterBytes += (weights + layer.outputs) * sizeof(double);
+        // the layers keep (and get synced) their double weights next to the fp32 master and 16 bit copy
+        r.mixedParameterBytes += (weights + layer.outputs) * (sizeof(double) + sizeof(float)) + weights * sizeof(uint16_t);
+        // a DenseLayer keeps a copy of its input and its output for backward
+        r.doubleActivationBytes += batch * (layer.inputs + layer.outputs) * sizeof(double);
+        r.mixedActivationBytes += batch * layer.outputs * sizeof(uint16_t);
+    }
+    if (!layers.empty()) {
+        r.mixedActivationBytes += batch * layers[0].inputs * sizeof(uint16_t);
+    }
+    return r;
+}
+
+void MixedPrecisionReport::print(std::ostream &out) const {
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    auto ratio = [](size_t a, size_t b) { return b ? static_cast<double>(a) / b : 0.0; };
+    out << std::fixed << std::setprecision(2);
+    out << "Mixed precision (" << precisionName(precision) << "): " << steps << " steps, " << skippedSteps
+        << " skipped, loss scale " << lossScale << "\n";
+    out << "  parameters   " << doubleParameterBytes << " -> " << mixedParameterBytes << " bytes ("
+        << ratio(mixedParameterBytes, doubleParameterBytes) << "x, the layers keep their double weights)\n";
+    out << "  activations  " << doubleActivationBytes << " -> " << mixedActivationBytes << " bytes per step ("
+        << ratio(doubleActivationBytes, mixedActivationBytes) << "x less)\n";
+    out.copyfmt(state);
+}
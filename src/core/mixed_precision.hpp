@@ -0,0 +1,97 @@
+#ifndef MIXED_PRECISION_HPP
+#define MIXED_PRECISION_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "../math/half.hpp"
+#include "../math/matrix.hpp"
+
+class NeuralNetwork;
+class DenseLayer;
+
+// Dynamic loss scaling for fp16: the loss gradient is multiplied by the scale so small gradients
+// do not flush to zero in 16 bits. A step whose gradients overflow is skipped and the scale backs
+// off, after growthInterval clean steps it grows again. bf16 has the float range and trains unscaled.
+struct LossScaleOptions {
+    double initialScale = 65536.0;
+    double growthFactor = 2.0;
+    double backoffFactor = 0.5;
+    int growthInterval = 1000;
+    double minScale = 1.0;
+};
+
+// Memory and loss scaling state of a mixed precision network (see MixedPrecision::report)
+struct MixedPrecisionReport {
+    Precision precision = Precision::Double;
+    long long steps = 0;
+    long long skippedSteps = 0;     // overflowed, parameters left unchanged
+    double lossScale = 1.0;
+    size_t doubleParameterBytes = 0;
+    size_t mixedParameterBytes = 0;  // the layers' double weights + fp32 master weights + 16 bit copies
+    size_t doubleActivationBytes = 0;  // layer inputs/outputs and gradients kept during the last step
+    size_t mixedActivationBytes = 0;
+
+    void print(std::ostream &out) const;
+};
+
+// Mixed precision training state of a dense NeuralNetwork, installed with NeuralNetwork::setPrecision().
+//
+// Weights and activations (layer outputs and the gradients passed between layers) are stored in
+// fp16 or bf16, products are accumulated in fp32 and the optimizer updates fp32 master weights.
+// After every step the master weights are copied back into the layers' double weights, so
+// forward(), inference, checkpoints and model files keep working on the same network; that double
+// copy stays resident, so parameters take 14 bytes a weight instead of 8 and the memory saving is in
+// the activations. Layers are looked up in nn.layers on every step; weights changed behind its back
+// (a checkpoint restore, loadFromFile, manual edits) no longer match the master copies and are taken
+// over at the next step.
+class MixedPrecision {
+public:
+    MixedPrecision(const NeuralNetwork &nn, Precision precision, const LossScaleOptions &options = LossScaleOptions());
+
+    // Same contract as NeuralNetwork::train_step
+    double train_step(NeuralNetwork &nn, const Matrix &inputs, const std::vector<int> &labels, double learning_rate);
+
+    // Rebuilds the master weights from the layers, after they were replaced or reloaded.
+    // Throws std::invalid_argument if the layers no longer fit (see the constructor).
+    void reload(const NeuralNetwork &nn);
+
+    Precision getPrecision() const { return precision; }
+    double lossScale() const { return scale; }
+    int cleanStepCount() const { return cleanSteps; }  // clean steps since the scale last changed
+    // Loss scaling state of a resumed run (TrainingState::lossScale / cleanSteps)
+    void setLossScale(double lossScale, int cleanStepCount);
+    MixedPrecisionReport report() const;
+
+private:
+    struct LayerState {
+        int inputs = 0, outputs = 0;
+        std::vector<float> master;          // inputs x outputs, fp32 master weights
+        std::vector<float> bias;
+        std::vector<uint16_t> weights;      // 16 bit copy used by forward/backward
+        std::vector<uint16_t> output;       // batch x outputs, stored activation
+        std::vector<float> weightGrad, biasGrad;
+    };
+
+    Precision precision;
+    LossScaleOptions options;
+    double scale;
+    int cleanSteps = 0;
+    long long steps = 0, skippedSteps = 0;
+    int lastBatch = 0;
+
+    std::vector<LayerState> layers;
+    std::vector<uint16_t> input;            // batch x inputs of the first layer
+    std::vector<uint16_t> gradient;         // gradient passed to the previous layer, 16 bit
+    std::vector<float> weightScratch, rowScratch, delta, inputScratch, gradScratch;
+    std::vector<double> activationRow, activatedRow;  // one row through the layer's activation function
+
+    void toHalf(const float* in, uint16_t* out, size_t n) const { convertToHalf(in, out, n, precision); }
+    void fromHalf(const uint16_t* in, float* out, size_t n) const { convertFromHalf(in, out, n, precision); }
+    static const DenseLayer& denseLayer(const NeuralNetwork &nn, size_t l);
+    void loadLayer(const DenseLayer &dense, LayerState &state) const;
+    bool matches(const DenseLayer &dense, const LayerState &state) const;
+    void syncTo(NeuralNetwork &nn) const;
+};
+
+#endif  // MIXED_PRECISION_HPP
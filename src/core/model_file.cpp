@@ -0,0 +1,375 @@
+#include "model_file.hpp"
+#include "../layers/dense_layer.hpp"
+#include "../layers/conv_layer.hpp"
+#include "../layers/dropout_layer.hpp"
+#include "../layers/batch_norm_layer.hpp"
+#include "../activations/activations.hpp"
+#include "../utils/mapped_file.hpp"
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <stdexcept>
+#include <typeinfo>
+
+static const char MAGIC[8] = {'N', 'N', 'C', 'P', 'P', 'M', 'D', 'L'};
+static const uint32_t DTYPE_F64 = 1;
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const uint64_t ALIGNMENT = 64;
+
+enum LayerType : uint32_t { LAYER_DENSE = 1, LAYER_CONV = 2, LAYER_DROPOUT = 3, LAYER_BATCHNORM = 4 };
+enum ActivationType : uint32_t { ACTIVATION_RELU = 1, ACTIVATION_SIGMOID = 2, ACTIVATION_SOFTMAX = 3, ACTIVATION_LINEAR = 4 };
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint32_t byteOrder;
+    uint32_t layerCount;
+    uint32_t tensorCount;
+    uint32_t reserved;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+    uint64_t metaChecksum;  // header bytes before this field + all records
+    uint64_t dataChecksum;  // bytes [dataOffset, fileSize)
+};
+
+struct LayerRecord {
+    uint32_t type;
+    uint32_t activation;
+    uint32_t isOutput;
+    uint32_t firstTensor;
+    uint32_t tensorCount;
+    int32_t kernelSize;  // conv only
+    int32_t stride;
+    int32_t padding;
+};
+
+struct TensorRecord {
+    uint32_t rows;
+    uint32_t cols;
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader must stay 64 bytes");
+static_assert(sizeof(LayerRecord) == 32, "LayerRecord must stay 32 bytes");
+static_assert(sizeof(TensorRecord) == 32, "TensorRecord must stay 32 bytes");
+
+// FNV-1a, 64 bit
+static uint64_t checksum(const unsigned char* bytes, size_t length, uint64_t hash = 14695981039346656037ULL) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+uint32_t ModelFile::activationId(const ActivationFunction &activation) {
+    if (typeid(activation) == typeid(ReLUFunction)) return ACTIVATION_RELU;
+    if (typeid(activation) == typeid(SigmoidFunction)) return ACTIVATION_SIGMOID;
+    if (typeid(activation) == typeid(SoftmaxFunction)) return ACTIVATION_SOFTMAX;
+    if (typeid(activation) == typeid(LinearFunction)) return ACTIVATION_LINEAR;
+    throw std::invalid_argument("Activation function has no model file type id");
+}
+
+ActivationFunction* ModelFile::createActivation(uint32_t type) {
+    switch (type) {
+        case ACTIVATION_RELU: return new activations::ReLU();
+        case ACTIVATION_SIGMOID: return new activations::Sigmoid();
+        case ACTIVATION_SOFTMAX: return new activations::Softmax();
+        case ACTIVATION_LINEAR: return new activations::Linear();
+        default: throw std::runtime_error("Unknown activation type in model file");
+    }
+}
+
+void ModelFile::save(const NeuralNetwork &nn, const std::string &filename) {
+    save(nn.layers, filename);
+}
+
+void ModelFile::save(const std::vector<std::unique_ptr<Layer>> &layers, const std::string &filename) {
+    if (filename.empty()) {
+        throw std::invalid_argument("Filename cannot be empty");
+    }
+
+    // Describe the graph and collect the tensors in file order
+    std::vector<LayerRecord> layerRecords;
+    std::vector<const Matrix*> tensors;
+    std::deque<Matrix> scalars;  // 1x1 tensors of layer settings that are not matrices, e.g. the dropout rate
+    for (const auto& layer : layers) {
+        LayerRecord record = {};
+        record.activation = layer->activation ? activationId(*layer->activation) : 0;
+        record.isOutput = layer->isOutputLayer ? 1 : 0;
+        record.firstTensor = static_cast<uint32_t>(tensors.size());
+
+        if (auto* dense = dynamic_cast<const DenseLayer*>(layer.get())) {
+            record.type = LAYER_DENSE;
+            tensors.push_back(&dense->weights);
+            tensors.push_back(&dense->biases);
+            if (dense->sparseWeights) {
+                // Pruned: the zeros of the weights are the pattern, the 1x1 tensor marks it (and keeps the density)
+                scalars.emplace_back(1, 1);
+                scalars.back().data[0][0] = dense->sparseWeights->density();
+                tensors.push_back(&scalars.back());
+            }
+        } else if (auto* conv = dynamic_cast<const ConvLayer*>(layer.get())) {
+            record.type = LAYER_CONV;
+            record.kernelSize = conv->kernel_size;
+            record.stride = conv->stride;
+            record.padding = conv->padding;
+            tensors.push_back(&conv->kernel);
+        } else if (auto* dropout = dynamic_cast<const DropoutLayer*>(layer.get())) {
+            record.type = LAYER_DROPOUT;
+            // rate, then seed, stream and position of the mask generator as exact 32 bit halves
+            const RandomStream &rng = dropout->getStream();
+            const uint64_t words[3] = {rng.getSeed(), rng.getStream(), rng.position()};
+            scalars.emplace_back(1, 7);
+            scalars.back().data[0][0] = dropout->rate;
+            for (int w = 0; w < 3; w++) {
+                scalars.back().data[0][1 + 2 * w] = static_cast<double>(words[w] >> 32);
+                scalars.back().data[0][2 + 2 * w] = static_cast<double>(words[w] & 0xffffffffULL);
+            }
+            tensors.push_back(&scalars.back());
+        } else if (auto* norm = dynamic_cast<const BatchNormLayer*>(layer.get())) {
+            record.type = LAYER_BATCHNORM;
+            tensors.push_back(&norm->gamma);
+            tensors.push_back(&norm->beta);
+            tensors.push_back(&norm->runningMean);
+            tensors.push_back(&norm->runningVar);
+            scalars.emplace_back(1, 2);
+            scalars.back().data[0][0] = norm->momentum;
+            scalars.back().data[0][1] = norm->epsilon;
+            tensors.push_back(&scalars.back());
+        } else {
+            throw std::invalid_argument("Layer type is not supported by the model file format");
+        }
+        record.tensorCount = static_cast<uint32_t>(tensors.size()) - record.firstTensor;
+        layerRecords.push_back(record);
+    }
+
+    // Lay the tensors out on aligned offsets
+    uint64_t recordsEnd = sizeof(FileHeader) + layerRecords.size() * sizeof(LayerRecord)
+                        + tensors.size() * sizeof(TensorRecord);
+    std::vector<TensorRecord> tensorRecords;
+    uint64_t offset = alignUp(recordsEnd);
+    for (const Matrix* tensor : tensors) {
+        TensorRecord record = {};
+        record.rows = static_cast<uint32_t>(tensor->rows);
+        record.cols = static_cast<uint32_t>(tensor->cols);
+        record.offset = offset;
+        record.bytes = static_cast<uint64_t>(tensor->rows) * tensor->cols * sizeof(double);
+        tensorRecords.push_back(record);
+        offset = alignUp(offset + record.bytes);
+    }
+
+    FileHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.dtype = DTYPE_F64;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.layerCount = static_cast<uint32_t>(layerRecords.size());
+    header.tensorCount = static_cast<uint32_t>(tensorRecords.size());
+    header.dataOffset = alignUp(recordsEnd);
+    header.fileSize = tensors.empty() ? header.dataOffset : offset;
+
+    uint64_t meta = checksum(reinterpret_cast<const unsigned char*>(&header), offsetof(FileHeader, metaChecksum));
+    meta = checksum(reinterpret_cast<const unsigned char*>(layerRecords.data()), layerRecords.size() * sizeof(LayerRecord), meta);
+    meta = checksum(reinterpret_cast<const unsigned char*>(tensorRecords.data()), tensorRecords.size() * sizeof(TensorRecord), meta);
+    header.metaChecksum = meta;
+
+    // Write to a temporary file and rename, so readers never see a half written model
+    std::string tmpFilename = filename + ".tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Could not create file " + tmpFilename);
+        }
+
+        const std::vector<char> zeros(ALIGNMENT, 0);
+        uint64_t position = 0;
+        auto writeBytes = [&](const void* bytes, uint64_t length) {
+            file.write(static_cast<const char*>(bytes), length);
+            if (position >= header.dataOffset) {
+                header.dataChecksum = checksum(static_cast<const unsigned char*>(bytes), length, header.dataChecksum);
+            }
+            position += length;
+        };
+        auto padTo = [&](uint64_t target) {
+            while (position < target) {
+                writeBytes(zeros.data(), std::min<uint64_t>(target - position, zeros.size()));
+            }
+        };
+
+        header.dataChecksum = 14695981039346656037ULL;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header)); // rewritten with the data checksum below
+        position = sizeof(header);
+        file.write(reinterpret_cast<const char*>(layerRecords.data()), layerRecords.size() * sizeof(LayerRecord));
+        file.write(reinterpret_cast<const char*>(tensorRecords.data()), tensorRecords.size() * sizeof(TensorRecord));
+        position = recordsEnd;
+        padTo(header.dataOffset);
+
+        for (size_t t = 0; t < tensors.size(); t++) {
+            padTo(tensorRecords[t].offset);
+            for (int i = 0; i < tensors[t]->rows; i++) {
+                writeBytes(tensors[t]->data[i], static_cast<uint64_t>(tensors[t]->cols) * sizeof(double));
+            }
+        }
+        padTo(header.fileSize);
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!file) {
+            throw std::runtime_error("Failed writing " + tmpFilename);
+        }
+    }
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        std::remove(tmpFilename.c_str());
+        throw std::runtime_error("Could not move " + tmpFilename + " to " + filename);
+    }
+}
+
+std::vector<std::unique_ptr<Layer>> ModelFile::readLayers(const std::string &filename, bool verifyData,
+                                                          std::shared_ptr<const void> &mapping) {
+    // Private writable mapping: parameters can be trained in place without touching the file
+    auto file = std::make_shared<MappedFile>(filename, true);
+    const unsigned char* base = file->data();
+    size_t size = file->size();
+
+    if (size < sizeof(FileHeader)) {
+        throw std::runtime_error("Model file is too small: " + filename);
+    }
+    FileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Not a model file (bad magic): " + filename);
+    }
+    if (header.version != VERSION) {
+        throw std::runtime_error("Unsupported model file version " + std::to_string(header.version) + ": " + filename);
+    }
+    if (header.dtype != DTYPE_F64 || header.byteOrder != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Model file dtype or byte order does not match this build: " + filename);
+    }
+    if (header.fileSize != size) {
+        throw std::runtime_error("Model file is truncated: " + filename);
+    }
+
+    uint64_t recordsEnd = sizeof(FileHeader) + static_cast<uint64_t>(header.layerCount) * sizeof(LayerRecord)
+                        + static_cast<uint64_t>(header.tensorCount) * sizeof(TensorRecord);
+    if (recordsEnd > header.dataOffset || header.dataOffset > size) {
+        throw std::runtime_error("Corrupt model file layout: " + filename);
+    }
+    const LayerRecord* layerRecords = reinterpret_cast<const LayerRecord*>(base + sizeof(FileHeader));
+    const TensorRecord* tensorRecords = reinterpret_cast<const TensorRecord*>(layerRecords + header.layerCount);
+
+    uint64_t meta = checksum(base, offsetof(FileHeader, metaChecksum));
+    meta = checksum(base + sizeof(FileHeader), recordsEnd - sizeof(FileHeader), meta);
+    if (meta != header.metaChecksum) {
+        throw std::runtime_error("Model file metadata checksum mismatch: " + filename);
+    }
+    if (verifyData && checksum(base + header.dataOffset, size - header.dataOffset) != header.dataChecksum) {
+        throw std::runtime_error("Model file data checksum mismatch: " + filename);
+    }
+
+    // Tensor views straight into the mapping
+    auto tensorView = [&](uint32_t index, int rows, int cols) {
+        if (index >= header.tensorCount) {
+            throw std::runtime_error("Tensor index out of range in " + filename);
+        }
+        const TensorRecord& record = tensorRecords[index];
+        if (static_cast<int>(record.rows) != rows || static_cast<int>(record.cols) != cols ||
+            record.bytes != static_cast<uint64_t>(rows) * cols * sizeof(double) ||
+            record.offset % ALIGNMENT != 0 || record.offset < header.dataOffset || record.offset + record.bytes > size) {
+            throw std::runtime_error("Tensor shape or offset does not match its layer in " + filename);
+        }
+        return Matrix::view(reinterpret_cast<double*>(file->mutableData() + record.offset), rows, cols);
+    };
+
+    std::vector<std::unique_ptr<Layer>> layers;
+    for (uint32_t l = 0; l < header.layerCount; l++) {
+        const LayerRecord& record = layerRecords[l];
+        if (record.firstTensor >= header.tensorCount) {
+            throw std::runtime_error("Layer references a missing tensor in " + filename);
+        }
+        bool isOutput = record.isOutput != 0;
+        if (record.type == LAYER_DROPOUT && record.tensorCount == 1) {
+            // 1x1: the rate alone (older files, the layer gets a new stream), 1x7: rate and generator
+            const int cols = tensorRecords[record.firstTensor].cols == 7 ? 7 : 1;
+            Matrix settings = tensorView(record.firstTensor, 1, cols);
+            double rate = settings.data[0][0];
+            if (!(rate >= 0.0 && rate < 1.0)) {
+                throw std::runtime_error("Invalid dropout rate in " + filename);
+            }
+            auto dropout = std::make_unique<DropoutLayer>(rate);
+            if (cols == 7) {
+                uint64_t words[3];
+                for (int w = 0; w < 3; w++) {
+                    words[w] = static_cast<uint64_t>(settings.data[0][1 + 2 * w]) << 32 |
+                               static_cast<uint64_t>(settings.data[0][2 + 2 * w]);
+                }
+                RandomStream rng(words[0], words[1]);
+                rng.seek(words[2]);
+                dropout->setStream(rng);
+            }
+            layers.push_back(std::move(dropout));
+            continue;
+        }
+        // Owned here until a layer takes it, so a bad tensor or a throwing constructor does not leak it
+        std::unique_ptr<ActivationFunction> activation(createActivation(record.activation));
+
+        if (record.type == LAYER_DENSE && (record.tensorCount == 2 || record.tensorCount == 3)) {
+            const TensorRecord& w = tensorRecords[record.firstTensor];
+            Matrix weights = tensorView(record.firstTensor, w.rows, w.cols);
+            Matrix biases = tensorView(record.firstTensor + 1, 1, w.cols);
+            auto dense = std::make_unique<DenseLayer>(std::move(weights), std::move(biases), activation.release(), isOutput);
+            if (record.tensorCount == 3) {
+                tensorView(record.firstTensor + 2, 1, 1);  // validates the marker
+                dense->sparseWeights = std::make_shared<const SparseMatrix>(SparseMatrix::fromDense(dense->weights));
+            }
+            layers.push_back(std::move(dense));
+        } else if (record.type == LAYER_CONV && record.tensorCount == 1) {
+            auto conv = std::make_unique<ConvLayer>(record.kernelSize, record.stride, record.padding, activation.release(), isOutput);
+            conv->kernel = tensorView(record.firstTensor, record.kernelSize, record.kernelSize);
+            layers.push_back(std::move(conv));
+        } else if (record.type == LAYER_BATCHNORM && record.tensorCount == 5) {
+            const int features = static_cast<int>(tensorRecords[record.firstTensor].cols);
+            Matrix gamma = tensorView(record.firstTensor, 1, features);
+            Matrix beta = tensorView(record.firstTensor + 1, 1, features);
+            Matrix runningMean = tensorView(record.firstTensor + 2, 1, features);
+            Matrix runningVar = tensorView(record.firstTensor + 3, 1, features);
+            Matrix settings = tensorView(record.firstTensor + 4, 1, 2);
+            auto norm = std::make_unique<BatchNormLayer>(std::move(gamma), std::move(beta), std::move(runningMean),
+                                                         std::move(runningVar), activation.release(), isOutput);
+            norm->momentum = settings.data[0][0];
+            norm->epsilon = settings.data[0][1];
+            layers.push_back(std::move(norm));
+        } else {
+            throw std::runtime_error("Unknown layer record in " + filename);
+        }
+    }
+
+    mapping = file;
+    return layers;
+}
+
+NeuralNetwork ModelFile::load(const std::string &filename, bool verifyData) {
+    NeuralNetwork nn;
+    try {
+        nn.layers = readLayers(filename, verifyData, nn.mappedStorage);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to load model: " << e.what() << std::endl;
+        throw;
+    }
+    return nn;
+}
+
+std::shared_ptr<const Weights> ModelFile::loadWeights(const std::string &filename, bool verifyData) {
+    std::shared_ptr<const void> mapping;
+    std::vector<std::unique_ptr<Layer>> layers = readLayers(filename, verifyData, mapping);
+    return std::make_shared<const Weights>(std::move(layers), std::move(mapping));
+}
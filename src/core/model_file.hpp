@@ -0,0 +1,49 @@
+#ifndef MODEL_FILE_HPP
+#define MODEL_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "neural_network.hpp"
+#include "weights.hpp"
+#include "../layers/layer.hpp"
+
+// Single-file model container (.nnm), replaces the headerless per-layer _layer_N.dat files.
+//
+// Layout (all integers little-endian, native doubles):
+//   header (64 bytes)   magic "NNCPPMDL", version, dtype, byte order mark, layer and tensor counts,
+//                       data offset, file size, metadata checksum, data checksum
+//   layer records       type (dense/conv/dropout/batchnorm), activation, output flag, tensor range,
+//                       conv parameters
+//   tensor records      rows, cols, offset, byte size (a dropout layer keeps its rate and mask stream in a 1x7 tensor,
+//                       batch normalization its gamma, beta, running statistics and (momentum, epsilon),
+//                       a pruned dense layer has a third 1x1 tensor, its weight density)
+//   tensor data         every tensor starts on a 64-byte boundary
+//
+// Loading maps the file and builds the layers directly on top of the mapped tensors (no copy),
+// so the topology comes from the file alone and startup cost does not grow with the model size.
+// The data checksum is the only step that touches every byte, it can be skipped on load.
+class ModelFile {
+public:
+    static const uint32_t VERSION = 1;
+
+    static void save(const std::vector<std::unique_ptr<Layer>> &layers, const std::string &filename);
+    static void save(const NeuralNetwork &nn, const std::string &filename);
+
+    // Rebuilds the network from the file, its parameters are copy-on-write views into the mapping
+    static NeuralNetwork load(const std::string &filename, bool verifyData = true);
+
+    // Same, as an immutable snapshot for InferenceContext / InferenceServer
+    static std::shared_ptr<const Weights> loadWeights(const std::string &filename, bool verifyData = true);
+
+    // Stable activation ids of the file format, also used by QuantizedModel files
+    static uint32_t activationId(const ActivationFunction &activation);
+    static ActivationFunction* createActivation(uint32_t id);
+
+private:
+    static std::vector<std::unique_ptr<Layer>> readLayers(const std::string &filename, bool verifyData,
+                                                          std::shared_ptr<const void> &mapping);
+};
+
+#endif  // MODEL_FILE_HPP
@@ -1,14 +1,40 @@
 #include "neural_network.hpp"
+#include "profiler.hpp"
+#include "compiled_model.hpp"
+#include "../utils/dataset.hpp"
+#include "../utils/trace.hpp"
 #include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
 
 void NeuralNetwork::addLayer(std::unique_ptr<Layer> layer) {
+    layer->training = training;
     layers.push_back(std::move(layer)); // move ownership of the layer to the vector
 }
 
+void NeuralNetwork::setTraining(bool enabled) {
+    training = enabled;
+    for (auto& layer : layers) {
+        layer->training = enabled;
+    }
+}
+
+bool NeuralNetwork::isTraining() const {
+    return training;
+}
+
 Matrix NeuralNetwork::forward(const Matrix& input) {
     Matrix curr = input;
-    for (auto& layer : layers) {
-        layer->forward(curr);
+    for (size_t i = 0; i < layers.size(); i++) {
+        auto& layer = layers[i];
+        if (layer->passesThrough()) continue;
+        {
+            TraceScope trace("forward", "layer", "layer", i);
+            AllocationScope allocations(AllocCategory::Forward);
+            ProfileScope profile(layer.get(), LayerPhase::Forward, curr);
+            layer->forward(curr);
+        }
         curr = layer->output;
 
         std::cout << "Layer Output:";  
@@ -17,6 +43,18 @@ Matrix NeuralNetwork::forward(const Matrix& input) {
     return curr;
 }
 
+std::shared_ptr<const Weights> NeuralNetwork::shareWeights() const {
+    return std::make_shared<const Weights>(layers);
+}
+
+CompiledModel NeuralNetwork::compile() const {
+    return CompiledModel::compile(*this);
+}
+
+CompiledModel NeuralNetwork::compile(const CompileOptions &options) const {
+    return CompiledModel::compile(*this, options);
+}
+
 void NeuralNetwork::train(Matrix &input, Matrix &target, int epochs, double learning_rate) {
     std::cout << "Training started for " << epochs << " epochs...\n";
     
@@ -35,6 +73,10 @@ void NeuralNetwork::train(Matrix &input, Matrix &target, int epochs, double lear
         // Backward pass (iterate from last to first layer)
         Matrix d_input = error;  // Start with error at output layer
         for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+            if ((*it)->passesThrough()) continue;
+            TraceScope trace("backward", "layer", "layer", layers.rend() - it - 1);
+            AllocationScope allocations(AllocCategory::Backward);
+            ProfileScope profile(it->get(), LayerPhase::Backward, (*it)->input);
             d_input = (*it)->backward(d_input, learning_rate);  // Pass the new gradient
         }
     }
@@ -66,6 +108,10 @@ void NeuralNetwork::train_batch(std::vector<Matrix> &inputs, std::vector<Matrix>
             // Backward pass (iterate from last to first layer)
             Matrix d_input = error;  // Start with error at output layer
             for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+            if ((*it)->passesThrough()) continue;
+            TraceScope trace("backward", "layer", "layer", layers.rend() - it - 1);
+            AllocationScope allocations(AllocCategory::Backward);
+            ProfileScope profile(it->get(), LayerPhase::Backward, (*it)->input);
             d_input = (*it)->backward(d_input, learning_rate);  // Pass the new gradient
             }
         }
@@ -74,6 +120,95 @@ void NeuralNetwork::train_batch(std::vector<Matrix> &inputs, std::vector<Matrix>
     std::cout << "Training completed!\n";
 }
 
+double NeuralNetwork::train_step(const Matrix &inputs, const std::vector<int> &labels, double learning_rate) {
+    if (inputs.rows != static_cast<int>(labels.size())) {
+        throw std::invalid_argument("Number of inputs must match number of labels");
+    }
+    if (layers.empty()) {
+        throw std::logic_error("Cannot train a network without layers");
+    }
+
+    if (mixedPrecision) {
+        return mixedPrecision->train_step(*this, inputs, labels, learning_rate);
+    }
+
+    TraceScope trace("train_step", "train", "batch", inputs.rows);
+    return train_step_from(0, inputs, labels, learning_rate);
+}
+
+double NeuralNetwork::train_step_from(size_t first, const Matrix &inputs, const std::vector<int> &labels,
+                                      double learning_rate, Matrix* d_inputs) {
+    if (inputs.rows != static_cast<int>(labels.size())) {
+        throw std::invalid_argument("Number of inputs must match number of labels");
+    }
+    if (first >= layers.size()) {
+        throw std::out_of_range("First trained layer is past the last layer");
+    }
+
+    // Forward pass (quiet, unlike forward())
+    const Matrix* curr = &inputs;
+    for (size_t i = first; i < layers.size(); i++) {
+        if (layers[i]->passesThrough()) continue;
+        TraceScope layerTrace("forward", "layer", "layer", i);
+        AllocationScope allocations(AllocCategory::Forward);
+        ProfileScope profile(layers[i].get(), LayerPhase::Forward, *curr);
+        layers[i]->forward(*curr);
+        curr = &layers[i]->output;
+    }
+    const Matrix& output = *curr;
+
+    // error = (output - one_hot(labels)) / batch_size, built in place instead of target matrices
+    int batch_size = output.rows;
+    Matrix error = output;
+    double loss = 0.0;
+    for (int i = 0; i < batch_size; i++) {
+        int label = labels[i];
+        if (label < 0 || label >= output.cols) {
+            throw std::out_of_range("Label out of range for the output layer");
+        }
+        loss -= std::log(std::max(output.data[i][label], 1e-12));
+        error.data[i][label] -= 1.0;
+        for (int j = 0; j < output.cols; j++) {
+            error.data[i][j] /= batch_size;
+        }
+    }
+
+    // Backward pass (iterate from last to first layer)
+    Matrix d_input = std::move(error);
+    for (size_t i = layers.size(); i-- > first;) {
+        if (layers[i]->passesThrough()) continue;
+        TraceScope layerTrace("backward", "layer", "layer", i);
+        AllocationScope allocations(AllocCategory::Backward);
+        ProfileScope profile(layers[i].get(), LayerPhase::Backward, layers[i]->input);
+        d_input = layers[i]->backward(d_input, learning_rate);
+    }
+    if (d_inputs) *d_inputs = std::move(d_input);
+
+    return loss / batch_size;
+}
+
+double NeuralNetwork::train_epoch(Dataset &dataset, int batch_size, double learning_rate) {
+    TraceScope trace("train_epoch", "train");
+    double total = 0.0;
+    long long samples = 0;
+    for (const Batch& batch : dataset.batches(batch_size)) {
+        total += train_step(batch.inputs, batch.labels, learning_rate) * batch.size;
+        samples += batch.size;
+    }
+    return samples ? total / samples : 0.0;
+}
+
+void NeuralNetwork::setPrecision(Precision precision, const LossScaleOptions &options) {
+    if (precision == Precision::Double) {
+        mixedPrecision.reset();  // the layers already hold the latest master weights
+    } else {
+        mixedPrecision = std::make_shared<MixedPrecision>(*this, precision, options);
+    }
+}
+
+Precision NeuralNetwork::getPrecision() const {
+    return mixedPrecision ? mixedPrecision->getPrecision() : Precision::Double;
+}
 
 void NeuralNetwork::saveToFile(const std::string &filename) {
     try {
@@ -101,6 +236,7 @@ void NeuralNetwork::loadFromFile(const std::string &filename) {
             std::string layerFilename = filename + "_layer_" + std::to_string(i) + ".dat";
             layers[i]->loadFromFile(layerFilename);
         }
+        if (mixedPrecision) mixedPrecision->reload(*this);
     } catch (const std::exception& e) {
         std::cerr << "Failed to load model: " << e.what() << std::endl;
         throw;
@@ -7,27 +7,64 @@
 #include "../layers/layer.hpp"
 #include "../math/matrix.hpp"
 #include "serializable.hpp"
+#include "weights.hpp"
+#include "mixed_precision.hpp"
 
 // cancel the usage of templates
 // we are going to use polymorphism and smart pointers instead
 // to be able to make a cnn and a dnn in the same class
 
+class Dataset;
+class CompiledModel;
+struct CompileOptions;
+
 // template<typename LayerType>
 class NeuralNetwork : public Trainable, public Serializable {
-private:
-    std::vector<std::unique_ptr<Layer>> layers;
 public:
+    std::vector<std::unique_ptr<Layer>> layers;
+    std::shared_ptr<const void> mappedStorage; // set when the parameters are views into a mapped model file
+    std::shared_ptr<MixedPrecision> mixedPrecision; // set by setPrecision() for 16 bit training
+    bool training = true;  // see setTraining()
 
-    // add a layer to the network
+    // add a layer to the network, it takes the network's train/eval mode
     void addLayer(std::unique_ptr<Layer> layer);
 
+    // Train/eval mode of every layer (default: training). In eval mode dropout is skipped, so
+    // forward() and train_step() see the deterministic network; inference snapshots always are.
+    void setTraining(bool training);
+    bool isTraining() const;
+
     // Forward pass through the network
     Matrix forward(const Matrix& input);
 
+    // Immutable copy of the current parameters, to be shared between threads through InferenceContext
+    std::shared_ptr<const Weights> shareWeights() const;
+
+    // Static fp32 execution plan of the eval-mode network for serving (see CompiledModel, include
+    // compiled_model.hpp): fused layers, kernels picked per layer, preallocated buffers
+    CompiledModel compile() const;
+    CompiledModel compile(const CompileOptions &options) const;
+
     // Train a single input data for number of epochs
     void train(Matrix &input, Matrix &target, int epochs, double learning_rate) override;
     // Train a batch of input data for number of epochs 
     void train_batch(std::vector<Matrix> &inputs, std::vector<Matrix> &targets, int epochs, double learning_rate) override;
+    // One SGD step on a minibatch (rows of inputs) with integer class labels, e.g. a DataLoader Batch.
+    // Gradients are averaged over the batch, returns the mean cross-entropy loss before the update.
+    double train_step(const Matrix &inputs, const std::vector<int> &labels, double learning_rate);
+    // train_step on layers [first, end) only, inputs being what layer first - 1 produced for the batch.
+    // For callers that compute the leading layers themselves (SweepRunner); d_inputs, when given,
+    // receives the loss gradient with respect to inputs. Double precision only.
+    double train_step_from(size_t first, const Matrix &inputs, const std::vector<int> &labels,
+                           double learning_rate, Matrix* d_inputs = nullptr);
+    // One pass over a streaming Dataset in minibatches, returns the mean loss of the epoch
+    double train_epoch(Dataset &dataset, int batch_size, double learning_rate);
+
+    // Precision of train_step/train_epoch: Double (default), or Float16/BFloat16 weights and activations
+    // with fp32 master weights (dense layers only, see MixedPrecision). Takes the current weights,
+    // call it again after loading new ones.
+    void setPrecision(Precision precision, const LossScaleOptions &options = LossScaleOptions());
+    Precision getPrecision() const;
 
     void saveToFile(const std::string &filename) override;
     void loadFromFile(const std::string &filename) override;
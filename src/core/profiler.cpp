@@ -0,0 +1,274 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NN_X86_KERNELS 1
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<Profiler*> Profiler::current{nullptr};
+thread_local ProfileScope* ProfileScope::innermost = nullptr;
+
+double Profiler::Roofline::attainable(double intensity) const {
+    return std::min(peakGflops, intensity * bandwidthGBs);
+}
+
+Profiler::~Profiler() {
+    disable();
+}
+
+void Profiler::enable() {
+    current.store(this, std::memory_order_relaxed);
+}
+
+void Profiler::disable() {
+    Profiler* self = this;
+    current.compare_exchange_strong(self, nullptr, std::memory_order_relaxed);
+}
+
+const char* Profiler::phaseName(LayerPhase phase) {
+    switch (phase) {
+        case LayerPhase::Forward: return "forward";
+        case LayerPhase::Backward: return "backward";
+        case LayerPhase::Update: return "update";
+    }
+    return "unknown";
+}
+
+void Profiler::record(const Layer* layer, LayerPhase phase, double seconds, const OpCost &cost) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto key = std::make_pair(layer, phase);
+    auto it = index.find(key);
+    if (it == index.end()) {
+        auto id = layerIds.emplace(layer, static_cast<int>(layerIds.size())).first->second;
+        Entry entry;
+        entry.layerId = id;
+        entry.layer = "#" + std::to_string(id) + " " + layer->describe();
+        entry.phase = phase;
+        it = index.emplace(key, entries.size()).first;
+        entries.push_back(entry);
+    }
+    Entry &entry = entries[it->second];
+    entry.calls++;
+    entry.seconds += seconds;
+    entry.flops += cost.flops;
+    entry.bytes += cost.bytes;
+}
+
+void Profiler::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    layerIds.clear();
+}
+
+std::vector<Profiler::Entry> Profiler::getEntries() const {
+    std::vector<Entry> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted = entries;
+    }
+    // Layer order first, then forward/backward/update
+    std::sort(sorted.begin(), sorted.end(), [](const Entry &a, const Entry &b) {
+        return a.layerId != b.layerId ? a.layerId < b.layerId : a.phase < b.phase;
+    });
+    return sorted;
+}
+
+void Profiler::setRoofline(const Roofline &roofline) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->roofline = roofline;
+}
+
+Profiler::Roofline Profiler::getRoofline() const {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (roofline.peakGflops > 0.0) return roofline;
+    }
+    Roofline measured = measureRoofline();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (roofline.peakGflops <= 0.0) roofline = measured;
+    return roofline;
+}
+
+// Independent multiply-add chains that hide the FMA latency, values stay bounded. Return the flops.
+static double fmaChainsScalar(long long rounds) {
+    double acc[8] = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8};
+    const double mul = 0.999999, add = 1e-7;
+    for (long long r = 0; r < rounds; r++) {
+        for (int k = 0; k < 8; k++) acc[k] = acc[k] * mul + add;
+    }
+    volatile double sink = acc[0] + acc[1] + acc[2] + acc[3] + acc[4] + acc[5] + acc[6] + acc[7];
+    (void)sink;
+    return 2.0 * 8 * rounds;
+}
+
+#ifdef NN_X86_KERNELS
+__attribute__((target("avx2,fma")))
+static double fmaChains256(long long rounds) {
+    const __m256d mul = _mm256_set1_pd(0.999999), add = _mm256_set1_pd(1e-7);
+    __m256d acc[10];
+    for (int k = 0; k < 10; k++) acc[k] = _mm256_set1_pd(0.1 * (k + 1));
+    for (long long r = 0; r < rounds; r++) {
+        for (int k = 0; k < 10; k++) acc[k] = _mm256_fmadd_pd(acc[k], mul, add);
+    }
+    __m256d sum = acc[0];
+    for (int k = 1; k < 10; k++) sum = _mm256_add_pd(sum, acc[k]);
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    volatile double sink = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    (void)sink;
+    return 2.0 * 4 * 10 * rounds;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+__attribute__((target("avx512f")))
+static double fmaChains512(long long rounds) {
+    const __m512d mul = _mm512_set1_pd(0.999999), add = _mm512_set1_pd(1e-7);
+    __m512d acc[12];
+    for (int k = 0; k < 12; k++) acc[k] = _mm512_set1_pd(0.1 * (k + 1));
+    for (long long r = 0; r < rounds; r++) {
+        for (int k = 0; k < 12; k++) acc[k] = _mm512_fmadd_pd(acc[k], mul, add);
+    }
+    __m512d sum = acc[0];
+    for (int k = 1; k < 12; k++) sum = _mm512_add_pd(sum, acc[k]);
+    volatile double sink = _mm512_reduce_add_pd(sum);
+    (void)sink;
+    return 2.0 * 8 * 12 * rounds;
+}
+#pragma GCC diagnostic pop
+#endif
+
+Profiler::Roofline Profiler::measureRoofline() {
+    Roofline result;
+
+    // Compute: the widest FMA the CPU has on every core the GEMM may use, so that no measured
+    // layer can beat the peak
+    {
+        const long long rounds = 4000000;
+        double flops = 0.0;
+        Clock::time_point start = Clock::now();
+#ifdef NN_X86_KERNELS
+        if (__builtin_cpu_supports("avx512f")) {
+            flops = fmaChains512(rounds);
+        } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            flops = fmaChains256(rounds);
+        } else {
+            flops = fmaChainsScalar(rounds);
+        }
+#else
+        flops = fmaChainsScalar(rounds);
+#endif
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.peakGflops = flops / seconds * 1e-9 * std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Memory: sum a 64 MB buffer, best of a few passes
+    {
+        std::vector<double> buffer(8 << 20, 1.0);
+        double best = 0.0;
+        for (int pass = 0; pass < 3; pass++) {
+            double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i + 3 < buffer.size(); i += 4) {
+                s0 += buffer[i];
+                s1 += buffer[i + 1];
+                s2 += buffer[i + 2];
+                s3 += buffer[i + 3];
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            volatile double sink = s0 + s1 + s2 + s3;
+            (void)sink;
+            best = std::max(best, buffer.size() * sizeof(double) / seconds * 1e-9);
+        }
+        result.bandwidthGBs = best;
+    }
+    return result;
+}
+
+void Profiler::report(std::ostream &out) const {
+    std::vector<Entry> sorted = getEntries();
+    Roofline peak = getRoofline();
+
+    double total = 0.0;
+    double phaseTotal[3] = {0.0, 0.0, 0.0};
+    for (const Entry &e : sorted) {
+        total += e.seconds;
+        phaseTotal[static_cast<int>(e.phase)] += e.seconds;
+    }
+
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    out << std::fixed << std::setprecision(2);
+    out << "Roofline: " << peak.peakGflops << " GFLOP/s peak, " << peak.bandwidthGBs << " GB/s memory\n";
+    out << std::left << std::setw(24) << "layer" << std::setw(10) << "phase" << std::right
+        << std::setw(9) << "calls" << std::setw(12) << "total ms" << std::setw(8) << "time%"
+        << std::setw(10) << "GFLOP/s" << std::setw(9) << "GB/s" << std::setw(9) << "FLOP/B"
+        << std::setw(10) << "roofline" << "\n";
+    for (const Entry &e : sorted) {
+        double bound = peak.attainable(e.intensity());
+        out << std::left << std::setw(24) << e.layer << std::setw(10) << phaseName(e.phase) << std::right
+            << std::setw(9) << e.calls << std::setw(12) << e.seconds * 1e3
+            << std::setw(7) << (total > 0.0 ? e.seconds / total * 100.0 : 0.0) << "%"
+            << std::setw(10) << e.gflops() << std::setw(9) << e.gbps() << std::setw(9) << e.intensity()
+            << std::setw(9) << (bound > 0.0 ? e.gflops() / bound * 100.0 : 0.0) << "%\n";
+    }
+    out << "total " << total * 1e3 << " ms (forward " << phaseTotal[0] * 1e3 << ", backward "
+        << phaseTotal[1] * 1e3 << ", update " << phaseTotal[2] * 1e3 << ")\n";
+    out.copyfmt(state);
+}
+
+void Profiler::writeJson(std::ostream &out) const {
+    std::vector<Entry> sorted = getEntries();
+    Roofline peak = getRoofline();
+
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    out << std::setprecision(9);
+    out << "{\n  \"roofline\": {\"peak_gflops\": " << peak.peakGflops
+        << ", \"bandwidth_gbs\": " << peak.bandwidthGBs << "},\n  \"layers\": [";
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const Entry &e = sorted[i];
+        double bound = peak.attainable(e.intensity());
+        out << (i ? ",\n" : "\n") << "    {\"layer\": \"" << e.layer << "\", \"phase\": \"" << phaseName(e.phase)
+            << "\", \"calls\": " << e.calls << ", \"seconds\": " << e.seconds
+            << ", \"flops\": " << e.flops << ", \"bytes\": " << e.bytes
+            << ", \"gflops\": " << e.gflops() << ", \"gbps\": " << e.gbps()
+            << ", \"intensity\": " << e.intensity() << ", \"attainable_gflops\": " << bound
+            << ", \"roofline_fraction\": " << (bound > 0.0 ? e.gflops() / bound : 0.0) << "}";
+    }
+    out << "\n  ]\n}\n";
+    out.copyfmt(state);
+}
+
+void Profiler::writeJson(const std::string &filename) const {
+    std::ofstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Cannot write profile: " + filename);
+    }
+    writeJson(file);
+}
+
+void ProfileScope::begin(const Layer* layer, LayerPhase phase, const Matrix &input) {
+    this->layer = layer;
+    this->phase = phase;
+    cost = layer->cost(phase, input);
+    parent = innermost;
+    innermost = this;
+    start = Clock::now();
+}
+
+void ProfileScope::end() {
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    innermost = parent;
+    if (parent) parent->childSeconds += elapsed;
+    profiler->record(layer, phase, std::max(0.0, elapsed - childSeconds), cost);
+}
@@ -0,0 +1,111 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <iostream>
+#include "../layers/layer.hpp"
+
+// Opt-in per-layer profiler: wall time, analytic FLOPs and bytes of every layer forward,
+// backward and weight update, compared against the machine's roofline.
+//
+//   Profiler profiler;
+//   profiler.enable();             // process wide, NeuralNetwork and the layers report to it
+//   nn.train_epoch(data, 64, 0.1);
+//   profiler.report(std::cout);
+//
+// While no profiler is enabled every instrumented call costs one predictable branch.
+class Profiler {
+public:
+    struct Entry {
+        int layerId = 0;        // layers are numbered in the order they were first seen
+        std::string layer;      // "#0 Dense 784x16"
+        LayerPhase phase;
+        long long calls = 0;
+        double seconds = 0.0;   // exclusive: the update inside backward is only counted as Update
+        double flops = 0.0;
+        double bytes = 0.0;
+
+        double gflops() const { return seconds > 0.0 ? flops / seconds * 1e-9 : 0.0; }
+        double gbps() const { return seconds > 0.0 ? bytes / seconds * 1e-9 : 0.0; }
+        double intensity() const { return bytes > 0.0 ? flops / bytes : 0.0; }  // FLOP per byte
+    };
+
+    // Peak compute and memory bandwidth, attainable GFLOP/s = min(peak, intensity * bandwidth)
+    struct Roofline {
+        double peakGflops = 0.0;
+        double bandwidthGBs = 0.0;
+        double attainable(double intensity) const;
+    };
+
+    Profiler() = default;
+    ~Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // Only one profiler can be enabled at a time, enabling another one takes over
+    void enable();
+    void disable();
+    bool isEnabled() const { return current.load(std::memory_order_relaxed) == this; }
+    static Profiler* active() { return current.load(std::memory_order_relaxed); }
+
+    void record(const Layer* layer, LayerPhase phase, double seconds, const OpCost &cost);
+    void reset();
+    std::vector<Entry> getEntries() const;
+
+    // Measured on first use by report()/writeJson() unless set explicitly
+    void setRoofline(const Roofline &roofline);
+    Roofline getRoofline() const;
+    // Times vector FMA chains (AVX-512 / AVX2 when available) scaled to the hardware threads, and a
+    // streaming read over a buffer larger than the caches
+    static Roofline measureRoofline();
+
+    void report(std::ostream &out) const;
+    void writeJson(std::ostream &out) const;
+    void writeJson(const std::string &filename) const;
+
+    static const char* phaseName(LayerPhase phase);
+
+private:
+    static std::atomic<Profiler*> current;
+
+    mutable std::mutex mutex;
+    std::vector<Entry> entries;
+    std::map<std::pair<const Layer*, LayerPhase>, size_t> index;
+    std::map<const Layer*, int> layerIds;
+    mutable Roofline roofline;
+};
+
+// Times one layer call for the enabled Profiler, nested scopes are subtracted from the enclosing one
+class ProfileScope {
+public:
+    ProfileScope(const Layer* layer, LayerPhase phase, const Matrix &input) : profiler(Profiler::active()) {
+        if (profiler) begin(layer, phase, input);
+    }
+    ~ProfileScope() {
+        if (profiler) end();
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler* profiler;
+    const Layer* layer = nullptr;
+    LayerPhase phase = LayerPhase::Forward;
+    OpCost cost;
+    std::chrono::steady_clock::time_point start;
+    double childSeconds = 0.0;
+    ProfileScope* parent = nullptr;
+
+    static thread_local ProfileScope* innermost;
+
+    void begin(const Layer* layer, LayerPhase phase, const Matrix &input);
+    void end();
+};
+
+#endif  // PROFILER_HPP
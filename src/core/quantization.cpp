@@ -0,0 +1,475 @@
+#include "quantization.hpp"
+#include "model_file.hpp"
+#include "../layers/dense_layer.hpp"
+#include "../utils/trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NN_X86_KERNELS 1
+#endif
+
+static const char MAGIC[8] = {'N', 'N', 'C', 'P', 'P', 'Q', '8', '\0'};
+static const int KERNEL_WIDTH = 64;  // bytes per step of the widest kernel
+static const int QMAX = QuantizedModel::QMAX;
+
+// FNV-1a, 64 bit (same as ModelFile)
+static uint64_t checksum(const void* data, size_t length, uint64_t hash) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int32_t dotScalar(const uint8_t* a, const int8_t* b, int n) {
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+}
+
+#ifdef NN_X86_KERNELS
+// vpmaddubsw multiplies u8 x s8 and adds pairs into int16 (at most 2 * 127 * 127, no saturation),
+// vpmaddwd against ones widens the pairs to int32
+__attribute__((target("avx2")))
+static int32_t dotAvx2(const uint8_t* a, const int8_t* b, int n) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+    for (int i = 0; i < n; i += 64) {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + 32));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + 32));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_maddubs_epi16(a0, b0), ones));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_maddubs_epi16(a1, b1), ones));
+    }
+    __m256i acc = _mm256_add_epi32(acc0, acc1);
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// vpdpbusd does the u8 x s8 products and the int32 accumulation in one instruction
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static int32_t dotAvx512Vnni(const uint8_t* a, const int8_t* b, int n) {
+    __m512i acc = _mm512_setzero_si512();
+    for (int i = 0; i < n; i += 64) {
+        __m512i va = _mm512_loadu_si512(a + i);
+        __m512i vb = _mm512_loadu_si512(b + i);
+        acc = _mm512_dpbusd_epi32(acc, va, vb);
+    }
+    alignas(64) int32_t lanes[16];
+    _mm512_store_si512(lanes, acc);
+    int32_t sum = 0;
+    for (int32_t lane : lanes) sum += lane;
+    return sum;
+}
+#endif
+
+QuantizedModel::DotKernel QuantizedModel::dotKernel(Int8Kernel kernel) {
+#ifdef NN_X86_KERNELS
+    switch (kernel) {
+        case Int8Kernel::Avx2: return dotAvx2;
+        case Int8Kernel::Avx512Vnni: return dotAvx512Vnni;
+        case Int8Kernel::Scalar: break;
+    }
+#endif
+    return dotScalar;
+}
+
+bool QuantizedModel::supported(Int8Kernel kernel) {
+    switch (kernel) {
+        case Int8Kernel::Scalar: return true;
+#ifdef NN_X86_KERNELS
+        case Int8Kernel::Avx2: return __builtin_cpu_supports("avx2");
+        case Int8Kernel::Avx512Vnni:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                   __builtin_cpu_supports("avx512vnni");
+#else
+        default: return false;
+#endif
+    }
+    return false;
+}
+
+Int8Kernel QuantizedModel::bestKernel() {
+    if (supported(Int8Kernel::Avx512Vnni)) return Int8Kernel::Avx512Vnni;
+    if (supported(Int8Kernel::Avx2)) return Int8Kernel::Avx2;
+    return Int8Kernel::Scalar;
+}
+
+const char* QuantizedModel::kernelName(Int8Kernel kernel) {
+    switch (kernel) {
+        case Int8Kernel::Scalar: return "scalar";
+        case Int8Kernel::Avx2: return "avx2";
+        case Int8Kernel::Avx512Vnni: return "avx512-vnni";
+    }
+    return "unknown";
+}
+
+void QuantizedModel::setKernel(Int8Kernel kernel) {
+    if (!supported(kernel)) {
+        throw std::invalid_argument(std::string("Int8 kernel not supported on this CPU: ") + kernelName(kernel));
+    }
+    this->kernel = kernel;
+}
+
+Int8Kernel QuantizedModel::getKernel() const {
+    return kernel;
+}
+
+const std::vector<QuantizedModel::DenseInt8>& QuantizedModel::getLayers() const {
+    return layers;
+}
+
+size_t QuantizedModel::parameterBytes() const {
+    size_t bytes = 0;
+    for (const DenseInt8 &layer : layers) {
+        bytes += static_cast<size_t>(layer.inputs) * layer.outputs * sizeof(int8_t);
+        bytes += layer.outputs * (sizeof(double) * 2 + sizeof(int32_t));  // scales, biases, weight sums
+    }
+    return bytes;
+}
+
+static int roundUp(int value, int multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Scale and zero point mapping [lo, hi] (widened to contain 0, so 0 is exact) onto [0, QMAX]
+static void chooseInputRange(double lo, double hi, double &scale, int32_t &zeroPoint) {
+    lo = std::min(lo, 0.0);
+    hi = std::max(hi, 0.0);
+    scale = (hi - lo) / QMAX;
+    if (scale <= 0.0 || !std::isfinite(scale)) scale = 1.0;
+    zeroPoint = static_cast<int32_t>(std::lround(-lo / scale));
+    zeroPoint = std::max(0, std::min(QMAX, zeroPoint));
+}
+
+QuantizedModel QuantizedModel::quantize(const NeuralNetwork &nn, const Matrix &calibration) {
+    TraceScope trace("quantize", "quantization");
+    if (nn.layers.empty()) {
+        throw std::invalid_argument("Cannot quantize a network without layers");
+    }
+    if (calibration.rows == 0) {
+        throw std::invalid_argument("Quantization needs at least one calibration sample");
+    }
+
+    QuantizedModel model;
+    Weights lowered(nn.layers);  // dropout left out, batch normalization folded into the dense layers
+    Matrix current = calibration, next;
+    for (size_t l = 0; l < lowered.size(); l++) {
+        const DenseLayer* dense = dynamic_cast<const DenseLayer*>(&lowered.layer(l));
+        if (!dense) {
+            throw std::invalid_argument("Only dense layers can be quantized, layer " + std::to_string(l) +
+                                        " is " + lowered.layer(l).describe());
+        }
+        const Matrix &w = dense->weights;
+        if (current.cols != w.rows) {
+            throw std::invalid_argument("Calibration input does not match layer " + std::to_string(l));
+        }
+
+        DenseInt8 q;
+        q.inputs = w.rows;
+        q.outputs = w.cols;
+        q.stride = roundUp(w.rows, KERNEL_WIDTH);
+        q.activation = dense->activation;
+        q.isOutputLayer = dense->isOutputLayer;
+
+        // Activation range of this layer's input over the calibration sample
+        double lo = current.data[0][0], hi = lo;
+        for (int i = 0; i < current.rows; i++) {
+            for (int j = 0; j < current.cols; j++) {
+                lo = std::min(lo, current.data[i][j]);
+                hi = std::max(hi, current.data[i][j]);
+            }
+        }
+        chooseInputRange(lo, hi, q.inputScale, q.inputZeroPoint);
+
+        // Symmetric per-output-neuron weight scales
+        q.weights.assign(static_cast<size_t>(q.outputs) * q.stride, 0);
+        q.weightScales.resize(q.outputs);
+        q.weightSums.assign(q.outputs, 0);
+        q.biases.resize(q.outputs);
+        for (int o = 0; o < q.outputs; o++) {
+            double maxAbs = 0.0;
+            for (int i = 0; i < q.inputs; i++) {
+                maxAbs = std::max(maxAbs, std::fabs(w.data[i][o]));
+            }
+            double scale = maxAbs > 0.0 ? maxAbs / QMAX : 1.0;
+            q.weightScales[o] = scale;
+            int8_t* row = &q.weights[static_cast<size_t>(o) * q.stride];
+            for (int i = 0; i < q.inputs; i++) {
+                long v = std::lround(w.data[i][o] / scale);
+                row[i] = static_cast<int8_t>(std::max(-QMAX, std::min(QMAX, static_cast<int>(v))));
+                q.weightSums[o] += row[i];
+            }
+            q.biases[o] = dense->biases.data[0][o];
+        }
+        model.layers.push_back(std::move(q));
+
+        dense->infer(current, next);
+        std::swap(current, next);
+    }
+    return model;
+}
+
+void QuantizedModel::infer(const Matrix &input, Matrix &output) const {
+    TraceScope trace("infer_int8", "quantization");
+    if (layers.empty()) {
+        throw std::logic_error("Cannot run inference on a model without layers");
+    }
+    if (input.cols != layers[0].inputs) {
+        throw std::invalid_argument("Input has " + std::to_string(input.cols) + " columns, model expects " +
+                                    std::to_string(layers[0].inputs));
+    }
+
+    DotKernel dot = dotKernel(kernel);
+    const int batch = input.rows;
+    std::vector<double> current(input.cols * static_cast<size_t>(batch)), next;
+    for (int r = 0; r < batch; r++) {
+        std::copy(input.data[r], input.data[r] + input.cols, &current[static_cast<size_t>(r) * input.cols]);
+    }
+
+    std::vector<uint8_t> quantized;
+    std::vector<double> row;
+    for (const DenseInt8 &layer : layers) {
+        // Requantize the layer input, padding stays 0 (the padding weights are 0 too)
+        quantized.assign(static_cast<size_t>(batch) * layer.stride, 0);
+        const double invScale = 1.0 / layer.inputScale;
+        for (int r = 0; r < batch; r++) {
+            const double* x = &current[static_cast<size_t>(r) * layer.inputs];
+            uint8_t* q = &quantized[static_cast<size_t>(r) * layer.stride];
+            for (int i = 0; i < layer.inputs; i++) {
+                int v = static_cast<int>(std::nearbyint(x[i] * invScale)) + layer.inputZeroPoint;
+                q[i] = static_cast<uint8_t>(std::max(0, std::min(QMAX, v)));
+            }
+        }
+
+        // int32 dot products, then back to real values
+        next.resize(static_cast<size_t>(batch) * layer.outputs);
+        row.resize(layer.outputs);
+        for (int r = 0; r < batch; r++) {
+            const uint8_t* q = &quantized[static_cast<size_t>(r) * layer.stride];
+            for (int o = 0; o < layer.outputs; o++) {
+                int32_t acc = dot(q, &layer.weights[static_cast<size_t>(o) * layer.stride], layer.stride);
+                acc -= layer.inputZeroPoint * layer.weightSums[o];
+                row[o] = layer.inputScale * layer.weightScales[o] * acc + layer.biases[o];
+            }
+            std::vector<double> activated = layer.activation->activate(row);
+            std::copy(activated.begin(), activated.end(), &next[static_cast<size_t>(r) * layer.outputs]);
+        }
+        std::swap(current, next);
+    }
+
+    const int outputs = layers.back().outputs;
+    if (output.rows != batch || output.cols != outputs) {
+        output = Matrix(batch, outputs);
+    }
+    for (int r = 0; r < batch; r++) {
+        std::copy(&current[static_cast<size_t>(r) * outputs], &current[static_cast<size_t>(r) * outputs] + outputs,
+                  output.data[r]);
+    }
+}
+
+Matrix QuantizedModel::forward(const Matrix &input) const {
+    Matrix output;
+    infer(input, output);
+    return output;
+}
+
+static int argmax(const double* values, int n) {
+    return static_cast<int>(std::max_element(values, values + n) - values);
+}
+
+QuantizationReport QuantizedModel::compare(const NeuralNetwork &reference, const QuantizedModel &quantized,
+                                           const Matrix &inputs, const std::vector<int> &labels) {
+    if (!labels.empty() && static_cast<int>(labels.size()) != inputs.rows) {
+        throw std::invalid_argument("Need one label per input row");
+    }
+
+    Matrix expected = inputs, next;
+    for (const auto &layer : reference.layers) {
+        if (layer->identityInEval()) continue;
+        layer->infer(expected, next);  // unfolded: the comparison also covers batch normalization folding
+        std::swap(expected, next);
+    }
+    Matrix actual = quantized.forward(inputs);
+    if (actual.cols != expected.cols) {
+        throw std::invalid_argument("Quantized model does not match the reference network");
+    }
+
+    QuantizationReport report;
+    report.samples = inputs.rows;
+    report.labelled = !labels.empty();
+    int referenceCorrect = 0, quantizedCorrect = 0, agree = 0;
+    double diffSum = 0.0;
+    for (int r = 0; r < inputs.rows; r++) {
+        int a = argmax(expected.data[r], expected.cols), b = argmax(actual.data[r], actual.cols);
+        agree += a == b;
+        if (!labels.empty()) {
+            referenceCorrect += a == labels[r];
+            quantizedCorrect += b == labels[r];
+        }
+        for (int c = 0; c < actual.cols; c++) {
+            double diff = std::fabs(expected.data[r][c] - actual.data[r][c]);
+            report.maxAbsDiff = std::max(report.maxAbsDiff, diff);
+            diffSum += diff;
+        }
+    }
+    if (inputs.rows > 0) {
+        report.agreement = static_cast<double>(agree) / inputs.rows;
+        report.referenceAccuracy = static_cast<double>(referenceCorrect) / inputs.rows;
+        report.quantizedAccuracy = static_cast<double>(quantizedCorrect) / inputs.rows;
+        report.meanAbsDiff = diffSum / (static_cast<double>(inputs.rows) * actual.cols);
+    }
+    for (const DenseInt8 &layer : quantized.layers) {
+        report.referenceBytes += (static_cast<size_t>(layer.inputs) + 1) * layer.outputs * sizeof(double);
+    }
+    report.quantizedBytes = quantized.parameterBytes();
+    return report;
+}
+
+void QuantizationReport::print(std::ostream &out) const {
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    out << std::fixed << std::setprecision(2);
+    out << "Quantization report (" << samples << " samples)\n";
+    if (labelled) {
+        out << "  accuracy    double " << referenceAccuracy * 100 << "%, int8 " << quantizedAccuracy * 100
+            << "%, delta " << (quantizedAccuracy - referenceAccuracy) * 100 << " points\n";
+    }
+    out << "  agreement   " << agreement * 100 << "% same top-1 class\n";
+    out << std::setprecision(6);
+    out << "  outputs     max |diff| " << maxAbsDiff << ", mean |diff| " << meanAbsDiff << "\n";
+    out << std::setprecision(2);
+    out << "  parameters  " << referenceBytes << " -> " << quantizedBytes << " bytes ("
+        << (quantizedBytes ? static_cast<double>(referenceBytes) / quantizedBytes : 0.0) << "x less)\n";
+    out.copyfmt(state);
+}
+
+// .nnq layout (little-endian, native doubles):
+//   magic "NNCPPQ8\0", version, layer count
+//   per layer: inputs, outputs, activation id, output flag, input scale, input zero point,
+//              weight scales, biases, int8 weights (outputs x inputs, unpadded)
+//   FNV-1a checksum of everything before it
+void QuantizedModel::save(const std::string &filename) const {
+    if (filename.empty()) {
+        throw std::invalid_argument("Filename cannot be empty");
+    }
+
+    std::string tmpFilename = filename + ".tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Could not create file " + tmpFilename);
+        }
+        uint64_t hash = 14695981039346656037ULL;
+        auto write = [&](const void* bytes, size_t length) {
+            file.write(static_cast<const char*>(bytes), length);
+            hash = checksum(bytes, length, hash);
+        };
+        auto writeU32 = [&](uint32_t value) { write(&value, sizeof(value)); };
+
+        write(MAGIC, sizeof(MAGIC));
+        writeU32(VERSION);
+        writeU32(static_cast<uint32_t>(layers.size()));
+        for (const DenseInt8 &layer : layers) {
+            writeU32(static_cast<uint32_t>(layer.inputs));
+            writeU32(static_cast<uint32_t>(layer.outputs));
+            writeU32(ModelFile::activationId(*layer.activation));
+            writeU32(layer.isOutputLayer ? 1 : 0);
+            write(&layer.inputScale, sizeof(double));
+            write(&layer.inputZeroPoint, sizeof(int32_t));
+            write(layer.weightScales.data(), layer.outputs * sizeof(double));
+            write(layer.biases.data(), layer.outputs * sizeof(double));
+            for (int o = 0; o < layer.outputs; o++) {
+                write(&layer.weights[static_cast<size_t>(o) * layer.stride], layer.inputs);
+            }
+        }
+        file.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        if (!file) {
+            throw std::runtime_error("Failed writing " + tmpFilename);
+        }
+    }
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        std::remove(tmpFilename.c_str());
+        throw std::runtime_error("Could not move " + tmpFilename + " to " + filename);
+    }
+}
+
+QuantizedModel QuantizedModel::load(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Could not open file " + filename);
+    }
+    uint64_t hash = 14695981039346656037ULL;
+    auto read = [&](void* bytes, size_t length) {
+        if (!file.read(static_cast<char*>(bytes), length)) {
+            throw std::runtime_error("Quantized model file is truncated: " + filename);
+        }
+        hash = checksum(bytes, length, hash);
+    };
+    auto readU32 = [&]() { uint32_t value; read(&value, sizeof(value)); return value; };
+
+    char magic[sizeof(MAGIC)];
+    read(magic, sizeof(magic));
+    if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Not a quantized model file: " + filename);
+    }
+    uint32_t version = readU32();
+    if (version != VERSION) {
+        throw std::runtime_error("Unsupported quantized model version " + std::to_string(version) + " in " + filename);
+    }
+
+    QuantizedModel model;
+    uint32_t layerCount = readU32();
+    for (uint32_t l = 0; l < layerCount; l++) {
+        DenseInt8 layer;
+        layer.inputs = static_cast<int>(readU32());
+        layer.outputs = static_cast<int>(readU32());
+        if (layer.inputs <= 0 || layer.outputs <= 0 || layer.inputs > (1 << 24) || layer.outputs > (1 << 24)) {
+            throw std::runtime_error("Invalid layer shape in " + filename);
+        }
+        if (l > 0 && layer.inputs != model.layers.back().outputs) {
+            throw std::runtime_error("Layer shapes do not chain in " + filename);
+        }
+        layer.stride = roundUp(layer.inputs, KERNEL_WIDTH);
+        layer.activation.reset(ModelFile::createActivation(readU32()));
+        layer.isOutputLayer = readU32() != 0;
+        read(&layer.inputScale, sizeof(double));
+        read(&layer.inputZeroPoint, sizeof(int32_t));
+        layer.weightScales.resize(layer.outputs);
+        layer.biases.resize(layer.outputs);
+        read(layer.weightScales.data(), layer.outputs * sizeof(double));
+        read(layer.biases.data(), layer.outputs * sizeof(double));
+        if (!(layer.inputScale > 0.0) || layer.inputZeroPoint < 0 || layer.inputZeroPoint > QMAX) {
+            throw std::runtime_error("Invalid input quantization parameters in " + filename);
+        }
+        layer.weights.assign(static_cast<size_t>(layer.outputs) * layer.stride, 0);
+        layer.weightSums.assign(layer.outputs, 0);
+        for (int o = 0; o < layer.outputs; o++) {
+            int8_t* row = &layer.weights[static_cast<size_t>(o) * layer.stride];
+            read(row, layer.inputs);
+            for (int i = 0; i < layer.inputs; i++) {
+                layer.weightSums[o] += row[i];
+            }
+        }
+        model.layers.push_back(std::move(layer));
+    }
+
+    uint64_t expected = hash, stored = 0;
+    if (!file.read(reinterpret_cast<char*>(&stored), sizeof(stored)) || stored != expected) {
+        throw std::runtime_error("Quantized model file checksum mismatch: " + filename);
+    }
+    return model;
+}
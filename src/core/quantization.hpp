@@ -0,0 +1,94 @@
+#ifndef QUANTIZATION_HPP
+#define QUANTIZATION_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "neural_network.hpp"
+#include "../math/matrix.hpp"
+#include "../activations/activation_function.hpp"
+
+// Inner product kernels of the int8 layers, picked at runtime from what the CPU supports
+enum class Int8Kernel { Scalar, Avx2, Avx512Vnni };
+
+// Accuracy of a QuantizedModel against the double model it was made from (see QuantizedModel::compare)
+struct QuantizationReport {
+    int samples = 0;
+    bool labelled = false;           // accuracies are only measured when labels were given
+    double referenceAccuracy = 0.0;  // fraction of labels the double model gets right
+    double quantizedAccuracy = 0.0;
+    double agreement = 0.0;          // fraction of samples where both models predict the same class
+    double maxAbsDiff = 0.0;         // over all outputs
+    double meanAbsDiff = 0.0;
+    size_t referenceBytes = 0;       // parameter bytes read per forward pass
+    size_t quantizedBytes = 0;
+
+    void print(std::ostream &out) const;
+};
+
+// Post-training int8 version of a trained dense network, for serving.
+//
+//   Matrix sample = ...;                                   // a few hundred training images
+//   QuantizedModel q = QuantizedModel::quantize(nn, sample);
+//   QuantizedModel::compare(nn, q, testImages, testLabels).print(std::cout);
+//   q.save("model.nnq");
+//
+// Weights get one symmetric scale per output neuron (int8 in [-127, 127]). Layer inputs are
+// quantized asymmetrically to [0, 127] with a scale and zero point chosen from the ranges seen
+// on the calibration sample, values outside the range are clamped. A layer multiplies in int8
+// with int32 accumulation, rescales to double, adds the bias and applies its activation, the
+// next layer requantizes. 7 bit inputs keep the pairwise sums of vpmaddubsw from saturating.
+class QuantizedModel {
+public:
+    struct DenseInt8 {
+        int inputs = 0, outputs = 0;
+        int stride = 0;                     // inputs rounded up to the kernel width, padding weights are 0
+        double inputScale = 1.0;            // real input = inputScale * (q - inputZeroPoint)
+        int32_t inputZeroPoint = 0;
+        std::vector<int8_t> weights;        // outputs x stride, one row per output neuron (transposed)
+        std::vector<double> weightScales;   // per output neuron
+        std::vector<int32_t> weightSums;    // per output neuron, for the zero point correction
+        std::vector<double> biases;
+        std::shared_ptr<ActivationFunction> activation;
+        bool isOutputLayer = false;
+    };
+
+    static const uint32_t VERSION = 1;
+    static constexpr int32_t QMAX = 127;  // quantized inputs are in [0, QMAX], weights in [-QMAX, QMAX]
+
+    // Sum of a[i] * b[i] over n bytes, n is a multiple of 64 and a[i] <= QMAX. Exposed for code that
+    // runs DenseInt8 layers on its own buffers (CompiledModel).
+    typedef int32_t (*DotKernel)(const uint8_t* a, const int8_t* b, int n);
+    static DotKernel dotKernel(Int8Kernel kernel);
+
+    // Every layer of nn must be a DenseLayer, calibration rows are representative inputs
+    static QuantizedModel quantize(const NeuralNetwork &nn, const Matrix &calibration);
+
+    static QuantizationReport compare(const NeuralNetwork &reference, const QuantizedModel &quantized,
+                                      const Matrix &inputs, const std::vector<int> &labels);
+
+    // Each row of input is one sample, output is resized as needed. Thread safe.
+    void infer(const Matrix &input, Matrix &output) const;
+    Matrix forward(const Matrix &input) const;
+
+    void save(const std::string &filename) const;
+    static QuantizedModel load(const std::string &filename);
+
+    // Uses the fastest kernel the CPU supports unless told otherwise, throws if kernel is unsupported
+    void setKernel(Int8Kernel kernel);
+    Int8Kernel getKernel() const;
+    static Int8Kernel bestKernel();
+    static bool supported(Int8Kernel kernel);
+    static const char* kernelName(Int8Kernel kernel);
+
+    size_t parameterBytes() const;
+    const std::vector<DenseInt8>& getLayers() const;
+
+private:
+    std::vector<DenseInt8> layers;
+    Int8Kernel kernel = bestKernel();
+};
+
+#endif  // QUANTIZATION_HPP
@@ -0,0 +1,357 @@
+#include "sweep_runner.hpp"
+#include "../layers/dense_layer.hpp"
+#include "../activations/activations.hpp"
+#include "../math/sparse_matrix.hpp"
+#include "../utils/thread_pool.hpp"
+#include "../utils/trace.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+std::string SweepConfig::name() const {
+    std::ostringstream text;
+    text << activation << " ";
+    for (size_t i = 0; i < hidden.size(); i++) text << (i ? "x" : "") << hidden[i];
+    text << " lr=" << learningRate;
+    return text.str();
+}
+
+std::unique_ptr<NeuralNetwork> SweepConfig::build(int inputs, int classes) const {
+    if (activation != "sigmoid" && activation != "relu") {
+        throw std::invalid_argument("Unknown sweep activation: " + activation);
+    }
+    auto nn = std::make_unique<NeuralNetwork>();
+    int previous = inputs;
+    for (int size : hidden) {
+        if (size <= 0) throw std::invalid_argument("Hidden layer sizes must be positive");
+        ActivationFunction* function = activation == "relu" ? static_cast<ActivationFunction*>(new activations::ReLU())
+                                                             : new activations::Sigmoid();
+        nn->addLayer(std::make_unique<DenseLayer>(previous, size, function));
+        previous = size;
+    }
+    nn->addLayer(std::make_unique<DenseLayer>(previous, classes, new activations::Softmax(), true));
+    return nn;
+}
+
+std::vector<SweepConfig> SweepConfig::grid(const std::vector<double> &learningRates,
+                                           const std::vector<std::vector<int>> &hidden,
+                                           const std::vector<std::string> &activations) {
+    std::vector<SweepConfig> configs;
+    for (const std::string &activation : activations) {
+        for (const std::vector<int> &sizes : hidden) {
+            for (double learningRate : learningRates) {
+                SweepConfig config;
+                config.learningRate = learningRate;
+                config.hidden = sizes;
+                config.activation = activation;
+                configs.push_back(config);
+            }
+        }
+    }
+    return configs;
+}
+
+void SweepRunner::add(const SweepConfig &config) {
+    add(config.name(), config.build(), config.learningRate);
+}
+
+void SweepRunner::add(const std::string &name, std::unique_ptr<NeuralNetwork> nn, double learningRate) {
+    if (!nn || nn->layers.empty()) {
+        throw std::invalid_argument("Sweep models need at least one layer");
+    }
+    Model model;
+    model.name = name;
+    model.nn = std::move(nn);
+    model.learningRate = learningRate;
+    models.push_back(std::move(model));
+}
+
+NeuralNetwork& SweepRunner::model(const std::string &name) {
+    for (Model &model : models) {
+        if (model.name == name) return *model.nn;
+    }
+    throw std::out_of_range("No sweep model named " + name);
+}
+
+namespace {
+
+// First dense layers of several models, run as one GEMM over their weights side by side
+struct FusedLayer {
+    std::vector<int> members;  // model indices
+    std::vector<int> offsets;  // first column of each member
+    Matrix weights;            // (inputs, total outputs) = [W1 | W2 | ...]
+    Matrix preActivations;     // X * weights
+    Matrix deltas;             // [D1 | D2 | ...], filled by the members
+    Matrix gradients;          // X^T * deltas
+};
+
+// A first layer that can join the shared GEMM: plain double dense training, more layers behind it
+DenseLayer* fusableLayer(NeuralNetwork &nn) {
+    if (nn.mixedPrecision || nn.layers.size() < 2) return nullptr;
+    DenseLayer* dense = dynamic_cast<DenseLayer*>(nn.layers[0].get());
+    if (!dense || dense->isOutputLayer || dense->sparseWeights) return nullptr;
+    return dense;
+}
+
+double trainingCost(const NeuralNetwork &nn) {
+    const Matrix none;
+    double flops = 0.0;
+    for (const auto &layer : nn.layers) flops += layer->cost(LayerPhase::Update, none).flops;
+    return flops;
+}
+
+// Activation of one model's columns of the shared product: output = f(preActivations[:, offset..] + biases)
+void activateColumns(const DenseLayer &layer, const Matrix &preActivations, int offset, Matrix &output) {
+    const int width = layer.weights.cols;
+    if (output.rows != preActivations.rows || output.cols != width) output = Matrix(preActivations.rows, width);
+    std::vector<double> row(width);
+    for (int r = 0; r < preActivations.rows; r++) {
+        for (int c = 0; c < width; c++) row[c] = preActivations.data[r][offset + c] + layer.biases.data[0][c];
+        std::vector<double> activated = layer.activation->activate(row);
+        std::copy(activated.begin(), activated.end(), output.data[r]);
+    }
+}
+
+// Shared first-layer product, on the sparse kernel for mostly-zero inputs as DenseLayer::infer does
+void multiplyInputs(const DenseLayer &first, const Matrix &inputs, const Matrix &weights, Matrix &out) {
+    if (first.sparseInputThreshold > 0.0 &&
+        SparseMatrix::densityOf(inputs, first.sparseInputThreshold) < first.sparseInputThreshold) {
+        thread_local SparseMatrix sparseInput;
+        sparseInput.assign(inputs);
+        sparseInput.multiply(weights, out);
+    } else {
+        out = inputs * weights;
+    }
+}
+
+// Eval mode accuracy of layers [first, end) on inputs (what layer first - 1 produced)
+double accuracy(const NeuralNetwork &nn, size_t first, const Matrix &inputs, const std::vector<int> &labels) {
+    Matrix buffers[2];
+    const Matrix* curr = &inputs;
+    for (size_t i = first; i < nn.layers.size(); i++) {
+        if (nn.layers[i]->identityInEval()) continue;
+        Matrix &out = buffers[i % 2];
+        nn.layers[i]->infer(*curr, out);
+        curr = &out;
+    }
+    int correct = 0;
+    for (int r = 0; r < curr->rows; r++) {
+        correct += std::max_element(curr->data[r], curr->data[r] + curr->cols) - curr->data[r] == labels[r];
+    }
+    return curr->rows ? static_cast<double>(correct) / curr->rows : 0.0;
+}
+
+}  // namespace
+
+std::vector<SweepResult> SweepRunner::run(DataLoader &loader, const Matrix &validationInputs,
+                                          const std::vector<int> &validationLabels, const SweepOptions &options) {
+    if (validationInputs.rows != static_cast<int>(validationLabels.size())) {
+        throw std::invalid_argument("Number of validation inputs must match number of labels");
+    }
+    if (options.steps <= 0 || options.evalInterval <= 0) {
+        throw std::invalid_argument("Sweep steps and evaluation interval must be positive");
+    }
+    TraceScope trace("sweep", "train", "models", models.size());
+    ThreadPool pool(options.threads, options.pin);
+
+    for (Model &model : models) {
+        model.result = SweepResult();
+        model.result.name = model.name;
+        model.result.learningRate = model.learningRate;
+        model.lossSum = 0.0;
+        model.lossSteps = 0;
+    }
+
+    // Active models, most expensive first so the pool does not end on a large straggler
+    std::vector<int> active(models.size());
+    for (size_t i = 0; i < models.size(); i++) active[i] = static_cast<int>(i);
+    std::stable_sort(active.begin(), active.end(), [&](int a, int b) {
+        return trainingCost(*models[a].nn) > trainingCost(*models[b].nn);
+    });
+
+    FusedLayer fused;
+    std::vector<int> slot(models.size(), -1);  // member index in fused, -1 when trained on its own
+    auto buildFusedLayer = [&] {
+        fused = FusedLayer();
+        std::fill(slot.begin(), slot.end(), -1);
+        if (!options.fuseGemms) return;
+        for (int index : active) {
+            DenseLayer* first = fusableLayer(*models[index].nn);
+            if (first && first->weights.rows == validationInputs.cols) fused.members.push_back(index);
+        }
+        if (fused.members.size() < 2) {  // nothing to share
+            fused.members.clear();
+            return;
+        }
+        int total = 0;
+        for (int index : fused.members) {
+            fused.offsets.push_back(total);
+            total += static_cast<DenseLayer*>(models[index].nn->layers[0].get())->weights.cols;
+        }
+        fused.weights = Matrix(validationInputs.cols, total);
+        for (size_t m = 0; m < fused.members.size(); m++) {
+            const Matrix &weights = static_cast<DenseLayer*>(models[fused.members[m]].nn->layers[0].get())->weights;
+            for (int r = 0; r < weights.rows; r++) {
+                std::copy(weights.data[r], weights.data[r] + weights.cols, fused.weights.data[r] + fused.offsets[m]);
+            }
+            slot[fused.members[m]] = static_cast<int>(m);
+            models[fused.members[m]].result.fused = true;
+        }
+    };
+    buildFusedLayer();
+
+    int checks = 0;
+    for (int step = 0; step < options.steps && !active.empty(); step++) {
+        const Batch &batch = loader.next();
+        if (batch.inputs.cols != validationInputs.cols) {
+            throw std::invalid_argument("Training and validation samples differ in size");
+        }
+
+        // One product for every fused first layer
+        if (!fused.members.empty()) {
+            TraceScope layerTrace("fused_forward", "layer", "models", fused.members.size());
+            multiplyInputs(*static_cast<DenseLayer*>(models[fused.members[0]].nn->layers[0].get()), batch.inputs,
+                           fused.weights, fused.preActivations);
+            if (fused.deltas.rows != batch.size || fused.deltas.cols != fused.weights.cols) {
+                fused.deltas = Matrix(batch.size, fused.weights.cols);
+            }
+        }
+
+        pool.parallelFor(static_cast<int>(active.size()), [&](int task) {
+            Model &model = models[active[task]];
+            const int member = slot[active[task]];
+            if (member < 0) {
+                model.lossSum += model.nn->train_step(batch.inputs, batch.labels, model.learningRate);
+            } else {
+                // Activation of this model's columns, then the rest of the network as train_step would
+                DenseLayer &first = *static_cast<DenseLayer*>(model.nn->layers[0].get());
+                const int offset = fused.offsets[member], width = first.weights.cols;
+                activateColumns(first, fused.preActivations, offset, first.output);
+                Matrix d_output;
+                model.lossSum += model.nn->train_step_from(1, first.output, batch.labels, model.learningRate, &d_output);
+
+                // delta = d_output * activation'(output) into this model's columns, bias update on the spot
+                std::vector<double> row(width);
+                for (int r = 0; r < batch.size; r++) {
+                    std::copy(first.output.data[r], first.output.data[r] + width, row.begin());
+                    std::vector<double> derivative = first.activation->derivative(row);
+                    for (int c = 0; c < width; c++) fused.deltas.data[r][offset + c] = d_output.data[r][c] * derivative[c];
+                }
+                for (int c = 0; c < width; c++) {
+                    double sum = 0.0;
+                    for (int r = 0; r < batch.size; r++) sum += fused.deltas.data[r][offset + c];
+                    first.biases.data[0][c] -= model.learningRate * sum;
+                }
+            }
+            model.lossSteps++;
+            model.result.steps++;
+        });
+
+        // One weight gradient product for every fused first layer, then each model updates its columns
+        if (!fused.members.empty()) {
+            TraceScope layerTrace("fused_backward", "layer", "models", fused.members.size());
+            Matrix inputs = batch.inputs;
+            fused.gradients = inputs.transpose() * fused.deltas;
+            pool.parallelFor(static_cast<int>(fused.members.size()), [&](int member) {
+                Model &model = models[fused.members[member]];
+                Matrix &weights = static_cast<DenseLayer*>(model.nn->layers[0].get())->weights;
+                const int offset = fused.offsets[member];
+                for (int r = 0; r < weights.rows; r++) {
+                    const double* gradient = fused.gradients.data[r] + offset;
+                    double* shared = fused.weights.data[r] + offset;
+                    for (int c = 0; c < weights.cols; c++) {
+                        weights.data[r][c] -= model.learningRate * gradient[c];
+                        shared[c] = weights.data[r][c];
+                    }
+                }
+            });
+        }
+
+        if ((step + 1) % options.evalInterval != 0 && step + 1 != options.steps) continue;
+
+        // Validation check (fused first layers again in one product), then the models trailing the
+        // best one by more than the margin stop
+        Matrix validationProduct;
+        if (!fused.members.empty()) {
+            multiplyInputs(*static_cast<DenseLayer*>(models[fused.members[0]].nn->layers[0].get()), validationInputs,
+                           fused.weights, validationProduct);
+        }
+        pool.parallelFor(static_cast<int>(active.size()), [&](int task) {
+            Model &model = models[active[task]];
+            const int member = slot[active[task]];
+            if (member < 0) {
+                model.result.accuracy = accuracy(*model.nn, 0, validationInputs, validationLabels);
+            } else {
+                Matrix hidden;
+                activateColumns(*static_cast<DenseLayer*>(model.nn->layers[0].get()), validationProduct,
+                                fused.offsets[member], hidden);
+                model.result.accuracy = accuracy(*model.nn, 1, hidden, validationLabels);
+            }
+            model.result.bestAccuracy = std::max(model.result.bestAccuracy, model.result.accuracy);
+            model.result.loss = model.lossSteps ? model.lossSum / model.lossSteps : 0.0;
+            model.lossSum = 0.0;
+            model.lossSteps = 0;
+        });
+        checks++;
+        double best = 0.0;
+        for (int index : active) best = std::max(best, models[index].result.accuracy);
+        const size_t before = active.size();
+        if (checks > options.graceEvaluations) {
+            active.erase(std::remove_if(active.begin(), active.end(), [&](int index) {
+                models[index].result.stopped = models[index].result.accuracy < best - options.stopMargin;
+                return models[index].result.stopped;
+            }), active.end());
+        }
+        if (options.log) {
+            std::ios state(nullptr);
+            state.copyfmt(*options.log);
+            *options.log << "step " << step + 1 << ": best validation accuracy " << std::fixed << std::setprecision(4)
+                         << best << ", " << active.size() << " of " << models.size() << " models training";
+            if (active.size() < before) *options.log << " (stopped " << before - active.size() << ")";
+            *options.log << std::endl;
+            options.log->copyfmt(state);
+        }
+        if (active.size() < before) buildFusedLayer();
+    }
+
+    std::vector<SweepResult> results;
+    for (const Model &model : models) results.push_back(model.result);
+    std::stable_sort(results.begin(), results.end(), [](const SweepResult &a, const SweepResult &b) {
+        return a.bestAccuracy > b.bestAccuracy;
+    });
+    return results;
+}
+
+void SweepRunner::writeTable(const std::vector<SweepResult> &results, std::ostream &out) {
+    size_t nameWidth = 5;
+    for (const SweepResult &result : results) nameWidth = std::max(nameWidth, result.name.size());
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    out << std::left << std::setw(static_cast<int>(nameWidth) + 2) << "model" << std::right
+        << std::setw(10) << "accuracy" << std::setw(10) << "best" << std::setw(10) << "loss"
+        << std::setw(8) << "steps" << std::setw(10) << "status" << std::setw(7) << "fused" << "\n";
+    for (const SweepResult &result : results) {
+        out << std::left << std::setw(static_cast<int>(nameWidth) + 2) << result.name << std::right << std::fixed
+            << std::setprecision(4) << std::setw(10) << result.accuracy << std::setw(10) << result.bestAccuracy
+            << std::setw(10) << result.loss << std::setw(8) << result.steps
+            << std::setw(10) << (result.stopped ? "stopped" : "done") << std::setw(7) << (result.fused ? "yes" : "no")
+            << "\n";
+    }
+    out.copyfmt(state);
+}
+
+void SweepRunner::saveCsv(const std::vector<SweepResult> &results, const std::string &filename) {
+    std::ofstream file(filename);
+    if (!file) {
+        std::cerr << "Error: Could not create file " << filename << std::endl;
+        throw std::runtime_error("Could not create sweep results file: " + filename);
+    }
+    file << "model,learning_rate,accuracy,best_accuracy,loss,steps,stopped,fused\n";
+    for (const SweepResult &result : results) {
+        file << "\"" << result.name << "\"," << result.learningRate << "," << result.accuracy << ","
+             << result.bestAccuracy << "," << result.loss << "," << result.steps << ","
+             << (result.stopped ? 1 : 0) << "," << (result.fused ? 1 : 0) << "\n";
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef SWEEP_RUNNER_HPP
+#define SWEEP_RUNNER_HPP
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "neural_network.hpp"
+#include "../math/numa.hpp"
+#include "../utils/data_loader.hpp"
+
+// One point of a hyperparameter grid over the main.cpp MNIST recipe
+struct SweepConfig {
+    double learningRate = 0.1;
+    std::vector<int> hidden = {16, 16};  // hidden layer sizes
+    std::string activation = "sigmoid";  // of the hidden layers: "sigmoid" or "relu"
+
+    std::string name() const;  // e.g. "sigmoid 16x16 lr=0.1"
+    // inputs -> hidden... -> classes (softmax), weights from the global Random streams
+    std::unique_ptr<NeuralNetwork> build(int inputs = 784, int classes = 10) const;
+
+    // Every combination, learning rate varying fastest
+    static std::vector<SweepConfig> grid(const std::vector<double> &learningRates,
+                                         const std::vector<std::vector<int>> &hidden,
+                                         const std::vector<std::string> &activations);
+};
+
+struct SweepOptions {
+    int steps = 1000;             // batches every model trains on, unless stopped
+    int evalInterval = 200;       // steps between validation checks (also after the last step)
+    int graceEvaluations = 1;     // checks before a model can be stopped
+    double stopMargin = 0.05;     // stop a model whose accuracy is this far below the best one
+    int threads = 0;              // pool size, 0: the hardware threads
+    PinMode pin = PinMode::None;  // placement of the pool workers
+    bool fuseGemms = true;        // one first-layer GEMM for all models, see SweepRunner
+    std::ostream* log = nullptr;  // one line per validation check
+};
+
+struct SweepResult {
+    std::string name;
+    double learningRate = 0.0;
+    double accuracy = 0.0;      // validation accuracy at the last check
+    double bestAccuracy = 0.0;  // best of all checks
+    double loss = 0.0;          // mean training loss since the previous check
+    int steps = 0;              // steps trained
+    bool stopped = false;       // stopped early for trailing the best model
+    bool fused = false;         // the first layer ran in the shared GEMM
+};
+
+// Trains K networks at once in one process, e.g. a hyperparameter sweep:
+//
+//   SweepRunner sweep;
+//   for (const SweepConfig &config : SweepConfig::grid({0.05, 0.1, 0.5}, {{16, 16}, {64}}, {"sigmoid", "relu"})) {
+//       sweep.add(config);
+//   }
+//   std::vector<SweepResult> results = sweep.run(loader, validationImages, validationLabels, options);
+//   SweepRunner::writeTable(results, std::cout);
+//
+// Every step takes one batch from the shared DataLoader and trains all active models on it, the
+// models spread over a ThreadPool. Since the models see the same inputs, the first dense layers
+// of all of them (same input size, plain double training) run as one product against their
+// weights concatenated side by side, X * [W1 | W2 | ...], and their weight gradients as one
+// X^T * [D1 | D2 | ...], instead of K narrow GEMMs that each stream X again. The rest of every
+// network trains on its own worker exactly like NeuralNetwork::train_step.
+//
+// Every evalInterval steps all models are scored on the validation set; after graceEvaluations
+// checks a model more than stopMargin below the best accuracy stops training.
+class SweepRunner {
+public:
+    void add(const SweepConfig &config);
+    void add(const std::string &name, std::unique_ptr<NeuralNetwork> nn, double learningRate);
+
+    int size() const { return static_cast<int>(models.size()); }
+    NeuralNetwork& model(int index) { return *models[index].nn; }
+    NeuralNetwork& model(const std::string &name);  // throws std::out_of_range
+
+    // Results sorted by best validation accuracy
+    std::vector<SweepResult> run(DataLoader &loader, const Matrix &validationInputs,
+                                 const std::vector<int> &validationLabels, const SweepOptions &options = SweepOptions());
+
+    static void writeTable(const std::vector<SweepResult> &results, std::ostream &out);
+    static void saveCsv(const std::vector<SweepResult> &results, const std::string &filename);
+
+private:
+    struct Model {
+        std::string name;
+        std::unique_ptr<NeuralNetwork> nn;
+        double learningRate;
+        SweepResult result;
+        double lossSum = 0.0;  // since the last check
+        int lossSteps = 0;
+    };
+    std::vector<Model> models;
+};
+
+#endif  // SWEEP_RUNNER_HPP
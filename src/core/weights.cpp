@@ -0,0 +1,42 @@
+#include "weights.hpp"
+#include "../layers/batch_norm_layer.hpp"
+
+Weights::Weights(const std::vector<std::unique_ptr<Layer>> &source) {
+    std::vector<std::unique_ptr<Layer>> copies;
+    copies.reserve(source.size());
+    for (const auto& layer : source) {
+        if (layer->identityInEval()) continue;  // e.g. dropout, inference never runs it
+        copies.push_back(layer->clone());
+    }
+    layers = lower(std::move(copies));
+}
+
+Weights::Weights(std::vector<std::unique_ptr<Layer>> &&layers, std::shared_ptr<const void> mappedStorage)
+    : layers(lower(std::move(layers))), mappedStorage(std::move(mappedStorage)) {}
+
+std::vector<std::unique_ptr<Layer>> Weights::lower(std::vector<std::unique_ptr<Layer>> source,
+                                                   std::vector<std::string>* sources) {
+    std::vector<std::unique_ptr<Layer>> lowered;
+    lowered.reserve(source.size());
+    if (sources) sources->clear();
+    for (auto& layer : source) {
+        if (layer->identityInEval()) continue;
+        auto* norm = dynamic_cast<const BatchNormLayer*>(layer.get());
+        if (norm && !lowered.empty() && norm->canFold(*lowered.back())) {
+            lowered.back() = norm->foldInto(static_cast<const DenseLayer&>(*lowered.back()));
+            if (sources) sources->back() += " + " + norm->describe();
+            continue;
+        }
+        if (sources) sources->push_back(layer->describe());
+        lowered.push_back(std::move(layer));
+    }
+    return lowered;
+}
+
+const Layer& Weights::layer(size_t i) const {
+    return *layers.at(i);
+}
+
+size_t Weights::size() const {
+    return layers.size();
+}
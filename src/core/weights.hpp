@@ -0,0 +1,34 @@
+#ifndef WEIGHTS_HPP
+#define WEIGHTS_HPP
+
+#include <vector>
+#include <memory>
+#include <string>
+#include "../layers/layer.hpp"
+
+// Immutable snapshot of a network's parameters.
+// Meant to be held through std::shared_ptr<const Weights> so any number of threads
+// can run inference on one copy of the model, each with its own InferenceContext.
+// Layers that are the identity at inference (dropout) are left out and batch normalization is folded
+// into the dense layer in front of it where possible (see lower()).
+class Weights {
+private:
+    std::vector<std::unique_ptr<Layer>> layers;
+    std::shared_ptr<const void> mappedStorage; // keeps a memory mapped model file alive (see ModelFile)
+public:
+    // Deep copies the parameters, later training of the source network does not affect the snapshot
+    explicit Weights(const std::vector<std::unique_ptr<Layer>> &source);
+    // Takes the layers as they are, e.g. views into a mapped file that mappedStorage keeps alive
+    Weights(std::vector<std::unique_ptr<Layer>> &&layers, std::shared_ptr<const void> mappedStorage);
+
+    // The layers as inference runs them: identityInEval layers dropped, every BatchNormLayer that
+    // follows a linear DenseLayer folded into its weights and biases. sources, when given, gets the
+    // describe() of the layers behind each result, e.g. "Dense 784x128 + BatchNorm 128".
+    static std::vector<std::unique_ptr<Layer>> lower(std::vector<std::unique_ptr<Layer>> layers,
+                                                     std::vector<std::string>* sources = nullptr);
+
+    const Layer& layer(size_t i) const;
+    size_t size() const;
+};
+
+#endif  // WEIGHTS_HPP
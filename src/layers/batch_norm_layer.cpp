@@ -0,0 +1,295 @@
+#include "batch_norm_layer.hpp"
+#include "../activations/linear_function.hpp"
+#include "../activations/softmax_function.hpp"
+#include "../core/profiler.hpp"
+#include "../utils/trace.hpp"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+BatchNormLayer::BatchNormLayer(int features) : BatchNormLayer(features, new LinearFunction(), false) {}
+
+BatchNormLayer::BatchNormLayer(int features, ActivationFunction* activationFunc, bool isOutputLayer)
+    : Layer(activationFunc, isOutputLayer), gamma(1, features), beta(1, features),
+      runningMean(1, features), runningVar(1, features) {
+    if (features <= 0) {
+        throw std::invalid_argument("Batch normalization needs at least one feature");
+    }
+    gamma.fill(1.0);
+    beta.fill(0.0);
+    runningMean.fill(0.0);
+    runningVar.fill(1.0);
+}
+
+BatchNormLayer::BatchNormLayer(Matrix gamma, Matrix beta, Matrix runningMean, Matrix runningVar,
+                               ActivationFunction* activationFunc, bool isOutputLayer)
+    : Layer(activationFunc, isOutputLayer), gamma(std::move(gamma)), beta(std::move(beta)),
+      runningMean(std::move(runningMean)), runningVar(std::move(runningVar)) {
+    checkShapes();
+}
+
+void BatchNormLayer::checkShapes() const {
+    const int n = gamma.cols;
+    if (gamma.rows != 1 || beta.rows != 1 || runningMean.rows != 1 || runningVar.rows != 1 ||
+        beta.cols != n || runningMean.cols != n || runningVar.cols != n || n <= 0) {
+        throw std::invalid_argument("Batch normalization parameters must be (1, features) rows of one width");
+    }
+}
+
+void BatchNormLayer::applyActivation(Matrix &values) const {
+    if (typeid(*activation) == typeid(SoftmaxFunction) && !isOutputLayer) {
+        throw std::logic_error("SoftmaxFunction can only be used in the output layer");
+    }
+    if (typeid(*activation) == typeid(LinearFunction)) return;
+    values = values.applyFunction([this](std::vector<double> &x) { return activation->activate(x); });
+}
+
+void BatchNormLayer::forward(const Matrix &input) {
+    const int n = input.rows, f = features();
+    if (input.cols != f) {
+        throw std::invalid_argument("Input width does not match the batch normalization features");
+    }
+    if (normalized.rows != n || normalized.cols != f) normalized = Matrix(n, f);
+    if (output.rows != n || output.cols != f || output.isView()) output = Matrix(n, f);
+    invStd.assign(f, 0.0);
+
+    std::vector<double> mean(f, 0.0);
+    batchStatistics = training;
+    if (batchStatistics) {
+        if (n < 2) {
+            throw std::invalid_argument("Batch normalization needs at least 2 samples per batch in training mode");
+        }
+        // Welford, one row at a time: every step is the same update across all features
+        std::vector<double> m2(f, 0.0);
+        for (int r = 0; r < n; r++) {
+            const double* x = input.data[r];
+            const double weight = 1.0 / (r + 1);
+            for (int j = 0; j < f; j++) {
+                const double delta = x[j] - mean[j];
+                mean[j] += delta * weight;
+                m2[j] += delta * (x[j] - mean[j]);
+            }
+        }
+        // Normalize with the biased variance, track the unbiased one
+        double* rm = runningMean.data[0];
+        double* rv = runningVar.data[0];
+        for (int j = 0; j < f; j++) {
+            invStd[j] = 1.0 / std::sqrt(m2[j] / n + epsilon);
+            rm[j] = momentum * rm[j] + (1.0 - momentum) * mean[j];
+            rv[j] = momentum * rv[j] + (1.0 - momentum) * m2[j] / (n - 1);
+        }
+    } else {
+        for (int j = 0; j < f; j++) {
+            mean[j] = runningMean.data[0][j];
+            invStd[j] = 1.0 / std::sqrt(runningVar.data[0][j] + epsilon);
+        }
+    }
+
+    const double* g = gamma.data[0];
+    const double* b = beta.data[0];
+    for (int r = 0; r < n; r++) {
+        const double* x = input.data[r];
+        double* xhat = normalized.data[r];
+        double* y = output.data[r];
+        for (int j = 0; j < f; j++) {
+            xhat[j] = (x[j] - mean[j]) * invStd[j];
+            y[j] = xhat[j] * g[j] + b[j];
+        }
+    }
+    applyActivation(output);
+}
+
+// With batch statistics the mean and variance depend on every sample, which gives the usual
+// d_x = gamma * invStd / N * (N * d_y - sum(d_y) - x_hat * sum(d_y * x_hat)); with running
+// statistics the layer is affine and d_x = d_y * gamma * invStd.
+Matrix BatchNormLayer::backward(Matrix &d_output, double learning_rate) {
+    const int n = normalized.rows, f = features();
+    if (d_output.rows != n || d_output.cols != f) {
+        throw std::invalid_argument("Gradient shape does not match the last batch normalization forward pass");
+    }
+
+    const double* g = gamma.data[0];
+    Matrix delta;
+    if (isOutputLayer || typeid(*activation) == typeid(LinearFunction)) {
+        delta = d_output;
+    } else {
+        // The activation derivatives take the pre-activation, gamma * x_hat + beta
+        Matrix preActivation(n, f);
+        for (int r = 0; r < n; r++) {
+            for (int j = 0; j < f; j++) preActivation.data[r][j] = normalized.data[r][j] * g[j] + beta.data[0][j];
+        }
+        Matrix d_activation = preActivation.applyFunction([this](std::vector<double> x) { return activation->derivative(x); });
+        delta = d_output.elementWiseMultiply(d_activation);
+    }
+
+    std::vector<double> d_gamma(f, 0.0), d_beta(f, 0.0);
+    for (int r = 0; r < n; r++) {
+        const double* d = delta.data[r];
+        const double* xhat = normalized.data[r];
+        for (int j = 0; j < f; j++) {
+            d_gamma[j] += d[j] * xhat[j];
+            d_beta[j] += d[j];
+        }
+    }
+
+    Matrix d_input(n, f);
+    for (int r = 0; r < n; r++) {
+        const double* d = delta.data[r];
+        const double* xhat = normalized.data[r];
+        double* dx = d_input.data[r];
+        if (batchStatistics) {
+            for (int j = 0; j < f; j++) {
+                dx[j] = g[j] * invStd[j] / n * (n * d[j] - d_beta[j] - xhat[j] * d_gamma[j]);
+            }
+        } else {
+            for (int j = 0; j < f; j++) dx[j] = d[j] * g[j] * invStd[j];
+        }
+    }
+
+    {
+        TraceScope trace("update", "layer");
+        ProfileScope profile(this, LayerPhase::Update, normalized);
+        double* gm = gamma.data[0];
+        double* bt = beta.data[0];
+        for (int j = 0; j < f; j++) {
+            gm[j] -= learning_rate * d_gamma[j];
+            bt[j] -= learning_rate * d_beta[j];
+        }
+    }
+    return d_input;
+}
+
+void BatchNormLayer::affine(std::vector<double> &scale, std::vector<double> &shift) const {
+    const int f = features();
+    scale.resize(f);
+    shift.resize(f);
+    for (int j = 0; j < f; j++) {
+        scale[j] = gamma.data[0][j] / std::sqrt(runningVar.data[0][j] + epsilon);
+        shift[j] = beta.data[0][j] - runningMean.data[0][j] * scale[j];
+    }
+}
+
+void BatchNormLayer::infer(const Matrix &input, Matrix &output) const {
+    const int n = input.rows, f = features();
+    if (input.cols != f) {
+        throw std::invalid_argument("Input width does not match the batch normalization features");
+    }
+    if (output.rows != n || output.cols != f || output.isView()) output = Matrix(n, f);
+    std::vector<double> scale, shift;
+    affine(scale, shift);
+    for (int r = 0; r < n; r++) {
+        const double* x = input.data[r];
+        double* y = output.data[r];
+        for (int j = 0; j < f; j++) y[j] = x[j] * scale[j] + shift[j];
+    }
+    applyActivation(output);
+}
+
+bool BatchNormLayer::canFold(const Layer &previous) const {
+    const DenseLayer* dense = dynamic_cast<const DenseLayer*>(&previous);
+    return dense && !dense->isOutputLayer && dense->activation &&
+           typeid(*dense->activation) == typeid(LinearFunction) && dense->weights.cols == features();
+}
+
+std::unique_ptr<DenseLayer> BatchNormLayer::foldInto(const DenseLayer &dense) const {
+    if (!canFold(dense)) {
+        throw std::invalid_argument("Batch normalization can only be folded into a linear dense layer of its width");
+    }
+    std::vector<double> scale, shift;
+    affine(scale, shift);
+    const int in = dense.weights.rows, f = features();
+    Matrix weights(in, f), biases(1, f);
+    for (int i = 0; i < in; i++) {
+        for (int j = 0; j < f; j++) weights.data[i][j] = dense.weights.data[i][j] * scale[j];
+    }
+    for (int j = 0; j < f; j++) biases.data[0][j] = dense.biases.data[0][j] * scale[j] + shift[j];
+
+    auto folded = std::make_unique<DenseLayer>(std::move(weights), std::move(biases), nullptr, isOutputLayer);
+    folded->activation = activation;  // shared with this layer
+    folded->sparseInputThreshold = dense.sparseInputThreshold;
+    if (dense.sparseWeights) {
+        folded->sparseWeights = std::make_shared<const SparseMatrix>(SparseMatrix::fromDense(folded->weights));
+    }
+    return folded;
+}
+
+std::unique_ptr<Layer> BatchNormLayer::clone() const {
+    return std::make_unique<BatchNormLayer>(*this);
+}
+
+std::string BatchNormLayer::describe() const {
+    std::ostringstream description;
+    description << "BatchNorm " << features();
+    return description.str();
+}
+
+OpCost BatchNormLayer::cost(LayerPhase phase, const Matrix &input) const {
+    double elements = phase == LayerPhase::Forward ? static_cast<double>(input.rows) * input.cols
+                                                   : static_cast<double>(normalized.rows) * normalized.cols;
+    double f = features();
+    OpCost c;
+    switch (phase) {
+        case LayerPhase::Forward:   // statistics (training) and the normalization
+            c.flops = (training ? 11.0 : 4.0) * elements;
+            c.bytes = ((training ? 3.0 : 2.0) * elements + 4.0 * f) * sizeof(double);
+            break;
+        case LayerPhase::Backward:  // gradient sums and d_input
+            c.flops = 10.0 * elements;
+            c.bytes = (3.0 * elements + 4.0 * f) * sizeof(double);
+            break;
+        case LayerPhase::Update:    // gamma and beta
+            c.flops = 4.0 * f;
+            c.bytes = 6.0 * f * sizeof(double);
+            break;
+    }
+    return c;
+}
+
+// gamma, beta, running mean and running variance, one row each
+void BatchNormLayer::saveToFile(const std::string &filename) {
+    try {
+        if (filename.empty()) {
+            throw std::invalid_argument("Filename cannot be empty");
+        }
+
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            std::cerr << "Error: Could not create file " << filename << std::endl;
+            return;
+        }
+        for (const Matrix* row : {&gamma, &beta, &runningMean, &runningVar}) {
+            file.write((char*)row->data[0], row->cols * sizeof(double));
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving batch normalization layer: " << e.what() << std::endl;
+        throw;
+    }
+}
+
+void BatchNormLayer::loadFromFile(const std::string &filename) {
+    try {
+        if (filename.empty()) {
+            throw std::invalid_argument("Filename cannot be empty");
+        }
+
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            std::cerr << "Error: Could not open file " << filename << " for loading!" << std::endl;
+            return;
+        }
+        file.seekg(0, std::ios::end);
+        if (file.tellg() != static_cast<std::streamoff>(4 * features() * sizeof(double))) {
+            throw std::runtime_error("Layer file size does not match the layer shape: " + filename);
+        }
+        file.seekg(0);
+        for (Matrix* row : {&gamma, &beta, &runningMean, &runningVar}) {
+            file.read((char*)row->data[0], row->cols * sizeof(double));
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading batch normalization layer: " << e.what() << std::endl;
+        throw;
+    }
+}
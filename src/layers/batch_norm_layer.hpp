@@ -0,0 +1,62 @@
+#ifndef BATCH_NORM_LAYER_HPP
+#define BATCH_NORM_LAYER_HPP
+
+#include "layer.hpp"
+#include "dense_layer.hpp"
+#include "../math/matrix.hpp"
+#include "../activations/activation_function.hpp"
+#include <memory>
+#include <vector>
+
+// Batch normalization over the features (columns) of a batch: y = act(gamma * x_hat + beta) with
+// x_hat = (x - mean) / sqrt(var + epsilon).
+//
+// Training mode normalizes with the batch statistics, computed in one pass over the rows (Welford,
+// every update running across a whole row of features so it vectorizes), and folds them into
+// running averages. Eval mode and infer() use the running averages, which makes the layer a fixed
+// per-feature affine map: Weights snapshots fold it into a preceding DenseLayer with a linear
+// activation (see foldInto), so the deployed model runs no normalization at all.
+class BatchNormLayer : public Layer {
+public:
+    Matrix gamma, beta;               // (1, features) learned scale and shift
+    Matrix runningMean, runningVar;   // (1, features) statistics used in eval mode and at inference
+    double momentum = 0.9;            // running = momentum * running + (1 - momentum) * batch
+    double epsilon = 1e-5;
+
+    explicit BatchNormLayer(int features);  // linear output
+    BatchNormLayer(int features, ActivationFunction* activationFunc, bool isOutputLayer = false);
+    // Takes ready parameters (e.g. views into a loaded model file)
+    BatchNormLayer(Matrix gamma, Matrix beta, Matrix runningMean, Matrix runningVar,
+                   ActivationFunction* activationFunc, bool isOutputLayer);
+
+    void forward(const Matrix &input) override;
+    Matrix backward(Matrix &d_output, double learning_rate) override;
+    void infer(const Matrix &input, Matrix &output) const override;  // running statistics
+    std::unique_ptr<Layer> clone() const override;
+    std::string describe() const override;
+    OpCost cost(LayerPhase phase, const Matrix &input) const override;
+
+    int features() const { return gamma.cols; }
+
+    // The eval mode transform before the activation, y = x * scale + shift per feature
+    void affine(std::vector<double> &scale, std::vector<double> &shift) const;
+    // Whether `previous` is a DenseLayer whose output this layer can be folded into: linear
+    // activation, matching width, not an output layer
+    bool canFold(const Layer &previous) const;
+    // A DenseLayer computing dense followed by this layer in eval mode: W' = W * scale,
+    // b' = b * scale + shift, with this layer's activation (pruned weights stay pruned)
+    std::unique_ptr<DenseLayer> foldInto(const DenseLayer &dense) const;
+
+    void saveToFile(const std::string &filename) override;
+    void loadFromFile(const std::string &filename) override;
+
+private:
+    Matrix normalized;             // x_hat of the last forward pass, for backward
+    std::vector<double> invStd;    // 1 / sqrt(var + epsilon) the last forward pass normalized with
+    bool batchStatistics = false;  // whether the last forward pass used the batch statistics
+
+    void checkShapes() const;
+    void applyActivation(Matrix &values) const;
+};
+
+#endif  // BATCH_NORM_LAYER_HPP
@@ -2,6 +2,8 @@
 #include <fstream>
 #include <typeinfo>
 #include "../activations/softmax_function.hpp"
+#include "../core/profiler.hpp"
+#include "../utils/trace.hpp"
 
 ConvLayer::ConvLayer(int kernel_size, int stride, int padding, ActivationFunction* activationFunc)
     : kernel_size(kernel_size), stride(stride), padding(padding), Layer(activationFunc),
@@ -16,8 +18,12 @@ ConvLayer::ConvLayer(int kernel_size, int stride, int padding, ActivationFunctio
     kernel.randomize();
 }
 
-void ConvLayer::forward(Matrix &input) {
+void ConvLayer::forward(const Matrix &input) {
     this->input = input;
+    infer(input, output);
+}
+
+void ConvLayer::infer(const Matrix &input, Matrix &output) const {
     int output_size = (input.rows - kernel_size + 2 * padding) / stride + 1;
     output = Matrix(output_size, output_size);
 
@@ -45,12 +51,41 @@ void ConvLayer::forward(Matrix &input) {
     }
 
     // Apply activation function
-    std::vector<double> row(output.cols);
-    output = output.applyFunction([this](std::vector<double> x) { 
+    output = output.applyFunction([this](std::vector<double> &x) { 
         return activation->activate(x); 
     });
 }
 
+std::unique_ptr<Layer> ConvLayer::clone() const {
+    return std::make_unique<ConvLayer>(*this);
+}
+
+std::string ConvLayer::describe() const {
+    return "Conv " + std::to_string(kernel_size) + "x" + std::to_string(kernel_size) +
+           " s" + std::to_string(stride) + " p" + std::to_string(padding);
+}
+
+OpCost ConvLayer::cost(LayerPhase phase, const Matrix &input) const {
+    double output_size = (input.rows - kernel_size + 2 * padding) / stride + 1;
+    double outputs = output_size * output_size, taps = kernel_size * kernel_size;
+    OpCost c;
+    switch (phase) {
+        case LayerPhase::Forward:   // one multiply-add per kernel tap and output pixel
+            c.flops = 2.0 * outputs * taps;
+            c.bytes = (static_cast<double>(input.rows) * input.cols + taps + outputs) * sizeof(double);
+            break;
+        case LayerPhase::Backward:  // activation derivative times the incoming gradient
+            c.flops = outputs;
+            c.bytes = 3.0 * outputs * sizeof(double);
+            break;
+        case LayerPhase::Update:
+            c.flops = 2.0 * taps;
+            c.bytes = 3.0 * taps * sizeof(double);
+            break;
+    }
+    return c;
+}
+
 Matrix ConvLayer::backward(Matrix &d_output, double learning_rate) {
     Matrix d_input(input.rows, input.cols);
     Matrix d_kernel(kernel_size, kernel_size);
@@ -67,6 +102,9 @@ Matrix ConvLayer::backward(Matrix &d_output, double learning_rate) {
     }
 
     // Update kernel weights using gradient descent
+    TraceScope trace("update", "layer");
+    AllocationScope allocations(AllocCategory::Update);
+    ProfileScope profile(this, LayerPhase::Update, input);
     for (int i = 0; i < kernel_size; i++) {
         for (int j = 0; j < kernel_size; j++) {
             kernel.data[i][j] -= learning_rate * d_kernel.data[i][j];
@@ -14,8 +14,12 @@ public:
     ConvLayer(int kernel_size, int stride, int padding, ActivationFunction* activationFunc);
     ConvLayer(int kernel_size, int stride, int padding, ActivationFunction* activationFunc, bool isOutputLayer);
 
-    void forward(Matrix &input) override;
+    void forward(const Matrix &input) override;
     Matrix backward(Matrix &d_output, double learning_rate) override;
+    void infer(const Matrix &input, Matrix &output) const override;
+    std::unique_ptr<Layer> clone() const override;
+    std::string describe() const override;
+    OpCost cost(LayerPhase phase, const Matrix &input) const override;
     void saveToFile(const std::string &filename) override;
     void loadFromFile(const std::string &filename) override;
     ~ConvLayer();
@@ -1,43 +1,160 @@
 #include "dense_layer.hpp"
 #include "../activations/softmax_function.hpp" // for last layer logic
+#include "../activations/ReLU_function.hpp"
+#include "../core/profiler.hpp"
+#include "../utils/trace.hpp"
 #include <fstream>
+#include <algorithm>
+#include <cmath>
+
+// Uniform init limit: He for (leaky) ReLU, xavier/glorot for the saturating activations
+static double initLimit(int input_size, int output_size, const ActivationFunction* activationFunc) {
+    if (dynamic_cast<const ReLUFunction*>(activationFunc)) {
+        return sqrt(6.0 / input_size);
+    }
+    return sqrt(6.0 / (input_size + output_size));
+}
 
 // Weights Matrix has input_size rows and output_size cols
 // Each neuron has 1 bias so the rows are 1
 DenseLayer::DenseLayer(int input_size, int output_size, ActivationFunction* activationFunc) 
     : weights(input_size, output_size), biases(1, output_size), Layer(activationFunc) {
-    // xavier/glorot initialization
-    double limit = sqrt(6.0 / (input_size + output_size));
+    double limit = initLimit(input_size, output_size, activationFunc);
     weights.randomize(-limit, limit);
     biases.randomize(-0.1, 0.1);
     isOutputLayer = false;
 }
 DenseLayer::DenseLayer(int input_size, int output_size, ActivationFunction* activationFunc, bool isOutputLayer) 
     : weights(input_size, output_size), biases(1, output_size), Layer(activationFunc, isOutputLayer) {
-    // xavier/glorot initialization
-    double limit = sqrt(6.0 / (input_size + output_size));
+    double limit = initLimit(input_size, output_size, activationFunc);
     weights.randomize(-limit, limit);
     biases.randomize(-0.1, 0.1);
 }
 
+DenseLayer::DenseLayer(Matrix weights, Matrix biases, ActivationFunction* activationFunc, bool isOutputLayer)
+    : Layer(activationFunc, isOutputLayer), weights(std::move(weights)), biases(std::move(biases)) {
+    if (this->biases.rows != 1 || this->biases.cols != this->weights.cols) {
+        throw std::invalid_argument("Biases must be a (1, output_size) row");
+    }
+}
+
 // Forward pass: Computes output = (input * weights) + biases
-void DenseLayer::forward(Matrix &input) {
-// Store the input for backpropagation
+void DenseLayer::forward(const Matrix &input) {
+    // Store the input for backpropagation
     this->input = input;
-    
-    // Compute the forward pass
-    output = input * weights;  // Matrix multiplication
-    output = output + biases;  // Add biases
+    infer(input, output);
+}
 
+// Stateless forward pass, each row of input is one sample
+void DenseLayer::infer(const Matrix &input, Matrix &output) const {
     // Check if the activation function is Softmax and enforce output layer usage
     if (typeid(*activation) == typeid(SoftmaxFunction) && !isOutputLayer) {
         throw std::logic_error("SoftmaxFunction can only be used in the output layer: new DenseLayer(..., true)");
     }
-    
+
+    // Matrix multiplication, skipping zeros when the weights are pruned or the input is mostly zeros
+    if (sparseWeights) {
+        SparseMatrix::multiply(input, *sparseWeights, output);
+    } else if (sparseInputThreshold > 0.0 &&
+               SparseMatrix::densityOf(input, sparseInputThreshold) < sparseInputThreshold) {
+        thread_local SparseMatrix sparseInput;  // keeps its buffers between calls
+        sparseInput.assign(input);
+        sparseInput.multiply(weights, output);
+    } else {
+        output = input * weights;
+    }
+    output = output.addRowVector(biases);  // Add biases to every sample in the batch
+
     // Apply activation function
-    output = output.applyFunction([this](std::vector<double> x) { 
-return activation->activate(x); 
-}); 
+    output = output.applyFunction([this](std::vector<double> &x) { 
+        return activation->activate(x); 
+    }); 
+}
+
+std::unique_ptr<Layer> DenseLayer::clone() const {
+    return std::make_unique<DenseLayer>(*this);
+}
+
+std::string DenseLayer::describe() const {
+    std::string description = "Dense " + std::to_string(weights.rows) + "x" + std::to_string(weights.cols);
+    if (sparseWeights) {
+        description += " (" + std::to_string(static_cast<int>(std::round(sparseWeights->density() * 100))) + "% dense)";
+    }
+    return description;
+}
+
+OpCost DenseLayer::cost(LayerPhase phase, const Matrix &input) const {
+    double batch = input.rows, in = weights.rows, out = weights.cols;
+    double params = in * out + out;
+    OpCost c;
+    switch (phase) {
+        case LayerPhase::Forward:   // input * weights + biases
+            if (sparseWeights) {
+                c.flops = 2.0 * batch * sparseWeights->nonZeros() + batch * out;
+                c.bytes = (batch * in + batch * out + out) * sizeof(double) + sparseWeights->bytes();
+                break;
+            }
+            c.flops = 2.0 * batch * in * out + batch * out;
+            c.bytes = (batch * in + params + batch * out) * sizeof(double);
+            break;
+        case LayerPhase::Backward:  // delta, input^T * delta, bias sums, delta * weights^T
+            c.flops = 4.0 * batch * in * out + 2.0 * batch * out;
+            c.bytes = (2.0 * batch * in + 2.0 * batch * out + 2.0 * params) * sizeof(double);
+            break;
+        case LayerPhase::Update:    // parameters -= learning_rate * gradients
+            c.flops = 2.0 * params;
+            c.bytes = 3.0 * params * sizeof(double);
+            break;
+    }
+    return c;
+}
+
+void DenseLayer::prune(double fraction) {
+    if (fraction < 0.0 || fraction > 1.0) {
+        throw std::invalid_argument("Pruning fraction must be in [0, 1]");
+    }
+    std::vector<double> magnitudes;
+    magnitudes.reserve(static_cast<size_t>(weights.rows) * weights.cols);
+    for (int i = 0; i < weights.rows; i++) {
+        for (int j = 0; j < weights.cols; j++) {
+            magnitudes.push_back(std::fabs(weights.data[i][j]));
+        }
+    }
+    size_t removed = static_cast<size_t>(std::llround(fraction * magnitudes.size()));
+
+    // Everything at or below the removed-th smallest magnitude goes (ties may prune a few more)
+    double threshold = -1.0;
+    if (removed > 0) {
+        std::nth_element(magnitudes.begin(), magnitudes.begin() + (removed - 1), magnitudes.end());
+        threshold = magnitudes[removed - 1];
+    }
+    SparseMatrix pruned = SparseMatrix::fromDense(weights, threshold);
+    weights = pruned.toDense();
+    ownSparseWeights = std::make_shared<SparseMatrix>(std::move(pruned));
+    sparseWeights = ownSparseWeights;
+}
+
+// Pruned weights stay zero: only the entries of the sparsity pattern move, in the dense weights
+// and in the CSR values, O(non-zeros) per step
+void DenseLayer::updatePruned(const Matrix &d_weights, double learning_rate) {
+    if (weights.isView()) {
+        weights = Matrix(weights);  // e.g. a mapped model file, train on a copy
+    }
+    // Two owners (sparseWeights and ownSparseWeights) means nobody else reads the values
+    if (ownSparseWeights != sparseWeights || sparseWeights.use_count() != 2) {
+        ownSparseWeights = std::make_shared<SparseMatrix>(*sparseWeights);
+        sparseWeights = ownSparseWeights;
+    }
+    SparseMatrix &sparse = *ownSparseWeights;
+    for (int i = 0; i < sparse.rows; i++) {
+        double* row = weights.data[i];
+        const double* gradient = d_weights.data[i];
+        for (int idx = sparse.rowStart[i]; idx < sparse.rowStart[i + 1]; idx++) {
+            const int j = sparse.columns[idx];
+            row[j] -= gradient[j] * learning_rate;
+            sparse.values[idx] = row[j];
+        }
+    }
 }
 
 // Backpropagation: Compute weight and bias updates
@@ -68,8 +185,17 @@ Matrix DenseLayer::backward(Matrix &d_output, double learning_rate) {
     // d_biases has shape (1, output_size)
     
     // Update parameters
-    weights = weights - (d_weights * learning_rate);
-    biases = biases - (d_biases * learning_rate);
+    {
+        TraceScope trace("update", "layer");
+        AllocationScope allocations(AllocCategory::Update);
+        ProfileScope profile(this, LayerPhase::Update, input);
+        if (sparseWeights) {
+            updatePruned(d_weights, learning_rate);
+        } else {
+            weights = weights - (d_weights * learning_rate);
+        }
+        biases = biases - (d_biases * learning_rate);
+    }
 
     // Propagate error to the previous layer
     Matrix d_input = delta * weights.transpose(); // d_input has shape (batch_size, input_size)
@@ -122,6 +248,14 @@ void DenseLayer::loadFromFile(const std::string &filename) {
             return;
         }
 
+        // The file has no header, so at least make sure it was written for this layer's shape
+        file.seekg(0, std::ios::end);
+        std::streamoff expected = static_cast<std::streamoff>(weights.rows * weights.cols + biases.rows * biases.cols) * sizeof(double);
+        if (file.tellg() != expected) {
+            throw std::runtime_error("Layer file size does not match the layer shape: " + filename);
+        }
+        file.seekg(0);
+
         std::cout << "Loading weights and biases from " << filename << std::endl;
 
         for (int i = 0; i < weights.rows; i++) {
@@ -130,6 +264,8 @@ void DenseLayer::loadFromFile(const std::string &filename) {
         for (int i = 0; i < biases.rows; i++) {
             file.read((char*)biases.data[i], biases.cols * sizeof(double));
         }
+        sparseWeights.reset();  // the file has no pruning state, the old CSR weights are stale
+        ownSparseWeights.reset();
 
         file.close();
         std::cout << "File loaded successfully!\n";
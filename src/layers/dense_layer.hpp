@@ -4,17 +4,37 @@
 #include "layer.hpp"
 #include "../core/serializable.hpp"
 #include "../math/matrix.hpp"
+#include "../math/sparse_matrix.hpp"
 #include "../activations/activation_function.hpp"
+#include <memory>
 
 class DenseLayer : public Layer {
 public:
     Matrix weights, biases; // weight => which neuron/pixels take action // biases => how high before getting active
 
+    // Inputs with fewer non-zeros than this fraction go through the sparse-dense kernel, 0 disables.
+    // The default stays a little below the crossover against the GEMM measured by
+    // bench/sparse_bench.cpp (about 0.05 for 784x16, 0.1 for 784x256), so MNIST (~19%) runs dense.
+    double sparseInputThreshold = 0.04;
+    // Set by prune(): CSR copy of the weights that forward/infer multiply with instead
+    std::shared_ptr<const SparseMatrix> sparseWeights;
+
     DenseLayer(int input_size, int output_size, ActivationFunction* activationFunc);
     DenseLayer(int input_size, int output_size, ActivationFunction* activationFunc, bool isOutputLayer);
+    // Takes ready parameters (e.g. views into a loaded model file), no random initialization
+    DenseLayer(Matrix weights, Matrix biases, ActivationFunction* activationFunc, bool isOutputLayer);
     
-    void forward(Matrix &input) override;
+    void forward(const Matrix &input) override;
     Matrix backward(Matrix &d_output, double learning_rate) override;
+    void infer(const Matrix &input, Matrix &output) const override;
+    std::unique_ptr<Layer> clone() const override;
+    std::string describe() const override;
+    OpCost cost(LayerPhase phase, const Matrix &input) const override;
+
+    // Magnitude pruning: zeroes the given fraction of weights with the smallest |w| and switches
+    // inference to the sparse weights. Training afterwards keeps the pruned weights at zero.
+    // ModelFile (.nnm) and checkpoints keep the pruning, loadFromFile (.dat) drops it.
+    void prune(double fraction);
 
     void saveToFile(const std::string &filename) override;
     void loadFromFile(const std::string &filename) override;
@@ -22,6 +42,13 @@ public:
     bool isEqual(DenseLayer &other); // For testing
 
     ~DenseLayer();
+
+private:
+    // sparseWeights when this layer made it and may update its values in place (copy on write:
+    // snapshots and clones that share it get a fresh copy taken first)
+    std::shared_ptr<SparseMatrix> ownSparseWeights;
+
+    void updatePruned(const Matrix &d_weights, double learning_rate);
 };
 
 #endif // DENSE_LAYER_HPP
@@ -0,0 +1,253 @@
+#include "dropout_layer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NN_X86_KERNELS 1
+#endif
+
+DropoutLayer::DropoutLayer(double rate) : Layer(), rate(rate), rng(Random::nextStream()) {
+    if (!(rate >= 0.0 && rate < 1.0)) {
+        throw std::invalid_argument("Dropout rate must be in [0, 1)");
+    }
+    isOutputLayer = false;
+}
+
+DropoutLayer::DropoutLayer(double rate, const RandomStream &stream) : Layer(), rate(rate), rng(stream) {
+    isOutputLayer = false;
+}
+
+// SplitMix64 finalizer: spreads (stream, clone number) over the 64 bit stream space, far from the
+// small stream numbers Random::nextStream hands out
+static uint64_t mixStream(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Mask word w has bit b set when draw 64 * w + b is below the threshold
+static void packScalar(const uint32_t* draws, uint32_t threshold, uint64_t* mask, size_t words) {
+    for (size_t w = 0; w < words; w++) {
+        uint64_t bits = 0;
+        for (int b = 0; b < 64; b++) {
+            bits |= static_cast<uint64_t>(draws[w * 64 + b] < threshold) << b;
+        }
+        mask[w] = bits;
+    }
+}
+
+// out[i] = in[i] * scale where the mask bit is set, 0 elsewhere
+static void applyScalar(const double* in, double* out, size_t first, size_t n, const uint64_t* mask, double scale) {
+    for (size_t i = first; i < n; i++) {
+        out[i] = (mask[i >> 6] >> (i & 63)) & 1 ? in[i] * scale : 0.0;
+    }
+}
+
+#ifdef NN_X86_KERNELS
+// Unsigned compares straight into mask registers: 16 mask bits per instruction
+__attribute__((target("avx512f")))
+static void packAvx512(const uint32_t* draws, uint32_t threshold, uint64_t* mask, size_t words) {
+    const __m512i limit = _mm512_set1_epi32(static_cast<int>(threshold));
+    for (size_t w = 0; w < words; w++) {
+        uint64_t bits = 0;
+        for (int part = 0; part < 4; part++) {
+            __m512i values = _mm512_loadu_si512(draws + w * 64 + part * 16);
+            bits |= static_cast<uint64_t>(_mm512_cmplt_epu32_mask(values, limit)) << (part * 16);
+        }
+        mask[w] = bits;
+    }
+}
+
+// Eight mask bits select the lanes of a zero-masking multiply
+__attribute__((target("avx512f")))
+static size_t applyAvx512(const double* in, double* out, size_t n, const uint64_t* mask, double scale) {
+    const __m512d factor = _mm512_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __mmask8 keep = static_cast<__mmask8>(mask[i >> 6] >> (i & 63));
+        _mm512_storeu_pd(out + i, _mm512_maskz_mul_pd(keep, _mm512_loadu_pd(in + i), factor));
+    }
+    return i;
+}
+
+// AVX2 has no unsigned compare: flip the sign bits and compare signed
+__attribute__((target("avx2")))
+static void packAvx2(const uint32_t* draws, uint32_t threshold, uint64_t* mask, size_t words) {
+    const __m256i sign = _mm256_set1_epi32(static_cast<int>(0x80000000u));
+    const __m256i limit = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(threshold)), sign);
+    for (size_t w = 0; w < words; w++) {
+        uint64_t bits = 0;
+        for (int part = 0; part < 8; part++) {
+            __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(draws + w * 64 + part * 8));
+            __m256i below = _mm256_cmpgt_epi32(limit, _mm256_xor_si256(values, sign));
+            bits |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(below))) << (part * 8);
+        }
+        mask[w] = bits;
+    }
+}
+
+// Four mask bits spread to lane masks that keep the scaled value or zero it
+__attribute__((target("avx2")))
+static size_t applyAvx2(const double* in, double* out, size_t n, const uint64_t* mask, double scale) {
+    const __m256i lanes = _mm256_set_epi64x(8, 4, 2, 1);
+    const __m256d factor = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i nibble = _mm256_set1_epi64x(static_cast<long long>((mask[i >> 6] >> (i & 63)) & 0xF));
+        __m256i keep = _mm256_cmpeq_epi64(_mm256_and_si256(nibble, lanes), lanes);
+        __m256d scaled = _mm256_mul_pd(_mm256_loadu_pd(in + i), factor);
+        _mm256_storeu_pd(out + i, _mm256_and_pd(_mm256_castsi256_pd(keep), scaled));
+    }
+    return i;
+}
+
+static bool hasAvx512() {
+    static const bool supported = __builtin_cpu_supports("avx512f");
+    return supported;
+}
+
+static bool hasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+// One 32 bit draw per element, kept when below (1 - rate) * 2^32. The draws come 1024 at a time
+// from a bulk fill and are packed 64 to a mask word.
+void DropoutLayer::drawMask(size_t elements) {
+    const uint32_t threshold = static_cast<uint32_t>(std::min(std::ldexp(1.0 - rate, 32), 4294967295.0));
+    mask.resize((elements + 63) / 64);
+    const size_t chunkWords = 16;  // mask words per fill, 1024 draws
+    uint64_t draws[chunkWords * 32];
+    for (size_t first = 0; first < mask.size(); first += chunkWords) {
+        const size_t words = std::min(chunkWords, mask.size() - first);
+        rng.fillBits(draws, words * 32);
+        const uint32_t* values = reinterpret_cast<const uint32_t*>(draws);
+#ifdef NN_X86_KERNELS
+        if (hasAvx512()) { packAvx512(values, threshold, &mask[first], words); continue; }
+        if (hasAvx2()) { packAvx2(values, threshold, &mask[first], words); continue; }
+#endif
+        packScalar(values, threshold, &mask[first], words);
+    }
+}
+
+void DropoutLayer::applyMask(const double* in, double* out, size_t n) const {
+    const double scale = 1.0 / (1.0 - rate);
+    size_t i = 0;
+#ifdef NN_X86_KERNELS
+    if (hasAvx512()) i = applyAvx512(in, out, n, mask.data(), scale);
+    else if (hasAvx2()) i = applyAvx2(in, out, n, mask.data(), scale);
+#endif
+    applyScalar(in, out, i, n, mask.data(), scale);
+}
+
+void DropoutLayer::forward(const Matrix &input) {
+    if (output.rows != input.rows || output.cols != input.cols || output.isView()) {
+        output = Matrix(input.rows, input.cols);
+    }
+    const size_t n = static_cast<size_t>(input.rows) * input.cols;
+    maskActive = training && rate > 0.0 && n > 0;
+    maskRows = input.rows;
+    maskCols = input.cols;
+    if (!maskActive) {
+        if (n > 0) std::copy(input.data[0], input.data[0] + n, output.data[0]);
+        return;
+    }
+    drawMask(n);
+    applyMask(input.data[0], output.data[0], n);
+}
+
+Matrix DropoutLayer::backward(Matrix &d_output, double /*learning_rate*/) {
+    if (d_output.rows != maskRows || d_output.cols != maskCols) {
+        throw std::invalid_argument("Gradient shape does not match the last dropout forward pass");
+    }
+    if (maskActive) {
+        applyMask(d_output.data[0], d_output.data[0], static_cast<size_t>(d_output.rows) * d_output.cols);
+    }
+    return std::move(d_output);  // the caller replaces its gradient with the result
+}
+
+void DropoutLayer::infer(const Matrix &input, Matrix &output) const {
+    if (output.rows != input.rows || output.cols != input.cols || output.isView()) {
+        output = Matrix(input.rows, input.cols);
+    }
+    const size_t n = static_cast<size_t>(input.rows) * input.cols;
+    if (n > 0) std::copy(input.data[0], input.data[0] + n, output.data[0]);
+}
+
+std::unique_ptr<Layer> DropoutLayer::clone() const {
+    // A replica must not repeat this layer's masks, nor shift the global stream numbering
+    const uint64_t stream = mixStream(mixStream(rng.getStream()) ^ ++clones);
+    std::unique_ptr<DropoutLayer> copy(new DropoutLayer(rate, RandomStream(rng.getSeed(), stream)));
+    copy->training = training;
+    return copy;
+}
+
+std::string DropoutLayer::describe() const {
+    std::ostringstream description;
+    description << "Dropout " << rate;
+    return description.str();
+}
+
+OpCost DropoutLayer::cost(LayerPhase phase, const Matrix &input) const {
+    double elements = phase == LayerPhase::Forward ? static_cast<double>(input.rows) * input.cols
+                                                   : static_cast<double>(maskRows) * maskCols;
+    OpCost c;
+    if (phase == LayerPhase::Update) return c;
+    c.flops = elements;  // one multiply per element, the mask bit selects 0 or the scale
+    c.bytes = 2.0 * elements * sizeof(double) + elements / 8.0;
+    return c;
+}
+
+void DropoutLayer::saveToFile(const std::string &filename) {
+    try {
+        if (filename.empty()) {
+            throw std::invalid_argument("Filename cannot be empty");
+        }
+
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            std::cerr << "Error: Could not create file " << filename << std::endl;
+            return;
+        }
+        file.write((char*)&rate, sizeof(rate));
+        const uint64_t stream[3] = {rng.getSeed(), rng.getStream(), rng.position()};
+        file.write((char*)stream, sizeof(stream));
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving dropout layer: " << e.what() << std::endl;
+        throw;
+    }
+}
+
+void DropoutLayer::loadFromFile(const std::string &filename) {
+    try {
+        if (filename.empty()) {
+            throw std::invalid_argument("Filename cannot be empty");
+        }
+
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            std::cerr << "Error: Could not open file " << filename << " for loading!" << std::endl;
+            return;
+        }
+        double loaded;
+        if (!file.read((char*)&loaded, sizeof(loaded)) || !(loaded >= 0.0 && loaded < 1.0)) {
+            throw std::runtime_error("Invalid dropout rate in file: " + filename);
+        }
+        rate = loaded;
+        uint64_t stream[3];
+        if (file.read((char*)stream, sizeof(stream))) {  // files written before the stream was saved end here
+            rng = RandomStream(stream[0], stream[1]);
+            rng.seek(stream[2]);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading dropout layer: " << e.what() << std::endl;
+        throw;
+    }
+}
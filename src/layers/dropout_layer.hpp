@@ -0,0 +1,64 @@
+#ifndef DROPOUT_LAYER_HPP
+#define DROPOUT_LAYER_HPP
+
+#include "layer.hpp"
+#include "../math/matrix.hpp"
+#include "../math/random.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Inverted dropout: in training mode every element is zeroed with probability `rate` and the
+// survivors are scaled by 1 / (1 - rate), so eval mode needs no rescaling.
+//
+// The mask is one bit per element (64x smaller than the activations it masks), drawn from the
+// layer's Philox stream 1024 values per vectorized fill. Scaling is fused into the masking pass in
+// forward and backward; backward works in place on the incoming gradient and keeps no input copy.
+// In eval mode the layer is an identity the network skips (see Layer::passesThrough), and Weights
+// snapshots leave it out, so inference pays no copy and no buffer for it.
+//
+// clone() derives the copy's stream from this layer's stream and a count of its clones, so replicas
+// draw their own masks without taking a stream of the global seed (weights initialized afterwards
+// stay the same however often a network is cloned). Files and checkpoints keep the stream and its
+// position, so a resumed run draws the same masks; the copy constructor keeps the stream as is.
+class DropoutLayer : public Layer {
+public:
+    double rate;  // probability of dropping an element, in [0, 1)
+
+    explicit DropoutLayer(double rate);
+
+    void forward(const Matrix &input) override;
+    Matrix backward(Matrix &d_output, double learning_rate) override;
+    void infer(const Matrix &input, Matrix &output) const override;  // identity
+    std::unique_ptr<Layer> clone() const override;
+    std::string describe() const override;
+    OpCost cost(LayerPhase phase, const Matrix &input) const override;
+    bool identityInEval() const override { return true; }
+
+    // Bytes of the mask of the last training forward pass
+    size_t maskBytes() const { return mask.size() * sizeof(uint64_t); }
+    // Whether element i (row-major) survived the last training forward pass
+    bool kept(size_t i) const { return (mask[i >> 6] >> (i & 63)) & 1; }
+
+    // The mask generator, e.g. to carry it over to a snapshot or restore it from a file
+    const RandomStream& getStream() const { return rng; }
+    void setStream(const RandomStream &stream) { rng = stream; }
+
+    void saveToFile(const std::string &filename) override;
+    void loadFromFile(const std::string &filename) override;
+
+private:
+    RandomStream rng;
+    mutable uint64_t clones = 0;  // clones taken so far, numbers the derived streams
+    std::vector<uint64_t> mask;
+    int maskRows = 0, maskCols = 0;  // shape the mask was drawn for
+    bool maskActive = false;         // false when the last forward pass did not drop anything
+
+    DropoutLayer(double rate, const RandomStream &stream);  // a clone, draws no global stream
+
+    void drawMask(size_t elements);
+    // out = in * mask * scale over n row-major elements (AVX-512 / AVX2 / scalar), in may alias out
+    void applyMask(const double* in, double* out, size_t n) const;
+};
+
+#endif  // DROPOUT_LAYER_HPP
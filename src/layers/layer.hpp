@@ -6,22 +6,50 @@
 #include "../activations/activation_function.hpp"
 #include <iostream>
 #include <memory>
+#include <string>
+
+// What a layer is doing when it gets profiled (see Profiler)
+enum class LayerPhase { Forward, Backward, Update };
+
+// Work of one call, computed from the shapes
+struct OpCost {
+    double flops = 0.0;
+    double bytes = 0.0;  // read + written, assuming every operand is touched once
+};
 
 // Abstract class for all layers
 class Layer : public Serializable {
 public:
     Matrix input, output;
-    std::unique_ptr<ActivationFunction> activation;
+    std::shared_ptr<ActivationFunction> activation; // shared (not unique) so clone() can reuse it
     bool isOutputLayer; // For softmax
+    bool training = true; // train/eval mode, switched for the whole network by NeuralNetwork::setTraining()
 
     // Constructors 
     Layer() {};
     Layer(ActivationFunction* activationFunc) : activation(activationFunc) {}
     Layer(ActivationFunction* activationFunc, bool isOutputLayer) : activation(activationFunc), isOutputLayer(isOutputLayer) {}
 
-    virtual void forward(Matrix &input) = 0;
+    virtual void forward(const Matrix &input) = 0;
     virtual Matrix backward(Matrix &d_output, double learning_rate) = 0;
 
+    // Same computation as forward() but writes into a caller owned buffer and touches no members,
+    // so one layer can be used by several threads at once (see InferenceContext)
+    virtual void infer(const Matrix &input, Matrix &output) const = 0;
+
+    // Deep copy of the parameters, used to build immutable shared Weights
+    virtual std::unique_ptr<Layer> clone() const = 0;
+
+    // True for layers that are the identity in eval mode (e.g. dropout): eval forward passes skip
+    // them and inference snapshots (Weights) leave them out
+    virtual bool identityInEval() const { return false; }
+    bool passesThrough() const { return !training && identityInEval(); }
+
+    // Short description for reports, e.g. "Dense 784x16"
+    virtual std::string describe() const { return "Layer"; }
+    // Analytic cost of one call of the phase on `input` (forward input or the stored one for backward)
+    virtual OpCost cost(LayerPhase, const Matrix &) const { return OpCost(); }
+
     virtual void saveToFile(const std::string &filename) = 0;
     virtual void loadFromFile(const std::string &filename) = 0;
 
@@ -0,0 +1,161 @@
+#include "allocation_stats.hpp"
+#include <iomanip>
+
+namespace {
+
+// One cache line per counter block, so the categories do not share lines
+struct alignas(64) AtomicCounters {
+    std::atomic<long long> allocations{0};
+    std::atomic<long long> frees{0};
+    std::atomic<long long> bytesAllocated{0};
+    std::atomic<long long> bytesFreed{0};
+    std::atomic<long long> liveBytes{0};
+    std::atomic<long long> peakBytes{0};
+
+    void allocate(long long bytes) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+        long long live = liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        long long peak = peakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+    void free(long long bytes) {
+        frees.fetch_add(1, std::memory_order_relaxed);
+        bytesFreed.fetch_add(bytes, std::memory_order_relaxed);
+        liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+    AllocationStats::Counters load() const {
+        AllocationStats::Counters c;
+        c.allocations = allocations.load(std::memory_order_relaxed);
+        c.frees = frees.load(std::memory_order_relaxed);
+        c.bytesAllocated = bytesAllocated.load(std::memory_order_relaxed);
+        c.bytesFreed = bytesFreed.load(std::memory_order_relaxed);
+        c.liveBytes = liveBytes.load(std::memory_order_relaxed);
+        c.peakBytes = peakBytes.load(std::memory_order_relaxed);
+        return c;
+    }
+    void resetPeak() {
+        peakBytes.store(liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+};
+
+AtomicCounters categoryCounters[allocCategoryCount];
+AtomicCounters totalCounters;
+thread_local AllocCategory currentCategory = AllocCategory::Other;
+
+}  // namespace
+
+std::atomic<int> AllocationStats::recording{0};
+
+void AllocationStats::enable() {
+    recording.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocationStats::disable() {
+    recording.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void AllocationStats::recordAllocation(AllocCategory category, size_t bytes) {
+    if (category == AllocCategory::Untracked) return;
+    categoryCounters[static_cast<int>(category)].allocate(static_cast<long long>(bytes));
+    totalCounters.allocate(static_cast<long long>(bytes));
+}
+
+void AllocationStats::recordFree(AllocCategory category, size_t bytes) {
+    if (category == AllocCategory::Untracked) return;
+    categoryCounters[static_cast<int>(category)].free(static_cast<long long>(bytes));
+    totalCounters.free(static_cast<long long>(bytes));
+}
+
+AllocCategory AllocationStats::current() {
+    return enabled() ? currentCategory : AllocCategory::Untracked;
+}
+
+const char* AllocationStats::categoryName(AllocCategory category) {
+    switch (category) {
+        case AllocCategory::Other: return "other";
+        case AllocCategory::Forward: return "forward";
+        case AllocCategory::Backward: return "backward";
+        case AllocCategory::Update: return "update";
+        case AllocCategory::Activation: return "activation";
+        case AllocCategory::Loader: return "loader";
+        case AllocCategory::Untracked: return "untracked";
+    }
+    return "unknown";
+}
+
+AllocationStats::Snapshot AllocationStats::snapshot() {
+    Snapshot s;
+    for (int i = 0; i < allocCategoryCount; i++) {
+        s.categories[i] = categoryCounters[i].load();
+    }
+    s.total = totalCounters.load();
+    return s;
+}
+
+void AllocationStats::resetPeak() {
+    for (auto &counters : categoryCounters) {
+        counters.resetPeak();
+    }
+    totalCounters.resetPeak();
+}
+
+static AllocationStats::Counters difference(const AllocationStats::Counters &after, const AllocationStats::Counters &before) {
+    AllocationStats::Counters d;
+    d.allocations = after.allocations - before.allocations;
+    d.frees = after.frees - before.frees;
+    d.bytesAllocated = after.bytesAllocated - before.bytesAllocated;
+    d.bytesFreed = after.bytesFreed - before.bytesFreed;
+    d.liveBytes = after.liveBytes - before.liveBytes;
+    d.peakBytes = after.peakBytes;
+    return d;
+}
+
+AllocationStats::Snapshot AllocationStats::Snapshot::operator-(const Snapshot &before) const {
+    Snapshot d;
+    for (int i = 0; i < allocCategoryCount; i++) {
+        d.categories[i] = difference(categories[i], before.categories[i]);
+    }
+    d.total = difference(total, before.total);
+    return d;
+}
+
+void AllocationStats::Snapshot::report(std::ostream &out) const {
+    auto row = [&out](const char* name, const Counters &c) {
+        out << std::left << std::setw(12) << name << std::right << std::setw(12) << c.allocations
+            << std::setw(12) << c.frees << std::setw(16) << c.bytesAllocated << std::setw(14) << c.liveBytes
+            << std::setw(14) << c.peakBytes << "\n";
+    };
+    out << std::left << std::setw(12) << "category" << std::right << std::setw(12) << "allocs"
+        << std::setw(12) << "frees" << std::setw(16) << "bytes" << std::setw(14) << "live" << std::setw(14) << "peak" << "\n";
+    for (int i = 0; i < allocCategoryCount; i++) {
+        row(categoryName(static_cast<AllocCategory>(i)), categories[i]);
+    }
+    row("total", total);
+}
+
+AllocationScope::AllocationScope(AllocCategory category) : previous(currentCategory) {
+    currentCategory = category;
+}
+
+AllocationScope::~AllocationScope() {
+    currentCategory = previous;
+}
+
+AllocationTracker::AllocationTracker() {
+    AllocationStats::enable();
+    restart();
+}
+
+AllocationTracker::~AllocationTracker() {
+    AllocationStats::disable();
+}
+
+void AllocationTracker::restart() {
+    AllocationStats::resetPeak();
+    start = AllocationStats::snapshot();
+}
+
+AllocationStats::Snapshot AllocationTracker::delta() const {
+    return AllocationStats::snapshot() - start;
+}
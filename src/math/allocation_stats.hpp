@@ -0,0 +1,94 @@
+#ifndef ALLOCATION_STATS_HPP
+#define ALLOCATION_STATS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+
+// What the code was doing when a Matrix buffer got allocated, set with AllocationScope.
+// Untracked marks buffers allocated while nothing was counting, their frees are not counted either.
+enum class AllocCategory { Other, Forward, Backward, Update, Activation, Loader, Untracked };
+const int allocCategoryCount = 6;  // the counted categories, Untracked has no counters
+
+// Process wide counters of the buffers Matrix allocates (values and row pointer tables).
+// Opt in, like the profiler: counting runs while an AllocationTracker lives (or between enable()
+// and disable()), then every allocation and free is a few relaxed atomic adds on shared counters.
+// Otherwise a Matrix allocation pays one relaxed load and writes no shared cache line. Live and
+// peak bytes cover the buffers allocated while counting: a buffer allocated before and freed while
+// counting is not seen, so warm up with counting on before measuring the net growth of a step.
+//
+//   AllocationTracker step;
+//   nn.train_step(batch.inputs, batch.labels, 0.1);
+//   AllocationStats::Snapshot used = step.delta();  // allocations, bytes, peak of this step
+//   used.report(std::cout);
+class AllocationStats {
+public:
+    struct Counters {
+        long long allocations = 0;
+        long long frees = 0;
+        long long bytesAllocated = 0;
+        long long bytesFreed = 0;
+        long long liveBytes = 0;   // allocated and not yet freed (a delta: net growth)
+        long long peakBytes = 0;   // highest liveBytes since the last resetPeak()
+    };
+
+    struct Snapshot {
+        Counters categories[allocCategoryCount];
+        Counters total;
+
+        const Counters& operator[](AllocCategory category) const { return categories[static_cast<int>(category)]; }
+        // Counts and live bytes become differences, peaks stay those of *this
+        Snapshot operator-(const Snapshot &before) const;
+        void report(std::ostream &out) const;
+    };
+
+    // Counting nests: it runs until every enable() has been matched by a disable()
+    static void enable();
+    static void disable();
+    static bool enabled() { return recording.load(std::memory_order_relaxed) > 0; }
+
+    static Snapshot snapshot();
+    // Restarts peak tracking from the current live bytes
+    static void resetPeak();
+
+    // The calling thread's category, Untracked while counting is off
+    static AllocCategory current();
+    static const char* categoryName(AllocCategory category);
+
+    // Called by Matrix, with the category current() gave at allocation
+    static void recordAllocation(AllocCategory category, size_t bytes);
+    static void recordFree(AllocCategory category, size_t bytes);
+
+private:
+    static std::atomic<int> recording;
+};
+
+// Attributes the Matrix allocations of this thread to a category until the scope ends (nests)
+class AllocationScope {
+public:
+    explicit AllocationScope(AllocCategory category);
+    ~AllocationScope();
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    AllocCategory previous;
+};
+
+// Allocations from construction on, e.g. per training step. Counts while it lives and resets the
+// (process wide) peak.
+class AllocationTracker {
+public:
+    AllocationTracker();
+    ~AllocationTracker();
+    AllocationTracker(const AllocationTracker&) = delete;
+    AllocationTracker& operator=(const AllocationTracker&) = delete;
+
+    AllocationStats::Snapshot delta() const;
+    void restart();
+
+private:
+    AllocationStats::Snapshot start;
+};
+
+#endif  // ALLOCATION_STATS_HPP
@@ -0,0 +1,714 @@
+#include "gemm.hpp"
+#include "../utils/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#include <cpuid.h>
+#define NN_X86_KERNELS 1
+#endif
+
+bool GemmConfig::operator==(const GemmConfig &other) const {
+    return kernel == other.kernel && mc == other.mc && kc == other.kc && nc == other.nc &&
+           threads == other.threads && split == other.split;
+}
+
+// Ordered by k and n first, so the entries that differ only in the batch size are neighbours
+bool GemmShape::operator<(const GemmShape &other) const {
+    if (k != other.k) return k < other.k;
+    if (n != other.n) return n < other.n;
+    return m < other.m;
+}
+
+// Row kernels: C (m x n) = A (m x k) * B (k x n) with leading dimensions lda, ldb, ldc
+typedef void (*RowKernel)(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n);
+// Micro-kernels: one register tile of C from an A panel (kc x rows) and a B panel (kc x columns).
+// mr x nr is the part of the tile inside C; accumulate adds to C instead of overwriting it.
+typedef void (*MicroKernel)(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr, bool accumulate);
+
+// Eight columns of C per pass over k, kept in locals
+static void rowsScalar(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n) {
+    for (int j0 = 0; j0 < n; j0 += 8) {
+        const int width = std::min(8, n - j0);
+        for (int i = 0; i < m; i++) {
+            double acc[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+            const double* ai = a + static_cast<size_t>(i) * lda;
+            for (int p = 0; p < k; p++) {
+                const double value = ai[p];
+                const double* bp = b + static_cast<size_t>(p) * ldb + j0;
+                for (int j = 0; j < width; j++) acc[j] += value * bp[j];
+            }
+            double* ci = c + static_cast<size_t>(i) * ldc + j0;
+            for (int j = 0; j < width; j++) ci[j] = acc[j];
+        }
+    }
+}
+
+// Writes the mr x nr corner of a rows x columns tile
+static inline void storeTile(const double* tile, int columns, double* c, int ldc, int mr, int nr, bool accumulate) {
+    for (int i = 0; i < mr; i++) {
+        double* ci = c + static_cast<size_t>(i) * ldc;
+        for (int j = 0; j < nr; j++) ci[j] = (accumulate ? ci[j] : 0.0) + tile[i * columns + j];
+    }
+}
+
+static void microScalar4x4(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr, bool accumulate) {
+    double acc[16] = {};
+    for (int p = 0; p < kc; p++, a += 4, b += 4) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) acc[i * 4 + j] += a[i] * b[j];
+        }
+    }
+    storeTile(acc, 4, c, ldc, mr, nr, accumulate);
+}
+
+#ifdef NN_X86_KERNELS
+// GCC 12 warns that the accumulator arrays may be used uninitialized through the unrolled loops
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// R rows x V vectors of C accumulated over all of k; masks cut the last vector of a narrow block
+template <int R, int V>
+__attribute__((target("avx512f")))
+static inline void rowTileAvx512(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int k,
+                                 const __mmask8* mask) {
+    __m512d acc[R][V];
+    for (int r = 0; r < R; r++) {
+        for (int v = 0; v < V; v++) acc[r][v] = _mm512_setzero_pd();
+    }
+    for (int p = 0; p < k; p++) {
+        const double* bp = b + static_cast<size_t>(p) * ldb;
+        __m512d row[V];
+        for (int v = 0; v < V; v++) row[v] = _mm512_maskz_loadu_pd(mask[v], bp + 8 * v);
+        for (int r = 0; r < R; r++) {
+            const __m512d broadcast = _mm512_set1_pd(a[static_cast<size_t>(r) * lda + p]);
+            for (int v = 0; v < V; v++) acc[r][v] = _mm512_fmadd_pd(broadcast, row[v], acc[r][v]);
+        }
+    }
+    for (int r = 0; r < R; r++) {
+        for (int v = 0; v < V; v++) _mm512_mask_storeu_pd(c + static_cast<size_t>(r) * ldc + 8 * v, mask[v], acc[r][v]);
+    }
+}
+
+// Four rows at a time for up to 16 columns, two for up to 32: 8 accumulators either way
+template <int R, int V>
+__attribute__((target("avx512f")))
+static inline void rowBlockAvx512(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k,
+                                  const __mmask8* mask) {
+    int i = 0;
+    for (; i + R <= m; i += R) {
+        rowTileAvx512<R, V>(a + static_cast<size_t>(i) * lda, lda, b, ldb, c + static_cast<size_t>(i) * ldc, ldc, k, mask);
+    }
+    for (; i < m; i++) {
+        rowTileAvx512<1, V>(a + static_cast<size_t>(i) * lda, lda, b, ldb, c + static_cast<size_t>(i) * ldc, ldc, k, mask);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void rowsAvx512(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n) {
+    for (int j0 = 0; j0 < n; j0 += 32) {
+        const int width = std::min(32, n - j0);
+        __mmask8 mask[4];
+        for (int v = 0; v < 4; v++) {
+            const int lanes = std::max(0, std::min(8, width - 8 * v));
+            mask[v] = static_cast<__mmask8>((1u << lanes) - 1);
+        }
+        switch ((width + 7) / 8) {
+            case 1: rowBlockAvx512<4, 1>(a, lda, b + j0, ldb, c + j0, ldc, m, k, mask); break;
+            case 2: rowBlockAvx512<4, 2>(a, lda, b + j0, ldb, c + j0, ldc, m, k, mask); break;
+            case 3: rowBlockAvx512<2, 3>(a, lda, b + j0, ldb, c + j0, ldc, m, k, mask); break;
+            default: rowBlockAvx512<2, 4>(a, lda, b + j0, ldb, c + j0, ldc, m, k, mask); break;
+        }
+    }
+}
+
+template <int MR, int NV>
+__attribute__((target("avx512f")))
+static void microAvx512(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr, bool accumulate) {
+    const int NR = 8 * NV;
+    __m512d acc[MR][NV];
+    for (int i = 0; i < MR; i++) {
+        for (int v = 0; v < NV; v++) acc[i][v] = _mm512_setzero_pd();
+    }
+    for (int p = 0; p < kc; p++, a += MR, b += NR) {
+        __m512d row[NV];
+        for (int v = 0; v < NV; v++) row[v] = _mm512_loadu_pd(b + 8 * v);
+        for (int i = 0; i < MR; i++) {
+            const __m512d broadcast = _mm512_set1_pd(a[i]);
+            for (int v = 0; v < NV; v++) acc[i][v] = _mm512_fmadd_pd(broadcast, row[v], acc[i][v]);
+        }
+    }
+    for (int i = 0; i < MR; i++) {
+        if (i >= mr) break;
+        double* ci = c + static_cast<size_t>(i) * ldc;
+        for (int v = 0; v < NV; v++) {
+            const int lanes = std::max(0, std::min(8, nr - 8 * v));
+            const __mmask8 mask = static_cast<__mmask8>((1u << lanes) - 1);
+            __m512d value = acc[i][v];
+            if (accumulate) value = _mm512_add_pd(value, _mm512_maskz_loadu_pd(mask, ci + 8 * v));
+            _mm512_mask_storeu_pd(ci + 8 * v, mask, value);
+        }
+    }
+}
+
+// maskload/maskstore lane masks: the first `lanes` of four lanes
+__attribute__((target("avx2")))
+static inline __m256i laneMask(int lanes) {
+    static const int64_t table[8] = {-1, -1, -1, -1, 0, 0, 0, 0};
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(table + 4 - std::max(0, std::min(4, lanes))));
+}
+
+template <int R, int V>
+__attribute__((target("avx2,fma")))
+static inline void rowTileAvx2(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int k,
+                               const __m256i* mask) {
+    __m256d acc[R][V];
+    for (int r = 0; r < R; r++) {
+        for (int v = 0; v < V; v++) acc[r][v] = _mm256_setzero_pd();
+    }
+    for (int p = 0; p < k; p++) {
+        const double* bp = b + static_cast<size_t>(p) * ldb;
+        __m256d row[V];
+        for (int v = 0; v < V; v++) row[v] = _mm256_maskload_pd(bp + 4 * v, mask[v]);
+        for (int r = 0; r < R; r++) {
+            const __m256d broadcast = _mm256_set1_pd(a[static_cast<size_t>(r) * lda + p]);
+            for (int v = 0; v < V; v++) acc[r][v] = _mm256_fmadd_pd(broadcast, row[v], acc[r][v]);
+        }
+    }
+    for (int r = 0; r < R; r++) {
+        for (int v = 0; v < V; v++) _mm256_maskstore_pd(c + static_cast<size_t>(r) * ldc + 4 * v, mask[v], acc[r][v]);
+    }
+}
+
+template <int R, int V>
+__attribute__((target("avx2,fma")))
+static inline void rowBlockAvx2(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k,
+                                const __m256i* mask) {
+    int i = 0;
+    for (; i + R <= m; i += R) {
+        rowTileAvx2<R, V>(a + static_cast<size_t>(i) * lda, lda, b, ldb, c + static_cast<size_t>(i) * ldc, ldc, k, mask);
+    }
+    for (; i < m; i++) {
+        rowTileAvx2<1, V>(a + static_cast<size_t>(i) * lda, lda, b, ldb, c + static_cast<size_t>(i) * ldc, ldc, k, mask);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void rowsAvx2(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n) {
+    for (int j0 = 0; j0 < n; j0 += 16) {
+        const int width = std::min(16, n - j0);
+        __m256i mask[4];
+        for (int v = 0; v < 4; v++) mask[v] = laneMask(width - 4 * v);
+        switch ((width + 3) / 4) {
+            case 1: rowBlockAvx2<4, 1>(a, lda, b + j0, ldb, c + j0, ldc, m, k, mask); break;
+            case 2: rowBlockAvx2<4, 2>(a, lda, b + j0, ldb, c + j0, ldc, m, k, mask); break;
+            case 3: rowBlockAvx2<2, 3>(a, lda, b + j0, ldb, c + j0, ldc, m, k, mask); break;
+            default: rowBlockAvx2<2, 4>(a, lda, b + j0, ldb, c + j0, ldc, m, k, mask); break;
+        }
+    }
+}
+
+template <int MR, int NV>
+__attribute__((target("avx2,fma")))
+static void microAvx2(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr, bool accumulate) {
+    const int NR = 4 * NV;
+    __m256d acc[MR][NV];
+    for (int i = 0; i < MR; i++) {
+        for (int v = 0; v < NV; v++) acc[i][v] = _mm256_setzero_pd();
+    }
+    for (int p = 0; p < kc; p++, a += MR, b += NR) {
+        __m256d row[NV];
+        for (int v = 0; v < NV; v++) row[v] = _mm256_loadu_pd(b + 4 * v);
+        for (int i = 0; i < MR; i++) {
+            const __m256d broadcast = _mm256_set1_pd(a[i]);
+            for (int v = 0; v < NV; v++) acc[i][v] = _mm256_fmadd_pd(broadcast, row[v], acc[i][v]);
+        }
+    }
+    for (int i = 0; i < MR; i++) {
+        if (i >= mr) break;
+        double* ci = c + static_cast<size_t>(i) * ldc;
+        for (int v = 0; v < NV; v++) {
+            const __m256i mask = laneMask(nr - 4 * v);
+            __m256d value = acc[i][v];
+            if (accumulate) value = _mm256_add_pd(value, _mm256_maskload_pd(ci + 4 * v, mask));
+            _mm256_maskstore_pd(ci + 4 * v, mask, value);
+        }
+    }
+}
+#pragma GCC diagnostic pop
+#endif
+
+struct KernelInfo {
+    const char* name;
+    int rows, columns;  // tile of C per call (row kernels: rows per pass and columns per pass over k)
+    RowKernel row;      // row kernels
+    MicroKernel micro;  // packed kernels
+};
+
+static KernelInfo kernelInfo(GemmKernel kernel) {
+    switch (kernel) {
+        case GemmKernel::RowScalar: return {"row_scalar", 1, 8, rowsScalar, nullptr};
+        case GemmKernel::PackedScalar4x4: return {"packed_scalar_4x4", 4, 4, nullptr, microScalar4x4};
+#ifdef NN_X86_KERNELS
+        case GemmKernel::RowAvx2: return {"row_avx2", 4, 16, rowsAvx2, nullptr};
+        case GemmKernel::RowAvx512: return {"row_avx512", 4, 32, rowsAvx512, nullptr};
+        case GemmKernel::PackedAvx2_4x8: return {"packed_avx2_4x8", 4, 8, nullptr, microAvx2<4, 2>};
+        case GemmKernel::PackedAvx2_6x8: return {"packed_avx2_6x8", 6, 8, nullptr, microAvx2<6, 2>};
+        case GemmKernel::PackedAvx512_4x16: return {"packed_avx512_4x16", 4, 16, nullptr, microAvx512<4, 2>};
+        case GemmKernel::PackedAvx512_8x8: return {"packed_avx512_8x8", 8, 8, nullptr, microAvx512<8, 1>};
+        case GemmKernel::PackedAvx512_8x16: return {"packed_avx512_8x16", 8, 16, nullptr, microAvx512<8, 2>};
+#else
+        case GemmKernel::RowAvx2: return {"row_avx2", 4, 16, nullptr, nullptr};
+        case GemmKernel::RowAvx512: return {"row_avx512", 4, 32, nullptr, nullptr};
+        case GemmKernel::PackedAvx2_4x8: return {"packed_avx2_4x8", 4, 8, nullptr, nullptr};
+        case GemmKernel::PackedAvx2_6x8: return {"packed_avx2_6x8", 6, 8, nullptr, nullptr};
+        case GemmKernel::PackedAvx512_4x16: return {"packed_avx512_4x16", 4, 16, nullptr, nullptr};
+        case GemmKernel::PackedAvx512_8x8: return {"packed_avx512_8x8", 8, 8, nullptr, nullptr};
+        case GemmKernel::PackedAvx512_8x16: return {"packed_avx512_8x16", 8, 16, nullptr, nullptr};
+#endif
+    }
+    return {"unknown", 1, 1, nullptr, nullptr};
+}
+
+// Columns [0, n) of rows [0, k) of B into panels of nr columns, each k rows of nr values, zero padded
+static void packB(const double* b, int ldb, int k, int n, int nr, double* out) {
+    for (int j0 = 0; j0 < n; j0 += nr) {
+        const int width = std::min(nr, n - j0);
+        for (int p = 0; p < k; p++, out += nr) {
+            const double* row = b + static_cast<size_t>(p) * ldb + j0;
+            int j = 0;
+            for (; j < width; j++) out[j] = row[j];
+            for (; j < nr; j++) out[j] = 0.0;
+        }
+    }
+}
+
+// Rows [0, m) of columns [0, k) of A into panels of mr rows, each k columns of mr values, zero padded
+static void packA(const double* a, int lda, int m, int k, int mr, double* out) {
+    for (int i0 = 0; i0 < m; i0 += mr) {
+        const int height = std::min(mr, m - i0);
+        const double* panel = a + static_cast<size_t>(i0) * lda;
+        for (int p = 0; p < k; p++, out += mr) {
+            int i = 0;
+            for (; i < height; i++) out[i] = panel[static_cast<size_t>(i) * lda + p];
+            for (; i < mr; i++) out[i] = 0.0;
+        }
+    }
+}
+
+static int roundUp(int value, int multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// jc over nc columns of B, pc over kc of the depth (B block packed once), ic over mc rows of A
+// (A block packed), then the register tiles: the B block stays in L2, an A panel in L1.
+static void multiplyPacked(const KernelInfo &kernel, const GemmConfig &config, const double* a, int lda,
+                           const double* b, int ldb, double* c, int ldc, int m, int k, int n) {
+    const int mr = kernel.rows, nr = kernel.columns;
+    const int mc = std::min(roundUp(std::max(config.mc, 1), mr), roundUp(m, mr));
+    const int nc = std::min(roundUp(std::max(config.nc, 1), nr), roundUp(n, nr));
+    const int kc = std::min(std::max(config.kc, 1), k);
+
+    thread_local std::vector<double> packedA, packedB;
+    packedA.resize(static_cast<size_t>(mc) * kc);
+    packedB.resize(static_cast<size_t>(nc) * kc);
+
+    for (int jc = 0; jc < n; jc += nc) {
+        const int nb = std::min(nc, n - jc);
+        for (int pc = 0; pc < k; pc += kc) {
+            const int kb = std::min(kc, k - pc);
+            packB(b + static_cast<size_t>(pc) * ldb + jc, ldb, kb, nb, nr, packedB.data());
+            for (int ic = 0; ic < m; ic += mc) {
+                const int mb = std::min(mc, m - ic);
+                packA(a + static_cast<size_t>(ic) * lda + pc, lda, mb, kb, mr, packedA.data());
+                for (int jr = 0; jr < nb; jr += nr) {
+                    const double* panelB = packedB.data() + static_cast<size_t>(jr / nr) * kb * nr;
+                    for (int ir = 0; ir < mb; ir += mr) {
+                        kernel.micro(kb, packedA.data() + static_cast<size_t>(ir / mr) * kb * mr, panelB,
+                                     c + static_cast<size_t>(ic + ir) * ldc + jc + jr, ldc,
+                                     std::min(mr, mb - ir), std::min(nr, nb - jr), pc > 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void multiplyRange(const KernelInfo &kernel, const GemmConfig &config, const double* a, int lda,
+                          const double* b, int ldb, double* c, int ldc, int m, int k, int n) {
+    if (kernel.row) kernel.row(a, lda, b, ldb, c, ldc, m, k, n);
+    else multiplyPacked(kernel, config, a, lda, b, ldb, c, ldc, m, k, n);
+}
+
+void Gemm::multiply(const double* a, const double* b, double* c, int m, int k, int n) {
+    multiply(config(m, k, n), a, b, c, m, k, n);
+}
+
+static thread_local int gemmThreadLimit = 0;  // 0: no limit
+
+int Gemm::threadLimit() {
+    return gemmThreadLimit;
+}
+
+GemmThreadLimit::GemmThreadLimit(int threads) : previous(gemmThreadLimit) {
+    gemmThreadLimit = std::max(1, threads);
+}
+
+GemmThreadLimit::~GemmThreadLimit() {
+    gemmThreadLimit = previous;
+}
+
+int GemmThreadLimit::shareOf(int workers) {
+    const int hardware = std::max(1u, std::thread::hardware_concurrency());
+    return std::max(1, hardware / std::max(1, workers));
+}
+
+// Threaded products run on one process wide pool of the hardware threads, started with the first
+// of them, instead of starting threads per call. One product uses it at a time: a product that finds
+// it busy (another thread is multiplying on every core already) runs on its calling thread.
+static ThreadPool& gemmPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+static std::mutex gemmPoolMutex;
+
+// Threads take contiguous runs of whole tiles of C, rows or columns; each packs its own blocks
+void Gemm::multiply(const GemmConfig &config, const double* a, const double* b, double* c, int m, int k, int n) {
+    if (m <= 0 || n <= 0) return;
+    if (!supported(config.kernel)) {
+        throw std::invalid_argument(std::string("GEMM kernel not supported on this CPU: ") + kernelName(config.kernel));
+    }
+    if (k <= 0) {
+        std::fill(c, c + static_cast<size_t>(m) * n, 0.0);
+        return;
+    }
+    const KernelInfo kernel = kernelInfo(config.kernel);
+    const bool byRows = config.split == GemmSplit::Rows;
+    const int unit = byRows ? kernel.rows : kernel.columns;
+    const int extent = byRows ? m : n;
+    const int units = (extent + unit - 1) / unit;
+    const int threads = gemmThreadLimit > 0 ? std::min(config.threads, gemmThreadLimit) : config.threads;
+    const int workers = std::max(1, std::min(threads, units));
+    std::unique_lock<std::mutex> poolLock(gemmPoolMutex, std::defer_lock);
+    if (workers == 1 || !poolLock.try_lock()) {
+        multiplyRange(kernel, config, a, k, b, n, c, n, m, k, n);
+        return;
+    }
+    const int chunk = (units + workers - 1) / workers * unit;
+    const int parts = (extent + chunk - 1) / chunk;
+    gemmPool().parallelFor(parts, [&](int index) {
+        const int begin = index * chunk;
+        const int count = std::min(extent, begin + chunk) - begin;
+        if (byRows) {
+            multiplyRange(kernel, config, a + static_cast<size_t>(begin) * k, k, b, n,
+                          c + static_cast<size_t>(begin) * n, n, count, k, n);
+        } else {
+            multiplyRange(kernel, config, a, k, b + begin, n, c + begin, n, m, k, count);
+        }
+    });
+}
+
+// Packing pays off once a block of B is reused by enough rows of A and is too wide for the row
+// kernels' registers; a thread is worth starting for about a million multiply-adds.
+GemmConfig Gemm::heuristic(int m, int k, int n) {
+    const bool avx512 = supported(GemmKernel::RowAvx512), avx2 = supported(GemmKernel::RowAvx2);
+    GemmConfig config;
+    if (m >= 64 && n > 32 && k >= 64) {
+        config.kernel = avx512 ? GemmKernel::PackedAvx512_8x16 : avx2 ? GemmKernel::PackedAvx2_6x8 : GemmKernel::PackedScalar4x4;
+    } else {
+        config.kernel = avx512 ? GemmKernel::RowAvx512 : avx2 ? GemmKernel::RowAvx2 : GemmKernel::RowScalar;
+    }
+    const double work = static_cast<double>(m) * k * n;
+    const int hardware = std::max(1u, std::thread::hardware_concurrency());
+    config.threads = static_cast<int>(std::max(1.0, std::min<double>(hardware, work / (1 << 20))));
+    config.split = m >= n ? GemmSplit::Rows : GemmSplit::Columns;
+    return config;
+}
+
+static std::mutex tuningMutex;
+static std::shared_ptr<const GemmTuning> installedTuning;
+static bool tuningLoaded = false;
+static std::atomic<uint64_t> tuningVersion{1};  // bumped on every change, invalidates the per-thread lookups
+
+std::shared_ptr<const GemmTuning> Gemm::tuning() {
+    std::lock_guard<std::mutex> lock(tuningMutex);
+    if (!tuningLoaded) {
+        tuningLoaded = true;
+        try {
+            GemmTuning loaded = GemmTuning::load(defaultTuningPath());
+            if (loaded.size() > 0) installedTuning = std::make_shared<const GemmTuning>(std::move(loaded));
+        } catch (const std::exception &e) {
+            std::cerr << "Ignoring the GEMM tuning cache: " << e.what() << std::endl;
+        }
+        tuningVersion++;
+    }
+    return installedTuning;
+}
+
+void Gemm::setTuning(std::shared_ptr<const GemmTuning> tuning) {
+    std::lock_guard<std::mutex> lock(tuningMutex);
+    installedTuning = std::move(tuning);
+    tuningLoaded = true;
+    tuningVersion++;
+}
+
+// The last few shapes of each thread are remembered, so a training step (a handful of shapes per
+// layer) looks the table up only when it changes
+GemmConfig Gemm::config(int m, int k, int n) {
+    struct Lookup {
+        uint64_t version = 0;
+        GemmShape shape;
+        GemmConfig config;
+    };
+    thread_local Lookup recent[8];
+    thread_local int next = 0;
+    const uint64_t version = tuningVersion.load(std::memory_order_acquire);
+    for (const Lookup &lookup : recent) {
+        if (lookup.version == version && lookup.shape.m == m && lookup.shape.k == k && lookup.shape.n == n) {
+            return lookup.config;
+        }
+    }
+    std::shared_ptr<const GemmTuning> table = tuning();
+    GemmConfig chosen;
+    if (!table || !table->find({m, k, n}, chosen) || !supported(chosen.kernel)) chosen = heuristic(m, k, n);
+    recent[next] = {version, {m, k, n}, chosen};
+    next = (next + 1) % 8;
+    return chosen;
+}
+
+std::string Gemm::defaultTuningPath() {
+    const char* env = std::getenv("NN_GEMM_TUNING");
+    return env && *env ? env : "gemm_tuning.txt";
+}
+
+static std::string collapseSpaces(const std::string &text) {
+    std::string result;
+    for (char ch : text) {
+        if (std::isspace(static_cast<unsigned char>(ch))) {
+            if (!result.empty() && result.back() != ' ') result += ' ';
+        } else {
+            result += ch;
+        }
+    }
+    if (!result.empty() && result.back() == ' ') result.pop_back();
+    return result;
+}
+
+std::string Gemm::cpuModel() {
+    static const std::string model = [] {
+        std::string name;
+#ifdef NN_X86_KERNELS
+        unsigned int regs[4];
+        if (__get_cpuid(0x80000000, &regs[0], &regs[1], &regs[2], &regs[3]) && regs[0] >= 0x80000004) {
+            char brand[49] = {};
+            for (unsigned int leaf = 0; leaf < 3; leaf++) {
+                __get_cpuid(0x80000002 + leaf, &regs[0], &regs[1], &regs[2], &regs[3]);
+                std::memcpy(brand + 16 * leaf, regs, sizeof(regs));
+            }
+            name = collapseSpaces(brand);
+        }
+#endif
+        if (name.empty()) {  // other architectures: what the kernel reports
+            std::ifstream cpuinfo("/proc/cpuinfo");
+            std::string line;
+            while (name.empty() && std::getline(cpuinfo, line)) {
+                size_t colon = line.find(':');
+                if (colon == std::string::npos) continue;
+                std::string key = collapseSpaces(line.substr(0, colon));
+                if (key == "model name" || key == "Processor" || key == "cpu model" || key == "uarch") {
+                    name = collapseSpaces(line.substr(colon + 1));
+                }
+            }
+        }
+        return name.empty() ? std::string("unknown") : name;
+    }();
+    return model;
+}
+
+bool Gemm::supported(GemmKernel kernel) {
+    switch (kernel) {
+        case GemmKernel::RowScalar:
+        case GemmKernel::PackedScalar4x4:
+            return true;
+#ifdef NN_X86_KERNELS
+        case GemmKernel::RowAvx2:
+        case GemmKernel::PackedAvx2_4x8:
+        case GemmKernel::PackedAvx2_6x8:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case GemmKernel::RowAvx512:
+        case GemmKernel::PackedAvx512_4x16:
+        case GemmKernel::PackedAvx512_8x8:
+        case GemmKernel::PackedAvx512_8x16:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* Gemm::kernelName(GemmKernel kernel) {
+    return kernelInfo(kernel).name;
+}
+
+bool Gemm::parseKernel(const std::string &name, GemmKernel &kernel) {
+    for (int i = 0; i <= static_cast<int>(GemmKernel::PackedAvx512_8x16); i++) {
+        if (name == kernelName(static_cast<GemmKernel>(i))) {
+            kernel = static_cast<GemmKernel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* Gemm::splitName(GemmSplit split) {
+    return split == GemmSplit::Rows ? "rows" : "columns";
+}
+
+int Gemm::tileRows(GemmKernel kernel) {
+    return kernelInfo(kernel).rows;
+}
+
+int Gemm::tileColumns(GemmKernel kernel) {
+    return kernelInfo(kernel).columns;
+}
+
+bool Gemm::packed(GemmKernel kernel) {
+    return kernel >= GemmKernel::PackedScalar4x4;
+}
+
+GemmTuning::GemmTuning(std::string cpu) : cpu(std::move(cpu)) {}
+
+void GemmTuning::set(const GemmShape &shape, const GemmConfig &config, double ns) {
+    entries[shape] = {config, ns};
+}
+
+bool GemmTuning::find(const GemmShape &shape, GemmConfig &config) const {
+    auto above = entries.lower_bound(shape);
+    if (above != entries.end() && above->first.m == shape.m && above->first.k == shape.k && above->first.n == shape.n) {
+        config = above->second.config;
+        return true;
+    }
+    // Same k and n: the neighbours on either side of m
+    const Entry* best = nullptr;
+    double bestDistance = 0.0;
+    auto consider = [&](std::map<GemmShape, Entry>::const_iterator it) {
+        if (it->first.k != shape.k || it->first.n != shape.n) return;
+        double distance = std::fabs(std::log(static_cast<double>(it->first.m) / std::max(shape.m, 1)));
+        if (!best || distance < bestDistance) {
+            best = &it->second;
+            bestDistance = distance;
+        }
+    };
+    if (above != entries.end()) consider(above);
+    if (above != entries.begin()) consider(std::prev(above));
+    if (!best) return false;
+    config = best->config;
+    return true;
+}
+
+static const char* sectionPrefix = "cpu ";
+
+static bool sectionOf(const std::string &line, std::string &cpu) {
+    if (line.compare(0, 4, sectionPrefix) != 0) return false;
+    cpu = collapseSpaces(line.substr(4));
+    return true;
+}
+
+void GemmTuning::save(const std::string &path) const {
+    try {
+        if (path.empty()) {
+            throw std::invalid_argument("Filename cannot be empty");
+        }
+        // Everything outside this CPU's section is kept as it is
+        std::vector<std::string> kept;
+        {
+            std::ifstream existing(path);
+            std::string line, section;
+            bool ours = false;
+            while (std::getline(existing, line)) {
+                if (sectionOf(line, section)) ours = section == collapseSpaces(cpu);
+                if (!ours) kept.push_back(line);
+            }
+        }
+        if (kept.empty()) kept.push_back("# GEMM tuning cache, one section per CPU model (see GemmTuner)");
+
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary);
+            if (!file) {
+                throw std::runtime_error("Could not create file " + temporary);
+            }
+            for (const std::string &line : kept) file << line << "\n";
+            file << sectionPrefix << collapseSpaces(cpu) << "\n";
+            file << "# m k n kernel mc kc nc threads split ns\n";
+            for (const auto &entry : entries) {
+                const GemmShape &s = entry.first;
+                const GemmConfig &c = entry.second.config;
+                file << s.m << ' ' << s.k << ' ' << s.n << ' ' << Gemm::kernelName(c.kernel) << ' '
+                     << c.mc << ' ' << c.kc << ' ' << c.nc << ' ' << c.threads << ' '
+                     << Gemm::splitName(c.split) << ' ' << entry.second.ns << "\n";
+            }
+            if (!file) {
+                throw std::runtime_error("Failed to write " + temporary);
+            }
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("Could not replace " + path);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving GEMM tuning: " << e.what() << std::endl;
+        throw;
+    }
+}
+
+GemmTuning GemmTuning::load(const std::string &path, const std::string &cpu) {
+    GemmTuning tuning(cpu);
+    std::ifstream file(path);
+    if (!file) return tuning;  // not tuned yet
+
+    const std::string wanted = collapseSpaces(cpu);
+    std::string line, section;
+    bool ours = false;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        if (sectionOf(line, section)) {
+            ours = section == wanted;
+            continue;
+        }
+        if (!ours || line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        GemmShape shape;
+        GemmConfig config;
+        std::string kernel, split;
+        double ns = 0.0;
+        bool valid = static_cast<bool>(fields >> shape.m >> shape.k >> shape.n >> kernel >> config.mc >> config.kc >>
+                                       config.nc >> config.threads >> split >> ns) &&
+                     Gemm::parseKernel(kernel, config.kernel) && (split == "rows" || split == "columns") &&
+                     shape.m > 0 && shape.k > 0 && shape.n > 0 && config.mc > 0 && config.kc > 0 &&
+                     config.nc > 0 && config.threads > 0;
+        if (!valid) {
+            throw std::runtime_error("Invalid GEMM tuning entry at " + path + ":" + std::to_string(lineNumber));
+        }
+        config.split = split == "rows" ? GemmSplit::Rows : GemmSplit::Columns;
+        tuning.set(shape, config, ns);
+    }
+    return tuning;
+}
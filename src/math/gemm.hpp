@@ -0,0 +1,120 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+
+// Kernels of the double precision product behind Matrix::operator*.
+//
+//   row_*     no packing: a few rows of C at a time are accumulated in registers over k, up to 32
+//             (AVX-512) / 16 (AVX2) columns per pass. Cheapest setup, best for small and narrow products.
+//   packed_*  blocked like BLIS: a kc x nc block of B and an mc x kc block of A are copied into
+//             micro-panels, and a register tile of C (rows x columns in the name) is computed per panel pair
+enum class GemmKernel {
+    RowScalar, RowAvx2, RowAvx512,
+    PackedScalar4x4, PackedAvx2_4x8, PackedAvx2_6x8, PackedAvx512_4x16, PackedAvx512_8x8, PackedAvx512_8x16
+};
+
+enum class GemmSplit { Rows, Columns };  // how threads divide C
+
+struct GemmConfig {
+    GemmKernel kernel = GemmKernel::RowScalar;
+    int mc = 96, kc = 256, nc = 512;  // packed kernels: rows of A, depth and columns of B per cache block
+    int threads = 1;
+    GemmSplit split = GemmSplit::Rows;
+
+    bool operator==(const GemmConfig &other) const;
+    bool operator!=(const GemmConfig &other) const { return !(*this == other); }
+};
+
+// C (m x n) = A (m x k) * B (k x n)
+struct GemmShape {
+    int m = 0, k = 0, n = 0;
+    bool operator<(const GemmShape &other) const;
+};
+
+class GemmTuning;
+
+// Row major double GEMM. multiply() without a config takes the entry of the installed tuning
+// table (see GemmTuner) for the shape, or for the nearest batch size with the same k and n, and
+// falls back to heuristic() for shapes that were never tuned. The table of this CPU model is loaded
+// from defaultTuningPath() on the first product. Threaded products run on a process wide ThreadPool,
+// one product at a time; a product that finds it busy runs on the calling thread.
+class Gemm {
+public:
+    static void multiply(const double* a, const double* b, double* c, int m, int k, int n);
+    static void multiply(const GemmConfig &config, const double* a, const double* b, double* c, int m, int k, int n);
+
+    static GemmConfig config(int m, int k, int n);     // what multiply() runs for the shape
+    static GemmConfig heuristic(int m, int k, int n);  // the choice without a tuning entry
+    // Most threads a product on the calling thread uses, 0: as the config says (see GemmThreadLimit)
+    static int threadLimit();
+
+    // Replaces the table multiply() consults, nullptr leaves only the heuristics
+    static void setTuning(std::shared_ptr<const GemmTuning> tuning);
+    static std::shared_ptr<const GemmTuning> tuning();
+    static std::string defaultTuningPath();  // NN_GEMM_TUNING, or gemm_tuning.txt in the working directory
+    static std::string cpuModel();           // the CPUID brand string, the key of a tuning table
+
+    static bool supported(GemmKernel kernel);
+    static const char* kernelName(GemmKernel kernel);
+    static bool parseKernel(const std::string &name, GemmKernel &kernel);
+    static const char* splitName(GemmSplit split);
+    static int tileRows(GemmKernel kernel);     // rows of C per kernel call
+    static int tileColumns(GemmKernel kernel);  // columns of C per kernel call
+    static bool packed(GemmKernel kernel);
+};
+
+// Caps the threads of the products on this thread for the scope. Threads that already run side by
+// side with others (ThreadPool and InferenceServer workers) take their share of the cores, so N
+// workers do not each split a GEMM over every core:
+//
+//   GemmThreadLimit limit(GemmThreadLimit::shareOf(workers));   // 1 when workers >= cores
+class GemmThreadLimit {
+public:
+    explicit GemmThreadLimit(int threads);
+    ~GemmThreadLimit();
+
+    GemmThreadLimit(const GemmThreadLimit&) = delete;
+    GemmThreadLimit& operator=(const GemmThreadLimit&) = delete;
+
+    // Hardware threads per worker of `workers` running at once, at least 1
+    static int shareOf(int workers);
+
+private:
+    int previous;
+};
+
+// The fastest configuration per shape on one CPU model.
+//
+// The cache file holds one section per CPU model, so a file shared across machines (e.g. in the
+// repo or on NFS) keeps every model's winners:
+//
+//   cpu Intel(R) Xeon(R) Platinum 8280 CPU @ 2.70GHz
+//   # m k n kernel mc kc nc threads split ns
+//   64 784 16 row_avx512 96 256 512 1 rows 10512.3
+class GemmTuning {
+public:
+    struct Entry {
+        GemmConfig config;
+        double ns = 0.0;  // median time of the winner when it was tuned
+    };
+
+    std::string cpu;
+    std::map<GemmShape, Entry> entries;
+
+    explicit GemmTuning(std::string cpu = Gemm::cpuModel());
+
+    void set(const GemmShape &shape, const GemmConfig &config, double ns);
+    // The entry of the shape, else the one with the same k and n and the closest m (by ratio)
+    bool find(const GemmShape &shape, GemmConfig &config) const;
+    size_t size() const { return entries.size(); }
+
+    // Rewrites this CPU's section of the file and keeps the other sections
+    void save(const std::string &path) const;
+    // The section of `cpu`; empty when the file or the section does not exist
+    static GemmTuning load(const std::string &path, const std::string &cpu = Gemm::cpuModel());
+};
+
+#endif  // GEMM_HPP
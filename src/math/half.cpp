@@ -0,0 +1,184 @@
+#include "half.hpp"
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NN_X86_KERNELS 1
+#endif
+
+const char* precisionName(Precision precision) {
+    switch (precision) {
+        case Precision::Double: return "double";
+        case Precision::Float16: return "fp16";
+        case Precision::BFloat16: return "bf16";
+    }
+    return "unknown";
+}
+
+static uint32_t floatBits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bitsToFloat(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Drops the low `shift` bits of mantissa, rounding to nearest even
+static uint32_t roundShift(uint32_t mantissa, int shift) {
+    uint32_t kept = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (kept & 1))) kept++;
+    return kept;
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits = floatBits(value);
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {  // inf, NaN (quieted, top payload bits kept like F16C)
+        return sign | (magnitude > 0x7f800000 ? 0x7e00 | ((magnitude & 0x7fffff) >> 13) : 0x7c00);
+    }
+    if (magnitude >= 0x477ff000) {  // rounds past 65504
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000) {   // below 2^-14: half subnormal or zero
+        int shift = 126 - static_cast<int>(magnitude >> 23);
+        if (shift > 24) return sign;
+        return sign | static_cast<uint16_t>(roundShift((magnitude & 0x7fffff) | 0x800000, shift));
+    }
+    // Rebias the exponent (127 -> 15), a mantissa carry correctly bumps the exponent
+    return sign | static_cast<uint16_t>(roundShift(magnitude - 0x38000000, 13));
+}
+
+float halfToFloat(uint16_t bits) {
+    uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+    uint32_t exponent = (bits >> 10) & 0x1f;
+    uint32_t mantissa = bits & 0x3ff;
+    if (exponent == 0) {
+        float magnitude = mantissa * (1.0f / 16777216.0f);  // mantissa * 2^-24, exact
+        return bitsToFloat(floatBits(magnitude) | sign);
+    }
+    if (exponent == 31) {
+        return bitsToFloat(sign | 0x7f800000 | (mantissa << 13));
+    }
+    return bitsToFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+uint16_t floatToBFloat16(float value) {
+    uint32_t bits = floatBits(value);
+    if ((bits & 0x7fffffff) > 0x7f800000) {
+        return static_cast<uint16_t>((bits >> 16) | 0x0040);  // quiet NaN
+    }
+    return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+float bfloat16ToFloat(uint16_t bits) {
+    return bitsToFloat(static_cast<uint32_t>(bits) << 16);
+}
+
+static std::atomic<bool> simdEnabled{true};
+
+void setHalfSimdEnabled(bool enabled) {
+    simdEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+#ifdef NN_X86_KERNELS
+__attribute__((target("avx,f16c")))
+static size_t toHalfF16c(const float* in, uint16_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+    }
+    return i;
+}
+
+__attribute__((target("avx,f16c")))
+static size_t fromHalfF16c(const uint16_t* in, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512bf16")))
+static size_t toBFloat16Avx512(const float* in, uint16_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), reinterpret_cast<__m256i&>(h));
+    }
+    return i;
+}
+
+// bf16 is the upper half of a float: widen and shift
+__attribute__((target("avx2")))
+static size_t fromBFloat16Avx2(const uint16_t* in, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_slli_epi32(wide, 16));
+    }
+    return i;
+}
+
+static bool hasF16c() {
+    static const bool supported = __builtin_cpu_supports("f16c");
+    return supported;
+}
+
+static bool hasAvx512Bf16() {
+    static const bool supported = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bf16");
+    return supported;
+}
+
+static bool hasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+void convertToHalf(const float* in, uint16_t* out, size_t n, Precision precision) {
+    size_t i = 0;
+    bool simd = simdEnabled.load(std::memory_order_relaxed);
+    if (precision == Precision::Float16) {
+#ifdef NN_X86_KERNELS
+        if (simd && hasF16c()) i = toHalfF16c(in, out, n);
+#endif
+        for (; i < n; i++) out[i] = floatToHalf(in[i]);
+    } else if (precision == Precision::BFloat16) {
+#ifdef NN_X86_KERNELS
+        if (simd && hasAvx512Bf16()) i = toBFloat16Avx512(in, out, n);
+#endif
+        for (; i < n; i++) out[i] = floatToBFloat16(in[i]);
+    } else {
+        throw std::invalid_argument("convertToHalf needs a 16 bit precision");
+    }
+}
+
+void convertFromHalf(const uint16_t* in, float* out, size_t n, Precision precision) {
+    size_t i = 0;
+    bool simd = simdEnabled.load(std::memory_order_relaxed);
+    if (precision == Precision::Float16) {
+#ifdef NN_X86_KERNELS
+        if (simd && hasF16c()) i = fromHalfF16c(in, out, n);
+#endif
+        for (; i < n; i++) out[i] = halfToFloat(in[i]);
+    } else if (precision == Precision::BFloat16) {
+#ifdef NN_X86_KERNELS
+        if (simd && hasAvx2()) i = fromBFloat16Avx2(in, out, n);
+#endif
+        for (; i < n; i++) out[i] = bfloat16ToFloat(in[i]);
+    } else {
+        throw std::invalid_argument("convertFromHalf needs a 16 bit precision");
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef HALF_HPP
+#define HALF_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Storage precision of parameters and activations (see NeuralNetwork::setPrecision)
+enum class Precision { Double, Float16, BFloat16 };
+
+const char* precisionName(Precision precision);
+
+// IEEE binary16 and bfloat16 kept as raw 16 bit patterns. Conversions from float round to
+// nearest even, overflow gives infinity and NaN stays NaN.
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t bits);
+uint16_t floatToBFloat16(float value);
+float bfloat16ToFloat(uint16_t bits);
+
+// Bulk conversions for Float16 / BFloat16 (not Double). They use F16C, AVX-512 BF16 and AVX2 when
+// the CPU has them and give the same bits as the scalar functions, except that the AVX-512 BF16
+// instruction flushes float denormals (below 1.2e-38) to zero.
+void convertToHalf(const float* in, uint16_t* out, size_t n, Precision precision);
+void convertFromHalf(const uint16_t* in, float* out, size_t n, Precision precision);
+
+// Forces the scalar conversions (for tests and benchmarks)
+void setHalfSimdEnabled(bool enabled);
+
+#endif  // HALF_HPP
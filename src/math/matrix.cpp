@@ -1,20 +1,58 @@
 #include "matrix.hpp"
+#include "gemm.hpp"
+#include "numa.hpp"
 #include <algorithm>  // For std::copy
 
+// Allocates one contiguous zeroed block plus the row pointer table
+void Matrix::allocate(int r, int c) {
+    rows = r;
+    cols = c;
+    // Large buffers under a MemoryPolicyScope come straight from the kernel, already zero
+    storage = static_cast<double*>(NumaMemory::map(static_cast<size_t>(r) * c * sizeof(double), NumaMemory::current()));
+    mappedStorage = storage != nullptr;
+    if (!mappedStorage) {
+        storage = new double[static_cast<size_t>(r) * c](); // () for initializing with zeros 0.0
+    }
+    ownsStorage = true;
+    data = new double*[rows];
+    allocCategory = AllocationStats::current();
+    AllocationStats::recordAllocation(allocCategory, static_cast<size_t>(r) * c * sizeof(double));
+    AllocationStats::recordAllocation(allocCategory, rows * sizeof(double*));
+    for (int i = 0; i < rows; i++) {
+        data[i] = storage + static_cast<size_t>(i) * cols;
+    }
+}
+
+void Matrix::release() {
+    if (data) {
+        AllocationStats::recordFree(allocCategory, rows * sizeof(double*));
+    }
+    if (ownsStorage && storage) {
+        AllocationStats::recordFree(allocCategory, static_cast<size_t>(rows) * cols * sizeof(double));
+    }
+    delete[] data;
+    if (ownsStorage && mappedStorage) {
+        NumaMemory::unmap(storage, static_cast<size_t>(rows) * cols * sizeof(double));
+    } else if (ownsStorage) {
+        delete[] storage;
+    }
+    data = nullptr;
+    storage = nullptr;
+    ownsStorage = true;
+    mappedStorage = false;
+}
+
 // Default constructor: Initializes empty matrix
-Matrix::Matrix() : rows(0), cols(0), data(nullptr) {}
+Matrix::Matrix() : storage(nullptr), ownsStorage(true), mappedStorage(false), allocCategory(AllocCategory::Other), rows(0), cols(0), data(nullptr) {}
 
 // Constructor: Initializes matrix with given rows and columns
-Matrix::Matrix(int r, int c) : rows(r), cols(c) {
+Matrix::Matrix(int r, int c) : storage(nullptr), ownsStorage(true), mappedStorage(false), allocCategory(AllocCategory::Other), rows(r), cols(c), data(nullptr) {
     try {
         if (r <= 0 || c <= 0) {
             throw std::invalid_argument("Matrix dimensions must be positive");
         }
 
-        data = new double*[rows];
-        for (int i = 0; i < rows; i++) {
-            data[i] = new double[cols](); // () for initializing with zeros 0.0
-        }
+        allocate(r, c);
     }
     catch (const std::exception& e) {
         std::cerr << "Error creating matrix: " << e.what() << std::endl;
@@ -23,44 +61,64 @@ Matrix::Matrix(int r, int c) : rows(r), cols(c) {
 }
 
 // Copy Constructor: Deep copy
-Matrix::Matrix(const Matrix &other) : rows(other.rows), cols(other.cols) {
-    data = new double*[rows];
-    for (int i = 0; i < rows; i++) {
-        data[i] = new double[cols];
-        std::copy(other.data[i], other.data[i] + cols, data[i]);  // deep iterator copy
+Matrix::Matrix(const Matrix &other) : storage(nullptr), ownsStorage(true), mappedStorage(false), allocCategory(AllocCategory::Other), rows(0), cols(0), data(nullptr) {
+    if (other.data) {
+        allocate(other.rows, other.cols);
+        for (int i = 0; i < rows; i++) {
+            std::copy(other.data[i], other.data[i] + cols, data[i]);  // deep iterator copy
+        }
     }
 }
 
+// Move Constructor: takes over the buffers (a moved view stays a view)
+Matrix::Matrix(Matrix &&other) noexcept
+    : storage(other.storage), ownsStorage(other.ownsStorage), mappedStorage(other.mappedStorage),
+      allocCategory(other.allocCategory), rows(other.rows), cols(other.cols), data(other.data) {
+    other.storage = nullptr;
+    other.data = nullptr;
+    other.ownsStorage = true;
+    other.mappedStorage = false;
+    other.rows = 0;
+    other.cols = 0;
+}
+
 // Destructor: Frees allocated memory to prevent memory leaks
 Matrix::~Matrix() {
-    try {
-        if (data) {
-            for (int i = 0; i < rows; i++) {
-                delete[] data[i];
-            }
-            delete[] data;
-        }
+    release();
+}
+
+Matrix Matrix::view(double* buffer, int r, int c) {
+    if (!buffer || r <= 0 || c <= 0) {
+        throw std::invalid_argument("Matrix view needs a buffer and positive dimensions");
     }
-    catch (const std::exception& e) {
-        std::cerr << "Error in matrix destructor: " << e.what() << std::endl;
+    Matrix m;
+    m.rows = r;
+    m.cols = c;
+    m.storage = buffer;
+    m.ownsStorage = false;
+    m.data = new double*[r];
+    m.allocCategory = AllocationStats::current();
+    AllocationStats::recordAllocation(m.allocCategory, r * sizeof(double*));
+    for (int i = 0; i < r; i++) {
+        m.data[i] = buffer + static_cast<size_t>(i) * c;
     }
+    return m;
+}
+
+bool Matrix::isView() const {
+    return !ownsStorage;
 }
 
-// Random Initialization (For weights)
+// Random Initialization (For weights): every call draws a fresh stream of the global seed
+// (see Random), the values come from one vectorized, multi-threaded bulk fill
 void Matrix::randomize(double lowerLimit, double upperLimit) {
     try {
         if (lowerLimit >= upperLimit) {
             throw std::invalid_argument("Lower limit must be less than upper limit");
         }
-
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dist(lowerLimit, upperLimit); 
-
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
-                data[i][j] = dist(gen);
-            }
+        RandomStream rng = Random::nextStream();
+        if (rows > 0 && cols > 0) {
+            rng.fillUniform(data[0], static_cast<size_t>(rows) * cols, lowerLimit, upperLimit);
         }
     }
     catch (const std::exception& e) {
@@ -69,6 +127,16 @@ void Matrix::randomize(double lowerLimit, double upperLimit) {
     }
 }
 
+void Matrix::randomizeNormal(double mean, double stddev) {
+    if (stddev < 0.0) {
+        throw std::invalid_argument("Standard deviation cannot be negative");
+    }
+    RandomStream rng = Random::nextStream();
+    if (rows > 0 && cols > 0) {
+        rng.fillNormal(data[0], static_cast<size_t>(rows) * cols, mean, stddev);
+    }
+}
+
 // Check Equality of two matrices
 bool Matrix::isEqual(const Matrix& other) const {
     if (this->rows != other.rows || this->cols != other.cols)
@@ -135,20 +203,27 @@ Matrix Matrix::sumRows() const {
     return result;
 }
 
+// Adds a (1, cols) row to every row, used for biases on a batch of inputs
+Matrix Matrix::addRowVector(const Matrix &row) const {
+    if (row.rows != 1 || row.cols != cols) {
+        throw std::invalid_argument("Row vector dimensions do not match for broadcast Addition");
+    }
+    Matrix result(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            result.data[i][j] = data[i][j] + row.data[0][j];
+        }
+    }
+    return result;
+}
+
 // Operator Overloading for Matrix Multiplication
 Matrix Matrix::operator*(const Matrix &other) const {
     if (cols != other.rows) {
         throw std::invalid_argument("Matrix dimensions do not match for multiplication");
     }
     Matrix result(rows, other.cols);
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < other.cols; j++) {
-            result.data[i][j] = 0;
-            for (int k = 0; k < cols; k++) {
-                result.data[i][j] = result.data[i][j] + (data[i][k] * other.data[k][j]);
-            }
-        }
-    }
+    Gemm::multiply(storage, other.storage, result.storage, rows, cols, other.cols);  // tuned kernel for the shape
     return result;
 }
 
@@ -167,21 +242,48 @@ Matrix Matrix::operator*(double scalar) const {
 Matrix& Matrix::operator=(const Matrix &other) {
     if (this == &other) return *this;  // Self-assignment check
 
-    // Free existing memory
-    for (int i = 0; i < rows; i++) {
-        delete[] data[i];
+    // Same shape: reuse the existing buffers instead of reallocating
+    // (for a view this writes through to the viewed memory)
+    if (rows == other.rows && cols == other.cols && data) {
+        for (int i = 0; i < rows; i++) {
+            std::copy(other.data[i], other.data[i] + cols, data[i]);
+        }
+        return *this;
+    }
+
+    // Free existing memory and copy new data
+    release();
+    rows = 0;
+    cols = 0;
+    if (other.data) {
+        allocate(other.rows, other.cols);
+        for (int i = 0; i < rows; i++) {
+            std::copy(other.data[i], other.data[i] + cols, data[i]); // Deep copy
+        }
     }
-    delete[] data;
 
-    // Copy new data
+    return *this;
+}
+
+// Move assignment: takes over the buffers of a temporary
+Matrix& Matrix::operator=(Matrix &&other) noexcept {
+    if (this == &other) return *this;
+
+    release();
+    storage = other.storage;
+    ownsStorage = other.ownsStorage;
+    mappedStorage = other.mappedStorage;
+    allocCategory = other.allocCategory;
     rows = other.rows;
     cols = other.cols;
-    data = new double*[rows];
-    for (int i = 0; i < rows; i++) {
-        data[i] = new double[cols];
-        std::copy(other.data[i], other.data[i] + cols, data[i]); // Deep copy
-    }
+    data = other.data;
 
+    other.storage = nullptr;
+    other.data = nullptr;
+    other.ownsStorage = true;
+    other.mappedStorage = false;
+    other.rows = 0;
+    other.cols = 0;
     return *this;
 }
 
@@ -198,6 +300,7 @@ Matrix Matrix::transpose() {
 
 // Apply Function (Activation) row wise // change vector later
 Matrix Matrix::applyFunction(std::function<std::vector<double>(std::vector<double>&)> func) {
+    AllocationScope scope(AllocCategory::Activation);
     Matrix result(rows, cols);
     std::vector<double> buffer(cols);
     for (int i = 0; i < rows; i++) { // For each row
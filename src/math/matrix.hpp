@@ -6,27 +6,46 @@
 #include <iomanip>  // For printing formatting
 #include <random>
 #include <functional>  // For using lambda function to pass member functions as pointer parameters
+#include "allocation_stats.hpp"
+#include "random.hpp"
 
 class Matrix {
+private:
+    double* storage;   // one contiguous rows * cols block, data[i] points into it
+    bool ownsStorage;  // false for views over memory owned elsewhere (e.g. a memory mapped model file)
+    bool mappedStorage;  // storage came from NumaMemory::map (a MemoryPolicyScope was active), not new[]
+    AllocCategory allocCategory;  // who allocated the buffers, for AllocationStats
+
+    void allocate(int r, int c);
+    void release();
+
 public:
     int rows, cols;
     double** data;
 
     Matrix();
     Matrix(int r, int c);
-    Matrix(const Matrix &other);
+    Matrix(const Matrix &other);  // always a deep, owning copy (also when copying a view)
+    Matrix(Matrix &&other) noexcept;
     ~Matrix();
 
-    void randomize(double lowerLimit = -0.1, double upperLimit = 0.1);
+    // Non-owning matrix over an existing row-major buffer, the buffer must outlive the view
+    static Matrix view(double* buffer, int r, int c);
+    bool isView() const;
+
+    void randomize(double lowerLimit = -0.1, double upperLimit = 0.1);  // uniform, see Random for seeding
+    void randomizeNormal(double mean = 0.0, double stddev = 1.0);
     void fill(double value);
     bool isEqual(const Matrix& other) const;
     Matrix operator+(const Matrix &other) const;
     Matrix operator-(const Matrix &other) const;
     Matrix elementWiseMultiply(const Matrix &other) const;
     Matrix sumRows() const;
+    Matrix addRowVector(const Matrix &row) const; // broadcast a (1, cols) row over every row
     Matrix operator*(const Matrix &other) const;
     Matrix operator*(double scalar) const;
     Matrix& operator=(const Matrix &other);
+    Matrix& operator=(Matrix &&other) noexcept;
     Matrix transpose();
     Matrix applyFunction(std::function<std::vector<double>(std::vector<double>&)> func);
     void print();
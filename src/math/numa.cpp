@@ -0,0 +1,284 @@
+#include "numa.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const int MPOL_INTERLEAVE_MODE = 3;  // MPOL_INTERLEAVE of <linux/mempolicy.h>
+
+// "0-3,8,10-11" to {0, 1, 2, 3, 8, 10, 11}
+static std::vector<int> parseCpuList(const std::string &text) {
+    std::vector<int> cpus;
+    std::stringstream list(text);
+    std::string range;
+    while (std::getline(list, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(), [](char ch) { return ch == '\n' || ch == ' '; }),
+                    range.end());
+        if (range.empty()) continue;
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        } catch (const std::exception&) {
+            return {};  // unreadable list: treated as no information
+        }
+    }
+    return cpus;
+}
+
+static std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        int count = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < count; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+NumaTopology NumaTopology::fromSysfs(const std::string &nodeDirectory, const std::vector<int> &allowed) {
+    NumaTopology topology;
+    std::vector<std::pair<int, std::vector<int>>> found;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(nodeDirectory, error)) {
+        const std::string name = entry.path().filename().string();
+        if (name.size() < 5 || name.compare(0, 4, "node") != 0 ||
+            !std::all_of(name.begin() + 4, name.end(), [](char ch) { return ch >= '0' && ch <= '9'; })) {
+            continue;
+        }
+        std::ifstream file(entry.path() / "cpulist");
+        std::string text;
+        std::getline(file, text);
+        std::vector<int> cpus = parseCpuList(text);
+        if (!allowed.empty()) {
+            cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu) {
+                return std::find(allowed.begin(), allowed.end(), cpu) == allowed.end();
+            }), cpus.end());
+        }
+        std::sort(cpus.begin(), cpus.end());
+        found.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+    }
+    std::sort(found.begin(), found.end());
+    for (auto &node : found) {
+        topology.memoryNodes.push_back(node.first);
+        topology.nodeCpus.push_back(std::move(node.second));  // empty when none of its CPUs is allowed
+    }
+    if (topology.cpuCount() == 0) {  // no sysfs (or nothing allowed in it): one node with every CPU
+        topology.nodeCpus.assign(1, allowed.empty() ? allowedCpus() : allowed);
+        topology.memoryNodes.assign(1, 0);
+    }
+    return topology;
+}
+
+const NumaTopology& NumaTopology::system() {
+    static const NumaTopology topology = fromSysfs("/sys/devices/system/node", allowedCpus());
+    return topology;
+}
+
+bool NumaTopology::isNuma() const {
+    int withCpus = 0;
+    for (const auto &cpus : nodeCpus) withCpus += !cpus.empty();
+    return withCpus > 1;
+}
+
+int NumaTopology::cpuCount() const {
+    int count = 0;
+    for (const auto &cpus : nodeCpus) count += static_cast<int>(cpus.size());
+    return count;
+}
+
+int NumaTopology::nodeOf(int cpu) const {
+    for (size_t node = 0; node < nodeCpus.size(); node++) {
+        if (std::binary_search(nodeCpus[node].begin(), nodeCpus[node].end(), cpu)) return static_cast<int>(node);
+    }
+    return -1;
+}
+
+int NumaTopology::workerCpu(int worker, PinMode mode) const {
+    if (mode == PinMode::None || worker < 0 || cpuCount() == 0) return -1;
+    if (mode == PinMode::Compact) {
+        int index = worker % cpuCount();
+        for (const auto &cpus : nodeCpus) {
+            if (index < static_cast<int>(cpus.size())) return cpus[index];
+            index -= static_cast<int>(cpus.size());
+        }
+        return -1;
+    }
+    // Spread: round robin over the nodes that have CPUs, then over the CPUs of the node
+    std::vector<const std::vector<int>*> usable;
+    for (const auto &cpus : nodeCpus) {
+        if (!cpus.empty()) usable.push_back(&cpus);
+    }
+    const std::vector<int> &cpus = *usable[worker % usable.size()];
+    return cpus[(worker / usable.size()) % cpus.size()];
+}
+
+bool NumaTopology::pinCurrentThread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+int NumaTopology::pinWorker(int worker, PinMode mode) const {
+    const int cpu = workerCpu(worker, mode);
+    return cpu >= 0 && pinCurrentThread(cpu) ? nodeOf(cpu) : -1;
+}
+
+int NumaTopology::currentCpu() {
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+const char* NumaTopology::modeName(PinMode mode) {
+    switch (mode) {
+        case PinMode::None: return "none";
+        case PinMode::Compact: return "compact";
+        case PinMode::Spread: return "spread";
+    }
+    return "unknown";
+}
+
+const char* NumaTopology::placementName(MemoryPlacement placement) {
+    switch (placement) {
+        case MemoryPlacement::Default: return "default";
+        case MemoryPlacement::FirstTouch: return "first_touch";
+        case MemoryPlacement::Interleave: return "interleave";
+    }
+    return "unknown";
+}
+
+namespace {
+
+thread_local MemoryPolicy currentPolicy;
+
+std::atomic<long long> mappedBuffers{0};
+std::atomic<long long> mappedBytes{0};
+std::atomic<long long> interleaved{0};
+std::atomic<long long> interleaveFailures{0};
+std::atomic<long long> hugePageBuffers{0};
+
+size_t pageBytes() {
+#ifdef __linux__
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+// Mapped length of a buffer: whole huge pages from 2 MB on, whole pages below
+size_t mappedLength(size_t bytes) {
+    const size_t unit = bytes >= NumaMemory::hugePageBytes ? NumaMemory::hugePageBytes : pageBytes();
+    return (bytes + unit - 1) / unit * unit;
+}
+
+}  // namespace
+
+void* NumaMemory::map(size_t bytes, const MemoryPolicy &policy) {
+#ifdef __linux__
+    if (bytes < minimumBytes || (policy.placement == MemoryPlacement::Default && !policy.hugePages)) return nullptr;
+    const size_t length = mappedLength(bytes);
+    const bool huge = length >= hugePageBytes;
+    // Over-allocate by one huge page and trim, so the buffer starts on a huge page boundary
+    const size_t reserved = huge ? length + hugePageBytes : length;
+    void* raw = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;  // the heap gets a try
+    char* address = static_cast<char*>(raw);
+    if (huge) {
+        const uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+        char* aligned = reinterpret_cast<char*>((start + hugePageBytes - 1) & ~static_cast<uintptr_t>(hugePageBytes - 1));
+        if (aligned > address) munmap(address, aligned - address);
+        char* tail = aligned + length;
+        if (tail < address + reserved) munmap(tail, address + reserved - tail);
+        address = aligned;
+    }
+
+    if (policy.hugePages && huge && madvise(address, length, MADV_HUGEPAGE) == 0) hugePageBuffers++;
+    if (policy.placement == MemoryPlacement::Interleave && NumaTopology::system().memoryNodes.size() > 1) {
+        unsigned long mask[16] = {};
+        for (int node : NumaTopology::system().memoryNodes) {
+            if (node >= 0 && node < 16 * 64) mask[node / 64] |= 1UL << (node % 64);
+        }
+        if (syscall(SYS_mbind, address, length, MPOL_INTERLEAVE_MODE, mask, 16 * 64 + 1, 0) == 0) interleaved++;
+        else interleaveFailures++;
+    }
+    mappedBuffers++;
+    mappedBytes += static_cast<long long>(length);
+    return address;
+#else
+    (void)bytes;
+    (void)policy;
+    return nullptr;
+#endif
+}
+
+void NumaMemory::unmap(void* address, size_t bytes) {
+#ifdef __linux__
+    if (!address) return;
+    const size_t length = mappedLength(bytes);
+    munmap(address, length);
+    mappedBuffers--;
+    mappedBytes -= static_cast<long long>(length);
+#else
+    (void)address;
+    (void)bytes;
+#endif
+}
+
+void NumaMemory::prefault(void* address, size_t bytes) {
+    volatile char* bytesOf = static_cast<volatile char*>(address);
+    const size_t page = pageBytes();
+    for (size_t offset = 0; offset < bytes; offset += page) bytesOf[offset] = bytesOf[offset];
+}
+
+MemoryPolicy NumaMemory::current() {
+    return currentPolicy;
+}
+
+NumaMemory::Stats NumaMemory::stats() {
+    Stats stats;
+    stats.mappedBuffers = mappedBuffers.load();
+    stats.mappedBytes = mappedBytes.load();
+    stats.interleaved = interleaved.load();
+    stats.interleaveFailures = interleaveFailures.load();
+    stats.hugePageBuffers = hugePageBuffers.load();
+    return stats;
+}
+
+MemoryPolicyScope::MemoryPolicyScope(const MemoryPolicy &policy) : previous(currentPolicy) {
+    currentPolicy = policy;
+}
+
+MemoryPolicyScope::~MemoryPolicyScope() {
+    currentPolicy = previous;
+}
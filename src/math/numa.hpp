@@ -0,0 +1,106 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Where the pages of a large Matrix buffer go (see MemoryPolicyScope)
+enum class MemoryPlacement {
+    Default,     // the heap: pages land on the node of the thread that zeroes them in the constructor
+    FirstTouch,  // fresh untouched pages, each placed on the node of the thread that first writes it
+    Interleave   // pages spread round robin over all memory nodes, for weights every socket reads
+};
+
+// How the workers of a pool map onto CPUs
+enum class PinMode {
+    None,     // the scheduler decides, threads may migrate between sockets
+    Compact,  // fill the CPUs of node 0 first, then node 1, ...
+    Spread    // alternate nodes: worker 0 on node 0, worker 1 on node 1, ...
+};
+
+struct MemoryPolicy {
+    MemoryPlacement placement = MemoryPlacement::Default;
+    bool hugePages = false;  // madvise(MADV_HUGEPAGE) on buffers of 2 MB and more (transparent huge pages)
+};
+
+// NUMA nodes and their CPUs, from /sys/devices/system/node, limited to the CPUs this process may
+// run on. Machines (or containers) without that information are one node holding every CPU, so all
+// of the placement and pinning below stays valid and simply has nothing to separate.
+class NumaTopology {
+public:
+    std::vector<std::vector<int>> nodeCpus;  // per node, sorted; empty for memory-only nodes
+    std::vector<int> memoryNodes;            // node numbers that have memory, the interleave set
+
+    static const NumaTopology& system();  // read once
+    // From a sysfs style directory of nodeN/cpulist files (for tests); allowedCpus empty: all
+    static NumaTopology fromSysfs(const std::string &nodeDirectory, const std::vector<int> &allowedCpus);
+
+    int nodes() const { return static_cast<int>(nodeCpus.size()); }
+    bool isNuma() const;    // more than one node with CPUs
+    int cpuCount() const;
+    int nodeOf(int cpu) const;  // -1 for a CPU outside the topology
+
+    // CPU for worker `worker` of a pool, -1 for PinMode::None
+    int workerCpu(int worker, PinMode mode) const;
+
+    // Restricts the calling thread to one CPU; false where affinity is not available
+    static bool pinCurrentThread(int cpu);
+    // pinCurrentThread(workerCpu(worker, mode)), returns the node or -1 when not pinned
+    int pinWorker(int worker, PinMode mode) const;
+    static int currentCpu();  // -1 when unknown
+
+    static const char* modeName(PinMode mode);
+    static const char* placementName(MemoryPlacement placement);
+};
+
+// Page level allocation behind Matrix under a non-default MemoryPolicy. Buffers of at least
+// minimumBytes are mapped directly (zeroed by the kernel, not touched here), 2 MB aligned from
+// 2 MB on so they can be backed by huge pages, and bound to the interleave set when asked for.
+// Smaller buffers stay on the heap: placing a few pages is not worth a system call.
+class NumaMemory {
+public:
+    static const size_t minimumBytes = 64 * 1024;
+    static const size_t hugePageBytes = 2 * 1024 * 1024;
+
+    struct Stats {
+        long long mappedBuffers = 0;      // currently mapped
+        long long mappedBytes = 0;
+        long long interleaved = 0;        // buffers bound to the interleave set since startup
+        long long interleaveFailures = 0; // mbind refused (e.g. seccomp), the buffer is left to first touch
+        long long hugePageBuffers = 0;    // buffers advised for huge pages since startup
+    };
+
+    // nullptr when the policy leaves this buffer to the heap
+    static void* map(size_t bytes, const MemoryPolicy &policy);
+    static void unmap(void* address, size_t bytes);
+    // Writes one byte per page from the calling thread, so first touch places them on its node
+    static void prefault(void* address, size_t bytes);
+
+    static MemoryPolicy current();  // the calling thread's, see MemoryPolicyScope
+    static Stats stats();
+};
+
+// Applies a memory policy to the Matrix allocations of this thread until the scope ends (nests).
+// Meant for long-lived buffers (weights, datasets, replicas): every large allocation inside the
+// scope is a fresh mapping, so per-step temporaries should be created outside it.
+//
+//   {
+//       MemoryPolicyScope shared({MemoryPlacement::Interleave, true});
+//       master = std::make_unique<NeuralNetwork>(...);   // read by every socket
+//   }
+//   // on each pinned worker:
+//   MemoryPolicyScope local({MemoryPlacement::FirstTouch, false});
+//   replica.addLayer(layer->clone());                   // pages on the worker's node
+class MemoryPolicyScope {
+public:
+    explicit MemoryPolicyScope(const MemoryPolicy &policy);
+    ~MemoryPolicyScope();
+    MemoryPolicyScope(const MemoryPolicyScope&) = delete;
+    MemoryPolicyScope& operator=(const MemoryPolicyScope&) = delete;
+
+private:
+    MemoryPolicy previous;
+};
+
+#endif  // NUMA_HPP
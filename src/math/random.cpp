@@ -0,0 +1,386 @@
+#include "random.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NN_X86_KERNELS 1
+#endif
+
+// Philox4x32 round multipliers and Weyl key increments
+static const uint32_t philoxM0 = 0xD2511F53u, philoxM1 = 0xCD9E8D57u;
+static const uint32_t philoxW0 = 0x9E3779B9u, philoxW1 = 0xBB67AE85u;
+static const int philoxRounds = 10;
+
+// Block b of a stream is Philox4x32-10 of the counter (b, stream) under the key seed: two words
+static void philoxBlock(uint64_t seed, uint64_t stream, uint64_t block, uint64_t* out) {
+    uint32_t x0 = static_cast<uint32_t>(block), x1 = static_cast<uint32_t>(block >> 32);
+    uint32_t x2 = static_cast<uint32_t>(stream), x3 = static_cast<uint32_t>(stream >> 32);
+    uint32_t k0 = static_cast<uint32_t>(seed), k1 = static_cast<uint32_t>(seed >> 32);
+    for (int round = 0; round < philoxRounds; round++) {
+        uint64_t p0 = static_cast<uint64_t>(philoxM0) * x0;
+        uint64_t p1 = static_cast<uint64_t>(philoxM1) * x2;
+        uint32_t y0 = static_cast<uint32_t>(p1 >> 32) ^ x1 ^ k0;
+        uint32_t y2 = static_cast<uint32_t>(p0 >> 32) ^ x3 ^ k1;
+        x1 = static_cast<uint32_t>(p1);
+        x3 = static_cast<uint32_t>(p0);
+        x0 = y0;
+        x2 = y2;
+        k0 += philoxW0;
+        k1 += philoxW1;
+    }
+    out[0] = x0 | static_cast<uint64_t>(x1) << 32;
+    out[1] = x2 | static_cast<uint64_t>(x3) << 32;
+}
+
+#ifdef NN_X86_KERNELS
+// Same rounds on 8 counters at once. mul_epu32 multiplies the even 32 bit lanes, the odd lanes
+// go through a 64 bit shift, and the blends put the low and high product halves back in place.
+__attribute__((target("avx2")))
+static size_t philoxAvx2(uint64_t seed, uint64_t stream, uint64_t block, uint64_t* out, size_t blocks) {
+    const __m256i m0 = _mm256_set1_epi32(static_cast<int>(philoxM0));
+    const __m256i m1 = _mm256_set1_epi32(static_cast<int>(philoxM1));
+    const __m256i w0 = _mm256_set1_epi32(static_cast<int>(philoxW0));
+    const __m256i w1 = _mm256_set1_epi32(static_cast<int>(philoxW1));
+    alignas(32) uint32_t lanes[4][8];
+    size_t b = 0;
+    for (; b + 8 <= blocks; b += 8) {
+        for (int l = 0; l < 8; l++) {
+            lanes[0][l] = static_cast<uint32_t>(block + b + l);
+            lanes[1][l] = static_cast<uint32_t>((block + b + l) >> 32);
+        }
+        __m256i x0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[0]));
+        __m256i x1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[1]));
+        __m256i x2 = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(stream)));
+        __m256i x3 = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(stream >> 32)));
+        __m256i k0 = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(seed)));
+        __m256i k1 = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(seed >> 32)));
+        for (int round = 0; round < philoxRounds; round++) {
+            __m256i even0 = _mm256_mul_epu32(x0, m0), odd0 = _mm256_mul_epu32(_mm256_srli_epi64(x0, 32), m0);
+            __m256i even1 = _mm256_mul_epu32(x2, m1), odd1 = _mm256_mul_epu32(_mm256_srli_epi64(x2, 32), m1);
+            __m256i lo0 = _mm256_blend_epi32(even0, _mm256_slli_epi64(odd0, 32), 0xAA);
+            __m256i hi0 = _mm256_blend_epi32(_mm256_srli_epi64(even0, 32), odd0, 0xAA);
+            __m256i lo1 = _mm256_blend_epi32(even1, _mm256_slli_epi64(odd1, 32), 0xAA);
+            __m256i hi1 = _mm256_blend_epi32(_mm256_srli_epi64(even1, 32), odd1, 0xAA);
+            x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1), k0);
+            x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3), k1);
+            x1 = lo1;
+            x3 = lo0;
+            k0 = _mm256_add_epi32(k0, w0);
+            k1 = _mm256_add_epi32(k1, w1);
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[0]), x0);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[1]), x1);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[2]), x2);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[3]), x3);
+        for (int l = 0; l < 8; l++) {
+            out[2 * (b + l)] = lanes[0][l] | static_cast<uint64_t>(lanes[1][l]) << 32;
+            out[2 * (b + l) + 1] = lanes[2][l] | static_cast<uint64_t>(lanes[3][l]) << 32;
+        }
+    }
+    return b;
+}
+
+// GCC 12's avx512fintrin.h fills the unused pass-through operand of the shifts and multiplies
+// with a self-initialized variable, which trips -Wmaybe-uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f")))
+static size_t philoxAvx512(uint64_t seed, uint64_t stream, uint64_t block, uint64_t* out, size_t blocks) {
+    const __m512i m0 = _mm512_set1_epi32(static_cast<int>(philoxM0));
+    const __m512i m1 = _mm512_set1_epi32(static_cast<int>(philoxM1));
+    const __m512i w0 = _mm512_set1_epi32(static_cast<int>(philoxW0));
+    const __m512i w1 = _mm512_set1_epi32(static_cast<int>(philoxW1));
+    const __mmask16 odd = 0xAAAA;
+    alignas(64) uint32_t lanes[4][16];
+    size_t b = 0;
+    for (; b + 16 <= blocks; b += 16) {
+        for (int l = 0; l < 16; l++) {
+            lanes[0][l] = static_cast<uint32_t>(block + b + l);
+            lanes[1][l] = static_cast<uint32_t>((block + b + l) >> 32);
+        }
+        __m512i x0 = _mm512_load_si512(lanes[0]);
+        __m512i x1 = _mm512_load_si512(lanes[1]);
+        __m512i x2 = _mm512_set1_epi32(static_cast<int>(static_cast<uint32_t>(stream)));
+        __m512i x3 = _mm512_set1_epi32(static_cast<int>(static_cast<uint32_t>(stream >> 32)));
+        __m512i k0 = _mm512_set1_epi32(static_cast<int>(static_cast<uint32_t>(seed)));
+        __m512i k1 = _mm512_set1_epi32(static_cast<int>(static_cast<uint32_t>(seed >> 32)));
+        for (int round = 0; round < philoxRounds; round++) {
+            __m512i even0 = _mm512_mul_epu32(x0, m0), odd0 = _mm512_mul_epu32(_mm512_srli_epi64(x0, 32), m0);
+            __m512i even1 = _mm512_mul_epu32(x2, m1), odd1 = _mm512_mul_epu32(_mm512_srli_epi64(x2, 32), m1);
+            __m512i lo0 = _mm512_mask_blend_epi32(odd, even0, _mm512_slli_epi64(odd0, 32));
+            __m512i hi0 = _mm512_mask_blend_epi32(odd, _mm512_srli_epi64(even0, 32), odd0);
+            __m512i lo1 = _mm512_mask_blend_epi32(odd, even1, _mm512_slli_epi64(odd1, 32));
+            __m512i hi1 = _mm512_mask_blend_epi32(odd, _mm512_srli_epi64(even1, 32), odd1);
+            x0 = _mm512_xor_si512(_mm512_xor_si512(hi1, x1), k0);
+            x2 = _mm512_xor_si512(_mm512_xor_si512(hi0, x3), k1);
+            x1 = lo1;
+            x3 = lo0;
+            k0 = _mm512_add_epi32(k0, w0);
+            k1 = _mm512_add_epi32(k1, w1);
+        }
+        _mm512_store_si512(lanes[0], x0);
+        _mm512_store_si512(lanes[1], x1);
+        _mm512_store_si512(lanes[2], x2);
+        _mm512_store_si512(lanes[3], x3);
+        for (int l = 0; l < 16; l++) {
+            out[2 * (b + l)] = lanes[0][l] | static_cast<uint64_t>(lanes[1][l]) << 32;
+            out[2 * (b + l) + 1] = lanes[2][l] | static_cast<uint64_t>(lanes[3][l]) << 32;
+        }
+    }
+    return b;
+}
+#pragma GCC diagnostic pop
+#endif
+
+// -1: not chosen yet, the best supported kernel is picked on first use
+static std::atomic<int> kernelChoice{-1};
+static std::atomic<int> threadCount{0};  // 0: hardware threads
+static std::atomic<uint64_t> streamCounter{0};
+
+static uint64_t initialSeed() {
+    const char* env = std::getenv("NN_SEED");
+    return env && *env ? std::strtoull(env, nullptr, 0) : 0x5EED5EED5EED5EEDULL;
+}
+
+static std::atomic<uint64_t>& globalSeed() {
+    static std::atomic<uint64_t> value{initialSeed()};
+    return value;
+}
+
+void RandomStream::generate(uint64_t seed, uint64_t stream, uint64_t first, uint64_t* out, size_t n) {
+    uint64_t pair[2];
+    size_t i = 0;
+    if ((first & 1) && n > 0) {  // starts on the second word of a block
+        philoxBlock(seed, stream, first >> 1, pair);
+        out[i++] = pair[1];
+    }
+    const uint64_t block = (first + i) >> 1;
+    const size_t blocks = (n - i) / 2;
+    size_t b = 0;
+#ifdef NN_X86_KERNELS
+    switch (Random::getKernel()) {
+        case Random::Kernel::Avx512: b = philoxAvx512(seed, stream, block, out + i, blocks); break;
+        case Random::Kernel::Avx2: b = philoxAvx2(seed, stream, block, out + i, blocks); break;
+        case Random::Kernel::Scalar: break;
+    }
+#endif
+    for (; b < blocks; b++) {
+        philoxBlock(seed, stream, block + b, out + i + 2 * b);
+    }
+    i += 2 * blocks;
+    if (i < n) {
+        philoxBlock(seed, stream, block + blocks, pair);
+        out[i] = pair[0];
+    }
+}
+
+// 52 random mantissa bits under the exponent of 1.0 give [1, 2), minus one gives [0, 1).
+// Integer ops only, so the conversion loops vectorize.
+static inline double unitInterval(uint64_t bits) {
+    uint64_t pattern = 0x3FF0000000000000ULL | (bits >> 12);
+    double value;
+    std::memcpy(&value, &pattern, sizeof(value));
+    return value - 1.0;
+}
+
+static void boxMuller(uint64_t a, uint64_t b, double &z0, double &z1) {
+    double r = std::sqrt(-2.0 * std::log(1.0 - unitInterval(a)));  // 1 - u is in (0, 1]
+    double theta = 6.283185307179586 * unitInterval(b);
+    z0 = r * std::cos(theta);
+    z1 = r * std::sin(theta);
+}
+
+// Runs fill(begin, end) over even aligned slices of [0, n) on up to Random::threads() threads.
+// Which thread generates a word never changes its value.
+template <typename Fill>
+static void parallelFill(size_t n, const Fill &fill) {
+    const size_t minimumPerThread = 1 << 16;
+    size_t workers = std::min<size_t>(static_cast<size_t>(Random::threads()), n / minimumPerThread);
+    if (workers <= 1) {
+        fill(0, n);
+        return;
+    }
+    size_t chunk = ((n + workers - 1) / workers + 1) & ~static_cast<size_t>(1);
+    std::vector<std::thread> pool;
+    for (size_t begin = chunk; begin < n; begin += chunk) {
+        pool.emplace_back([&fill, begin, chunk, n] { fill(begin, std::min(n, begin + chunk)); });
+    }
+    fill(0, std::min(n, chunk));
+    for (std::thread &thread : pool) thread.join();
+}
+
+static const size_t wordBatch = 512;  // words generated per conversion pass, stays in L1
+
+RandomStream::RandomStream() : RandomStream(Random::nextStream()) {}
+
+RandomStream::RandomStream(uint64_t seed, uint64_t stream) : seed(seed), stream(stream) {}
+
+RandomStream::result_type RandomStream::operator()() {
+    uint64_t block = word >> 1;
+    if (block != cachedBlock) {
+        philoxBlock(seed, stream, block, cached);
+        cachedBlock = block;
+    }
+    return cached[word++ & 1];
+}
+
+double RandomStream::uniform() {
+    return unitInterval((*this)());
+}
+
+double RandomStream::uniform(double lo, double hi) {
+    return lo + (hi - lo) * uniform();
+}
+
+double RandomStream::normal() {
+    uint64_t a = (*this)(), b = (*this)();
+    double z0, z1;
+    boxMuller(a, b, z0, z1);
+    return z0;
+}
+
+uint64_t RandomStream::below(uint64_t n) {
+    if (n == 0) {
+        throw std::invalid_argument("RandomStream::below needs a positive bound");
+    }
+    // Lemire's multiply-shift, rejecting the few products that would bias small values
+    const uint64_t threshold = (0 - n) % n;
+    while (true) {
+        unsigned __int128 product = static_cast<unsigned __int128>((*this)()) * n;
+        if (static_cast<uint64_t>(product) >= threshold) {
+            return static_cast<uint64_t>(product >> 64);
+        }
+    }
+}
+
+void RandomStream::fillUniform(double* out, size_t n, double lo, double hi) {
+    const uint64_t first = word;
+    const double range = hi - lo;
+    parallelFill(n, [&](size_t begin, size_t end) {
+        uint64_t bits[wordBatch];
+        for (size_t i = begin; i < end; i += wordBatch) {
+            size_t count = std::min(wordBatch, end - i);
+            generate(seed, stream, first + i, bits, count);
+            for (size_t k = 0; k < count; k++) out[i + k] = lo + range * unitInterval(bits[k]);
+        }
+    });
+    word += n;
+}
+
+void RandomStream::fillNormal(double* out, size_t n, double mean, double stddev) {
+    word += word & 1;
+    const uint64_t first = word;
+    parallelFill(n, [&](size_t begin, size_t end) {  // begin is even: pairs never straddle threads
+        uint64_t bits[wordBatch];
+        for (size_t i = begin; i < end; i += wordBatch) {
+            size_t count = std::min(wordBatch, end - i);
+            generate(seed, stream, first + i, bits, (count + 1) & ~static_cast<size_t>(1));
+            for (size_t k = 0; k < count; k += 2) {
+                double z0, z1;
+                boxMuller(bits[k], bits[k + 1], z0, z1);
+                out[i + k] = mean + stddev * z0;
+                if (k + 1 < count) out[i + k + 1] = mean + stddev * z1;
+            }
+        }
+    });
+    word += (n + 1) & ~static_cast<uint64_t>(1);
+}
+
+void RandomStream::fillBits(uint64_t* out, size_t n) {
+    const uint64_t first = word;
+    parallelFill(n, [&](size_t begin, size_t end) {
+        generate(seed, stream, first + begin, out + begin, end - begin);
+    });
+    word += n;
+}
+
+bool RandomStream::operator==(const RandomStream &other) const {
+    return seed == other.seed && stream == other.stream && word == other.word;
+}
+
+std::ostream& operator<<(std::ostream &out, const RandomStream &rng) {
+    return out << rng.seed << ' ' << rng.stream << ' ' << rng.word;
+}
+
+std::istream& operator>>(std::istream &in, RandomStream &rng) {
+    uint64_t seed, stream, word;
+    if (in >> seed >> stream >> word) {
+        rng = RandomStream(seed, stream);
+        rng.word = word;
+    }
+    return in;
+}
+
+void Random::setSeed(uint64_t seed) {
+    globalSeed().store(seed, std::memory_order_relaxed);
+    streamCounter.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Random::seed() {
+    return globalSeed().load(std::memory_order_relaxed);
+}
+
+RandomStream Random::nextStream() {
+    return RandomStream(seed(), streamCounter.fetch_add(1, std::memory_order_relaxed));
+}
+
+void Random::setThreads(int threads) {
+    if (threads < 0) {
+        throw std::invalid_argument("Thread count cannot be negative");
+    }
+    threadCount.store(threads, std::memory_order_relaxed);
+}
+
+int Random::threads() {
+    int threads = threadCount.load(std::memory_order_relaxed);
+    if (threads > 0) return threads;
+    static const int hardware = std::max(1u, std::thread::hardware_concurrency());
+    return hardware;
+}
+
+bool Random::supported(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Scalar: return true;
+#ifdef NN_X86_KERNELS
+        case Kernel::Avx2: return __builtin_cpu_supports("avx2");
+        case Kernel::Avx512: return __builtin_cpu_supports("avx512f");
+#else
+        default: return false;
+#endif
+    }
+    return false;
+}
+
+void Random::setKernel(Kernel kernel) {
+    if (!supported(kernel)) {
+        throw std::runtime_error(std::string("CPU does not support the ") + kernelName(kernel) + " generator");
+    }
+    kernelChoice.store(static_cast<int>(kernel), std::memory_order_relaxed);
+}
+
+Random::Kernel Random::getKernel() {
+    int choice = kernelChoice.load(std::memory_order_relaxed);
+    if (choice < 0) {
+        Kernel best = supported(Kernel::Avx512) ? Kernel::Avx512 : supported(Kernel::Avx2) ? Kernel::Avx2 : Kernel::Scalar;
+        choice = static_cast<int>(best);
+        kernelChoice.store(choice, std::memory_order_relaxed);
+    }
+    return static_cast<Kernel>(choice);
+}
+
+const char* Random::kernelName(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Scalar: return "scalar";
+        case Kernel::Avx2: return "avx2";
+        case Kernel::Avx512: return "avx512";
+    }
+    return "unknown";
+}
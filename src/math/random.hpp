@@ -0,0 +1,81 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+// Word i of a stream is a keyed hash of (seed, stream, i) with no hidden state, so any range of a
+// stream can be generated on its own: bulk fills run 8/16 counters per AVX2/AVX-512 instruction
+// and split across threads, and give the same numbers whatever the SIMD width or thread count.
+//
+//   RandomStream rng = Random::nextStream();   // per tensor: stream k of the global seed
+//   rng.fillUniform(values, n, -limit, limit);
+//   std::shuffle(order.begin(), order.end(), rng);
+class RandomStream {
+public:
+    using result_type = uint64_t;  // a UniformRandomBitGenerator, works with std::shuffle and <random>
+
+    RandomStream();  // the next stream of the global seed, see Random::nextStream
+    RandomStream(uint64_t seed, uint64_t stream);
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~static_cast<result_type>(0); }
+    result_type operator()();  // next 64 random bits
+
+    double uniform();  // [0, 1), 52 random mantissa bits
+    double uniform(double lo, double hi);
+    double normal();   // standard normal, Box-Muller over the next two words (the second output is dropped)
+    uint64_t below(uint64_t n);  // uniform integer in [0, n), n > 0
+
+    // Next n values. fillUniform gives the same numbers as n calls of uniform(lo, hi); fillNormal
+    // starts at an even word and uses both outputs of every Box-Muller pair. Large fills run on
+    // Random::threads() threads.
+    void fillUniform(double* out, size_t n, double lo, double hi);
+    void fillNormal(double* out, size_t n, double mean, double stddev);
+    void fillBits(uint64_t* out, size_t n);  // raw words, e.g. packed dropout masks
+
+    uint64_t position() const { return word; }  // words consumed so far
+    void seek(uint64_t position) { word = position; }
+    uint64_t getSeed() const { return seed; }
+    uint64_t getStream() const { return stream; }
+
+    // Words [first, first + n) of (seed, stream), the primitive every fill is built on
+    static void generate(uint64_t seed, uint64_t stream, uint64_t first, uint64_t* out, size_t n);
+
+    bool operator==(const RandomStream &other) const;
+    bool operator!=(const RandomStream &other) const { return !(*this == other); }
+    // "seed stream position", e.g. for TrainingState::rngState
+    friend std::ostream& operator<<(std::ostream &out, const RandomStream &rng);
+    friend std::istream& operator>>(std::istream &in, RandomStream &rng);
+
+private:
+    uint64_t seed, stream;
+    uint64_t word = 0;
+    uint64_t cachedBlock = ~0ULL;  // the block (two words) behind `cached`
+    uint64_t cached[2];
+};
+
+// Process wide seed and stream numbering. The seed defaults to the NN_SEED environment variable
+// (or a fixed value), so a program that builds its networks in the same order gets the same
+// weights on every run; setSeed() also restarts the stream numbering.
+class Random {
+public:
+    static void setSeed(uint64_t seed);
+    static uint64_t seed();
+    // Stream 0, 1, 2, ... of the global seed. Reproducible as long as tensors are created in the
+    // same order; code on worker threads should pass an explicit stream to RandomStream instead.
+    static RandomStream nextStream();
+
+    static void setThreads(int threads);  // threads of a large fill, defaults to the hardware threads
+    static int threads();
+
+    enum class Kernel { Scalar, Avx2, Avx512 };
+    static void setKernel(Kernel kernel);  // forces a generator kernel (for tests and benchmarks)
+    static Kernel getKernel();
+    static bool supported(Kernel kernel);
+    static const char* kernelName(Kernel kernel);
+};
+
+#endif  // RANDOM_HPP
@@ -0,0 +1,125 @@
+#include "sparse_matrix.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+SparseMatrix::SparseMatrix(int rows, int cols) : rows(rows), cols(cols), rowStart(rows + 1, 0) {
+    if (rows < 0 || cols < 0) {
+        throw std::invalid_argument("Sparse matrix dimensions must not be negative");
+    }
+}
+
+SparseMatrix SparseMatrix::fromDense(const Matrix &dense, double threshold) {
+    SparseMatrix sparse;
+    sparse.assign(dense, threshold);
+    return sparse;
+}
+
+void SparseMatrix::assign(const Matrix &dense, double threshold) {
+    rows = dense.rows;
+    cols = dense.cols;
+    values.clear();
+    columns.clear();
+    rowStart.resize(rows + 1);
+    rowStart[0] = 0;
+    for (int i = 0; i < rows; i++) {
+        const double* row = dense.data[i];
+        for (int j = 0; j < cols; j++) {
+            if (std::fabs(row[j]) > threshold) {
+                values.push_back(row[j]);
+                columns.push_back(j);
+            }
+        }
+        rowStart[i + 1] = static_cast<int>(values.size());
+    }
+}
+
+void SparseMatrix::gather(const Matrix &dense) {
+    if (dense.rows != rows || dense.cols != cols) {
+        throw std::invalid_argument("Matrix shape does not match the sparse matrix");
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int idx = rowStart[i]; idx < rowStart[i + 1]; idx++) {
+            values[idx] = dense.data[i][columns[idx]];
+        }
+    }
+}
+
+Matrix SparseMatrix::toDense() const {
+    Matrix dense(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        for (int idx = rowStart[i]; idx < rowStart[i + 1]; idx++) {
+            dense.data[i][columns[idx]] = values[idx];
+        }
+    }
+    return dense;
+}
+
+double SparseMatrix::density() const {
+    return rows && cols ? static_cast<double>(values.size()) / (static_cast<double>(rows) * cols) : 0.0;
+}
+
+size_t SparseMatrix::bytes() const {
+    return values.size() * (sizeof(double) + sizeof(int)) + rowStart.size() * sizeof(int);
+}
+
+static void resizeZeroed(Matrix &out, int rows, int cols) {
+    if (out.rows != rows || out.cols != cols || out.isView()) {
+        out = Matrix(rows, cols);
+    } else {
+        out.fill(0.0);
+    }
+}
+
+// Row i of the result is the sum of the rows of dense picked by row i's non-zeros
+void SparseMatrix::multiply(const Matrix &dense, Matrix &out) const {
+    if (cols != dense.rows) {
+        throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+    }
+    resizeZeroed(out, rows, dense.cols);
+    const int n = dense.cols;
+    for (int i = 0; i < rows; i++) {
+        double* o = out.data[i];
+        for (int idx = rowStart[i]; idx < rowStart[i + 1]; idx++) {
+            const double v = values[idx];
+            const double* b = dense.data[columns[idx]];
+            for (int j = 0; j < n; j++) {
+                o[j] += v * b[j];
+            }
+        }
+    }
+}
+
+// Every non-zero x[r][k] scatters x * (row k of sparse) into row r of the result
+void SparseMatrix::multiply(const Matrix &dense, const SparseMatrix &sparse, Matrix &out) {
+    if (dense.cols != sparse.rows) {
+        throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+    }
+    resizeZeroed(out, dense.rows, sparse.cols);
+    for (int r = 0; r < dense.rows; r++) {
+        const double* x = dense.data[r];
+        double* o = out.data[r];
+        for (int k = 0; k < dense.cols; k++) {
+            const double xk = x[k];
+            if (xk == 0.0) continue;
+            for (int idx = sparse.rowStart[k]; idx < sparse.rowStart[k + 1]; idx++) {
+                o[sparse.columns[idx]] += xk * sparse.values[idx];
+            }
+        }
+    }
+}
+
+double SparseMatrix::densityOf(const Matrix &dense, double stopAbove) {
+    const double total = static_cast<double>(dense.rows) * dense.cols;
+    if (total == 0.0) return 0.0;
+    const double limit = stopAbove * total;
+    size_t nonZeros = 0;
+    for (int i = 0; i < dense.rows; i++) {
+        const double* row = dense.data[i];
+        for (int j = 0; j < dense.cols; j++) {
+            nonZeros += row[j] != 0.0;
+        }
+        if (nonZeros > limit) break;
+    }
+    return nonZeros / total;
+}
@@ -0,0 +1,42 @@
+#ifndef SPARSE_MATRIX_HPP
+#define SPARSE_MATRIX_HPP
+
+#include <vector>
+#include <cstddef>
+#include "matrix.hpp"
+
+// Compressed sparse row matrix: the non-zeros of row i are values[rowStart[i] .. rowStart[i + 1])
+// with their column in columns[]. Used by DenseLayer for mostly-zero inputs (MNIST pixels) and
+// for magnitude pruned weights.
+class SparseMatrix {
+public:
+    int rows = 0, cols = 0;
+    std::vector<double> values;
+    std::vector<int> columns;
+    std::vector<int> rowStart;  // rows + 1 entries
+
+    SparseMatrix() = default;
+    SparseMatrix(int rows, int cols);  // all zeros
+
+    // Keeps the entries with |x| > threshold
+    static SparseMatrix fromDense(const Matrix &dense, double threshold = 0.0);
+    // Same, reusing this matrix's buffers (no allocation once they are large enough)
+    void assign(const Matrix &dense, double threshold = 0.0);
+    // Copies the entries at this matrix's non-zero positions out of dense, the pattern stays
+    void gather(const Matrix &dense);
+    Matrix toDense() const;
+
+    size_t nonZeros() const { return values.size(); }
+    double density() const;
+    size_t bytes() const;  // values + indices
+
+    // out = this * dense, out is resized as needed
+    void multiply(const Matrix &dense, Matrix &out) const;
+    // out = dense * sparse, zero entries of dense are skipped too
+    static void multiply(const Matrix &dense, const SparseMatrix &sparse, Matrix &out);
+
+    // Fraction of non-zero entries of a dense matrix, stops scanning once it is known to exceed stopAbove
+    static double densityOf(const Matrix &dense, double stopAbove = 1.0);
+};
+
+#endif  // SPARSE_MATRIX_HPP
@@ -0,0 +1,144 @@
+#include "augmentation.hpp"
+#include "../math/random.hpp"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+// Philox stream of one (epoch, sample), distinct for up to 2^32 samples per epoch
+static uint64_t sampleStream(uint64_t epoch, uint64_t sample) {
+    return (epoch << 32) + sample;
+}
+
+// Key of the elastic displacement noise, so it does not reuse the affine parameters' numbers
+static const uint64_t elasticKey = 0xE7037ED1A0B428DBULL;
+
+Augmenter::Augmenter(int rows, int cols, const AugmentationConfig &config, uint64_t seed)
+    : rows(rows), cols(cols), config(config), seed(seed) {
+    if (rows <= 0 || cols <= 0) {
+        throw std::invalid_argument("Augmenter needs positive image dimensions");
+    }
+    if (config.elasticAlpha > 0.0) {
+        int radius = std::max(1, static_cast<int>(std::ceil(3.0 * config.elasticSigma)));
+        blurKernel.resize(2 * radius + 1);
+        float sum = 0.0f;
+        for (int i = -radius; i <= radius; i++) {
+            blurKernel[i + radius] = std::exp(-(i * i) / (2.0f * config.elasticSigma * config.elasticSigma));
+            sum += blurKernel[i + radius];
+        }
+        for (float& k : blurKernel) k /= sum;
+    }
+}
+
+// Random displacement field in [-1, 1], gaussian blurred (separable) and scaled by alpha.
+// Both passes run over whole rows (kernel tap outer, pixels inner) so the inner loops vectorize.
+void Augmenter::elasticField(Workspace &w, uint64_t stream) const {
+    int n = rows * cols;
+    int radius = static_cast<int>(blurKernel.size() / 2);
+    int pcols = cols + 2 * radius;
+    RandomStream rng(seed ^ elasticKey, stream);
+    float alpha = static_cast<float>(config.elasticAlpha);
+
+    for (std::vector<float>* field : {&w.dx, &w.dy}) {
+        std::vector<float>& f = *field;
+        f.assign(n, 0.0f);
+
+        // Horizontal pass: each noise row sits in a zero padded buffer (zero outside the image)
+        w.rowBuffer.assign(pcols, 0.0f);
+        w.tmp.assign(n, 0.0f);
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < cols; x++) {
+                w.rowBuffer[radius + x] = static_cast<float>(rng.uniform(-1.0, 1.0));
+            }
+            float* __restrict out = &w.tmp[y * cols];
+            for (int k = 0; k <= 2 * radius; k++) {
+                const float weight = blurKernel[k];
+                const float* __restrict in = &w.rowBuffer[k];
+                for (int x = 0; x < cols; x++) {
+                    out[x] += weight * in[x];
+                }
+            }
+        }
+
+        // Vertical pass: whole rows weighted and accumulated
+        for (int y = 0; y < rows; y++) {
+            float* __restrict out = &f[y * cols];
+            for (int k = std::max(-radius, -y); k <= std::min(radius, rows - 1 - y); k++) {
+                const float weight = alpha * blurKernel[k + radius];
+                const float* __restrict in = &w.tmp[(y + k) * cols];
+                for (int x = 0; x < cols; x++) {
+                    out[x] += weight * in[x];
+                }
+            }
+        }
+    }
+}
+
+void Augmenter::apply(const uint8_t* src, double* dst, uint64_t epoch, uint64_t sample, Workspace &w) const {
+    const uint64_t stream = sampleStream(epoch, sample);
+    RandomStream rng(seed, stream);
+
+    // Inverse affine map (output pixel -> source pixel) around the image center
+    double angle = rng.uniform(-config.maxRotation, config.maxRotation);
+    double scale = 1.0 + rng.uniform(-config.maxScale, config.maxScale);
+    double shear = rng.uniform(-config.maxShear, config.maxShear);
+    double shiftX = rng.uniform(-config.maxShift, config.maxShift);
+    double shiftY = rng.uniform(-config.maxShift, config.maxShift);
+    float a11 = static_cast<float>(std::cos(angle) / scale), a12 = static_cast<float>(std::sin(angle) / scale + shear);
+    float a21 = static_cast<float>(-std::sin(angle) / scale), a22 = static_cast<float>(std::cos(angle) / scale);
+    float cx = (cols - 1) * 0.5f, cy = (rows - 1) * 0.5f;
+
+    // Source with a zero border (one pixel left and top, two right and bottom so the clamped
+    // coordinates' right and lower neighbours exist), so sampling needs no bounds branches
+    int pcols = cols + 3;
+    w.padded.assign(static_cast<size_t>(rows + 3) * pcols, 0.0f);
+    for (int y = 0; y < rows; y++) {
+        float* row = &w.padded[(y + 1) * pcols + 1];
+        for (int x = 0; x < cols; x++) {
+            row[x] = src[y * cols + x] * (1.0f / 255.0f);
+        }
+    }
+
+    bool elastic = config.elasticAlpha > 0.0;
+    if (elastic) elasticField(w, stream);
+
+    w.srcX.resize(cols);
+    w.srcY.resize(cols);
+    const float maxX = static_cast<float>(cols + 1), maxY = static_cast<float>(rows + 1);
+    for (int y = 0; y < rows; y++) {
+        float v = y - cy;
+        // Coordinates for the whole row first (plain arithmetic, vectorizes),
+        // shifted by +1 into the padded image and clamped into the zero border
+        for (int x = 0; x < cols; x++) {
+            float u = x - cx;
+            float sx = cx + a11 * u + a12 * v - static_cast<float>(shiftX) + 1.0f;
+            float sy = cy + a21 * u + a22 * v - static_cast<float>(shiftY) + 1.0f;
+            if (elastic) {
+                sx += w.dx[y * cols + x];
+                sy += w.dy[y * cols + x];
+            }
+            w.srcX[x] = std::min(std::max(sx, 0.0f), maxX);
+            w.srcY[x] = std::min(std::max(sy, 0.0f), maxY);
+        }
+
+        // Bilinear sampling, branch free
+        double* out = dst + static_cast<size_t>(y) * cols;
+        for (int x = 0; x < cols; x++) {
+            int x0 = static_cast<int>(w.srcX[x]);
+            int y0 = static_cast<int>(w.srcY[x]);
+            float fx = w.srcX[x] - x0, fy = w.srcY[x] - y0;
+            const float* p = &w.padded[y0 * pcols + x0];
+            float top = p[0] + fx * (p[1] - p[0]);
+            float bottom = p[pcols] + fx * (p[pcols + 1] - p[pcols]);
+            out[x] = top + fy * (bottom - top);
+        }
+    }
+
+    if (config.noiseStddev > 0.0) {
+        int n = rows * cols;
+        w.noise.resize(n);
+        rng.fillNormal(w.noise.data(), n, 0.0, config.noiseStddev);
+        for (int i = 0; i < n; i++) {
+            dst[i] = std::min(1.0, std::max(0.0, dst[i] + w.noise[i]));
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef AUGMENTATION_HPP
+#define AUGMENTATION_HPP
+
+#include <vector>
+#include <cstdint>
+
+// Random distortions applied to uint8 images while batches are assembled (see DataLoader).
+struct AugmentationConfig {
+    double maxShift = 2.0;       // translation in pixels, sub-pixel amounts included
+    double maxRotation = 0.15;   // radians
+    double maxScale = 0.1;       // zoom in/out by up to 10%
+    double maxShear = 0.1;
+    double elasticAlpha = 0.0;   // elastic displacement strength in pixels, 0 disables it
+    double elasticSigma = 4.0;   // smoothing of the elastic displacement field
+    double noiseStddev = 0.0;    // gaussian noise added to the normalized pixels
+};
+
+// Applies a random affine warp, optional elastic distortion and noise to one image.
+//
+// The random numbers come from Philox streams (see RandomStream): they only depend on (seed, epoch,
+// sample), never on which worker thread handles the sample or in which order, so augmented runs
+// are reproducible.
+// apply() is const and thread safe, each worker passes its own Workspace.
+class Augmenter {
+public:
+    // Scratch buffers, one per worker thread, reused for every image
+    struct Workspace {
+        std::vector<float> padded;   // source image with a zero border
+        std::vector<float> dx, dy;   // elastic displacement field
+        std::vector<float> tmp;      // separable blur pass
+        std::vector<float> rowBuffer;
+        std::vector<float> srcX, srcY;
+        std::vector<double> noise;   // gaussian pixel noise
+    };
+
+    Augmenter(int rows, int cols, const AugmentationConfig &config, uint64_t seed = 0);
+
+    // src: rows * cols uint8 pixels, dst: rows * cols values in [0, 1]
+    void apply(const uint8_t* src, double* dst, uint64_t epoch, uint64_t sample, Workspace &workspace) const;
+
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+
+private:
+    int rows, cols;
+    AugmentationConfig config;
+    uint64_t seed;
+    std::vector<float> blurKernel;  // normalized gaussian for the elastic field
+
+    void elasticField(Workspace &workspace, uint64_t stream) const;
+};
+
+#endif  // AUGMENTATION_HPP
@@ -0,0 +1,344 @@
+#include "benchmark.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCHMARK_HAS_TSC 1
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t readCycleCounter() {
+#ifdef BENCHMARK_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+bool Benchmark::hasCycleCounter() {
+#ifdef BENCHMARK_HAS_TSC
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Nearest-rank percentile of an ascending sample
+static double percentile(const std::vector<double> &sorted, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+Benchmark::Benchmark(const BenchmarkOptions &options) : options(options) {}
+
+const BenchmarkResult& Benchmark::run(const std::string &name, const std::function<void()> &fn,
+                                      double flops, double bytes) {
+    return run(name, fn, flops, bytes, options);
+}
+
+const BenchmarkResult& Benchmark::run(const std::string &name, const std::function<void()> &fn,
+                                      double flops, double bytes, const BenchmarkOptions &opts) {
+    // Warmup, doubling the iteration count until one repetition lasts minSeconds
+    long long iterations = 1;
+    for (int w = 0; w < std::max(1, opts.warmup); w++) {
+        while (true) {
+            Clock::time_point start = Clock::now();
+            for (long long i = 0; i < iterations; i++) fn();
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds >= opts.minSeconds || iterations >= opts.maxIterations) break;
+            // Jump close to the target instead of doubling from 1 for fast functions
+            double scale = seconds > 0.0 ? opts.minSeconds / seconds * 1.2 : 10.0;
+            iterations = std::min(opts.maxIterations,
+                                  std::max(iterations * 2, static_cast<long long>(iterations * std::min(scale, 100.0))));
+        }
+    }
+
+    std::vector<double> times(opts.repetitions), cycles(opts.repetitions);
+    for (int r = 0; r < opts.repetitions; r++) {
+        uint64_t startCycles = readCycleCounter();
+        Clock::time_point start = Clock::now();
+        for (long long i = 0; i < iterations; i++) fn();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        uint64_t endCycles = readCycleCounter();
+        times[r] = ns / iterations;
+        cycles[r] = static_cast<double>(endCycles - startCycles) / iterations;
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.repetitions = opts.repetitions;
+    result.flops = flops;
+    result.bytes = bytes;
+
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    result.min_ns = sorted.front();
+    result.max_ns = sorted.back();
+    result.median_ns = percentile(sorted, 0.5);
+    result.p90_ns = percentile(sorted, 0.9);
+    result.p99_ns = percentile(sorted, 0.99);
+    double sum = 0.0, squares = 0.0;
+    for (double t : times) sum += t;
+    result.mean_ns = sum / times.size();
+    for (double t : times) squares += (t - result.mean_ns) * (t - result.mean_ns);
+    result.stddev_ns = times.size() > 1 ? std::sqrt(squares / (times.size() - 1)) : 0.0;
+
+    std::sort(cycles.begin(), cycles.end());
+    result.cycles = hasCycleCounter() ? percentile(cycles, 0.5) : 0.0;
+
+    results.push_back(result);
+    return results.back();
+}
+
+static std::string formatTime(double ns) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    if (ns < 1e3) out << ns << " ns";
+    else if (ns < 1e6) out << ns / 1e3 << " us";
+    else if (ns < 1e9) out << ns / 1e6 << " ms";
+    else out << ns / 1e9 << " s";
+    return out.str();
+}
+
+void Benchmark::printHeader(std::ostream &out) {
+    out << std::left << std::setw(36) << "benchmark" << std::right
+        << std::setw(12) << "median" << std::setw(12) << "p90" << std::setw(12) << "p99"
+        << std::setw(14) << "cycles" << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s" << "\n";
+}
+
+void Benchmark::print(const BenchmarkResult &r, std::ostream &out) {
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    out << std::left << std::setw(36) << r.name << std::right
+        << std::setw(12) << formatTime(r.median_ns) << std::setw(12) << formatTime(r.p90_ns)
+        << std::setw(12) << formatTime(r.p99_ns) << std::fixed << std::setprecision(0)
+        << std::setw(14) << r.cycles << std::setprecision(2);
+    out << std::setw(10);
+    if (r.flops > 0.0) out << r.gflops(); else out << "-";
+    out << std::setw(10);
+    if (r.bytes > 0.0) out << r.gbps(); else out << "-";
+    out << "\n";
+    out.copyfmt(state);
+}
+
+static std::string jsonEscape(const std::string &s) {
+    std::string escaped;
+    for (char c : s) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void Benchmark::writeJson(std::ostream &out) const {
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    out << std::defaultfloat << std::setprecision(17);
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+#if defined(__VERSION__)
+    out << "    \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n";
+#endif
+    out << "    \"cycle_counter\": " << (hasCycleCounter() ? "true" : "false") << "\n  },\n";
+    out << "  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult &r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << jsonEscape(r.name) << "\""
+            << ", \"iterations\": " << r.iterations << ", \"repetitions\": " << r.repetitions
+            << ", \"median_ns\": " << r.median_ns << ", \"mean_ns\": " << r.mean_ns
+            << ", \"min_ns\": " << r.min_ns << ", \"max_ns\": " << r.max_ns
+            << ", \"p90_ns\": " << r.p90_ns << ", \"p99_ns\": " << r.p99_ns
+            << ", \"stddev_ns\": " << r.stddev_ns << ", \"cycles\": " << r.cycles
+            << ", \"flops\": " << r.flops << ", \"bytes\": " << r.bytes
+            << ", \"gflops\": " << r.gflops() << ", \"gbps\": " << r.gbps() << "}";
+    }
+    out << "\n  ]\n}\n";
+    out.copyfmt(state);
+}
+
+void Benchmark::writeJson(const std::string &filename) const {
+    std::ofstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Cannot write benchmark results: " + filename);
+    }
+    writeJson(file);
+}
+
+// Minimal reader for the files writeJson() produces: objects, arrays, strings, numbers and literals
+namespace {
+class JsonReader {
+public:
+    explicit JsonReader(const std::string &text) : text(text) {}
+
+    std::vector<BenchmarkResult> readResults() {
+        std::vector<BenchmarkResult> results;
+        expect('{');
+        if (peek() == '}') return results;
+        do {
+            std::string key = readString();
+            expect(':');
+            if (key == "benchmarks") {
+                expect('[');
+                if (peek() != ']') {
+                    do results.push_back(readResult()); while (accept(','));
+                }
+                expect(']');
+            } else {
+                skipValue();
+            }
+        } while (accept(','));
+        expect('}');
+        return results;
+    }
+
+private:
+    const std::string &text;
+    size_t pos = 0;
+
+    [[noreturn]] void fail(const std::string &what) {
+        throw std::runtime_error("Invalid benchmark JSON at offset " + std::to_string(pos) + ": " + what);
+    }
+    char peek() {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) pos++;
+        return pos < text.size() ? text[pos] : '\0';
+    }
+    bool accept(char c) {
+        if (peek() != c) return false;
+        pos++;
+        return true;
+    }
+    void expect(char c) {
+        if (!accept(c)) fail(std::string("expected '") + c + "'");
+    }
+    std::string readString() {
+        expect('"');
+        std::string s;
+        while (pos < text.size() && text[pos] != '"') {
+            if (text[pos] == '\\' && pos + 1 < text.size()) pos++;
+            s += text[pos++];
+        }
+        if (pos >= text.size()) fail("unterminated string");
+        pos++;
+        return s;
+    }
+    double readNumber() {
+        peek();
+        const char* begin = text.c_str() + pos;
+        char* end = nullptr;
+        double value = std::strtod(begin, &end);
+        if (end == begin) fail("expected a number");
+        pos += end - begin;
+        return value;
+    }
+    void skipValue() {
+        char c = peek();
+        if (c == '"') { readString(); return; }
+        if (c == '{' || c == '[') {
+            char close = c == '{' ? '}' : ']';
+            pos++;
+            if (accept(close)) return;
+            do {
+                if (c == '{') { readString(); expect(':'); }
+                skipValue();
+            } while (accept(','));
+            expect(close);
+            return;
+        }
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            while (pos < text.size() && std::isalpha(static_cast<unsigned char>(text[pos]))) pos++;
+            return;
+        }
+        readNumber();
+    }
+    BenchmarkResult readResult() {
+        BenchmarkResult r;
+        std::map<std::string, double*> fields = {
+            {"median_ns", &r.median_ns}, {"mean_ns", &r.mean_ns}, {"min_ns", &r.min_ns}, {"max_ns", &r.max_ns},
+            {"p90_ns", &r.p90_ns}, {"p99_ns", &r.p99_ns}, {"stddev_ns", &r.stddev_ns},
+            {"cycles", &r.cycles}, {"flops", &r.flops}, {"bytes", &r.bytes}};
+        expect('{');
+        if (accept('}')) return r;
+        do {
+            std::string key = readString();
+            expect(':');
+            auto field = fields.find(key);
+            if (key == "name") r.name = readString();
+            else if (key == "iterations") r.iterations = static_cast<long long>(readNumber());
+            else if (key == "repetitions") r.repetitions = static_cast<int>(readNumber());
+            else if (field != fields.end()) *field->second = readNumber();
+            else skipValue();
+        } while (accept(','));
+        expect('}');
+        return r;
+    }
+};
+}  // namespace
+
+std::vector<BenchmarkResult> Benchmark::readJson(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Cannot open benchmark baseline: " + filename);
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+    return JsonReader(text).readResults();
+}
+
+int Benchmark::compare(const std::vector<BenchmarkResult> &baseline, const std::vector<BenchmarkResult> &current,
+                       double threshold, std::ostream &out) {
+    std::map<std::string, const BenchmarkResult*> before;
+    for (const BenchmarkResult &r : baseline) before[r.name] = &r;
+
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    int regressions = 0;
+    out << std::left << std::setw(36) << "benchmark" << std::right << std::setw(12) << "baseline"
+        << std::setw(12) << "current" << std::setw(10) << "change" << "\n";
+    for (const BenchmarkResult &r : current) {
+        out << std::left << std::setw(36) << r.name << std::right;
+        auto it = before.find(r.name);
+        if (it == before.end()) {
+            out << std::setw(12) << "-" << std::setw(12) << formatTime(r.median_ns) << std::setw(10) << "new" << "\n";
+            continue;
+        }
+        double old = it->second->median_ns;
+        double change = old > 0.0 ? r.median_ns / old - 1.0 : 0.0;
+        out << std::setw(12) << formatTime(old) << std::setw(12) << formatTime(r.median_ns)
+            << std::setw(9) << std::fixed << std::setprecision(1) << std::showpos << change * 100.0 << "%";
+        out.copyfmt(state);
+        if (change > threshold) {
+            out << "  REGRESSION";
+            regressions++;
+        } else if (change < -threshold) {
+            out << "  improved";
+        }
+        out << "\n";
+        before.erase(it);
+    }
+    for (const auto &missing : before) {
+        out << std::left << std::setw(36) << missing.first << std::right
+            << std::setw(12) << formatTime(missing.second->median_ns) << std::setw(12) << "-"
+            << std::setw(10) << "missing" << "\n";
+    }
+    out << regressions << " regression(s) beyond " << threshold * 100.0 << "%\n";
+    out.copyfmt(state);
+    return regressions;
+}
@@ -0,0 +1,77 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <iostream>
+
+// Timing statistics of one benchmark, all times are per call of the benchmarked function
+struct BenchmarkResult {
+    std::string name;
+    long long iterations = 0;  // calls per repetition
+    int repetitions = 0;
+    double median_ns = 0.0, mean_ns = 0.0, min_ns = 0.0, max_ns = 0.0;
+    double p90_ns = 0.0, p99_ns = 0.0, stddev_ns = 0.0;
+    double cycles = 0.0;       // time stamp counter ticks per call at the median, 0 if there is no TSC
+    double flops = 0.0;        // floating point operations per call, 0 if not meaningful
+    double bytes = 0.0;        // bytes moved per call, 0 if not meaningful
+
+    double gflops() const { return median_ns > 0.0 ? flops / median_ns : 0.0; }
+    double gbps() const { return median_ns > 0.0 ? bytes / median_ns : 0.0; }
+};
+
+struct BenchmarkOptions {
+    int warmup = 2;            // untimed repetitions, also used to pick the iteration count
+    int repetitions = 15;      // timed repetitions the statistics are taken over
+    double minSeconds = 0.02;  // each repetition repeats the function until it runs at least this long
+    long long maxIterations = 1000000;
+};
+
+// Keeps the compiler from dropping a computation whose result is never used
+template <typename T>
+inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+// Dependency-free micro/macro benchmark harness (used by bench/nn_bench.cpp).
+//
+// run() times a function over several repetitions after a warmup and keeps the results,
+// writeJson()/readJson() store them so later runs can be compared against a saved baseline.
+class Benchmark {
+public:
+    explicit Benchmark(const BenchmarkOptions &options = BenchmarkOptions());
+
+    // flops/bytes: work done by one call, used for the GFLOP/s and GB/s columns
+    const BenchmarkResult& run(const std::string &name, const std::function<void()> &fn,
+                               double flops = 0.0, double bytes = 0.0);
+    const BenchmarkResult& run(const std::string &name, const std::function<void()> &fn,
+                               double flops, double bytes, const BenchmarkOptions &options);
+
+    const std::vector<BenchmarkResult>& getResults() const { return results; }
+
+    static void printHeader(std::ostream &out);
+    static void print(const BenchmarkResult &result, std::ostream &out);
+
+    void writeJson(std::ostream &out) const;
+    void writeJson(const std::string &filename) const;
+    static std::vector<BenchmarkResult> readJson(const std::string &filename);
+
+    // Prints the median of every benchmark next to the baseline and returns how many got slower
+    // than baseline * (1 + threshold). Benchmarks present in only one of the two are listed, not counted.
+    static int compare(const std::vector<BenchmarkResult> &baseline, const std::vector<BenchmarkResult> &current,
+                       double threshold, std::ostream &out);
+
+    static bool hasCycleCounter();
+
+private:
+    BenchmarkOptions options;
+    std::vector<BenchmarkResult> results;
+};
+
+#endif  // BENCHMARK_HPP
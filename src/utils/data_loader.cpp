@@ -0,0 +1,159 @@
+#include "data_loader.hpp"
+#include "trace.hpp"
+#include "../math/random.hpp"
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <stdexcept>
+
+DataLoader::DataLoader(const IdxFile &images, const IdxFile &labels, int batchSize,
+                       bool shuffle, uint64_t seed, int numWorkers, int ringSize, const Augmenter* augmenter)
+    : images(images), labels(labels), batchSize(batchSize), shuffle(shuffle), seed(seed), augmenter(augmenter) {
+    if (images.dtype() != IdxFile::DataType::UByte || labels.dtype() != IdxFile::DataType::UByte) {
+        throw std::invalid_argument("DataLoader expects ubyte image and label files");
+    }
+    if (images.count() != labels.count() || labels.sampleSize() != 1) {
+        throw std::invalid_argument("DataLoader needs exactly one label per image");
+    }
+    if (images.count() == 0) {
+        throw std::invalid_argument("DataLoader needs at least one sample");
+    }
+    if (batchSize <= 0 || numWorkers <= 0) {
+        throw std::invalid_argument("DataLoader needs a positive batch size and worker count");
+    }
+    if (augmenter && static_cast<size_t>(augmenter->getRows()) * augmenter->getCols() != images.sampleSize()) {
+        throw std::invalid_argument("Augmenter image size does not match the dataset");
+    }
+
+    batchesInEpoch = static_cast<int>((images.count() + batchSize - 1) / batchSize);
+    ring.resize(std::max(2, ringSize));  // at least double buffered
+    for (int i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&DataLoader::workerLoop, this);
+    }
+}
+
+DataLoader::~DataLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+const Batch& DataLoader::next() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // The caller is done with the previous batch, its slot can be refilled
+    if (lastServed >= 0) {
+        ring[lastServed % ring.size()].state = SlotState::Free;
+        cv.notify_all();
+    }
+
+    long long index = nextToServe++;
+    Slot& slot = ring[index % ring.size()];
+    auto ready = [&] { return slot.state == SlotState::Ready && slot.index == index; };
+    if (!ready()) {
+        TraceScope trace("wait_for_batch", "data", "batch", index);
+        auto start = std::chrono::steady_clock::now();
+        cv.wait(lock, ready);
+        stall += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    lastServed = index;
+    return slot.batch;
+}
+
+double DataLoader::stallSeconds() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stall;
+}
+
+std::vector<uint32_t> DataLoader::epochOrder(int epoch) const {
+    std::vector<uint32_t> order(images.count());
+    std::iota(order.begin(), order.end(), 0);
+    if (shuffle) {
+        // Fisher-Yates over Philox stream `epoch`, the same permutation on every platform
+        RandomStream rng(seed, static_cast<uint64_t>(epoch));
+        for (size_t i = order.size(); i > 1; i--) {
+            std::swap(order[i - 1], order[rng.below(i)]);
+        }
+    }
+    return order;
+}
+
+std::shared_ptr<const std::vector<uint32_t>> DataLoader::orderFor(int epoch) {
+    if (epoch == cachedEpoch) return cachedOrder;
+    if (epoch == previousEpoch) return previousOrder;
+
+    // Workers never lag behind by a full epoch, so keeping two permutations is enough
+    previousEpoch = cachedEpoch;
+    previousOrder = cachedOrder;
+    cachedEpoch = epoch;
+    cachedOrder = std::make_shared<const std::vector<uint32_t>>(epochOrder(epoch));
+    return cachedOrder;
+}
+
+void DataLoader::workerLoop() {
+    Tracer::setThreadName("DataLoader worker");
+    Augmenter::Workspace workspace;  // per worker scratch buffers
+    while (true) {
+        long long index;
+        Slot* slot;
+        std::shared_ptr<const std::vector<uint32_t>> order;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || ring[nextToFill % ring.size()].state == SlotState::Free; });
+            if (stopping) return;
+
+            index = nextToFill++;
+            slot = &ring[index % ring.size()];
+            slot->state = SlotState::Filling;
+            slot->index = index;
+            order = orderFor(static_cast<int>(index / batchesInEpoch));
+        }
+
+        {
+            TraceScope trace("fill_batch", "data", "batch", index);
+            AllocationScope allocations(AllocCategory::Loader);
+            fill(slot->batch, index, *order, workspace);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot->state = SlotState::Ready;
+        }
+        cv.notify_all();
+    }
+}
+
+void DataLoader::fill(Batch &batch, long long index, const std::vector<uint32_t> &order, Augmenter::Workspace &workspace) {
+    size_t first = static_cast<size_t>(index % batchesInEpoch) * batchSize;
+    int n = static_cast<int>(std::min<size_t>(batchSize, images.count() - first));
+    int cols = static_cast<int>(images.sampleSize());
+
+    // Reuse the slot's buffers, they only change shape for the last batch of an epoch
+    if (batch.inputs.rows != n || batch.inputs.cols != cols) {
+        batch.inputs = Matrix(n, cols);
+    }
+    batch.labels.resize(n);
+    batch.size = n;
+    batch.epoch = static_cast<int>(index / batchesInEpoch);
+
+    const uint8_t* pixels = images.ubyteData();
+    const uint8_t* labelBytes = labels.ubyteData();
+    for (int i = 0; i < n; i++) {
+        uint32_t sample = order[first + i];
+        const uint8_t* src = pixels + static_cast<size_t>(sample) * cols;
+        double* row = batch.inputs.data[i];
+        if (augmenter) {
+            augmenter->apply(src, row, batch.epoch, sample, workspace);
+        } else {
+            for (int j = 0; j < cols; j++) {
+                row[j] = src[j] / 255.0;
+            }
+        }
+        batch.labels[i] = labelBytes[sample];
+    }
+}
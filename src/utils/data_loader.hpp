@@ -0,0 +1,80 @@
+#ifndef DATA_LOADER_HPP
+#define DATA_LOADER_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include "idx_file.hpp"
+#include "augmentation.hpp"
+#include "dataset.hpp"
+#include "../math/matrix.hpp"
+
+// Assembles shuffled minibatches from IDX images/labels on background threads.
+//
+// Batches are written into a fixed ring of reusable slots (at least 2, so the next batch is
+// built while the trainer works on the current one). Workers run ahead by at most the ring size,
+// and the time the trainer spends waiting in next() is reported as stall time.
+// Batch order is the same for a given seed whatever the number of workers.
+// With an Augmenter every image is distorted on the fly by the workers (training data only).
+class DataLoader {
+public:
+    DataLoader(const IdxFile &images, const IdxFile &labels, int batchSize,
+               bool shuffle = true, uint64_t seed = 0, int numWorkers = 1, int ringSize = 2,
+               const Augmenter* augmenter = nullptr);
+    ~DataLoader();
+
+    DataLoader(const DataLoader&) = delete;
+    DataLoader& operator=(const DataLoader&) = delete;
+
+    // Next batch, epochs follow each other without end (the last batch of an epoch can be smaller).
+    // The reference stays valid until the following call.
+    const Batch& next();
+
+    int batchesPerEpoch() const { return batchesInEpoch; }
+    double stallSeconds() const;  // total time next() waited for data
+
+    // Sample order of an epoch, exposed for testing
+    std::vector<uint32_t> epochOrder(int epoch) const;
+
+private:
+    enum class SlotState { Free, Filling, Ready };
+    struct Slot {
+        Batch batch;
+        SlotState state = SlotState::Free;
+        long long index = -1;  // global batch number held by the slot
+    };
+
+    const IdxFile &images;
+    const IdxFile &labels;
+    int batchSize;
+    bool shuffle;
+    uint64_t seed;
+    int batchesInEpoch;
+    const Augmenter* augmenter;  // not owned, may be null
+
+    std::vector<Slot> ring;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    long long nextToFill = 0;     // next global batch index a worker will claim
+    long long nextToServe = 0;    // next global batch index next() hands out
+    long long lastServed = -1;
+    bool stopping = false;
+    double stall = 0.0;
+
+    // Permutations of the epochs in flight (workers run at most ringSize batches ahead)
+    int cachedEpoch = -1;
+    std::shared_ptr<const std::vector<uint32_t>> cachedOrder;
+    std::shared_ptr<const std::vector<uint32_t>> previousOrder;
+    int previousEpoch = -1;
+
+    std::vector<std::thread> workers;
+
+    void workerLoop();
+    std::shared_ptr<const std::vector<uint32_t>> orderFor(int epoch);  // requires mutex
+    void fill(Batch &batch, long long index, const std::vector<uint32_t> &order, Augmenter::Workspace &workspace);
+};
+
+#endif  // DATA_LOADER_HPP
@@ -0,0 +1,238 @@
+#include "dataset.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#else
+#include <fstream>
+#endif
+
+// Positional reads from one file, plus page cache hints where the platform has them
+class IdxStreamDataset::ChunkReader {
+private:
+    std::string filename;
+    bool hints;
+#ifndef _WIN32
+    int fd = -1;
+#else
+    std::ifstream file;
+#endif
+
+public:
+    ChunkReader(const std::string &filename, bool hints) : filename(filename), hints(hints) {
+#ifndef _WIN32
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open " + filename);
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (hints) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+        file.open(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Could not open " + filename);
+        }
+#endif
+    }
+
+    ~ChunkReader() {
+#ifndef _WIN32
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    void read(uint64_t offset, size_t length, unsigned char* dst) {
+#ifndef _WIN32
+        size_t done = 0;
+        while (done < length) {
+            ssize_t n = pread(fd, dst + done, length - done, static_cast<off_t>(offset + done));
+            if (n <= 0) {
+                throw std::runtime_error("Unexpected end of " + filename);
+            }
+            done += static_cast<size_t>(n);
+        }
+#else
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(reinterpret_cast<char*>(dst), length);
+        if (!file) {
+            throw std::runtime_error("Unexpected end of " + filename);
+        }
+#endif
+    }
+
+    // Start reading the next range ahead of time, forget the range already consumed
+    void advise(uint64_t consumedOffset, size_t consumedLength, uint64_t nextOffset, size_t nextLength) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+        if (!hints) return;
+        if (nextLength > 0) posix_fadvise(fd, static_cast<off_t>(nextOffset), static_cast<off_t>(nextLength), POSIX_FADV_WILLNEED);
+        if (consumedLength > 0) posix_fadvise(fd, static_cast<off_t>(consumedOffset), static_cast<off_t>(consumedLength), POSIX_FADV_DONTNEED);
+#else
+        (void)consumedOffset; (void)consumedLength; (void)nextOffset; (void)nextLength;
+#endif
+    }
+
+    IdxFile::Header readHeader() {
+        unsigned char bytes[4 + 4 * 255];
+        read(0, 4, bytes);
+        size_t ndims = bytes[3];
+        read(4, 4 * ndims, bytes + 4);
+        return IdxFile::parseHeader(bytes, 4 + 4 * ndims, filename);
+    }
+};
+
+IdxStreamDataset::IdxStreamDataset(const std::string &imagesFile, const std::string &labelsFile)
+    : IdxStreamDataset(imagesFile, labelsFile, Options()) {}
+
+IdxStreamDataset::IdxStreamDataset(const std::string &imagesFile, const std::string &labelsFile, const Options &options)
+    : options(options) {
+    if (options.chunkSamples == 0) {
+        throw std::invalid_argument("chunkSamples must be positive");
+    }
+    imageReader = std::make_unique<ChunkReader>(imagesFile, options.readaheadHints);
+    labelReader = std::make_unique<ChunkReader>(labelsFile, options.readaheadHints);
+    imageHeader = imageReader->readHeader();
+    labelHeader = labelReader->readHeader();
+
+    numSamples = imageHeader.dims[0];
+    elementsPerSample = 1;
+    for (size_t d = 1; d < imageHeader.dims.size(); d++) {
+        elementsPerSample *= imageHeader.dims[d];
+    }
+    if (labelHeader.dims.size() != 1 || labelHeader.dims[0] != numSamples) {
+        throw std::invalid_argument("Label file must hold exactly one label per image");
+    }
+
+    imageSampleBytes = elementsPerSample * IdxFile::elementSize(imageHeader.type);
+    labelSampleBytes = IdxFile::elementSize(labelHeader.type);
+    imageChunk.resize(options.chunkSamples * imageSampleBytes);
+    labelChunk.resize(options.chunkSamples * labelSampleBytes);
+    shuffleImages.resize(options.shuffleBuffer * imageSampleBytes);
+    shuffleLabels.resize(options.shuffleBuffer * labelSampleBytes);
+    sampleScratch.resize(imageSampleBytes);
+}
+
+IdxStreamDataset::~IdxStreamDataset() = default;
+
+size_t IdxStreamDataset::bufferBytes() const {
+    return imageChunk.size() + labelChunk.size() + shuffleImages.size() + shuffleLabels.size() + sampleScratch.size();
+}
+
+void IdxStreamDataset::reset() {
+    epoch++;
+    rng = RandomStream(options.seed, static_cast<uint64_t>(epoch));
+    nextToRead = 0;
+    chunkFirst = chunkCount = chunkPosition = 0;
+    shuffleFilled = 0;
+
+    // Prime the shuffle buffer
+    while (shuffleFilled < options.shuffleBuffer &&
+           readSample(&shuffleImages[shuffleFilled * imageSampleBytes], &shuffleLabels[shuffleFilled * labelSampleBytes])) {
+        shuffleFilled++;
+    }
+}
+
+bool IdxStreamDataset::readSample(unsigned char* image, unsigned char* label) {
+    if (chunkPosition == chunkCount) {
+        if (nextToRead == numSamples) return false;
+
+        // Next chunk, then hint the one after it and drop the one just finished
+        size_t previousFirst = chunkFirst, previousCount = chunkCount;
+        chunkFirst = nextToRead;
+        chunkCount = std::min(options.chunkSamples, numSamples - chunkFirst);
+        chunkPosition = 0;
+        TraceScope trace("read_chunk", "data", "samples", chunkCount);
+        imageReader->read(imageHeader.size + chunkFirst * imageSampleBytes, chunkCount * imageSampleBytes, imageChunk.data());
+        labelReader->read(labelHeader.size + chunkFirst * labelSampleBytes, chunkCount * labelSampleBytes, labelChunk.data());
+        nextToRead += chunkCount;
+
+        size_t aheadCount = std::min(options.chunkSamples, numSamples - nextToRead);
+        imageReader->advise(imageHeader.size + previousFirst * imageSampleBytes, previousCount * imageSampleBytes,
+                            imageHeader.size + nextToRead * imageSampleBytes, aheadCount * imageSampleBytes);
+        labelReader->advise(labelHeader.size + previousFirst * labelSampleBytes, previousCount * labelSampleBytes,
+                            labelHeader.size + nextToRead * labelSampleBytes, aheadCount * labelSampleBytes);
+    }
+
+    std::memcpy(image, &imageChunk[chunkPosition * imageSampleBytes], imageSampleBytes);
+    std::memcpy(label, &labelChunk[chunkPosition * labelSampleBytes], labelSampleBytes);
+    chunkPosition++;
+    return true;
+}
+
+bool IdxStreamDataset::nextSample(unsigned char* image, unsigned char* label) {
+    if (options.shuffleBuffer == 0) {
+        return readSample(image, label);
+    }
+    if (shuffleFilled == 0) return false;
+
+    // Emit a random resident sample and refill its slot from the stream
+    size_t slot = rng.below(shuffleFilled);
+    unsigned char* slotImage = &shuffleImages[slot * imageSampleBytes];
+    unsigned char* slotLabel = &shuffleLabels[slot * labelSampleBytes];
+    std::memcpy(image, slotImage, imageSampleBytes);
+    std::memcpy(label, slotLabel, labelSampleBytes);
+
+    if (!readSample(slotImage, slotLabel)) {
+        // Stream exhausted: move the last resident sample into the hole
+        shuffleFilled--;
+        std::memcpy(slotImage, &shuffleImages[shuffleFilled * imageSampleBytes], imageSampleBytes);
+        std::memcpy(slotLabel, &shuffleLabels[shuffleFilled * labelSampleBytes], labelSampleBytes);
+    }
+    return true;
+}
+
+// ubyte pixels are normalized to [0, 1], other dtypes are used as stored
+void IdxStreamDataset::decodeInto(const unsigned char* image, double* row) const {
+    if (imageHeader.type == IdxFile::DataType::UByte) {
+        for (size_t j = 0; j < elementsPerSample; j++) {
+            row[j] = image[j] / 255.0;
+        }
+        return;
+    }
+    size_t elementBytes = IdxFile::elementSize(imageHeader.type);
+    for (size_t j = 0; j < elementsPerSample; j++) {
+        row[j] = IdxFile::decode(imageHeader.type, image + j * elementBytes);
+    }
+}
+
+bool IdxStreamDataset::nextBatch(Batch &batch, int batchSize) {
+    TraceScope trace("next_batch", "data");
+    AllocationScope allocations(AllocCategory::Loader);
+    if (batchSize <= 0) {
+        throw std::invalid_argument("Batch size must be positive");
+    }
+    if (epoch < 0) reset();
+
+    unsigned char label[8];
+    int n = 0;
+    int cols = static_cast<int>(elementsPerSample);
+    if (batch.inputs.rows != batchSize || batch.inputs.cols != cols) {
+        batch.inputs = Matrix(batchSize, cols);
+    }
+    batch.labels.resize(batchSize);
+
+    while (n < batchSize && nextSample(sampleScratch.data(), label)) {
+        decodeInto(sampleScratch.data(), batch.inputs.data[n]);
+        batch.labels[n] = static_cast<int>(IdxFile::decode(labelHeader.type, label));
+        n++;
+    }
+    if (n == 0) return false;
+
+    // Last batch of the epoch can be smaller
+    if (n < batchSize) {
+        Matrix partial(n, cols);
+        for (int i = 0; i < n; i++) {
+            std::copy(batch.inputs.data[i], batch.inputs.data[i] + cols, partial.data[i]);
+        }
+        batch.inputs = std::move(partial);
+        batch.labels.resize(n);
+    }
+    batch.size = n;
+    batch.epoch = epoch;
+    return true;
+}
@@ -0,0 +1,117 @@
+#ifndef DATASET_HPP
+#define DATASET_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "idx_file.hpp"
+#include "../math/matrix.hpp"
+#include "../math/random.hpp"
+
+// One minibatch: normalized inputs, one sample per row, plus plain integer labels
+struct Batch {
+    Matrix inputs;            // (size, sampleSize), pixels scaled to [0, 1]
+    std::vector<int> labels;  // class index per row (no one-hot matrices)
+    int size = 0;
+    int epoch = 0;
+};
+
+// Streaming source of minibatches, for datasets that do not fit in memory.
+// One pass over the data is an epoch, reset() starts the next one.
+class Dataset {
+public:
+    virtual ~Dataset() = default;
+
+    virtual void reset() = 0;
+    // Fills batch with up to batchSize samples, false once the epoch is exhausted
+    virtual bool nextBatch(Batch &batch, int batchSize) = 0;
+    virtual int sampleSize() const = 0;
+
+    // Input iterator over the batches of one epoch, the Batch buffer is reused between steps
+    class Iterator {
+    private:
+        Dataset* dataset = nullptr;
+        int batchSize = 0;
+        Batch batch;
+        bool done = true;
+    public:
+        Iterator() = default;
+        Iterator(Dataset* dataset, int batchSize) : dataset(dataset), batchSize(batchSize) {
+            done = !dataset->nextBatch(batch, batchSize);
+        }
+        const Batch& operator*() const { return batch; }
+        const Batch* operator->() const { return &batch; }
+        Iterator& operator++() { done = !dataset->nextBatch(batch, batchSize); return *this; }
+        bool operator!=(const Iterator &other) const { return done != other.done; }
+    };
+
+    class Range {
+    private:
+        Dataset* dataset;
+        int batchSize;
+    public:
+        Range(Dataset* dataset, int batchSize) : dataset(dataset), batchSize(batchSize) {}
+        Iterator begin() { dataset->reset(); return Iterator(dataset, batchSize); }
+        Iterator end() { return Iterator(); }
+    };
+
+    // for (const Batch& batch : dataset.batches(64)) { ... }  runs one epoch
+    Range batches(int batchSize) { return Range(this, batchSize); }
+};
+
+// IDX images and labels read front to back in fixed size chunks.
+//
+// Memory stays bounded by the chunk and shuffle buffers whatever the file size: samples flow
+// through a shuffle buffer (a random resident sample is emitted and replaced by the next one read),
+// which gives an approximate shuffle. Consumed file ranges are dropped from the page cache and
+// the next chunk is prefetched through posix_fadvise when readaheadHints is on.
+class IdxStreamDataset : public Dataset {
+public:
+    struct Options {
+        size_t chunkSamples = 4096;     // samples per read
+        size_t shuffleBuffer = 16384;   // resident samples for shuffling, 0 keeps the file order
+        uint64_t seed = 0;
+        bool readaheadHints = true;     // posix_fadvise, ignored where unavailable
+    };
+
+    IdxStreamDataset(const std::string &imagesFile, const std::string &labelsFile, const Options &options);
+    IdxStreamDataset(const std::string &imagesFile, const std::string &labelsFile);
+    ~IdxStreamDataset();
+
+    void reset() override;
+    bool nextBatch(Batch &batch, int batchSize) override;
+    int sampleSize() const override { return static_cast<int>(elementsPerSample); }
+
+    size_t count() const { return numSamples; }
+    size_t bufferBytes() const;  // fixed memory used for buffering, independent of count()
+
+private:
+    class ChunkReader;  // platform file access
+    std::unique_ptr<ChunkReader> imageReader, labelReader;
+    IdxFile::Header imageHeader, labelHeader;
+    Options options;
+    size_t numSamples = 0;
+    size_t elementsPerSample = 0;
+    size_t imageSampleBytes = 0, labelSampleBytes = 0;
+
+    // current chunk read from the files
+    std::vector<unsigned char> imageChunk, labelChunk;
+    size_t chunkFirst = 0, chunkCount = 0, chunkPosition = 0;
+    size_t nextToRead = 0;  // next sample index not yet read from disk
+
+    // shuffle buffer of raw samples
+    std::vector<unsigned char> shuffleImages, shuffleLabels;
+    size_t shuffleFilled = 0;
+    std::vector<unsigned char> sampleScratch;
+
+    int epoch = -1;
+    RandomStream rng{0, 0};
+
+    bool readSample(unsigned char* image, unsigned char* label);  // next sample in file order
+    bool nextSample(unsigned char* image, unsigned char* label);  // next sample after shuffling
+    void decodeInto(const unsigned char* image, double* row) const;
+};
+
+#endif  // DATASET_HPP
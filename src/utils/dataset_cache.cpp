@@ -0,0 +1,167 @@
+#include "dataset_cache.hpp"
+#include "idx_file.hpp"
+#include "trace.hpp"
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <random>
+#include <stdexcept>
+
+static const char MAGIC[8] = {'N', 'N', 'C', 'P', 'P', 'D', 'S', 'C'};
+static const uint64_t ALIGNMENT = 64;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t sourceHash;
+    uint64_t imagesOffset;
+    uint64_t labelsOffset;
+    uint64_t fileSize;
+};
+static_assert(sizeof(CacheHeader) == 64, "CacheHeader must stay 64 bytes");
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+// Word at a time multiply-xorshift hash, fast enough to run over the sources on every start
+static uint64_t hashBytes(const unsigned char* bytes, size_t length, uint64_t hash) {
+    const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ bytes[i]) * prime;
+    }
+    return hash ^ length;
+}
+
+uint64_t DatasetCache::hashSources(const std::string &imagesFile, const std::string &labelsFile) {
+    MappedFile images(imagesFile), labels(labelsFile);
+    uint64_t hash = hashBytes(images.data(), images.size(), 0x243F6A8885A308D3ULL);
+    return hashBytes(labels.data(), labels.size(), hash);
+}
+
+std::shared_ptr<const DatasetCache> DatasetCache::open(const std::string &imagesFile, const std::string &labelsFile,
+                                                       const std::string &cachePath) {
+    std::string path = cachePath.empty() ? imagesFile + ".cache" : cachePath;
+    uint64_t sourceHash = hashSources(imagesFile, labelsFile);
+
+    std::shared_ptr<DatasetCache> cache(new DatasetCache());
+    if (!cache->tryMap(path, sourceHash)) {
+        TraceScope trace("build_cache", "data");
+        build(imagesFile, labelsFile, path, sourceHash);
+        if (!cache->tryMap(path, sourceHash)) {
+            throw std::runtime_error("Could not read back the dataset cache " + path);
+        }
+        cache->rebuilt = true;
+    }
+    return cache;
+}
+
+bool DatasetCache::tryMap(const std::string &cachePath, uint64_t sourceHash) {
+    std::unique_ptr<MappedFile> mapped;
+    try {
+        mapped = std::make_unique<MappedFile>(cachePath);
+    } catch (const std::runtime_error&) {
+        return false;  // no cache yet
+    }
+
+    CacheHeader header;
+    if (mapped->size() < sizeof(header)) return false;
+    std::memcpy(&header, mapped->data(), sizeof(header));
+    size_t imageBytes = header.count * header.rows * header.cols * sizeof(float);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        header.sourceHash != sourceHash || header.fileSize != mapped->size() ||
+        header.imagesOffset % ALIGNMENT != 0 || header.imagesOffset + imageBytes > header.labelsOffset ||
+        header.labelsOffset + header.count > header.fileSize) {
+        return false;  // stale or foreign file, rebuild it
+    }
+
+    numSamples = header.count;
+    imageRows = static_cast<int>(header.rows);
+    imageCols = static_cast<int>(header.cols);
+    pixels = reinterpret_cast<const float*>(mapped->data() + header.imagesOffset);
+    labelBytes = mapped->data() + header.labelsOffset;
+    file = std::move(mapped);
+    return true;
+}
+
+void DatasetCache::build(const std::string &imagesFile, const std::string &labelsFile,
+                         const std::string &cachePath, uint64_t sourceHash) {
+    IdxFile images(imagesFile), labels(labelsFile);
+    if (images.dtype() != IdxFile::DataType::UByte || images.dims().size() != 3 ||
+        labels.dtype() != IdxFile::DataType::UByte || labels.dims().size() != 1 || labels.count() != images.count()) {
+        throw std::runtime_error("Expected matching [N, rows, cols] ubyte images and [N] ubyte labels");
+    }
+
+    CacheHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.rows = static_cast<uint32_t>(images.dims()[1]);
+    header.cols = static_cast<uint32_t>(images.dims()[2]);
+    header.count = images.count();
+    header.sourceHash = sourceHash;
+    header.imagesOffset = alignUp(sizeof(header));
+    size_t sampleSize = images.sampleSize();
+    header.labelsOffset = alignUp(header.imagesOffset + header.count * sampleSize * sizeof(float));
+    header.fileSize = header.labelsOffset + header.count;
+
+    // Written under a temporary name, so concurrent processes never map a half written cache
+    std::string tmpPath = cachePath + ".tmp" + std::to_string(std::random_device()());
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Could not create dataset cache " + tmpPath);
+        }
+        std::vector<char> padding(ALIGNMENT, 0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(padding.data(), header.imagesOffset - sizeof(header));
+
+        // Normalize one image at a time
+        const uint8_t* src = images.ubyteData();
+        std::vector<float> row(sampleSize);
+        for (size_t i = 0; i < header.count; i++) {
+            for (size_t j = 0; j < sampleSize; j++) {
+                row[j] = *src++ / 255.0f;
+            }
+            file.write(reinterpret_cast<const char*>(row.data()), sampleSize * sizeof(float));
+        }
+        file.write(padding.data(), header.labelsOffset - (header.imagesOffset + header.count * sampleSize * sizeof(float)));
+        file.write(reinterpret_cast<const char*>(labels.ubyteData()), header.count);
+        if (!file) {
+            throw std::runtime_error("Failed writing dataset cache " + tmpPath);
+        }
+    }
+    if (std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("Could not move dataset cache into place: " + cachePath);
+    }
+}
+
+void DatasetCache::toMatrix(size_t first, size_t n, Matrix &out) const {
+    if (n == 0 || first + n > numSamples) {
+        throw std::out_of_range("Dataset sample range out of bounds");
+    }
+    AllocationScope allocations(AllocCategory::Loader);
+    int size = sampleSize();
+    if (out.rows != static_cast<int>(n) || out.cols != size) {
+        out = Matrix(static_cast<int>(n), size);
+    }
+    for (size_t i = 0; i < n; i++) {
+        const float* src = image(first + i);
+        double* row = out.data[i];
+        for (int j = 0; j < size; j++) {
+            row[j] = src[j];
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef DATASET_CACHE_HPP
+#define DATASET_CACHE_HPP
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "mapped_file.hpp"
+#include "../math/matrix.hpp"
+
+// Preprocessed copy of an IDX image/label pair for instant startup.
+//
+// The first open() parses the IDX files and writes one aligned binary blob: a header with the
+// hash of both source files, the images already normalized to [0, 1] and flattened as a float
+// [N, rows * cols] tensor, and the labels as uint8. Later opens map the blob and use it in place,
+// preprocessing is skipped as long as the stored hash matches the source files.
+class DatasetCache {
+public:
+    static const uint32_t VERSION = 1;
+
+    // cachePath defaults to imagesFile + ".cache"
+    static std::shared_ptr<const DatasetCache> open(const std::string &imagesFile, const std::string &labelsFile,
+                                                    const std::string &cachePath = "");
+
+    size_t count() const { return numSamples; }
+    int rows() const { return imageRows; }
+    int cols() const { return imageCols; }
+    int sampleSize() const { return imageRows * imageCols; }
+
+    const float* images() const { return pixels; }         // [count, sampleSize], 64-byte aligned
+    const float* image(size_t i) const { return pixels + i * sampleSize(); }
+    const uint8_t* labels() const { return labelBytes; }  // [count]
+
+    // Samples [first, first + n) as rows of out (n, sampleSize), reuses out when the shape matches
+    void toMatrix(size_t first, size_t n, Matrix &out) const;
+
+    bool wasRebuilt() const { return rebuilt; }  // true when this open had to preprocess the sources
+
+    // Hash of the source files as stored in the cache header
+    static uint64_t hashSources(const std::string &imagesFile, const std::string &labelsFile);
+
+private:
+    std::unique_ptr<MappedFile> file;
+    size_t numSamples = 0;
+    int imageRows = 0, imageCols = 0;
+    const float* pixels = nullptr;
+    const uint8_t* labelBytes = nullptr;
+    bool rebuilt = false;
+
+    DatasetCache() = default;
+    bool tryMap(const std::string &cachePath, uint64_t sourceHash);
+    static void build(const std::string &imagesFile, const std::string &labelsFile,
+                      const std::string &cachePath, uint64_t sourceHash);
+};
+
+#endif  // DATASET_CACHE_HPP
@@ -0,0 +1,132 @@
+#include "idx_file.hpp"
+#include "trace.hpp"
+#include <stdexcept>
+#include <cstring>
+
+static uint32_t readBigEndian32(const unsigned char* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+IdxFile::Header IdxFile::parseHeader(const unsigned char* bytes, size_t length, const std::string &filename) {
+    if (length < 4 || bytes[0] != 0 || bytes[1] != 0) {
+        throw std::runtime_error("Not an IDX file (bad magic number): " + filename);
+    }
+    Header header;
+    header.type = static_cast<DataType>(bytes[2]);
+    switch (header.type) {
+        case DataType::UByte: case DataType::Byte: case DataType::Short:
+        case DataType::Int: case DataType::Float: case DataType::Double:
+            break;
+        default:
+            throw std::runtime_error("Unknown IDX data type in " + filename);
+    }
+
+    size_t ndims = bytes[3];
+    header.size = 4 + 4 * ndims;
+    if (ndims == 0 || length < header.size) {
+        throw std::runtime_error("Truncated IDX header in " + filename);
+    }
+    for (size_t d = 0; d < ndims; d++) {
+        header.dims.push_back(readBigEndian32(bytes + 4 + 4 * d));
+    }
+    return header;
+}
+
+IdxFile::IdxFile(const std::string &filename) : file(std::make_shared<MappedFile>(filename)) {
+    TraceScope trace("open_idx", "data");
+    Header header = parseHeader(file->data(), file->size(), filename);
+    type = header.type;
+    shape = header.dims;
+
+    size_t total = 1;
+    for (size_t d : shape) {
+        total *= d;
+    }
+    if (file->size() != header.size + total * elementSize()) {
+        throw std::runtime_error("IDX file size does not match its header: " + filename);
+    }
+    elements = file->data() + header.size;
+}
+
+size_t IdxFile::elementSize(DataType type) {
+    switch (type) {
+        case DataType::UByte: case DataType::Byte: return 1;
+        case DataType::Short: return 2;
+        case DataType::Int: case DataType::Float: return 4;
+        case DataType::Double: return 8;
+    }
+    return 0;
+}
+
+size_t IdxFile::sampleSize() const {
+    size_t n = 1;
+    for (size_t d = 1; d < shape.size(); d++) {
+        n *= shape[d];
+    }
+    return n;
+}
+
+const uint8_t* IdxFile::ubyteData() const {
+    if (type != DataType::UByte) {
+        throw std::logic_error("IDX file does not hold unsigned bytes");
+    }
+    return elements;
+}
+
+double IdxFile::decode(DataType type, const unsigned char* p) {
+    switch (type) {
+        case DataType::UByte: return p[0];
+        case DataType::Byte: return static_cast<int8_t>(p[0]);
+        case DataType::Short: return static_cast<int16_t>((p[0] << 8) | p[1]);
+        case DataType::Int: return static_cast<int32_t>(readBigEndian32(p));
+        case DataType::Float: {
+            uint32_t bits = readBigEndian32(p);
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            return f;
+        }
+        case DataType::Double: {
+            uint64_t bits = (static_cast<uint64_t>(readBigEndian32(p)) << 32) | readBigEndian32(p + 4);
+            double d;
+            std::memcpy(&d, &bits, sizeof(d));
+            return d;
+        }
+    }
+    return 0.0;
+}
+
+double IdxFile::value(size_t index) const {
+    return decode(type, elements + index * elementSize());
+}
+
+void IdxFile::toMatrix(size_t first, size_t n, Matrix &out, double scale) const {
+    if (n == 0 || first + n > count()) {
+        throw std::out_of_range("IDX sample range out of bounds");
+    }
+    AllocationScope allocations(AllocCategory::Loader);
+    int cols = static_cast<int>(sampleSize());
+    if (out.rows != static_cast<int>(n) || out.cols != cols) {
+        out = Matrix(static_cast<int>(n), cols);
+    }
+
+    if (type == DataType::UByte) {
+        // Fast path for MNIST: straight byte to double conversion
+        const uint8_t* src = elements + first * cols;
+        for (size_t i = 0; i < n; i++) {
+            double* row = out.data[i];
+            for (int j = 0; j < cols; j++) {
+                row[j] = src[j] * scale;
+            }
+            src += cols;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        size_t offset = (first + i) * cols;
+        for (int j = 0; j < cols; j++) {
+            out.data[i][j] = value(offset + j) * scale;
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef IDX_FILE_HPP
+#define IDX_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "mapped_file.hpp"
+#include "../math/matrix.hpp"
+
+// Memory mapped IDX file (the MNIST format): validated header, zero-copy access to the elements.
+//
+// Header: two zero bytes, a dtype byte, a dimension count byte, then one big-endian uint32 per
+// dimension. The elements follow in big-endian order. For ubyte files (MNIST images and labels)
+// the mapped bytes are the tensor itself, e.g. images are a [N, 28, 28] uint8 view.
+// Conversion to double only happens for the rows a caller asks for (see toMatrix).
+class IdxFile {
+public:
+    enum class DataType : uint8_t {
+        UByte = 0x08, Byte = 0x09, Short = 0x0B, Int = 0x0C, Float = 0x0D, Double = 0x0E
+    };
+
+    struct Header {
+        DataType type;
+        std::vector<size_t> dims;
+        size_t size;  // header bytes, the elements start here
+    };
+
+    explicit IdxFile(const std::string &filename);
+
+    // Shared with readers that do not map the file (see IdxStreamDataset).
+    // bytes must hold at least 4 bytes, and 4 + 4 * ndims for a complete parse.
+    static Header parseHeader(const unsigned char* bytes, size_t length, const std::string &filename);
+    static size_t elementSize(DataType type);
+    static double decode(DataType type, const unsigned char* element);
+
+    DataType dtype() const { return type; }
+    size_t elementSize() const { return elementSize(type); }
+    const std::vector<size_t>& dims() const { return shape; }
+    size_t count() const { return shape[0]; }  // number of samples (first dimension)
+    size_t sampleSize() const;                 // elements per sample (product of the other dimensions)
+
+    // Raw element bytes, big-endian for multi byte types
+    const unsigned char* bytes() const { return elements; }
+    // The [N, ...] uint8 tensor, only for ubyte files
+    const uint8_t* ubyteData() const;
+
+    // Element at a flat index, decoded from any dtype
+    double value(size_t index) const;
+
+    // Writes samples [first, first + n) as the rows of out (n, sampleSize), each element times scale.
+    // out is reused when it already has that shape, so a batch buffer can be filled over and over.
+    void toMatrix(size_t first, size_t n, Matrix &out, double scale = 1.0) const;
+
+private:
+    std::shared_ptr<MappedFile> file;
+    DataType type;
+    std::vector<size_t> shape;
+    const unsigned char* elements;
+};
+
+#endif  // IDX_FILE_HPP
@@ -0,0 +1,73 @@
+#include "mapped_file.hpp"
+#include <stdexcept>
+#include <fstream>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &filename, bool copyOnWrite) {
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not stat " + filename);
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length == 0) {
+        close(fd);
+        throw std::runtime_error("File is empty: " + filename);
+    }
+
+    int protection = copyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void* address = mmap(nullptr, length, protection, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps its own reference to the file
+    if (address == MAP_FAILED) {
+        throw std::runtime_error("Could not mmap " + filename);
+    }
+    bytes = static_cast<unsigned char*>(address);
+    mapped = true;
+#else
+    (void)copyOnWrite;
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Could not open " + filename);
+    }
+    length = static_cast<size_t>(file.tellg());
+    if (length == 0) {
+        throw std::runtime_error("File is empty: " + filename);
+    }
+    bytes = static_cast<unsigned char*>(::operator new[](length, std::align_val_t(64)));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes), length);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped && bytes) {
+        munmap(bytes, length);
+    }
+#else
+    if (bytes) {
+        ::operator delete[](bytes, std::align_val_t(64));
+    }
+#endif
+}
+
+void MappedFile::willNeedSequential() const {
+#ifndef _WIN32
+    if (mapped) {
+        madvise(bytes, length, MADV_SEQUENTIAL);
+        madvise(bytes, length, MADV_WILLNEED);
+    }
+#endif
+}
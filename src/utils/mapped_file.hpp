@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <cstddef>
+
+// Read-only view of a whole file through mmap.
+// With copyOnWrite the pages are mapped private and writable: writes stay in this process
+// and never reach the file, so parameters loaded in place can still be trained.
+// Without mmap (Windows) the file is read into a 64-byte aligned buffer instead.
+class MappedFile {
+private:
+    unsigned char* bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;  // false when the fallback buffer is used
+
+public:
+    explicit MappedFile(const std::string &filename, bool copyOnWrite = false);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return bytes; }
+    unsigned char* mutableData() { return bytes; } // only valid with copyOnWrite
+    size_t size() const { return length; }
+
+    // Hint that the whole file will be read front to back soon
+    void willNeedSequential() const;
+};
+
+#endif  // MAPPED_FILE_HPP
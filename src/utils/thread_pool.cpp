@@ -0,0 +1,82 @@
+#include "thread_pool.hpp"
+#include "../math/gemm.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads, PinMode pin) {
+    if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i, pin, threads);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+// Claims indices until none are left, keeping the first exception
+void ThreadPool::runTasks() {
+    for (int i = nextIndex++; i < taskCount; i = nextIndex++) {
+        try {
+            (*task)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+            nextIndex = taskCount;  // skip what is left
+        }
+    }
+}
+
+void ThreadPool::workerLoop(int worker, PinMode pin, int threads) {
+    NumaTopology::system().pinWorker(worker, pin);
+    GemmThreadLimit limit(GemmThreadLimit::shareOf(threads));
+    long long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        runTasks();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0) finished.notify_all();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &body) {
+    if (count <= 0) return;
+    if (workers.empty() || count == 1) {
+        for (int i = 0; i < count; i++) body(i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &body;
+        taskCount = count;
+        nextIndex = 0;
+        busy = static_cast<int>(workers.size());
+        error = nullptr;
+        generation++;
+    }
+    wake.notify_all();
+    {
+        GemmThreadLimit limit(GemmThreadLimit::shareOf(size()));  // the caller is one of the workers now
+        runTasks();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return busy == 0; });
+    task = nullptr;
+    if (error) {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
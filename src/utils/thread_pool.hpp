@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../math/numa.hpp"
+
+// Fixed set of worker threads for fork-join loops. parallelFor hands out the indices one at a
+// time from a shared counter, so tasks of uneven size balance themselves; the calling thread
+// works too, a pool of n threads runs n - 1 workers. With a PinMode the workers pin themselves
+// to CPUs of the NUMA topology (worker w takes NumaTopology::workerCpu(w, mode)). Tasks multiply
+// with their share of the cores (GemmThreadLimit), not with a GEMM on every core each.
+//
+//   ThreadPool pool(4);
+//   pool.parallelFor(models.size(), [&](int i) { models[i].train_step(batch.inputs, batch.labels, 0.1); });
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads = 0, PinMode pin = PinMode::None);  // 0: the hardware threads
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Runs body(i) for every i in [0, count) and returns once all are done. The first exception
+    // thrown by a task is rethrown here (the remaining indices are still handed out, but skipped).
+    // Not reentrant: tasks must not call parallelFor on the same pool.
+    void parallelFor(int count, const std::function<void(int)> &body);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    bool stopping = false;
+    long long generation = 0;  // bumped for every parallelFor
+
+    // The loop in flight
+    const std::function<void(int)>* task = nullptr;
+    int taskCount = 0;
+    std::atomic<int> nextIndex{0};
+    int busy = 0;  // workers still inside the current loop
+    std::exception_ptr error;
+
+    void workerLoop(int worker, PinMode pin, int threads);
+    void runTasks();
+};
+
+#endif  // THREAD_POOL_HPP
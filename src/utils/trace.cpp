@@ -0,0 +1,228 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct Event {
+    const char* name;
+    const char* category;
+    const char* argName;
+    int64_t argValue;
+    int64_t startNs;
+    int64_t endNs;
+};
+
+// Written only by its thread, read by writeJson() once recording has stopped
+struct ThreadBuffer {
+    int tid = 0;
+    const char* threadName = nullptr;
+    std::unique_ptr<Event[]> events{new Event[Tracer::bufferEvents]};
+    std::atomic<uint64_t> head{0};  // total events ever written, the ring holds the last bufferEvents
+    bool retired = false;           // its thread has exited, guarded by Registry::mutex
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;  // oldest first, kept after their thread exits
+    int nextTid = 0;
+    uint64_t droppedEvents = 0;  // in retired buffers that were let go before an export
+    int64_t epochNs = Tracer::now();
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+thread_local ThreadBuffer* localBuffer = nullptr;
+thread_local const char* localName = nullptr;  // set before the buffer exists, buffers are only made while tracing
+
+uint64_t storedEvents(const ThreadBuffer &buffer) {
+    return std::min<uint64_t>(buffer.head.load(std::memory_order_acquire), Tracer::bufferEvents);
+}
+
+// Drops the buffers of exited threads, all of them or the oldest beyond `keep`. Registry mutex held.
+void dropRetired(Registry &r, size_t keep) {
+    size_t retired = std::count_if(r.buffers.begin(), r.buffers.end(), [](const auto &b) { return b->retired; });
+    for (auto it = r.buffers.begin(); it != r.buffers.end() && retired > keep;) {
+        if ((*it)->retired) {
+            if (keep > 0) r.droppedEvents += storedEvents(**it);  // never exported
+            it = r.buffers.erase(it);
+            retired--;
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Marks the thread's buffer retired when the thread exits
+struct BufferOwner {
+    ~BufferOwner() {
+        if (!localBuffer) return;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        localBuffer->retired = true;
+        localBuffer = nullptr;
+        dropRetired(r, Tracer::maxRetiredBuffers);
+    }
+};
+
+ThreadBuffer* threadBuffer() {
+    if (!localBuffer) {
+        static thread_local BufferOwner owner;
+        (void)owner;
+        auto buffer = std::make_shared<ThreadBuffer>();
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        buffer->tid = r.nextTid++;
+        buffer->threadName = localName;
+        r.buffers.push_back(buffer);
+        localBuffer = buffer.get();
+    }
+    return localBuffer;
+}
+
+// Empties the live buffers and drops the retired ones. Registry mutex held.
+void clearBuffers(Registry &r) {
+    for (auto &buffer : r.buffers) {
+        buffer->head.store(0, std::memory_order_relaxed);
+    }
+    dropRetired(r, 0);
+    r.droppedEvents = 0;
+    r.epochNs = Tracer::now();
+}
+
+std::string jsonEscape(const char* s) {
+    std::string escaped;
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') escaped += '\\';
+        escaped += *s;
+    }
+    return escaped;
+}
+
+// NN_TRACE=<file>: trace from startup and write the file when the program exits
+struct EnvironmentTrace {
+    std::string path;
+    EnvironmentTrace() {
+        registry();  // constructed first so it is destroyed after this object
+        const char* env = std::getenv("NN_TRACE");
+        if (env && *env) {
+            path = env;
+            Tracer::setThreadName("main");
+            Tracer::start();
+        }
+    }
+    ~EnvironmentTrace() {
+        if (path.empty()) return;
+        Tracer::stop();
+        try {
+            const size_t events = Tracer::eventCount();
+            Tracer::writeJson(path);
+            std::cerr << "Trace written to " << path << " (" << events << " events)" << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "Failed to write trace: " << e.what() << std::endl;
+        }
+    }
+};
+
+EnvironmentTrace environmentTrace;
+
+}  // namespace
+
+std::atomic<bool> Tracer::active{false};
+
+void Tracer::start() {
+    active.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::stop() {
+    active.store(false, std::memory_order_relaxed);
+}
+
+void Tracer::clear() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    clearBuffers(r);
+}
+
+size_t Tracer::eventCount() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    size_t count = 0;
+    for (auto &buffer : r.buffers) {
+        count += storedEvents(*buffer);
+    }
+    return count;
+}
+
+size_t Tracer::droppedEventCount() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    uint64_t dropped = r.droppedEvents;
+    for (auto &buffer : r.buffers) {
+        dropped += buffer->head.load(std::memory_order_acquire) - storedEvents(*buffer);
+    }
+    return static_cast<size_t>(dropped);
+}
+
+void Tracer::setThreadName(const char* name) {
+    localName = name;
+    if (localBuffer) localBuffer->threadName = name;
+}
+
+void Tracer::record(const char* name, const char* category, int64_t startNs, int64_t endNs,
+                    const char* argName, int64_t argValue) {
+    ThreadBuffer* buffer = threadBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head % bufferEvents] = {name, category, argName, argValue, startNs, endNs};
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::writeJson(std::ostream &out) {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    std::ios state(nullptr);
+    state.copyfmt(out);
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"neural-network\"}}";
+    for (auto &buffer : r.buffers) {
+        out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+            << ", \"args\": {\"name\": \"";
+        if (buffer->threadName) out << jsonEscape(buffer->threadName);
+        else out << "thread " << buffer->tid;
+        out << "\"}}";
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > bufferEvents ? head - bufferEvents : 0;
+        for (uint64_t i = first; i < head; i++) {
+            const Event &e = buffer->events[i % bufferEvents];
+            if (e.startNs < r.epochNs) continue;  // recorded before the last clear()
+            out << ",\n{\"name\": \"" << jsonEscape(e.name) << "\", \"cat\": \"" << jsonEscape(e.category)
+                << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+                << ", \"ts\": " << (e.startNs - r.epochNs) / 1e3 << ", \"dur\": " << (e.endNs - e.startNs) / 1e3;
+            if (e.argName) out << ", \"args\": {\"" << jsonEscape(e.argName) << "\": " << e.argValue << "}";
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    out.copyfmt(state);
+    clearBuffers(r);
+}
+
+void Tracer::writeJson(const std::string &filename) {
+    std::ofstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Cannot write trace: " + filename);
+    }
+    writeJson(file);
+}
@@ -0,0 +1,79 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <iostream>
+
+// Timeline tracing for multi-threaded runs, written as Chrome trace-event JSON
+// (open it in https://ui.perfetto.dev or chrome://tracing).
+//
+// Set NN_TRACE=trace.json to record the whole run and write the file at exit, or call
+// Tracer::start() / Tracer::stop() / Tracer::writeJson() around the part of interest.
+// Every thread records into its own fixed-size ring buffer without locking, when a buffer
+// wraps the oldest events are dropped. The buffers of exited threads are kept for the next export,
+// at most maxRetiredBuffers of them, and writeJson() clears what it wrote, so a long running
+// process tracing all the time holds a bounded amount of memory. While tracing is off a TraceScope
+// is one branch.
+class Tracer {
+public:
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static void start();
+    static void stop();
+    // Drops everything recorded so far
+    static void clear();
+
+    // Events recorded so far over all threads (dropped ones not included)
+    static size_t eventCount();
+    // Events lost since the last export or clear(): overwritten by a wrapped ring, or in the buffer
+    // of an exited thread that had to make room
+    static size_t droppedEventCount();
+
+    // Writes the events and clears them, the next export starts where this one ended.
+    // Only call while no thread is recording, e.g. after stop()
+    static void writeJson(std::ostream &out);
+    static void writeJson(const std::string &filename);
+
+    // Label for the calling thread in the trace viewer, name must be a string literal
+    static void setThreadName(const char* name);
+
+    // One complete event, name/category must be string literals (only the pointer is stored)
+    static void record(const char* name, const char* category, int64_t startNs, int64_t endNs,
+                       const char* argName = nullptr, int64_t argValue = 0);
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static constexpr size_t bufferEvents = 1 << 15;  // per thread, 1.5 MB once the thread records
+    static constexpr size_t maxRetiredBuffers = 16;  // buffers of exited threads kept until the next export
+
+private:
+    static std::atomic<bool> active;
+};
+
+// Records the lifetime of the scope as one event, e.g. TraceScope trace("train_step", "nn");
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category, const char* argName = nullptr, int64_t argValue = 0)
+        : name(name), category(category), argName(argName), argValue(argValue),
+          startNs(Tracer::enabled() ? Tracer::now() : -1) {}
+    ~TraceScope() {
+        if (startNs >= 0) Tracer::record(name, category, startNs, Tracer::now(), argName, argValue);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    const char* argName;
+    int64_t argValue;
+    int64_t startNs;
+};
+
+#endif  // TRACE_HPP
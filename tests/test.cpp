@@ -1,15 +1,48 @@
 #include "../src/math/matrix.hpp"
 #include "../src/layers/dense_layer.hpp"
 #include "../src/layers/conv_layer.hpp"
+#include "../src/layers/dropout_layer.hpp"
+#include "../src/layers/batch_norm_layer.hpp"
 #include "../src/core/neural_network.hpp"
+#include "../src/core/inference_context.hpp"
+#include "../src/core/inference_server.hpp"
+#include "../src/core/model_file.hpp"
+#include "../src/core/checkpoint_manager.hpp"
+#include "../src/core/profiler.hpp"
+#include "../src/core/quantization.hpp"
+#include "../src/core/compiled_model.hpp"
+#include "../src/core/gemm_tuner.hpp"
+#include "../src/core/sweep_runner.hpp"
+#include "../src/core/evaluator.hpp"
+#include "../src/math/sparse_matrix.hpp"
+#include "../src/math/half.hpp"
+#include "../src/math/gemm.hpp"
+#include "../src/math/random.hpp"
+#include "../src/math/numa.hpp"
 #include "../src/activations/activations.hpp"
 #include "../src/utils/utils.hpp"
+#include "../src/utils/idx_file.hpp"
+#include "../src/utils/data_loader.hpp"
+#include "../src/utils/augmentation.hpp"
+#include "../src/utils/dataset_cache.hpp"
+#include "../src/utils/dataset.hpp"
+#include "../src/utils/benchmark.hpp"
+#include "../src/utils/trace.hpp"
+#include "../src/utils/thread_pool.hpp"
 #include "./test_runner.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
 #include <functional>
 #include <chrono>
+#include <thread>
+#include <fstream>
+#include <cstdio>
+#include <sstream>
+#include <random>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 
@@ -113,6 +146,276 @@ bool testMatrixRandomInitialization() {
     return true;
 }
 
+// Philox streams: known answer, same numbers for every kernel and thread count, reproducible init
+bool testCounterRng() {
+    // Random123 known answer for Philox4x32-10, counter 0 and key 0
+    uint64_t words[2];
+    RandomStream::generate(0, 0, 0, words, 2);
+    if (words[0] != 0xE169C58D6627E8D5ULL || words[1] != 0x9B00DBD8BC57AC4CULL) return false;
+
+    // Odd start and length, compared against one word at a time
+    std::vector<uint64_t> reference(1001);
+    RandomStream sequential(42, 7);
+    sequential.seek(3);
+    for (uint64_t &word : reference) word = sequential();
+    Random::Kernel best = Random::getKernel();
+    for (Random::Kernel kernel : {Random::Kernel::Scalar, Random::Kernel::Avx2, Random::Kernel::Avx512}) {
+        if (!Random::supported(kernel)) continue;
+        Random::setKernel(kernel);
+        std::vector<uint64_t> bulk(reference.size());
+        RandomStream::generate(42, 7, 3, bulk.data(), bulk.size());
+        if (bulk != reference) {
+            Random::setKernel(best);
+            return false;
+        }
+    }
+    Random::setKernel(best);
+
+    // A large fill split across threads gives the values of uniform() one by one
+    const size_t n = 300001;
+    std::vector<double> single(n), threaded(n);
+    RandomStream a(5, 1), b(5, 1), c(5, 1);
+    Random::setThreads(1);
+    a.fillUniform(single.data(), n, -2.0, 3.0);
+    Random::setThreads(4);
+    b.fillUniform(threaded.data(), n, -2.0, 3.0);
+    Random::setThreads(0);
+    if (single != threaded || a != b) return false;
+    for (size_t i = 0; i < n; i += 997) {
+        c.seek(i);
+        if (c.uniform(-2.0, 3.0) != single[i]) return false;
+    }
+
+    // Normals: moments of a large sample
+    std::vector<double> normals(100000);
+    RandomStream(9, 0).fillNormal(normals.data(), normals.size(), 1.0, 2.0);
+    double mean = 0.0, variance = 0.0;
+    for (double z : normals) mean += z;
+    mean /= normals.size();
+    for (double z : normals) variance += (z - mean) * (z - mean);
+    variance /= normals.size();
+    if (std::abs(mean - 1.0) > 0.05 || std::abs(variance - 4.0) > 0.1) return false;
+
+    // The text form resumes the stream where it stopped
+    RandomStream saved(11, 3);
+    saved();
+    saved();
+    saved();
+    std::ostringstream text;
+    text << saved;
+    RandomStream restored;
+    std::istringstream(text.str()) >> restored;
+    if (restored != saved || restored() != saved()) return false;
+
+    // The same global seed gives the same network, a different one does not
+    uint64_t previousSeed = Random::seed();
+    auto firstWeights = [](uint64_t seed) {
+        Random::setSeed(seed);
+        DenseLayer first(30, 20, new activations::ReLU());
+        DenseLayer second(20, 10, new activations::Sigmoid());
+        return std::make_pair(first.weights, second.weights);
+    };
+    auto run1 = firstWeights(123), run2 = firstWeights(123), run3 = firstWeights(124);
+    Random::setSeed(previousSeed);
+    double heLimit = std::sqrt(6.0 / 30);
+    for (int i = 0; i < 30; i++) {
+        for (int j = 0; j < 20; j++) {
+            if (std::abs(run1.first.data[i][j]) > heLimit) return false;
+        }
+    }
+    return run1.first.isEqual(run2.first) && run1.second.isEqual(run2.second) &&
+           !run1.first.isEqual(run3.first);
+}
+
+// Every GEMM kernel matches the textbook product, and the tuning cache round trips and decides operator*
+bool testGemmAutotuner() {
+    // Every kernel, blocking and thread split against the textbook loop, on shapes with ragged edges
+    const int shapes[][3] = {{37, 53, 29}, {1, 784, 16}, {5, 3, 70}, {130, 300, 40}, {9, 1, 33}};
+    for (const auto &shape : shapes) {
+        const int m = shape[0], k = shape[1], n = shape[2];
+        Matrix a(m, k), b(k, n), c(m, n), expected(m, n);
+        a.randomize(-1.0, 1.0);
+        b.randomize(-1.0, 1.0);
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                for (int p = 0; p < k; p++) expected.data[i][j] += a.data[i][p] * b.data[p][j];
+            }
+        }
+        for (int kernel = 0; kernel <= static_cast<int>(GemmKernel::PackedAvx512_8x16); kernel++) {
+            GemmConfig config;
+            config.kernel = static_cast<GemmKernel>(kernel);
+            if (!Gemm::supported(config.kernel)) continue;
+            config.mc = 20;  // several blocks in every direction
+            config.kc = 17;
+            config.nc = 24;
+            for (int threads : {1, 3}) {
+                for (GemmSplit split : {GemmSplit::Rows, GemmSplit::Columns}) {
+                    config.threads = threads;
+                    config.split = split;
+                    c.fill(-1.0);
+                    Gemm::multiply(config, a.data[0], b.data[0], c.data[0], m, k, n);
+                    for (int i = 0; i < m; i++) {
+                        for (int j = 0; j < n; j++) {
+                            if (std::abs(c.data[i][j] - expected.data[i][j]) > 1e-9) return false;
+                        }
+                    }
+                }
+            }
+        }
+        Matrix product = a * b;
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                if (std::abs(product.data[i][j] - expected.data[i][j]) > 1e-9) return false;
+            }
+        }
+
+        // Threaded products from several threads at once share the GEMM pool (or run alone while it is busy)
+        GemmConfig threaded = Gemm::heuristic(m, k, n);
+        threaded.threads = 3;
+        std::vector<Matrix> results(4, Matrix(m, n));
+        std::vector<std::thread> callers;
+        for (auto &result : results) {
+            callers.emplace_back([&] {
+                for (int repeat = 0; repeat < 5; repeat++) Gemm::multiply(threaded, a.data[0], b.data[0], result.data[0], m, k, n);
+            });
+        }
+        for (auto &caller : callers) caller.join();
+        for (const auto &result : results) {
+            for (int i = 0; i < m; i++) {
+                for (int j = 0; j < n; j++) {
+                    if (std::abs(result.data[i][j] - expected.data[i][j]) > 1e-9) return false;
+                }
+            }
+        }
+    }
+
+    // Tune the shapes of a small network: forward, weight gradient and input gradient per layer
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(20, 12, new activations::ReLU()));
+    nn.addLayer(std::make_unique<DenseLayer>(12, 5, new activations::Softmax(), true));
+    std::vector<GemmShape> shapesOfNet = GemmTuner::shapes(nn, {1, 8});
+    if (shapesOfNet.size() != 12) return false;
+    GemmTunerOptions options;
+    options.secondsPerCandidate = 0.0001;
+    options.repetitions = 1;
+    options.maxThreads = 2;
+    GemmTuning tuned("Test CPU");
+    GemmTuner::tune(shapesOfNet, tuned, options);
+    if (tuned.size() != shapesOfNet.size()) return false;
+
+    // The cache keeps other CPU models' sections when one is rewritten
+    const std::string path = "test_gemm_tuning.txt";
+    GemmTuning other("Other CPU");
+    GemmConfig otherConfig;
+    otherConfig.kernel = GemmKernel::PackedScalar4x4;
+    otherConfig.threads = 4;
+    otherConfig.split = GemmSplit::Columns;
+    other.set({64, 784, 16}, otherConfig, 1234.5);
+    other.save(path);
+    tuned.save(path);
+    tuned.save(path);
+    GemmTuning loaded = GemmTuning::load(path, "Test CPU");
+    GemmTuning otherLoaded = GemmTuning::load(path, "Other CPU");
+    GemmTuning missing = GemmTuning::load(path, "Unknown CPU");
+    std::remove(path.c_str());
+    if (loaded.size() != tuned.size() || otherLoaded.size() != 1 || missing.size() != 0) return false;
+    for (const auto &entry : tuned.entries) {
+        GemmConfig config;
+        if (!loaded.find(entry.first, config) || config != entry.second.config) return false;
+    }
+    GemmConfig found;
+    if (!otherLoaded.find({64, 784, 16}, found) || found != otherConfig) return false;
+    // Untuned batch sizes take the entry of the nearest one with the same k and n
+    if (!otherLoaded.find({100, 784, 16}, found) || found != otherConfig) return false;
+    if (otherLoaded.find({64, 784, 10}, found)) return false;
+
+    // Installed, the table decides what operator* runs; without an entry the heuristic does
+    std::shared_ptr<const GemmTuning> previous = Gemm::tuning();
+    GemmTuning table;
+    GemmConfig scalar;
+    scalar.kernel = GemmKernel::PackedScalar4x4;
+    table.set({3, 20, 12}, scalar, 1.0);
+    Gemm::setTuning(std::make_shared<const GemmTuning>(table));
+    bool installed = Gemm::config(3, 20, 12) == scalar && Gemm::config(5, 20, 12) == scalar &&
+                     Gemm::config(3, 20, 13) == Gemm::heuristic(3, 20, 13);
+    Gemm::setTuning(nullptr);
+    bool cleared = Gemm::config(3, 20, 12) == Gemm::heuristic(3, 20, 12);
+    Gemm::setTuning(previous);
+    return installed && cleared;
+}
+
+// Topology parsing and worker placement, and large Matrix buffers mapped under a memory policy
+bool testNumaAllocation() {
+    // Two nodes of two CPUs each in a sysfs style directory
+    const std::string directory = "./tests/numa_tmp";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory + "/node0");
+    std::filesystem::create_directories(directory + "/node1");
+    std::filesystem::create_directories(directory + "/possible");
+    std::ofstream(directory + "/node0/cpulist") << "0-1\n";
+    std::ofstream(directory + "/node1/cpulist") << "2,3\n";
+    NumaTopology two = NumaTopology::fromSysfs(directory, {});
+    NumaTopology restricted = NumaTopology::fromSysfs(directory, {2, 3});
+    NumaTopology missing = NumaTopology::fromSysfs(directory + "/none", {0, 1, 2});
+    std::filesystem::remove_all(directory);
+    bool topology = two.nodes() == 2 && two.isNuma() && two.cpuCount() == 4 && two.memoryNodes.size() == 2 &&
+                    two.nodeOf(1) == 0 && two.nodeOf(2) == 1 && two.nodeOf(7) == -1 &&
+                    two.workerCpu(0, PinMode::Spread) == 0 && two.workerCpu(1, PinMode::Spread) == 2 &&
+                    two.workerCpu(2, PinMode::Spread) == 1 && two.workerCpu(5, PinMode::Spread) == 2 &&
+                    two.workerCpu(2, PinMode::Compact) == 2 && two.workerCpu(4, PinMode::Compact) == 0 &&
+                    two.workerCpu(0, PinMode::None) == -1;
+    // Only the allowed CPUs count; node 0 keeps its memory but has no CPU left
+    topology = topology && !restricted.isNuma() && restricted.cpuCount() == 2 && restricted.memoryNodes.size() == 2 &&
+               restricted.workerCpu(0, PinMode::Spread) == 2 && restricted.workerCpu(1, PinMode::Spread) == 3;
+    // No sysfs: one node with every allowed CPU
+    topology = topology && missing.nodes() == 1 && missing.cpuCount() == 3 && missing.memoryNodes.size() == 1;
+    if (!topology) return false;
+
+    const NumaTopology &system = NumaTopology::system();
+    if (system.nodes() < 1 || system.cpuCount() < 1) return false;
+    for (int worker = 0; worker < system.cpuCount(); worker++) {
+        if (system.nodeOf(system.workerCpu(worker, PinMode::Spread)) < 0) return false;
+    }
+    bool pinned = true;
+    std::thread([&] {
+        const int cpu = system.workerCpu(0, PinMode::Compact);
+        if (NumaTopology::pinCurrentThread(cpu)) pinned = NumaTopology::currentCpu() == cpu;
+    }).join();
+    if (!pinned) return false;
+
+    // Small buffers and the default policy stay on the heap
+    const NumaMemory::Stats before = NumaMemory::stats();
+    {
+        Matrix heap(600, 600);
+        MemoryPolicyScope scope({MemoryPlacement::Interleave, true});
+        Matrix small(10, 10);
+        if (NumaMemory::stats().mappedBuffers != before.mappedBuffers) return false;
+    }
+    bool mapped = true;
+    {
+        MemoryPolicyScope scope({MemoryPlacement::Interleave, true});
+        Matrix weights(600, 600);  // 2.7 MB: huge page aligned
+        {
+            MemoryPolicyScope inner({MemoryPlacement::Default, false});
+            Matrix heap(600, 600);
+            mapped = NumaMemory::stats().mappedBuffers == before.mappedBuffers + 1;
+        }
+        Matrix copy = weights;  // copies follow the policy of the thread that makes them
+        const NumaMemory::Stats during = NumaMemory::stats();
+        mapped = mapped && during.mappedBuffers == before.mappedBuffers + 2 &&
+                 during.hugePageBuffers == before.hugePageBuffers + 2 &&
+                 reinterpret_cast<uintptr_t>(weights.data[0]) % NumaMemory::hugePageBytes == 0;
+        for (int i = 0; i < weights.rows; i++) {
+            for (int j = 0; j < weights.cols; j++) mapped = mapped && weights.data[i][j] == 0.0;
+        }
+        weights.fill(2.0);
+        Matrix product = weights * copy;
+        mapped = mapped && product.data[599][599] == 0.0 && weights.data[599][599] == 2.0;
+    }
+    const NumaMemory::Stats after = NumaMemory::stats();
+    return mapped && after.mappedBuffers == before.mappedBuffers && after.mappedBytes == before.mappedBytes;
+}
+
 // Test for Matrix Apply Function
 bool testMatrixApplyFunction() {
     // Create a 2x2 matrix with specific values
@@ -206,6 +509,88 @@ bool testNeuralNetworkForward() {
     return output.rows == 1 && output.cols == 1;
 }
 
+// Several threads share one Weights snapshot, each with its own InferenceContext
+bool testSharedWeightsConcurrentInference() {
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(4, 8, new activations::ReLU()));
+    nn.addLayer(std::make_unique<DenseLayer>(8, 3, new activations::Softmax(), true));
+
+    Matrix input(2, 4); // batch of 2 samples
+    for (int j = 0; j < 4; j++) {
+        input.data[0][j] = 0.1 * j;
+        input.data[1][j] = -0.2 * j;
+    }
+
+    std::shared_ptr<const Weights> weights = nn.shareWeights();
+    InferenceContext reference(weights);
+    Matrix expected = reference.forward(input);
+
+    // Batched inference must match running the samples one at a time
+    Matrix single(1, 4);
+    for (int j = 0; j < 4; j++) single.data[0][j] = input.data[1][j];
+    const Matrix& second = reference.forward(single);
+    for (int j = 0; j < 3; j++) {
+        if (abs(second.data[0][j] - expected.data[1][j]) > 1e-12) return false;
+    }
+
+    const int num_threads = 8;
+    std::vector<int> ok(num_threads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            InferenceContext ctx(weights);
+            bool same = true;
+            for (int r = 0; r < 200; r++) {
+                same = same && ctx.forward(input).isEqual(expected);
+            }
+            ok[t] = same;
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (int t = 0; t < num_threads; t++) {
+        if (!ok[t]) return false;
+    }
+    return true;
+}
+
+// Samples submitted one by one come back with the same outputs as a direct forward pass
+bool testInferenceServerBatching() {
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(4, 6, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(6, 3, new activations::Softmax(), true));
+    std::shared_ptr<const Weights> weights = nn.shareWeights();
+    InferenceContext reference(weights);
+
+    InferenceServer server(weights, 8, 1000);
+    std::vector<Matrix> samples;
+    std::vector<std::future<Matrix>> results;
+    try {
+        server.submit(Matrix(1, 5));  // a sample of the wrong width never reaches a batch
+        return false;
+    } catch (const std::invalid_argument &) {
+    }
+    for (int i = 0; i < 20; i++) {
+        Matrix sample(1, 4);
+        for (int j = 0; j < 4; j++) sample.data[0][j] = 0.05 * i - 0.1 * j;
+        samples.push_back(sample);
+        results.push_back(server.submit(sample));
+    }
+
+    for (int i = 0; i < 20; i++) {
+        Matrix output = results[i].get();
+        const Matrix& expected = reference.forward(samples[i]);
+        if (output.rows != 1 || output.cols != 3) return false;
+        for (int j = 0; j < 3; j++) {
+            if (abs(output.data[0][j] - expected.data[0][j]) > 1e-12) return false;
+        }
+    }
+
+    server.stop();
+    InferenceServer::Stats stats = server.getStats();
+    return stats.requests == 20 && stats.batches >= 3; // at most 8 samples per batch
+}
+
 // MNIST Data Tests
 bool testMNISTDataLoading() {
     std::string images_file = "./data/train-images-idx3-ubyte";
@@ -219,6 +604,493 @@ bool testMNISTDataLoading() {
            images[0].rows == 28 && images[0].cols == 28;
 }
 
+// Writes a small IDX file: big-endian dims followed by the raw element bytes
+static void writeIdxFile(const std::string &filename, uint8_t dtype, const std::vector<uint32_t> &dims,
+                         const std::vector<unsigned char> &elements) {
+    std::ofstream file(filename, std::ios::binary);
+    unsigned char header[4] = {0, 0, dtype, static_cast<unsigned char>(dims.size())};
+    file.write((char*)header, 4);
+    for (uint32_t d : dims) {
+        unsigned char be[4] = {(unsigned char)(d >> 24), (unsigned char)(d >> 16), (unsigned char)(d >> 8), (unsigned char)d};
+        file.write((char*)be, 4);
+    }
+    file.write((char*)elements.data(), elements.size());
+}
+
+bool testIdxFileReader() {
+    const std::string images = "./tests/test_images.idx";
+    const std::string floats = "./tests/test_floats.idx";
+
+    // 3 images of 2x2 pixels
+    writeIdxFile(images, 0x08, {3, 2, 2}, {0, 51, 102, 255, 1, 2, 3, 4, 10, 20, 30, 40});
+    // big-endian float32 values 1.5 and -2.0
+    writeIdxFile(floats, 0x0D, {2}, {0x3f, 0xc0, 0, 0, 0xc0, 0, 0, 0});
+
+    IdxFile imageFile(images);
+    bool ok = imageFile.count() == 3 && imageFile.sampleSize() == 4 && imageFile.ubyteData()[3] == 255;
+
+    // Lazy per batch normalization of samples 0 and 1
+    Matrix batch;
+    imageFile.toMatrix(0, 2, batch, 1.0 / 255.0);
+    ok = ok && batch.rows == 2 && batch.cols == 4 && batch.data[0][1] == 51 / 255.0 && batch.data[1][3] == 4 / 255.0;
+
+    IdxFile floatFile(floats);
+    ok = ok && floatFile.dtype() == IdxFile::DataType::Float && floatFile.value(0) == 1.5 && floatFile.value(1) == -2.0;
+
+    // A header that does not match the file size is rejected
+    writeIdxFile(images, 0x08, {4, 2, 2}, {0, 1, 2, 3});
+    bool rejected = false;
+    try {
+        IdxFile bad(images);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+
+    std::remove(images.c_str());
+    std::remove(floats.c_str());
+
+    // Real label file shipped with the repo
+    IdxFile labels("./data/t10k-labels-idx1-ubyte");
+    ok = ok && labels.count() == 10000 && labels.dims().size() == 1;
+
+    return ok && rejected;
+}
+
+// Shuffled minibatches cover each sample once per epoch, and train_step learns from them
+bool testDataLoaderTraining() {
+    const std::string images = "./tests/test_loader_images.idx";
+    const std::string labels = "./tests/test_loader_labels.idx";
+
+    // 10 samples of 2x2 pixels, class 0 lights the left column, class 1 the right one
+    std::vector<unsigned char> pixels, classes;
+    for (int i = 0; i < 10; i++) {
+        int label = i % 2;
+        classes.push_back(label);
+        unsigned char on = 200 + i, off = i;
+        pixels.insert(pixels.end(), {label ? off : on, label ? on : off, label ? off : on, label ? on : off});
+    }
+    writeIdxFile(images, 0x08, {10, 2, 2}, pixels);
+    writeIdxFile(labels, 0x08, {10}, classes);
+
+    bool ok = true;
+    {
+        IdxFile imageFile(images), labelFile(labels);
+        DataLoader loader(imageFile, labelFile, 4, true, 123, 2, 3);
+        ok = loader.batchesPerEpoch() == 3;
+
+        NeuralNetwork nn;
+        nn.addLayer(std::make_unique<DenseLayer>(4, 4, new activations::Sigmoid()));
+        nn.addLayer(std::make_unique<DenseLayer>(4, 2, new activations::Softmax(), true));
+
+        double firstLoss = 0, lastLoss = 0;
+        for (int epoch = 0; epoch < 60; epoch++) {
+            std::vector<int> seen(10, 0);
+            double epochLoss = 0;
+            for (int b = 0; b < loader.batchesPerEpoch(); b++) {
+                const Batch& batch = loader.next();
+                ok = ok && batch.epoch == epoch && batch.size == (b < 2 ? 4 : 2);
+                for (int i = 0; i < batch.size; i++) {
+                    int sample = static_cast<int>(batch.inputs.data[i][0] * 255.0 + 0.5);
+                    sample = sample >= 200 ? sample - 200 : sample;  // recover the sample number
+                    seen[sample]++;
+                    ok = ok && batch.labels[i] == sample % 2;
+                }
+                epochLoss += nn.train_step(batch.inputs, batch.labels, 0.5);
+            }
+            ok = ok && std::count(seen.begin(), seen.end(), 1) == 10;
+            if (epoch == 0) firstLoss = epochLoss;
+            lastLoss = epochLoss;
+        }
+        ok = ok && lastLoss < firstLoss * 0.5 && loader.stallSeconds() >= 0.0;
+
+        // Same seed, same order
+        DataLoader again(imageFile, labelFile, 4, true, 123);
+        ok = ok && again.epochOrder(5) == loader.epochOrder(5) && again.epochOrder(5) != loader.epochOrder(6);
+    }
+
+    // An empty dataset has no batches to hand out
+    writeIdxFile(images, 0x08, {0, 2, 2}, {});
+    writeIdxFile(labels, 0x08, {0}, {});
+    bool rejected = false;
+    try {
+        IdxFile imageFile(images), labelFile(labels);
+        DataLoader empty(imageFile, labelFile, 4, true, 123);
+    } catch (const std::invalid_argument &) {
+        rejected = true;
+    }
+    ok = ok && rejected;
+
+    std::remove(images.c_str());
+    std::remove(labels.c_str());
+    return ok;
+}
+
+// Models trained together match the same models trained alone, and trailing models stop early
+bool testSweepRunner() {
+    ThreadPool pool(3);
+    std::vector<std::atomic<int>> visits(100);
+    pool.parallelFor(100, [&](int i) { visits[i]++; });
+    bool ok = std::all_of(visits.begin(), visits.end(), [](const std::atomic<int> &count) { return count == 1; });
+    bool rethrown = false;
+    try {
+        pool.parallelFor(10, [](int i) { if (i == 7) throw std::runtime_error("task failed"); });
+    } catch (const std::runtime_error&) {
+        rethrown = true;
+    }
+    std::atomic<int> sum{0};
+    pool.parallelFor(10, [&](int i) { sum += i; });
+    // Tasks multiply with their share of the cores, the caller gets its own limit back afterwards
+    std::atomic<int> limited{0};
+    pool.parallelFor(6, [&](int) { limited += Gemm::threadLimit() == GemmThreadLimit::shareOf(3); });
+    if (!ok || !rethrown || sum != 45 || limited != 6 || Gemm::threadLimit() != 0) return false;
+
+    // 200 samples of 4x4 pixels, class c lights row c plus some noise
+    const std::string images = "./tests/test_sweep_images.idx";
+    const std::string labels = "./tests/test_sweep_labels.idx";
+    std::vector<unsigned char> pixels, classes;
+    std::mt19937 gen(5);
+    for (int i = 0; i < 200; i++) {
+        int label = i % 4;
+        classes.push_back(label);
+        for (int p = 0; p < 16; p++) pixels.push_back(p / 4 == label ? 150 + gen() % 100 : (gen() % 4 == 0 ? gen() % 120 : 0));
+    }
+    writeIdxFile(images, 0x08, {200, 4, 4}, pixels);
+    writeIdxFile(labels, 0x08, {200}, classes);
+
+    bool same = true, stopping = true;
+    {
+        IdxFile imageFile(images), labelFile(labels);
+        Matrix validation;
+        imageFile.toMatrix(0, 200, validation, 1.0 / 255.0);
+        std::vector<int> validationLabels(classes.begin(), classes.end());
+
+        // The same three models fused into one first-layer GEMM and trained one by one
+        std::vector<SweepConfig> configs = SweepConfig::grid({0.3, 0.8}, {{8}, {6, 5}}, {"sigmoid", "relu"});
+        configs.resize(3);
+        SweepRunner runners[2];
+        for (SweepRunner &runner : runners) {
+            Random::setSeed(77);
+            for (const SweepConfig &config : configs) runner.add(config.name(), config.build(16, 4), config.learningRate);
+        }
+        SweepOptions options;
+        options.steps = 30;
+        options.evalInterval = 10;
+        options.stopMargin = 1.0;  // nobody stops
+        options.threads = 2;
+        std::vector<SweepResult> results[2];
+        for (int fuse = 0; fuse < 2; fuse++) {
+            DataLoader loader(imageFile, labelFile, 16, true, 9);
+            options.fuseGemms = fuse == 1;
+            results[fuse] = runners[fuse].run(loader, validation, validationLabels, options);
+        }
+        for (int m = 0; m < 3; m++) {
+            NeuralNetwork &alone = runners[0].model(m), &fused = runners[1].model(m);
+            for (size_t l = 0; l < alone.layers.size(); l++) {
+                const DenseLayer* a = dynamic_cast<DenseLayer*>(alone.layers[l].get());
+                const DenseLayer* b = dynamic_cast<DenseLayer*>(fused.layers[l].get());
+                for (int i = 0; i < a->weights.rows; i++) {
+                    for (int j = 0; j < a->weights.cols; j++) same = same && std::abs(a->weights.data[i][j] - b->weights.data[i][j]) < 1e-9;
+                }
+                for (int j = 0; j < a->biases.cols; j++) same = same && std::abs(a->biases.data[0][j] - b->biases.data[0][j]) < 1e-9;
+            }
+            same = same && results[0][m].steps == 30 && !results[0][m].fused && results[1][m].fused &&
+                   std::abs(results[0][m].accuracy - results[1][m].accuracy) < 1e-12;
+        }
+
+        // A model that cannot learn (learning rate 0) falls behind and stops after the grace check
+        SweepRunner sweep;
+        Random::setSeed(78);
+        SweepConfig good;
+        good.hidden = {8};
+        good.learningRate = 0.5;
+        SweepConfig frozen = good;
+        frozen.learningRate = 0.0;
+        sweep.add(good.name(), good.build(16, 4), good.learningRate);
+        sweep.add("frozen", frozen.build(16, 4), frozen.learningRate);
+        options = SweepOptions();
+        options.steps = 200;
+        options.evalInterval = 25;
+        options.stopMargin = 0.2;
+        options.threads = 2;
+        DataLoader loader(imageFile, labelFile, 16, true, 3);
+        std::vector<SweepResult> outcome = sweep.run(loader, validation, validationLabels, options);
+        stopping = outcome.size() == 2 && outcome[0].name == good.name() && outcome[0].bestAccuracy > 0.9 &&
+                   outcome[0].steps == 200 && !outcome[0].stopped && outcome[1].name == "frozen" &&
+                   outcome[1].stopped && outcome[1].steps == 50;
+        std::ostringstream table;
+        SweepRunner::writeTable(outcome, table);
+        stopping = stopping && table.str().find("stopped") != std::string::npos;
+        if (!stopping) SweepRunner::writeTable(outcome, std::cout);
+    }
+    std::remove(images.c_str());
+    std::remove(labels.c_str());
+    return same && stopping;
+}
+
+// Batched, multi-threaded evaluation matches a one sample at a time reference
+bool testEvaluator() {
+    // argmax / rank / topK kernels on rows of every tail length, with ties
+    std::mt19937 gen(11);
+    for (int n : {1, 3, 4, 7, 8, 10, 13, 17, 33}) {
+        std::vector<double> row(n);
+        for (int trial = 0; trial < 50; trial++) {
+            for (double &x : row) x = static_cast<double>(gen() % 6) - 2.5;
+            const int label = static_cast<int>(gen() % n);
+            const int expectedMax = static_cast<int>(std::max_element(row.begin(), row.end()) - row.begin());
+            int expectedRank = 0;
+            for (int j = 0; j < n; j++) expectedRank += row[j] > row[label] || (row[j] == row[label] && j < label);
+            for (SimdKernel simd : {SimdKernel::Scalar, SimdKernel::Avx2, SimdKernel::Avx512}) {
+                if (!CompiledModel::supported(simd)) continue;
+                if (Evaluator::argmax(row.data(), n, simd) != expectedMax) return false;
+                if (Evaluator::rank(row.data(), n, label, simd) != expectedRank) return false;
+            }
+            std::vector<int> top = Evaluator::topK(row.data(), n, 3);
+            bool inTop = std::find(top.begin(), top.end(), label) != top.end();
+            if (inTop != (expectedRank < 3) || top[0] != expectedMax) return false;
+        }
+    }
+
+    // 2500 samples of 12 pixels, 5 classes, a random (untrained) network
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(12, 9, new activations::ReLU()));
+    nn.addLayer(std::make_unique<DenseLayer>(9, 5, new activations::Softmax(), true));
+    const int samples = 2500;
+    std::vector<unsigned char> pixels(samples * 12), classes(samples);
+    for (auto &pixel : pixels) pixel = static_cast<unsigned char>(gen() % 256);
+    for (auto &label : classes) label = static_cast<unsigned char>(gen() % 5);
+    Matrix inputs(samples, 12);
+    std::vector<int> labels(classes.begin(), classes.end());
+    for (int r = 0; r < samples; r++) {
+        for (int c = 0; c < 12; c++) inputs.data[r][c] = pixels[r * 12 + c] / 255.0;
+    }
+
+    // Reference: one sample at a time
+    InferenceContext context(nn.shareWeights());
+    std::vector<long long> confusion(25, 0);
+    long long correct = 0, top2 = 0;
+    double loss = 0.0;
+    Matrix sample(1, 12);
+    for (int r = 0; r < samples; r++) {
+        std::copy(inputs.data[r], inputs.data[r] + 12, sample.data[0]);
+        const Matrix &output = context.forward(sample);
+        const double* row = output.data[0];
+        int guess = static_cast<int>(std::max_element(row, row + 5) - row);
+        confusion[labels[r] * 5 + guess]++;
+        correct += guess == labels[r];
+        int better = 0;
+        for (int j = 0; j < 5; j++) better += row[j] > row[labels[r]];
+        top2 += better < 2;
+        loss -= std::log(std::max(row[labels[r]], 1e-12));
+    }
+
+    EvaluatorOptions options;
+    options.topK = 2;
+    options.batchSize = 300;  // ragged last batch
+    options.threads = 1;
+    Evaluator single(options);
+    options.threads = 3;
+    Evaluator threaded(options);
+    Evaluation one = single.evaluate(nn, inputs, labels);
+    Evaluation three = threaded.evaluate(nn, inputs, labels);
+    bool ok = one.samples == samples && one.classes == 5 && one.confusion == confusion && one.correct == correct &&
+              one.topKCorrect == top2 && std::abs(one.loss() - loss / samples) < 1e-9 &&
+              three.confusion == one.confusion && three.lossSum == one.lossSum && three.topKCorrect == one.topKCorrect;
+
+    // Metrics from the confusion matrix
+    long long predictedAs2 = 0, actual2 = 0;
+    for (int a = 0; a < 5; a++) predictedAs2 += confusion[a * 5 + 2];
+    for (int p = 0; p < 5; p++) actual2 += confusion[2 * 5 + p];
+    ok = ok && one.support(2) == actual2 && one.predicted(2) == predictedAs2 &&
+         std::abs(one.recall(2) - static_cast<double>(confusion[12]) / actual2) < 1e-12 &&
+         (predictedAs2 == 0 || std::abs(one.precision(2) - static_cast<double>(confusion[12]) / predictedAs2) < 1e-12) &&
+         std::abs(one.accuracy() - static_cast<double>(correct) / samples) < 1e-12;
+    std::ostringstream report;
+    report.precision(7);
+    one.report(report);
+    ok = ok && report.str().find("Confusion") != std::string::npos;
+    ok = ok && report.precision() == 7 && !(report.flags() & std::ios::fixed);  // the caller's format is kept
+
+    // The IDX path reads the same samples
+    const std::string images = "./tests/test_eval_images.idx";
+    const std::string labelFile = "./tests/test_eval_labels.idx";
+    writeIdxFile(images, 0x08, {static_cast<uint32_t>(samples), 3, 4}, pixels);
+    writeIdxFile(labelFile, 0x08, {static_cast<uint32_t>(samples)}, classes);
+    {
+        IdxFile imageIdx(images), labelIdx(labelFile);
+        Evaluation fromFile = threaded.evaluate(nn, imageIdx, labelIdx);
+        ok = ok && fromFile.confusion == one.confusion && std::abs(fromFile.lossSum - one.lossSum) < 1e-9;
+    }
+    std::remove(images.c_str());
+    std::remove(labelFile.c_str());
+
+    // Labels the network cannot produce are an error
+    labels[1234] = 7;
+    bool rejected = false;
+    try {
+        threaded.evaluate(nn, inputs, labels);
+    } catch (const std::out_of_range&) {
+        rejected = true;
+    }
+    return ok && rejected;
+}
+
+// No distortion reproduces the image, random distortions depend only on (seed, epoch, sample)
+bool testAugmentation() {
+    const int rows = 8, cols = 8;
+    std::vector<uint8_t> image(rows * cols);
+    for (int i = 0; i < rows * cols; i++) image[i] = static_cast<uint8_t>((i * 37) % 256);
+
+    AugmentationConfig none;
+    none.maxShift = none.maxRotation = none.maxScale = none.maxShear = 0.0;
+    Augmenter identity(rows, cols, none);
+    Augmenter::Workspace workspace;
+    std::vector<double> out(rows * cols);
+    identity.apply(image.data(), out.data(), 0, 0, workspace);
+    for (int i = 0; i < rows * cols; i++) {
+        if (abs(out[i] - image[i] / 255.0) > 1e-6) return false;
+    }
+
+    AugmentationConfig config;
+    config.elasticAlpha = 2.0;
+    config.elasticSigma = 1.5;
+    config.noiseStddev = 0.05;
+    Augmenter augmenter(rows, cols, config, 99);
+    Augmenter::Workspace otherWorkspace;
+    std::vector<double> a(rows * cols), b(rows * cols), c(rows * cols);
+    augmenter.apply(image.data(), a.data(), 3, 17, workspace);
+    augmenter.apply(image.data(), c.data(), 3, 18, workspace);
+    augmenter.apply(image.data(), b.data(), 3, 17, otherWorkspace);  // as if on another worker
+
+    for (double v : a) {
+        if (!(v >= 0.0 && v <= 1.0)) return false;
+    }
+    if (!(a == b && a != c)) return false;
+
+    // Pure shifts of a white image: the vacated rows and columns read the zero border on every
+    // side. A one pixel marker gives the shift (its bilinear centroid moves by exactly the shift).
+    const int size = 12, center = 6;
+    AugmentationConfig shiftOnly = none;
+    shiftOnly.maxShift = 3.0;
+    Augmenter shifter(size, size, shiftOnly, 5);
+    std::vector<uint8_t> white(size * size, 255), marker(size * size, 0);
+    marker[center * size + center] = 255;
+    std::vector<double> shifted(size * size), dot(size * size);
+    // Coverage of a source coordinate by the white image under bilinear sampling
+    auto covered = [size](double s) { return std::max(0.0, std::min({1.0, 1.0 + s, static_cast<double>(size) - s})); };
+    bool vacatedRightOrBottom = false;
+    for (uint64_t sample = 0; sample < 32; sample++) {
+        shifter.apply(white.data(), shifted.data(), 0, sample, workspace);
+        shifter.apply(marker.data(), dot.data(), 0, sample, workspace);
+        double mass = 0.0, shiftX = 0.0, shiftY = 0.0;
+        for (int i = 0; i < size * size; i++) {
+            mass += dot[i];
+            shiftX += dot[i] * (i % size - center);
+            shiftY += dot[i] * (i / size - center);
+        }
+        shiftX /= mass;
+        shiftY /= mass;
+        vacatedRightOrBottom = vacatedRightOrBottom || shiftX <= -1.0 || shiftY <= -1.0;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                if (abs(shifted[y * size + x] - covered(x - shiftX) * covered(y - shiftY)) > 1e-4) return false;
+            }
+        }
+    }
+    return vacatedRightOrBottom;
+}
+
+// First open preprocesses and writes the cache, the next one maps it, a changed source rebuilds it
+bool testDatasetCache() {
+    const std::string images = "./tests/test_cache_images.idx";
+    const std::string labels = "./tests/test_cache_labels.idx";
+    const std::string cache = "./tests/test_cache.bin";
+    std::remove(cache.c_str());
+
+    writeIdxFile(images, 0x08, {3, 2, 2}, {0, 51, 102, 255, 1, 2, 3, 4, 10, 20, 30, 40});
+    writeIdxFile(labels, 0x08, {3}, {7, 1, 9});
+
+    bool ok;
+    {
+        auto first = DatasetCache::open(images, labels, cache);
+        auto second = DatasetCache::open(images, labels, cache);
+        Matrix batch;
+        second->toMatrix(1, 2, batch);
+        ok = first->wasRebuilt() && !second->wasRebuilt() &&
+             second->count() == 3 && second->sampleSize() == 4 &&
+             second->image(0)[3] == 1.0f && second->labels()[2] == 9 &&
+             reinterpret_cast<uintptr_t>(second->images()) % 64 == 0 &&
+             batch.rows == 2 && batch.data[1][0] == static_cast<double>(10 / 255.0f);
+    }
+
+    writeIdxFile(labels, 0x08, {3}, {7, 1, 8});
+    {
+        auto changed = DatasetCache::open(images, labels, cache);
+        ok = ok && changed->wasRebuilt() && changed->labels()[2] == 8;
+    }
+
+    std::remove(images.c_str());
+    std::remove(labels.c_str());
+    std::remove(cache.c_str());
+    return ok;
+}
+
+// Streaming reads in small chunks: every sample once per epoch, shuffled, fixed buffer size
+bool testStreamingDataset() {
+    const std::string images = "./tests/test_stream_images.idx";
+    const std::string labels = "./tests/test_stream_labels.idx";
+
+    // 50 samples of 2x2, pixel 0 holds the sample number, class is the sample number mod 2
+    std::vector<unsigned char> pixels, classes;
+    for (int i = 0; i < 50; i++) {
+        int label = i % 2;
+        pixels.insert(pixels.end(), {(unsigned char)i, (unsigned char)(label ? 0 : 255), (unsigned char)(label ? 255 : 0), 0});
+        classes.push_back(label);
+    }
+    writeIdxFile(images, 0x08, {50, 2, 2}, pixels);
+    writeIdxFile(labels, 0x08, {50}, classes);
+
+    bool ok = true;
+    {
+        IdxStreamDataset::Options options;
+        options.chunkSamples = 7;
+        options.shuffleBuffer = 10;
+        options.seed = 3;
+        IdxStreamDataset dataset(images, labels, options);
+        ok = dataset.count() == 50 && dataset.sampleSize() == 4 &&
+             dataset.bufferBytes() == (7 + 10) * (4 + 1) + 4;
+
+        std::vector<int> firstOrder;
+        for (int epoch = 0; epoch < 2; epoch++) {
+            std::vector<int> order;
+            for (const Batch& batch : dataset.batches(8)) {
+                for (int i = 0; i < batch.size; i++) {
+                    int sample = static_cast<int>(batch.inputs.data[i][0] * 255.0 + 0.5);
+                    ok = ok && batch.labels[i] == sample % 2;
+                    order.push_back(sample);
+                }
+            }
+            std::vector<int> sorted = order;
+            std::sort(sorted.begin(), sorted.end());
+            for (int i = 0; i < 50; i++) ok = ok && sorted[i] == i;
+            if (epoch == 0) firstOrder = order;
+            else ok = ok && order != firstOrder;  // reshuffled
+            ok = ok && !std::is_sorted(order.begin(), order.end());
+        }
+
+        // Training consumes the stream through its iterator
+        NeuralNetwork nn;
+        nn.addLayer(std::make_unique<DenseLayer>(4, 4, new activations::Sigmoid()));
+        nn.addLayer(std::make_unique<DenseLayer>(4, 2, new activations::Softmax(), true));
+        double first = nn.train_epoch(dataset, 8, 0.5), last = first;
+        for (int epoch = 0; epoch < 30; epoch++) last = nn.train_epoch(dataset, 8, 0.5);
+        ok = ok && last < first;
+    }
+
+    std::remove(images.c_str());
+    std::remove(labels.c_str());
+    return ok;
+}
+
 // Model Save/Load Tests
 bool testModelSaveLoad() {
     // Create first network
@@ -260,6 +1132,99 @@ bool testModelSaveLoad() {
     return weightsMatch && biasesMatch;
 }
 
+// Single-file model: topology rebuilt from the file, parameters used in place, corruption detected
+bool testModelFileRoundTrip() {
+    const std::string filename = "./tests/test_model.nnm";
+
+    NeuralNetwork nn1;
+    nn1.addLayer(std::make_unique<DenseLayer>(5, 4, new activations::ReLU()));
+    nn1.addLayer(std::make_unique<DenseLayer>(4, 3, new activations::Softmax(), true));
+    ModelFile::save(nn1, filename);
+
+    NeuralNetwork nn2 = ModelFile::load(filename);
+    auto* w1 = dynamic_cast<DenseLayer*>(nn1.layers[1].get());
+    auto* w2 = dynamic_cast<DenseLayer*>(nn2.layers[1].get());
+    if (nn2.layers.size() != 2 || !w2 || !w2->isOutputLayer || !w2->weights.isView() ||
+        !w1->weights.isEqual(w2->weights) || !w1->biases.isEqual(w2->biases)) {
+        std::remove(filename.c_str());
+        return false;
+    }
+
+    // Zero-copy weights for concurrent inference give the same outputs
+    Matrix input(1, 5);
+    for (int j = 0; j < 5; j++) input.data[0][j] = 0.3 * j - 0.5;
+    InferenceContext expected(nn1.shareWeights());
+    InferenceContext loaded(ModelFile::loadWeights(filename, false));
+    bool sameOutput = expected.forward(input).isEqual(loaded.forward(input));
+
+    // Flip one parameter byte: the data checksum has to catch it
+    {
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-9, std::ios::end);
+        file.put(0x5a);
+    }
+    bool corruptionDetected = false;
+    try {
+        ModelFile::load(filename);
+    } catch (const std::runtime_error&) {
+        corruptionDetected = true;
+    }
+
+    std::remove(filename.c_str());
+    return sameOutput && corruptionDetected;
+}
+
+// Background checkpoints keep the newest K and resume parameters, counters and RNG exactly
+bool testCheckpointResume() {
+    const std::string directory = "./tests/checkpoints_tmp";
+    std::filesystem::remove_all(directory);
+
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(2, 3, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(3, 2, new activations::Softmax(), true));
+    Matrix input(1, 2), target(1, 2);
+    input.data[0][0] = 1; target.data[0][1] = 1;
+
+    std::mt19937 rng(7);
+    TrainingState state;
+    state.learningRate = 0.1;
+    Matrix expectedWeights;
+    std::string expectedRng;
+    {
+        CheckpointManager checkpoints(directory, "xor", 2);
+        for (int step = 1; step <= 4; step++) {
+            nn.train(input, target, 1, state.learningRate);
+            rng();  // the trainer's own use of the generator, e.g. shuffling
+            state.step = step;
+            state.epoch = step / 2;
+            std::ostringstream rngText;
+            rngText << rng;
+            state.rngState = rngText.str();
+            checkpoints.save(nn, state);
+        }
+        checkpoints.wait();
+        expectedWeights = dynamic_cast<DenseLayer*>(nn.layers[0].get())->weights;
+        expectedRng = state.rngState;
+        if (checkpoints.listCheckpoints() != std::vector<long long>{3, 4}) {
+            std::filesystem::remove_all(directory);
+            return false;
+        }
+    }
+
+    NeuralNetwork resumed;
+    TrainingState restored;
+    CheckpointManager checkpoints(directory, "xor", 2);
+    bool found = checkpoints.restoreLatest(resumed, restored);
+    std::filesystem::remove_all(directory);
+    if (!found || resumed.layers.size() != 2) return false;
+
+    std::mt19937 resumedRng;
+    std::istringstream(restored.rngState) >> resumedRng;
+    return restored.step == 4 && restored.epoch == 2 && restored.learningRate == 0.1 &&
+           restored.rngState == expectedRng && resumedRng() == rng() &&
+           dynamic_cast<DenseLayer*>(resumed.layers[0].get())->weights.isEqual(expectedWeights);
+}
+
 // Simple Model Accuracy Test with XOR Problem
 bool testModelAccuracy() {
     NeuralNetwork nn;
@@ -304,28 +1269,689 @@ bool testModelAccuracy() {
     // nn.saveToFile("./src/models/xor_model");
     
         
-    int correct = 0;
+    // All four samples in one batch, labels from the one-hot targets
+    Matrix batch(4, 2);
+    std::vector<int> labels(inputs.size());
     for (int i = 0; i < inputs.size(); i++) {
-        Matrix output = nn.forward(inputs[i]);
+        batch.data[i][0] = inputs[i].data[0][0];
+        batch.data[i][1] = inputs[i].data[0][1];
+        labels[i] = targets[i].data[0][1] > targets[i].data[0][0]; // 1 if index 1 is greater than index 0, else 0
+    }
+    EvaluatorOptions options;
+    options.topK = 1;
+    Evaluator evaluator(options);
+    Evaluation result = evaluator.evaluate(nn, batch, labels);
+    result.report(std::cout);
 
-        // For Softmax output with 2 neurons:
-        // output[0] represents probability of class 0
-        // output[1] represents probability of class 1
+    double accuracy = result.accuracy();
+    std::cout << "\nFinal accuracy: " << accuracy * 100 << "%\n";
 
-        cout<<"Predicted: " << output.data[0][0] << ", " << output.data[0][1] << endl;
-        cout<<"Actual: " << targets[i].data[0][0] << ", " << targets[i].data[0][1] << endl;
-        
-        bool predicted = output.data[0][1] > output.data[0][0]; // predict 1 if index 1 is greater than index 0, else 0
-        bool actual = targets[i].data[0][1] > targets[i].data[0][0]; // actual 1 if index 1 is greater than index 0, else 0
-        if (predicted == actual) {
-            correct++;
+    return accuracy >= 0.75; // Expect at least 75% accuracy
+}
+
+// Benchmark Tests
+bool testBenchmarkHarness() {
+    BenchmarkOptions options;
+    options.warmup = 1;
+    options.repetitions = 5;
+    options.minSeconds = 0.001;
+    Benchmark bench(options);
+
+    Matrix a(32, 32), b(32, 32), c;
+    a.randomize();
+    b.randomize();
+    const BenchmarkResult &r = bench.run("matrix/multiply/32", [&] { c = a * b; doNotOptimize(c.data); },
+                                         2.0 * 32 * 32 * 32, 3.0 * 32 * 32 * sizeof(double));
+    bool ok = r.iterations >= 1 && r.repetitions == 5 &&
+              r.min_ns > 0.0 && r.min_ns <= r.median_ns && r.median_ns <= r.p90_ns &&
+              r.p90_ns <= r.p99_ns && r.p99_ns <= r.max_ns && r.gflops() > 0.0;
+
+    // JSON round trip keeps names and statistics
+    const std::string path = "./tests/test_bench.json";
+    bench.writeJson(path);
+    std::vector<BenchmarkResult> loaded = Benchmark::readJson(path);
+    std::remove(path.c_str());
+    ok = ok && loaded.size() == 1 && loaded[0].name == r.name && loaded[0].median_ns == r.median_ns &&
+         loaded[0].iterations == r.iterations && loaded[0].flops == r.flops;
+
+    // A 2x slower run is flagged at a 10% threshold, an unchanged one is not
+    std::vector<BenchmarkResult> slower = loaded;
+    slower[0].median_ns *= 2.0;
+    std::ostringstream report;
+    report << std::setprecision(7);
+    ok = ok && Benchmark::compare(loaded, slower, 0.10, report) == 1;
+    ok = ok && Benchmark::compare(loaded, loaded, 0.10, report) == 0;
+
+    // The printers leave the caller's stream format alone
+    Benchmark::print(r, report);
+    bench.writeJson(report);
+    return ok && report.precision() == 7 && !(report.flags() & (std::ios::fixed | std::ios::showpos));
+}
+
+bool testLayerProfiler() {
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(4, 3, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(3, 2, new activations::Softmax(), true));
+    Matrix inputs(8, 4);
+    inputs.randomize(0.0, 1.0);
+    std::vector<int> labels = {0, 1, 0, 1, 0, 1, 0, 1};
+
+    Profiler profiler;
+    profiler.setRoofline({10.0, 10.0});  // fixed, skips the measurement
+    nn.train_step(inputs, labels, 0.1);  // not enabled yet, nothing recorded
+    bool ok = profiler.getEntries().empty();
+
+    profiler.enable();
+    for (int i = 0; i < 3; i++) nn.train_step(inputs, labels, 0.1);
+    profiler.disable();
+    nn.train_step(inputs, labels, 0.1);
+
+    std::vector<Profiler::Entry> entries = profiler.getEntries();
+    ok = ok && entries.size() == 6;  // 2 layers x forward/backward/update
+    if (!ok) return false;
+    for (const Profiler::Entry &e : entries) {
+        ok = ok && e.calls == 3 && e.seconds > 0.0 && e.flops > 0.0 && e.bytes > 0.0;
+    }
+    // Numbered in forward order, flops follow the shapes: 3 * (2*8*4*3 + 8*3) for the first forward
+    ok = ok && entries[0].layer == "#0 Dense 4x3" && entries[0].phase == LayerPhase::Forward &&
+         entries[0].flops == 3 * (2.0 * 8 * 4 * 3 + 8 * 3);
+    ok = ok && entries[3].layer == "#1 Dense 3x2" && entries[5].phase == LayerPhase::Update &&
+         entries[5].flops == 3 * 2.0 * (3 * 2 + 2);
+
+    std::ostringstream table, json;
+    profiler.report(table);
+    profiler.writeJson(json);
+    ok = ok && table.str().find("#1 Dense 3x2") != std::string::npos &&
+         json.str().find("\"phase\": \"update\"") != std::string::npos;
+    return ok;
+}
+
+bool testTraceExport() {
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(4, 3, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(3, 2, new activations::Softmax(), true));
+    Matrix inputs(8, 4);
+    inputs.randomize(0.0, 1.0);
+    std::vector<int> labels = {0, 1, 0, 1, 0, 1, 0, 1};
+
+    bool wasEnabled = Tracer::enabled();  // NN_TRACE may be tracing the whole test run
+    Tracer::stop();
+    Tracer::clear();
+    nn.train_step(inputs, labels, 0.1);
+    bool ok = Tracer::eventCount() == 0;  // off: nothing recorded
+
+    Tracer::start();
+    nn.train_step(inputs, labels, 0.1);
+    std::thread worker([&] {
+        Tracer::setThreadName("test worker");
+        TraceScope trace("worker_task", "test", "items", 42);
+    });
+    worker.join();
+    Tracer::stop();
+
+    // train_step + 2 forward + 2 backward + 2 update on this thread, one event on the worker
+    ok = ok && Tracer::eventCount() == 8;
+    std::ostringstream json;
+    Tracer::writeJson(json);
+    std::string text = json.str();
+    ok = ok && text.find("\"traceEvents\"") != std::string::npos &&
+         text.find("\"name\": \"train_step\"") != std::string::npos &&
+         text.find("\"args\": {\"layer\": 1}") != std::string::npos &&
+         text.find("\"name\": \"test worker\"") != std::string::npos &&
+         text.find("\"args\": {\"items\": 42}") != std::string::npos;
+    ok = ok && Tracer::eventCount() == 0;  // the export cleared what it wrote
+
+    // Exited threads keep their buffers up to maxRetiredBuffers, the oldest beyond that are dropped
+    Tracer::start();
+    for (size_t i = 0; i < Tracer::maxRetiredBuffers + 2; i++) {
+        std::thread([] { TraceScope trace("short_task", "test"); }).join();
+    }
+    Tracer::stop();
+    ok = ok && Tracer::eventCount() == Tracer::maxRetiredBuffers && Tracer::droppedEventCount() == 2;
+
+    Tracer::clear();
+    ok = ok && Tracer::eventCount() == 0 && Tracer::droppedEventCount() == 0;
+    if (wasEnabled) Tracer::start();
+    return ok;
+}
+
+// Allocation budget of one training step once the layer buffers exist
+bool testAllocationBudget() {
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(4, 3, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<DenseLayer>(3, 2, new activations::Softmax(), true));
+    Matrix inputs(8, 4);
+    inputs.randomize(0.0, 1.0);
+    std::vector<int> labels = {0, 1, 0, 1, 0, 1, 0, 1};
+
+    // Counting is opt in: without a tracker a step leaves the counters alone
+    const long long idle = AllocationStats::snapshot().total.allocations;
+    nn.train_step(inputs, labels, 0.1);
+    if (AllocationStats::enabled() || AllocationStats::snapshot().total.allocations != idle) {
+        return false;
+    }
+
+    // Warm up while counting, so the measured step frees buffers that were counted
+    AllocationStats::enable();
+    nn.train_step(inputs, labels, 0.1);
+
+    AllocationTracker step;
+    nn.train_step(inputs, labels, 0.1);
+    AllocationStats::Snapshot used = step.delta();
+
+    bool ok = used.total.allocations <= 64 &&      // budget per step
+              used.total.liveBytes == 0 &&         // everything allocated in the step is freed again
+              used.total.allocations == used.total.frees &&
+              used[AllocCategory::Forward].allocations > 0 && used[AllocCategory::Backward].allocations > 0 &&
+              used[AllocCategory::Update].allocations > 0 && used[AllocCategory::Activation].allocations > 0 &&
+              used[AllocCategory::Loader].allocations == 0;
+
+    // Views only allocate their row table and are counted as loader work inside an AllocationScope
+    std::vector<double> buffer(6, 1.0);
+    AllocationTracker views;
+    {
+        AllocationScope scope(AllocCategory::Loader);
+        Matrix view = Matrix::view(buffer.data(), 2, 3);
+    }
+    AllocationStats::Snapshot viewUsed = views.delta();
+    ok = ok && viewUsed[AllocCategory::Loader].allocations == 1 &&
+         viewUsed[AllocCategory::Loader].bytesAllocated == static_cast<long long>(2 * sizeof(double*)) &&
+         viewUsed.total.liveBytes == 0;
+    AllocationStats::disable();
+    if (!ok) used.report(std::cout);
+    return ok;
+}
+
+// int8 model stays close to the double one, every kernel gives the same result and it round trips a file
+bool testInt8Quantization() {
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(100, 32, new activations::Sigmoid()));  // 100 inputs: padded rows
+    nn.addLayer(std::make_unique<DenseLayer>(32, 4, new activations::Softmax(), true));
+    Matrix calibration(256, 100), inputs(128, 100);
+    calibration.randomize(0.0, 1.0);
+    inputs.randomize(0.0, 1.0);
+
+    QuantizedModel q = QuantizedModel::quantize(nn, calibration);
+    QuantizationReport report = QuantizedModel::compare(nn, q, inputs, {});
+    bool ok = report.agreement >= 0.9 && report.maxAbsDiff < 0.05 &&
+              report.quantizedBytes * 4 < report.referenceBytes;
+
+    Matrix best = q.forward(inputs);
+    for (Int8Kernel kernel : {Int8Kernel::Scalar, Int8Kernel::Avx2, Int8Kernel::Avx512Vnni}) {
+        if (!QuantizedModel::supported(kernel)) continue;
+        q.setKernel(kernel);
+        ok = ok && q.forward(inputs).isEqual(best);
+    }
+
+    const std::string filename = "./tests/test_model.nnq";
+    q.save(filename);
+    ok = ok && QuantizedModel::load(filename).forward(inputs).isEqual(best);
+    {
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-20, std::ios::end);
+        file.put(0x5a);
+    }
+    bool corruptionDetected = false;
+    try {
+        QuantizedModel::load(filename);
+    } catch (const std::runtime_error&) {
+        corruptionDetected = true;
+    }
+    std::remove(filename.c_str());
+
+    if (!ok) report.print(std::cout);
+    return ok && corruptionDetected;
+}
+
+// Sparse inputs and pruned weights give the dense results, pruned weights stay zero while training
+bool testSparseDenseLayer() {
+    Matrix input(8, 50);
+    for (int i = 0; i < input.rows; i++) {
+        for (int j = (i * 7) % 10; j < input.cols; j += 10) input.data[i][j] = 0.1 * (j % 7) + 0.05;  // ~10% non-zero
+    }
+    SparseMatrix csr = SparseMatrix::fromDense(input);
+    bool ok = csr.nonZeros() == 40 && csr.toDense().isEqual(input) && SparseMatrix::densityOf(input) == 0.1;
+
+    DenseLayer layer(50, 6, new activations::Sigmoid());
+    Matrix sparseOut, denseOut;
+    layer.sparseInputThreshold = 0.3;
+    layer.infer(input, sparseOut);  // below sparseInputThreshold
+    layer.sparseInputThreshold = 0.0;
+    layer.infer(input, denseOut);
+    auto close = [](const Matrix &a, const Matrix &b) {
+        if (a.rows != b.rows || a.cols != b.cols) return false;
+        for (int i = 0; i < a.rows; i++)
+            for (int j = 0; j < a.cols; j++)
+                if (std::fabs(a.data[i][j] - b.data[i][j]) > 1e-12) return false;
+        return true;
+    };
+    ok = ok && close(sparseOut, denseOut);
+
+    // 70% of the weights pruned: the CSR weights match the zeroed dense ones
+    layer.prune(0.7);
+    ok = ok && layer.sparseWeights && layer.sparseWeights->nonZeros() == 90;
+    Matrix prunedOut, reference = input * layer.weights;
+    layer.infer(input, prunedOut);
+    ok = ok && close(prunedOut, reference.addRowVector(layer.biases).applyFunction(
+                                    [&](std::vector<double> &x) { return layer.activation->activate(x); }));
+
+    Matrix d_output(8, 6);
+    d_output.randomize();
+    layer.forward(input);
+    std::unique_ptr<Layer> snapshot = layer.clone();  // shares the CSR weights until the update
+    layer.backward(d_output, 0.1);
+    int zeros = 0;
+    for (int i = 0; i < 50; i++)
+        for (int j = 0; j < 6; j++) zeros += layer.weights.data[i][j] == 0.0;
+    ok = ok && zeros >= 210 && layer.sparseWeights->toDense().isEqual(layer.weights);
+    auto &before = static_cast<DenseLayer&>(*snapshot);
+    ok = ok && before.sparseWeights != layer.sparseWeights && before.sparseWeights->toDense().isEqual(before.weights) &&
+         !before.weights.isEqual(layer.weights);
+    layer.forward(input);
+    layer.backward(d_output, 0.1);  // sole owner now, updated in place
+    ok = ok && layer.sparseWeights->toDense().isEqual(layer.weights);
+
+    // The model file keeps the pruning, training the loaded layer keeps the zeros
+    std::vector<std::unique_ptr<Layer>> layers;
+    layers.push_back(layer.clone());
+    ModelFile::save(layers, "./tests/test_pruned.nnm");
+    NeuralNetwork loaded = ModelFile::load("./tests/test_pruned.nnm");
+    std::remove("./tests/test_pruned.nnm");
+    auto* restored = dynamic_cast<DenseLayer*>(loaded.layers[0].get());
+    ok = ok && restored && restored->sparseWeights &&
+         restored->sparseWeights->nonZeros() == layer.sparseWeights->nonZeros();
+    if (!ok) return false;
+    restored->forward(input);
+    restored->backward(d_output, 0.1);
+    ok = ok && restored->sparseWeights->toDense().isEqual(restored->weights);
+
+    // The .dat files do not, loading one drops the stale CSR weights
+    DenseLayer dense(50, 6, new activations::Sigmoid());
+    dense.saveToFile("./tests/test_pruned_layer.dat");
+    layer.loadFromFile("./tests/test_pruned_layer.dat");
+    std::remove("./tests/test_pruned_layer.dat");
+    return ok && !layer.sparseWeights && layer.isEqual(dense);
+}
+
+// Dropout: bit mask, fused scaling in forward and backward, skipped in eval mode and at inference
+bool testDropoutLayer() {
+    DropoutLayer dropout(0.3);
+    Matrix x(64, 100), gradient(64, 100);
+    x.fill(1.0);
+    gradient.fill(2.0);
+    dropout.forward(x);
+    Matrix d_input = dropout.backward(gradient, 0.1);
+    const double scale = 1.0 / 0.7;
+    int dropped = 0;
+    for (int i = 0; i < x.rows; i++) {
+        for (int j = 0; j < x.cols; j++) {
+            bool kept = dropout.kept(static_cast<size_t>(i) * x.cols + j);
+            dropped += !kept;
+            if (dropout.output.data[i][j] != (kept ? scale : 0.0) || d_input.data[i][j] != (kept ? 2.0 * scale : 0.0)) {
+                return false;
+            }
         }
     }
+    if (std::abs(dropped / 6400.0 - 0.3) > 0.03 || dropout.maskBytes() != 800) return false;
 
-    double accuracy = static_cast<double>(correct) / inputs.size();
-    std::cout << "\nFinal accuracy: " << accuracy * 100 << "%\n";
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(20, 10, new activations::ReLU()));
+    nn.addLayer(std::make_unique<DropoutLayer>(0.5));
+    nn.addLayer(std::make_unique<DenseLayer>(10, 3, new activations::Softmax(), true));
+    Matrix batch(16, 20);
+    batch.randomize(0.0, 1.0);
+    std::vector<int> labels(16);
+    for (int i = 0; i < 16; i++) labels[i] = i % 3;
+    double loss = nn.train_step(batch, labels, 0.05);
+    if (!std::isfinite(loss)) return false;
+
+    // Eval mode: train_step sees the deterministic network, the same one inference runs
+    nn.setTraining(false);
+    std::shared_ptr<const Weights> weights = nn.shareWeights();
+    InferenceContext context(weights);
+    Matrix hidden, expected;
+    nn.layers[0]->infer(batch, hidden);
+    nn.layers[2]->infer(hidden, expected);
+    const Matrix &actual = context.forward(batch);
+    double evalLoss = 0.0;
+    for (int i = 0; i < 16; i++) evalLoss -= std::log(std::max(expected.data[i][labels[i]], 1e-12));
+    if (weights->size() != 2 || !actual.isEqual(expected) ||
+        std::abs(nn.train_step(batch, labels, 0.0) - evalLoss / 16) > 1e-12 || nn.layers[1]->training) {
+        return false;
+    }
 
-    return accuracy >= 0.75; // Expect at least 75% accuracy
+    // The model file keeps the layer, its rate and its mask stream
+    auto* original = dynamic_cast<DropoutLayer*>(nn.layers[1].get());
+    const std::string filename = "./tests/test_dropout.nnm";
+    ModelFile::save(nn, filename);
+    NeuralNetwork loaded = ModelFile::load(filename);
+    size_t servedLayers = ModelFile::loadWeights(filename)->size();
+    std::remove(filename.c_str());
+    auto* restored = dynamic_cast<DropoutLayer*>(loaded.layers.size() == 3 ? loaded.layers[1].get() : nullptr);
+    if (!restored || restored->rate != 0.5 || servedLayers != 2 || restored->getStream() != original->getStream()) {
+        return false;
+    }
+
+    // A restored layer draws the masks the original would have, a clone draws its own without
+    // taking a stream of the global seed
+    const uint64_t before = Random::nextStream().getStream();
+    std::unique_ptr<Layer> replica = original->clone(), second = original->clone();
+    if (Random::nextStream().getStream() != before + 1) {
+        return false;
+    }
+    Matrix ones(8, 100);
+    ones.fill(1.0);
+    for (Layer* layer : std::initializer_list<Layer*>{original, restored, replica.get(), second.get()}) {
+        layer->training = true;
+        layer->forward(ones);
+    }
+    return restored->output.isEqual(original->output) && !replica->output.isEqual(original->output) &&
+           !second->output.isEqual(replica->output);
+}
+
+// Welford statistics, the backward pass against central differences, and folding into the dense
+// layer in front: the served (folded) model gives the outputs of the unfolded layers
+bool testBatchNormLayer() {
+    Matrix x(32, 5);
+    x.randomize(-2.0, 3.0);
+    BatchNormLayer norm(5);
+    norm.momentum = 0.0;  // running statistics = statistics of the last batch
+    norm.forward(x);
+    for (int j = 0; j < 5; j++) {
+        double mean = 0.0, var = 0.0, outMean = 0.0, outVar = 0.0;
+        for (int i = 0; i < 32; i++) mean += x.data[i][j] / 32;
+        for (int i = 0; i < 32; i++) var += (x.data[i][j] - mean) * (x.data[i][j] - mean) / 32;
+        for (int i = 0; i < 32; i++) outMean += norm.output.data[i][j] / 32;
+        for (int i = 0; i < 32; i++) outVar += (norm.output.data[i][j] - outMean) * (norm.output.data[i][j] - outMean) / 32;
+        if (std::abs(norm.runningMean.data[0][j] - mean) > 1e-12 || std::abs(norm.runningVar.data[0][j] - var * 32 / 31) > 1e-12 ||
+            std::abs(outMean) > 1e-12 || std::abs(outVar - var / (var + norm.epsilon)) > 1e-9) {
+            return false;
+        }
+    }
+
+    // d(sum(w * y)) / dx with a non-linear activation
+    BatchNormLayer probe(5, new activations::Sigmoid());
+    probe.gamma.randomize(0.5, 1.5);
+    probe.beta.randomize(-0.5, 0.5);
+    Matrix small(8, 5), w(8, 5);
+    small.randomize(-1.0, 1.0);
+    w.randomize(-1.0, 1.0);
+    auto loss = [&](const Matrix &in) {
+        BatchNormLayer copy = probe;
+        copy.forward(in);
+        double sum = 0.0;
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 5; j++) sum += w.data[i][j] * copy.output.data[i][j];
+        }
+        return sum;
+    };
+    probe.forward(small);
+    Matrix gradient = w;
+    Matrix d_input = probe.backward(gradient, 0.0);
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 5; j++) {
+            Matrix plus = small, minus = small;
+            plus.data[i][j] += 1e-6;
+            minus.data[i][j] -= 1e-6;
+            if (std::abs((loss(plus) - loss(minus)) / 2e-6 - d_input.data[i][j]) > 1e-6) return false;
+        }
+    }
+
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(12, 8, new activations::Linear()));
+    nn.addLayer(std::make_unique<BatchNormLayer>(8, new activations::ReLU()));
+    nn.addLayer(std::make_unique<DenseLayer>(8, 3, new activations::Softmax(), true));
+    Matrix batch(16, 12);
+    batch.randomize(0.0, 1.0);
+    std::vector<int> labels(16);
+    for (int i = 0; i < 16; i++) labels[i] = i % 3;
+    for (int step = 0; step < 5; step++) {
+        if (!std::isfinite(nn.train_step(batch, labels, 0.1))) return false;
+    }
+
+    // Eval mode: the folded snapshot has two dense layers and matches the layers run one by one
+    nn.setTraining(false);
+    std::shared_ptr<const Weights> weights = nn.shareWeights();
+    Matrix hidden, normalized, expected;
+    nn.layers[0]->infer(batch, hidden);
+    nn.layers[1]->infer(hidden, normalized);
+    nn.layers[2]->infer(normalized, expected);
+    auto maxDiff = [&](const Matrix &actual) {
+        double diff = 0.0;
+        for (int i = 0; i < expected.rows; i++) {
+            for (int j = 0; j < expected.cols; j++) diff = std::max(diff, std::abs(actual.data[i][j] - expected.data[i][j]));
+        }
+        return diff;
+    };
+    InferenceContext context(weights);
+    auto* folded = dynamic_cast<const DenseLayer*>(&weights->layer(0));
+    if (weights->size() != 2 || !folded || typeid(*folded->activation) != typeid(ReLUFunction) ||
+        maxDiff(context.forward(batch)) > 1e-9) {
+        return false;
+    }
+
+    // The model file keeps the statistics, serving it folds again
+    const std::string filename = "./tests/test_batchnorm.nnm";
+    ModelFile::save(nn, filename);
+    NeuralNetwork loaded = ModelFile::load(filename);
+    std::shared_ptr<const Weights> served = ModelFile::loadWeights(filename);
+    std::remove(filename.c_str());
+    auto* restored = dynamic_cast<BatchNormLayer*>(loaded.layers.size() == 3 ? loaded.layers[1].get() : nullptr);
+    auto* trained = static_cast<BatchNormLayer*>(nn.layers[1].get());
+    InferenceContext servedContext(served);
+    return restored && restored->runningVar.isEqual(trained->runningVar) && restored->gamma.isEqual(trained->gamma) &&
+           served->size() == 2 && maxDiff(servedContext.forward(batch)) <= 1e-9;
+}
+
+// The compiled plan (folded batch norm, dropped dropout, fixed/tiled/sparse/affine/int8 kernels,
+// batches split over the preallocated buffers) gives the outputs of the layer-by-layer model
+bool testCompiledModel() {
+    NeuralNetwork nn;
+    nn.addLayer(std::make_unique<DenseLayer>(30, 24, new activations::Linear()));
+    nn.addLayer(std::make_unique<BatchNormLayer>(24, new activations::ReLU()));
+    nn.addLayer(std::make_unique<DropoutLayer>(0.2));
+    nn.addLayer(std::make_unique<DenseLayer>(24, 70, new activations::Sigmoid()));
+    nn.addLayer(std::make_unique<BatchNormLayer>(70));
+    nn.addLayer(std::make_unique<DenseLayer>(70, 40, new activations::ReLU()));
+    nn.addLayer(std::make_unique<DenseLayer>(40, 5, new activations::Softmax(), true));
+    Matrix batch(21, 30);
+    batch.randomize(0.0, 1.0);
+    for (int i = 0; i < 21; i++) {
+        for (int j = i % 3; j < 30; j += 3) batch.data[i][j] = 0.0;  // zero inputs take the skip path
+    }
+    std::vector<int> labels(21);
+    for (int i = 0; i < 21; i++) labels[i] = i % 5;
+    for (int step = 0; step < 3; step++) nn.train_step(batch, labels, 0.1);
+    nn.setTraining(false);
+    static_cast<DenseLayer*>(nn.layers[5].get())->prune(0.8);
+
+    InferenceContext context(nn.shareWeights());
+    const Matrix expected = context.forward(batch);
+    std::vector<float> input(21 * 30), output(21 * 5);
+    for (int i = 0; i < 21; i++) {
+        for (int j = 0; j < 30; j++) input[i * 30 + j] = static_cast<float>(batch.data[i][j]);
+    }
+    auto maxDiff = [&](const Matrix &reference) {
+        double diff = 0.0;
+        for (int i = 0; i < 21; i++) {
+            for (int o = 0; o < 5; o++) diff = std::max(diff, std::abs(output[i * 5 + o] - reference.data[i][o]));
+        }
+        return diff;
+    };
+
+    const CompiledModel::Kernel expectedKernels[] = {CompiledModel::Kernel::DenseFixed, CompiledModel::Kernel::DenseTiled,
+                                                     CompiledModel::Kernel::Affine, CompiledModel::Kernel::Sparse,
+                                                     CompiledModel::Kernel::DenseFixed};
+    CompileOptions options;
+    options.maxBatch = 8;
+    for (SimdKernel simd : {SimdKernel::Scalar, SimdKernel::Avx2, SimdKernel::Avx512}) {
+        if (!CompiledModel::supported(simd)) continue;
+        options.simd = simd;
+        CompiledModel model = nn.compile(options);
+        if (model.size() != 5 || model.step(0).source != "Dense 30x24 + BatchNorm 24" || model.inputSize() != 30) {
+            return false;
+        }
+        for (size_t s = 0; s < model.size(); s++) {
+            if (model.step(s).kernel != expectedKernels[s]) return false;
+        }
+        CompiledModel copy = model;  // shares the plan, own buffers
+        copy.run(input.data(), output.data(), 21);
+        if (maxDiff(expected) > 1e-4) return false;
+    }
+
+    // int8 steps follow the QuantizedModel they come from
+    NeuralNetwork dense;
+    dense.addLayer(std::make_unique<DenseLayer>(30, 16, new activations::ReLU()));
+    dense.addLayer(std::make_unique<DenseLayer>(16, 5, new activations::Softmax(), true));
+    options = CompileOptions();
+    options.calibration = batch;
+    CompiledModel int8 = dense.compile(options);
+    int8.run(input.data(), output.data(), 21);
+    return int8.step(0).kernel == CompiledModel::Kernel::Int8 && int8.step(1).kernel == CompiledModel::Kernel::Int8 &&
+           maxDiff(QuantizedModel::quantize(dense, batch).forward(batch)) < 1e-2;
+}
+
+// 16 bit conversions round correctly, fp16/bf16 training tracks double and loss scaling recovers from overflow
+bool testMixedPrecisionTraining() {
+    bool ok = floatToHalf(1.0f) == 0x3c00 && floatToHalf(65504.0f) == 0x7bff && floatToHalf(65520.0f) == 0x7c00 &&
+              floatToHalf(5.9604645e-8f) == 0x0001 && halfToFloat(0xc000) == -2.0f &&
+              floatToBFloat16(1.0f) == 0x3f80 && bfloat16ToFloat(0x4049) == 3.140625f;
+    std::vector<float> values(1000);
+    for (size_t i = 0; i < values.size(); i++) values[i] = std::sin(0.37f * i) * std::pow(2.0f, static_cast<int>(i % 40) - 20);
+    for (Precision precision : {Precision::Float16, Precision::BFloat16}) {
+        std::vector<uint16_t> simd(values.size()), scalar(values.size());
+        convertToHalf(values.data(), simd.data(), values.size(), precision);
+        setHalfSimdEnabled(false);
+        convertToHalf(values.data(), scalar.data(), values.size(), precision);
+        setHalfSimdEnabled(true);
+        ok = ok && simd == scalar;
+    }
+
+    // Two separable classes, the same initial weights in every precision
+    Matrix inputs(32, 6);
+    std::vector<int> labels(32);
+    for (int r = 0; r < 32; r++) {
+        labels[r] = r % 2;
+        for (int j = 0; j < 6; j++) inputs.data[r][j] = (j < 3) == (labels[r] == 0) ? 0.8 + 0.01 * r : 0.1;
+    }
+    NeuralNetwork reference;
+    reference.addLayer(std::make_unique<DenseLayer>(6, 5, new activations::Sigmoid()));
+    reference.addLayer(std::make_unique<DenseLayer>(5, 2, new activations::Softmax(), true));
+    auto copyOf = [&reference]() {
+        auto nn = std::make_unique<NeuralNetwork>();
+        for (const auto &layer : reference.layers) nn->addLayer(layer->clone());
+        return nn;
+    };
+    auto fp16 = copyOf(), bf16 = copyOf();
+    fp16->setPrecision(Precision::Float16);
+    bf16->setPrecision(Precision::BFloat16);
+    double first = 0.0, lossDouble = 0.0, loss16 = 0.0, lossBf16 = 0.0;
+    for (int step = 0; step < 200; step++) {
+        lossDouble = reference.train_step(inputs, labels, 0.5);
+        loss16 = fp16->train_step(inputs, labels, 0.5);
+        lossBf16 = bf16->train_step(inputs, labels, 0.5);
+        if (step == 0) first = loss16;
+    }
+    auto* w = dynamic_cast<DenseLayer*>(fp16->layers[0].get());
+    auto* wRef = dynamic_cast<DenseLayer*>(reference.layers[0].get());
+    double maxDiff = 0.0;
+    for (int i = 0; i < 6; i++)
+        for (int j = 0; j < 5; j++) maxDiff = std::max(maxDiff, std::fabs(w->weights.data[i][j] - wRef->weights.data[i][j]));
+    ok = ok && loss16 < 0.5 * first && std::fabs(loss16 - lossDouble) < 0.05 && std::fabs(lossBf16 - lossDouble) < 0.05 &&
+         maxDiff < 0.1 && fp16->getPrecision() == Precision::Float16;
+
+    // A loss scale far too large overflows fp16: the step is skipped and the scale backs off
+    auto scaled = copyOf();
+    LossScaleOptions options;
+    options.initialScale = 1e30;
+    options.backoffFactor = 1e-10;
+    scaled->setPrecision(Precision::Float16, options);
+    Matrix before = dynamic_cast<DenseLayer*>(scaled->layers[0].get())->weights;
+    scaled->train_step(inputs, labels, 0.5);
+    MixedPrecisionReport report = scaled->mixedPrecision->report();
+    ok = ok && report.skippedSteps == 1 && std::fabs(report.lossScale / 1e20 - 1.0) < 1e-9 &&
+         dynamic_cast<DenseLayer*>(scaled->layers[0].get())->weights.isEqual(before);
+    scaled->train_step(inputs, labels, 0.5);
+    ok = ok && scaled->mixedPrecision->report().skippedSteps == 2;  // 1e20 still overflows fp16
+    for (int i = 0; i < 3; i++) scaled->train_step(inputs, labels, 0.5);
+    report = scaled->mixedPrecision->report();
+    ok = ok && report.steps == 5 && report.skippedSteps == 3 && report.lossScale == 1.0 &&
+         report.mixedParameterBytes > report.doubleParameterBytes &&  // the layers keep their doubles
+         report.mixedActivationBytes < report.doubleActivationBytes;
+
+    // Restoring a checkpoint replaces the layers: the master weights and the loss scale follow,
+    // so the resumed fp16 run repeats the original one exactly
+    {
+        const std::string directory = "./tests/checkpoints_mixed_tmp";
+        std::filesystem::remove_all(directory);
+        auto resumed = copyOf();
+        LossScaleOptions growing;
+        growing.initialScale = 1024.0;
+        growing.growthInterval = 3;
+        resumed->setPrecision(Precision::Float16, growing);
+        for (int step = 0; step < 5; step++) resumed->train_step(inputs, labels, 0.5);
+        TrainingState state;
+        state.step = 5;
+        {
+            CheckpointManager checkpoints(directory, "mixed", 1);
+            checkpoints.save(*resumed, state);
+            checkpoints.wait();
+        }
+        std::vector<double> losses;
+        for (int step = 0; step < 4; step++) losses.push_back(resumed->train_step(inputs, labels, 0.5));
+        Matrix expected = dynamic_cast<DenseLayer*>(resumed->layers[0].get())->weights;
+        const double expectedScale = resumed->mixedPrecision->lossScale();
+
+        CheckpointManager checkpoints(directory, "mixed", 1);
+        TrainingState restored;
+        bool found = checkpoints.restoreLatest(*resumed, restored);
+        std::filesystem::remove_all(directory);
+        ok = ok && found && restored.lossScale == 2048.0 && restored.cleanSteps == 2;
+        for (int step = 0; step < 4; step++) ok = ok && resumed->train_step(inputs, labels, 0.5) == losses[step];
+        ok = ok && dynamic_cast<DenseLayer*>(resumed->layers[0].get())->weights.isEqual(expected) &&
+             resumed->mixedPrecision->lossScale() == expectedScale;
+    }
+
+    if (!ok) std::cout << "loss fp16 " << loss16 << " bf16 " << lossBf16 << " double " << lossDouble
+                       << ", max weight diff " << maxDiff << std::endl;
+    return ok;
+}
+
+// Performance Tests: budgets are for the reference machine, scaled by TestRunner::calibrate()
+void runPerformanceTests(TestRunner &runner) {
+    // MNIST hidden layer on a minibatch
+    auto dense = std::make_shared<DenseLayer>(784, 16, new activations::Sigmoid());
+    auto batch = std::make_shared<Matrix>(64, 784);
+    batch->randomize(0.0, 1.0);
+    PerfBudget denseBudget;
+    denseBudget.itemsPerRun = 64;
+    denseBudget.minItemsPerSecond = 20000;
+    runner.runPerfTest("Dense 784x16 Forward Batch 64 Throughput", [dense, batch] { dense->forward(*batch); }, denseBudget);
+
+    // Opening and normalizing an MNIST sized file (2000 images)
+    const std::string images = "./tests/test_perf_images.idx";
+    writeIdxFile(images, 0x08, {2000, 28, 28}, std::vector<unsigned char>(2000 * 784, 128));
+    PerfBudget loadBudget;
+    loadBudget.maxMilliseconds = 8;
+    runner.runPerfTest("IDX Load 2000 Images Latency", [images] {
+        IdxFile file(images);
+        Matrix all;
+        file.toMatrix(0, file.count(), all, 1.0 / 255.0);
+    }, loadBudget);
+    std::remove(images.c_str());
+
+    // Steady state training step of the main.cpp network
+    auto nn = std::make_shared<NeuralNetwork>();
+    nn->addLayer(std::make_unique<DenseLayer>(784, 16, new activations::Sigmoid()));
+    nn->addLayer(std::make_unique<DenseLayer>(16, 16, new activations::Sigmoid()));
+    nn->addLayer(std::make_unique<DenseLayer>(16, 10, new activations::Softmax(), true));
+    auto labels = std::make_shared<std::vector<int>>(64, 3);
+    PerfBudget stepBudget;
+    stepBudget.itemsPerRun = 64;
+    stepBudget.minItemsPerSecond = 6000;
+    stepBudget.maxAllocations = 96;
+    runner.runPerfTest("Train Step Batch 64 Throughput and Allocations",
+                       [nn, batch, labels] { nn->train_step(*batch, *labels, 0.01); }, stepBudget);
 }
 
 int main() {
@@ -338,29 +1964,58 @@ int main() {
     runner.runTest("Matrix Transpose", testMatrixTranspose);
     runner.runTest("Matrix Scalar Multiplication", testMatrixScalarMultiplication);
     runner.runTest("Matrix Random Initialization", testMatrixRandomInitialization);
+    runner.runTest("Counter-Based RNG", testCounterRng);
+    runner.runTest("GEMM Autotuner", testGemmAutotuner);
+    runner.runTest("NUMA Allocation", testNumaAllocation);
     runner.runTest("Matrix Apply Function", testMatrixApplyFunction);
     
 
     std::cout << "\nRunning Layer Tests..." << std::endl;
     runner.runTest("Dense Layer Forward Pass", testDenseLayerForward);
     runner.runTest("Conv Layer Forward Pass", testConvLayerForward);
+    runner.runTest("Sparse Dense Layer", testSparseDenseLayer);
+    runner.runTest("Dropout Layer", testDropoutLayer);
+    runner.runTest("Batch Norm Layer", testBatchNormLayer);
 
 
     std::cout << "\nRunning Neural Network Tests..." << std::endl;
     runner.runTest("Neural Network Forward Pass", testNeuralNetworkForward);
+    runner.runTest("Shared Weights Concurrent Inference", testSharedWeightsConcurrentInference);
+    runner.runTest("Inference Server Batching", testInferenceServerBatching);
+    runner.runTest("Layer Profiler", testLayerProfiler);
+    runner.runTest("Trace Export", testTraceExport);
+    runner.runTest("Allocation Budget", testAllocationBudget);
+    runner.runTest("Int8 Quantization", testInt8Quantization);
+    runner.runTest("Compiled Model", testCompiledModel);
+    runner.runTest("Mixed Precision Training", testMixedPrecisionTraining);
 
 
     std::cout << "\nRunning Data Loading Tests..." << std::endl;
     runner.runTest("MNIST Data Loading", testMNISTDataLoading);
+    runner.runTest("IDX File Reader", testIdxFileReader);
+    runner.runTest("Data Loader Training", testDataLoaderTraining);
+    runner.runTest("Sweep Runner", testSweepRunner);
+    runner.runTest("Evaluator", testEvaluator);
+    runner.runTest("Data Augmentation", testAugmentation);
+    runner.runTest("Dataset Cache", testDatasetCache);
+    runner.runTest("Streaming Dataset", testStreamingDataset);
 
 
     std::cout << "\nRunning Model Save/Load Tests..." << std::endl;
     runner.runTest("Model Save and Load", testModelSaveLoad);
+    runner.runTest("Model File Round Trip", testModelFileRoundTrip);
+    runner.runTest("Checkpoint Resume", testCheckpointResume);
+
+    std::cout << "\nRunning Benchmark Tests..." << std::endl;
+    runner.runTest("Benchmark Harness", testBenchmarkHarness);
+
+    std::cout << "\nRunning Performance Tests..." << std::endl;
+    runPerformanceTests(runner);
 
     std::cout << "\nRunning Model Accuracy Tests..." << std::endl;
     runner.runTest("Model Accuracy", testModelAccuracy);
 
     runner.printSummary();
 
-    return 0;
+    return runner.failedCount() == 0 ? 0 : 1;
 }
\ No newline at end of file
@@ -2,17 +2,42 @@
 #define TEST_RUNNER_HPP
 
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <functional>
 #include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "../src/math/matrix.hpp"
+#include "../src/math/allocation_stats.hpp"
+
+// Budget for a timed test. Throughput and latency limits are for this project's reference
+// machine and get scaled by the runner's calibration factor, 0 disables a limit.
+struct PerfBudget {
+    double itemsPerRun = 1.0;       // samples, requests, ... processed by one call of the body
+    double minItemsPerSecond = 0.0;
+    double maxMilliseconds = 0.0;   // per call, compared against the median
+    long long maxAllocations = -1;  // Matrix allocations per call, -1 disables the check
+    int warmup = 1;
+    int repetitions = 9;
+};
 
 class TestRunner {
     private:
+        struct Timing {
+            std::string name;
+            double seconds;
+        };
+
         int totalTests = 0;
         int passedTests = 0;
         std::string currentTestName;
-    
+        std::vector<Timing> timings;
+        double calibration = 0.0;  // > 1 on a machine faster than the reference, 0 until calibrated
+
         void testResult(bool passed) {
             totalTests++;
             if (passed) {
@@ -22,22 +47,143 @@ class TestRunner {
                 std::cout << currentTestName << " FAILED" << std::endl;
             }
         }
-    
+
+        static double secondsSince(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        static double median(std::vector<double> values) {
+            std::sort(values.begin(), values.end());
+            size_t n = values.size();
+            return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+        }
+
+        // Drops runs more than 3 median absolute deviations above the median (preemption, page faults)
+        static std::vector<double> rejectOutliers(const std::vector<double> &samples) {
+            double m = median(samples);
+            std::vector<double> deviations;
+            for (double s : samples) deviations.push_back(std::fabs(s - m));
+            double mad = median(deviations);
+            std::vector<double> kept;
+            for (double s : samples) {
+                if (mad == 0.0 || s <= m + 3.0 * 1.4826 * mad) kept.push_back(s);
+            }
+            return kept;
+        }
+
     public:
+        // Time of the reference workload (128x128 Matrix multiply) on the reference machine
+        static constexpr double referenceSeconds = 2.5e-3;
+
         void runTest(const std::string name, std::function<bool()> test) {
             currentTestName = name;
+            auto start = std::chrono::steady_clock::now();
             bool result = test();
-    
+            timings.push_back({name, secondsSince(start)});
+
             testResult(result);
         }
-    
+
+        // Measures how fast this machine runs the reference workload, NN_PERF_SCALE overrides it
+        // (e.g. NN_PERF_SCALE=0.5 halves every throughput requirement on a slow CI machine)
+        double calibrate() {
+            const char* env = std::getenv("NN_PERF_SCALE");
+            if (env && *env) {
+                calibration = std::atof(env);
+            } else {
+                // The textbook triple loop rather than operator*, whose kernel depends on the GEMM tuning
+                Matrix a(128, 128), b(128, 128), c(128, 128);
+                a.randomize();
+                b.randomize();
+                double best = 1e30;  // fastest run, the least disturbed by other load
+                for (int i = 0; i < 15; i++) {
+                    auto start = std::chrono::steady_clock::now();
+                    for (int r = 0; r < 128; r++) {
+                        for (int j = 0; j < 128; j++) {
+                            double sum = 0.0;
+                            for (int k = 0; k < 128; k++) sum += a.data[r][k] * b.data[k][j];
+                            c.data[r][j] = sum;
+                        }
+                    }
+                    best = std::min(best, secondsSince(start));
+                }
+                calibration = referenceSeconds / best;
+            }
+            std::ios state(nullptr);
+            state.copyfmt(std::cout);
+            std::cout << "Performance calibration factor: " << std::setprecision(3) << calibration << std::endl;
+            std::cout.copyfmt(state);
+            return calibration;
+        }
+
+        void setCalibration(double factor) {
+            calibration = factor;
+        }
+
+        // Repeats body, rejects outliers and checks the median against the scaled budget
+        void runPerfTest(const std::string name, std::function<void()> body, const PerfBudget &budget) {
+            if (calibration <= 0.0) calibrate();
+            currentTestName = name;
+            auto testStart = std::chrono::steady_clock::now();
+
+            for (int i = 0; i < budget.warmup; i++) body();
+            std::vector<double> samples;
+            long long allocations = 0;
+            for (int i = 0; i < std::max(1, budget.repetitions); i++) {
+                AllocationTracker tracker;
+                auto start = std::chrono::steady_clock::now();
+                body();
+                samples.push_back(secondsSince(start));
+                allocations = std::max(allocations, tracker.delta().total.allocations);
+            }
+            std::vector<double> kept = rejectOutliers(samples);
+            double seconds = median(kept);
+            timings.push_back({name, secondsSince(testStart)});
+
+            bool passed = true;
+            std::ostringstream detail;
+            detail << std::fixed << std::setprecision(3) << seconds * 1e3 << " ms median of "
+                   << kept.size() << "/" << samples.size() << " runs";
+            if (budget.minItemsPerSecond > 0.0) {
+                double rate = budget.itemsPerRun / seconds, required = budget.minItemsPerSecond * calibration;
+                detail << std::setprecision(0) << ", " << rate << "/s (need " << required << ")";
+                passed = passed && rate >= required;
+            }
+            if (budget.maxMilliseconds > 0.0) {
+                double limit = budget.maxMilliseconds / calibration;
+                detail << std::setprecision(3) << ", limit " << limit << " ms";
+                passed = passed && seconds * 1e3 <= limit;
+            }
+            if (budget.maxAllocations >= 0) {
+                detail << ", " << allocations << " allocations (max " << budget.maxAllocations << ")";
+                passed = passed && allocations <= budget.maxAllocations;
+            }
+            std::cout << name << ": " << detail.str() << std::endl;
+            testResult(passed);
+        }
+
+        int failedCount() const {
+            return totalTests - passedTests;
+        }
+
         void printSummary() {
             std::cout << "\nTest Summary:" << std::endl;
             std::cout << "Total Tests: " << totalTests << std::endl;
             std::cout << "Passed: " << passedTests << std::endl;
             std::cout << "Failed: " << (totalTests - passedTests) << std::endl;
             std::cout << "Success Rate: " << (static_cast<double>(passedTests) / totalTests * 100) << "%" << std::endl;
+
+            std::vector<Timing> slowest = timings;
+            std::sort(slowest.begin(), slowest.end(), [](const Timing &a, const Timing &b) { return a.seconds > b.seconds; });
+            std::cout << "\nSlowest Tests:" << std::endl;
+            std::ios state(nullptr);
+            state.copyfmt(std::cout);
+            for (size_t i = 0; i < slowest.size() && i < 5; i++) {
+                std::cout << std::fixed << std::setprecision(1) << std::setw(10) << slowest[i].seconds * 1e3
+                          << " ms  " << slowest[i].name << std::endl;
+            }
+            std::cout.copyfmt(state);
         }
     };
 
-#endif  // TEST_RUNNER_HPP
\ No newline at end of file
+#endif  // TEST_RUNNER_HPP